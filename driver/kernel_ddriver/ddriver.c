@@ -4,6 +4,8 @@
 #include <linux/fs.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
 #include "ddriver_ctl.h"
 /******************************************************************************
 * SECTION: Macro definitions
@@ -65,6 +67,9 @@ struct ddriver
     int  open_count;
     int  layout_size;
     int  iounit_size;
+    atomic_t inflight;                                /* Requests in progress */
+    struct ddriver_state_ext  ext;                    /* Extended state */
+    struct ddriver_region_map regions;                /* Regions registered by the fs */
 };
 
 static struct ddriver disk = {
@@ -91,6 +96,39 @@ int check_valid(size_t size){
     }
     return 0;
 }
+/**
+ * @brief Find the registered region containing pos
+ * 
+ * @param pos           Byte offset
+ * @return int          enum ddriver_region_type
+ */
+static int region_of(long pos) {
+    unsigned int i;
+    for (i = 0; i < disk.regions.count; i++) {
+        if (pos >= disk.regions.regions[i].offset && 
+            pos <  disk.regions.regions[i].offset + disk.regions.regions[i].size) {
+            return disk.regions.regions[i].type;
+        }
+    }
+    return DDRIVER_REGION_OTHER;
+}
+/**
+ * @brief Account one read/write: queue depth and target region
+ * 
+ * @param is_write      Write or read
+ * @return int          Region type of the head position
+ */
+static int account_begin(int is_write) {
+    int depth  = atomic_inc_return(&disk.inflight);
+    int region = region_of(GET_HEAD_POS(disk));
+
+    disk.ext.qdepth_hist[(depth < DDRIVER_QDEPTH_BUCKETS ? depth : DDRIVER_QDEPTH_BUCKETS) - 1]++;
+    if (is_write)
+        disk.ext.region_writes[region]++;
+    else
+        disk.ext.region_reads[region]++;
+    return region;
+}
 /******************************************************************************
 * SECTION: Function definitions
 *******************************************************************************/
@@ -128,12 +166,22 @@ device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
     IGNORE_ARG(offset);
     IGNORE_ARG(file);
     int res = check_valid(size);
+    int region;
+    u64 start;
     if(res < 0)
         return res;
-    if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
+    region = account_begin(0);
+    start = ktime_get_ns();                           /* No emulated delay here, account copy time */
+    res = copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ);
+    start = ktime_get_ns() - start;
+    disk.ext.read_ns += start;
+    disk.ext.region_ns[region] += start;
+    atomic_dec(&disk.inflight);
+    if (res)
         return -EFAULT;
     FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
     INC_READCNT(disk);
+    disk.ext.bytes_read += CONFIG_BLOCK_SZ;
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -150,13 +198,23 @@ device_write(struct file *file, const char *user_buffer, size_t size, loff_t *of
     IGNORE_ARG(offset);
     IGNORE_ARG(file);
     int res = check_valid(size);
+    int region;
+    u64 start;
     if(res < 0)
         return res;
 
-    if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
+    region = account_begin(1);
+    start = ktime_get_ns();
+    res = copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ);
+    start = ktime_get_ns() - start;
+    disk.ext.write_ns += start;
+    disk.ext.region_ns[region] += start;
+    atomic_dec(&disk.inflight);
+    if (res)
         return -EFAULT;
     FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
     INC_WRITECNT(disk);
+    disk.ext.bytes_written += CONFIG_BLOCK_SZ;
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -170,6 +228,7 @@ device_write(struct file *file, const char *user_buffer, size_t size, loff_t *of
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
     IGNORE_ARG(file);
+    s64 prev = GET_HEAD_POS(disk), moved;
     if (!IS_ADDR_ALIGN(offset)) {
         kernel_alert("offset %lld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
@@ -187,6 +246,8 @@ device_seek(struct file *file, loff_t offset, int whence) {
         break;
     }
     INC_SEEKCNT(disk);
+    moved = (s64)GET_HEAD_POS(disk) - prev;
+    disk.ext.seek_distance += moved < 0 ? -moved : moved;
     return GET_HEAD_POS(disk);
 }
 /**
@@ -201,7 +262,10 @@ static long
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
     IGNORE_ARG(file);
     int ret;
+    unsigned int i;
     struct ddriver_state state;
+    struct ddriver_state_ext ext;
+    static struct ddriver_region_map map;             /* Too large for the kernel stack */
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
@@ -222,12 +286,42 @@ device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
         disk.read_cnt = 0;
         disk.write_cnt = 0;
         disk.seek_cnt = 0;
+        memset(&disk.ext, 0, sizeof(disk.ext));
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_STATE_EXT:                    /* Extended Device State, versioned by size */
+        ret = copy_from_user(&ext, (void __user *)arg, 2 * sizeof(unsigned int));
+        if (ret) 
+            return -EFAULT;
+        if (ext.size < 2 * sizeof(unsigned int))
+            return -EINVAL;
+        i = ext.size < sizeof(ext) ? ext.size : sizeof(ext);
+        ext = disk.ext;
+        ext.version = DDRIVER_STATE_EXT_VERSION;
+        ext.size = i;
+        ext.read_cnt = disk.read_cnt;
+        ext.write_cnt = disk.write_cnt;
+        ext.seek_cnt = disk.seek_cnt;
+        ret = copy_to_user((void __user *)arg, &ext, ext.size);
+        if (ret) 
+            return -EFAULT;
+        break;
+    case IOC_REQ_DEVICE_REGION_MAP:                   /* Region Map */
+        ret = copy_from_user(&map, (void __user *)arg, sizeof(map));
+        if (ret) 
+            return -EFAULT;
+        if (map.count > DDRIVER_MAX_REGIONS)
+            return -EINVAL;
+        for (i = 0; i < map.count; i++) {
+            if (map.regions[i].type >= DDRIVER_REGION_TYPES)
+                return -EINVAL;
+        }
+        disk.regions = map;
+        break;
     default:
         break;
     }
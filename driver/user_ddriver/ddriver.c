@@ -6,10 +6,12 @@
 #include "string.h"
 #include <linux/fs.h>
 #include "ddriver_ctl.h"
+#include "include/ddriver_trace.h"
 #include "stdio.h"
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <stddef.h>
 
 extern int errno;
 
@@ -46,6 +48,7 @@ extern int errno;
 
 #define CONFIG_DISK_SZ  (4 * 1024 * 1024)
 #define CONFIG_BLOCK_SZ (512)
+#define CONFIG_TRACE_BATCH  (256)                    /* 追踪记录攒够这么多条写一次文件 */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
@@ -57,7 +60,8 @@ extern int errno;
 #define INC_WRITECNT(disk)      (disk.write_cnt++)
 #define INC_SEEKCNT(disk)       (disk.seek_cnt++)
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000),                   \
+                                 disk.ext.rw_ops##_ns += disk.rw_ops##_lat * 1000000ULL)
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
@@ -74,6 +78,20 @@ struct ddriver
     int  major_num;
     int  layout_size;
     int  iounit_size;
+    int  inflight;                                   /* 在途的读写请求数 */
+    struct ddriver_state_ext  ext;                   /* 扩展状态 */
+    struct ddriver_region_map regions;               /* 文件系统登记的区域表 */
+};
+
+struct ddriver_tracer
+{
+    int      fd;                                     /* 追踪文件，-1表示未开启 */
+    int      lock;
+    uint32_t capacity;                               /* 环的记录槽数 */
+    uint64_t total;                                  /* 已产生的记录数（含未落盘的） */
+    uint64_t start_ns;
+    int      nbuf;
+    struct ddriver_trace_rec buf[CONFIG_TRACE_BATCH];
 };
 /******************************************************************************
 * SECTION: Global Variable
@@ -92,6 +110,10 @@ struct ddriver disk = {
     .iounit_size = CONFIG_BLOCK_SZ
 };
 
+struct ddriver_tracer tracer = {
+    .fd = -1
+};
+
 FILE *debugf = NULL;
 /******************************************************************************
 * SECTION: Helper Functions
@@ -104,18 +126,214 @@ int check_valid(size_t size) {
     return 0;
 }
 
+/**
+ * @brief 查找pos所在的已登记区域
+ * 
+ * @param pos 
+ * @return int enum ddriver_region_type
+ */
+int region_of(off_t pos) {
+    unsigned int i;
+    for (i = 0; i < disk.regions.count; i++) {
+        if (pos >= disk.regions.regions[i].offset && 
+            pos <  disk.regions.regions[i].offset + disk.regions.regions[i].size) {
+            return disk.regions.regions[i].type;
+        }
+    }
+    return DDRIVER_REGION_OTHER;
+}
+
 int emulate_rotate(int fd, off_t start, off_t end) {
     int bytes_per_track = disk.layout_size / disk.track_num;
     int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
+    int distance = llabs((long long)(end - start)) % bytes_per_track; 
+    unsigned long long delay_us;
     
+    disk.ext.seek_distance += llabs((long long)(end - start));
     if (distance == 0) {
         return 0;
     }
 
+    delay_us = (unsigned long long)distance * lat_per_track * 1000 / bytes_per_track;
     usleep(distance * lat_per_track / bytes_per_track * 1000);
+    disk.ext.rotate_ns += delay_us * 1000;
+    disk.ext.region_ns[region_of(end)] += delay_us * 1000;
     return 0;
 }
+
+/**
+ * @brief 一次读写开始：记录队列深度和目标区域
+ * 
+ * @param pos 磁头位置
+ * @param is_write 
+ */
+void account_begin(off_t pos, int is_write) {
+    int depth  = __sync_add_and_fetch(&disk.inflight, 1);
+    int region = region_of(pos);
+
+    disk.ext.qdepth_hist[(depth < DDRIVER_QDEPTH_BUCKETS ? depth : DDRIVER_QDEPTH_BUCKETS) - 1]++;
+    if (is_write) {
+        disk.ext.region_writes[region]++;
+        disk.ext.region_ns[region] += disk.write_lat * 1000000ULL;
+    }
+    else {
+        disk.ext.region_reads[region]++;
+        disk.ext.region_ns[region] += disk.read_lat * 1000000ULL;
+    }
+}
+
+/**
+ * @brief 单调时钟，单位ns
+ * 
+ * @return uint64_t 
+ */
+uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 请求开始的时间戳，未开启追踪时为0，免去取时钟的开销
+ * 
+ * @return uint64_t 
+ */
+uint64_t trace_begin() {
+    return tracer.fd >= 0 ? trace_now() : 0;
+}
+
+/**
+ * @brief 写追踪文件失败时停止追踪，设备本身的读写不受影响
+ * 
+ * @param what 
+ */
+void trace_fail(const char *what) {
+    user_alert("trace %s failed: %s, tracing stopped", what, strerror(errno));
+    close(tracer.fd);
+    tracer.fd   = -1;
+    tracer.nbuf = 0;
+}
+
+/**
+ * @brief 把缓冲的记录写到环上（环尾回绕时拆成两次写），然后更新头部的total
+ */
+void trace_flush() {
+    uint64_t first = tracer.total - tracer.nbuf;
+    uint32_t slot, run;
+    int      done = 0;
+
+    while (done < tracer.nbuf) {
+        slot = (first + done) % tracer.capacity;
+        run  = tracer.capacity - slot;
+        if (run > (uint32_t)(tracer.nbuf - done)) {
+            run = tracer.nbuf - done;
+        }
+        if (pwrite(tracer.fd, tracer.buf + done, run * sizeof(struct ddriver_trace_rec),
+                   sizeof(struct ddriver_trace_hdr) + (off_t)slot * sizeof(struct ddriver_trace_rec))
+            != (ssize_t)(run * sizeof(struct ddriver_trace_rec))) {
+            trace_fail("write");
+            return;
+        }
+        done += run;
+    }
+    if (pwrite(tracer.fd, &tracer.total, sizeof(tracer.total), offsetof(struct ddriver_trace_hdr, total))
+        != sizeof(tracer.total)) {
+        trace_fail("write");
+        return;
+    }
+    tracer.nbuf = 0;
+}
+
+/**
+ * @brief 追加一条追踪记录
+ * 
+ * @param op enum ddriver_trace_op
+ * @param offset 
+ * @param from 
+ * @param len 
+ * @param start trace_begin()的返回值
+ */
+void trace_record(int op, off_t offset, off_t from, size_t len, uint64_t start) {
+    struct ddriver_trace_rec *rec;
+    uint64_t now;
+
+    if (tracer.fd < 0) {
+        return;
+    }
+    now = trace_now();
+    while (__sync_lock_test_and_set(&tracer.lock, 1)) {
+        ;
+    }
+    rec = &tracer.buf[tracer.nbuf++];
+    rec->ts_ns  = start - tracer.start_ns;
+    rec->offset = offset;
+    rec->from   = from;
+    rec->lat_ns = now - start;
+    rec->len    = len;
+    rec->op     = op;
+    rec->region = region_of(offset);
+    tracer.total++;
+    if (tracer.nbuf == CONFIG_TRACE_BATCH) {
+        trace_flush();
+    }
+    __sync_lock_release(&tracer.lock);
+}
+
+/**
+ * @brief 环境变量DDRIVER_TRACE给出路径时开启追踪
+ * 
+ * @return int 
+ */
+int trace_open() {
+    struct ddriver_trace_hdr hdr;
+    char *path    = getenv(DDRIVER_TRACE_ENV);
+    char *records = getenv(DDRIVER_TRACE_RECORDS_ENV);
+
+    if (path == NULL || *path == '\0') {
+        return 0;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic        = DDRIVER_TRACE_MAGIC;
+    hdr.version      = DDRIVER_TRACE_VERSION;
+    hdr.rec_size     = sizeof(struct ddriver_trace_rec);
+    hdr.capacity     = (records && atoi(records) > 0) ? atoi(records) : DDRIVER_TRACE_RECORDS;
+    hdr.disk_size    = disk.layout_size;
+    hdr.block_size   = disk.iounit_size;
+    hdr.track_num    = disk.track_num;
+    hdr.read_lat_us  = disk.read_lat * 1000;
+    hdr.write_lat_us = disk.write_lat * 1000;
+    hdr.seek_lat_us  = disk.seek_lat * 1000;
+
+    tracer.fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (tracer.fd < 0) {
+        user_alert("can't open trace: %s", path);
+        return -1;
+    }
+    if (pwrite(tracer.fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        trace_fail("header write");
+        return -1;
+    }
+    tracer.capacity = hdr.capacity;
+    tracer.total    = 0;
+    tracer.nbuf     = 0;
+    tracer.start_ns = trace_now();
+    user_info("tracing to %s, %u records", path, hdr.capacity);
+    return 0;
+}
+
+/**
+ * @brief 落盘剩余记录并关闭追踪文件
+ */
+void trace_close() {
+    if (tracer.fd < 0) {
+        return;
+    }
+    trace_flush();
+    if (tracer.fd >= 0) {
+        close(tracer.fd);
+        tracer.fd = -1;
+    }
+}
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
@@ -158,6 +376,7 @@ int ddriver_open(char *path) {
         user_panic("can't init log: %s", log_path);
         return -1;
     }
+    trace_open();
 
     return fd;
 }
@@ -168,6 +387,7 @@ int ddriver_open(char *path) {
  * @return int 
  */
 int ddriver_close(int fd) {
+    trace_close();
     return close(fd) && fclose(debugf);
 }
 /**
@@ -181,6 +401,7 @@ int ddriver_close(int fd) {
 int ddriver_seek(int fd, off_t offset, int whence){
     int ret = 0;
     int cur = 0;
+    uint64_t start = trace_begin();
 
     if (!IS_ADDR_ALIGN(offset)) {
         user_alert("offset %ld must be aligned to block size %d", 
@@ -196,6 +417,7 @@ int ddriver_seek(int fd, off_t offset, int whence){
         return ret;
     }
     emulate_rotate(fd, cur, ret);
+    trace_record(DDRIVER_TRACE_SEEK, ret, cur, 0, start);
     return ret;
 }
 /**
@@ -211,10 +433,17 @@ int ddriver_write(int fd, char *buf, size_t size){
     if(res < 0)
         return res;
         
+    uint64_t start = trace_begin();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+
+    account_begin(pos, 1);
     RW_DELAY(disk, write);
     write(fd, buf, size);
 
     INC_WRITECNT(disk);
+    disk.ext.bytes_written += size;
+    __sync_sub_and_fetch(&disk.inflight, 1);
+    trace_record(DDRIVER_TRACE_WRITE, pos, 0, size, start);
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -230,10 +459,17 @@ int ddriver_read(int fd, char *buf, size_t size){
     if(res < 0)
         return res;
 
+    uint64_t start = trace_begin();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+
+    account_begin(pos, 0);
     RW_DELAY(disk, read);
     read(fd, buf, size);
 
     INC_READCNT(disk);
+    disk.ext.bytes_read += size;
+    __sync_sub_and_fetch(&disk.inflight, 1);
+    trace_record(DDRIVER_TRACE_READ, pos, 0, size, start);
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -246,6 +482,9 @@ int ddriver_read(int fd, char *buf, size_t size){
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     struct ddriver_state state;
+    struct ddriver_state_ext ext;
+    struct ddriver_region_map *map;
+    unsigned int size, i;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
@@ -268,10 +507,38 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
         disk.read_cnt = 0;
         disk.write_cnt = 0;
         disk.seek_cnt = 0;
+        memset(&disk.ext, 0, sizeof(disk.ext));
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         memcpy(arg, &disk.iounit_size, sizeof(int));
         break;
+    case IOC_REQ_DEVICE_STATE_EXT:                    /* Extended Device State */
+        size = ((struct ddriver_state_ext *)arg)->size;
+        if (size < 2 * sizeof(unsigned int)) {
+            return -EINVAL;
+        }
+        ext = disk.ext;
+        ext.version = DDRIVER_STATE_EXT_VERSION;
+        ext.size = size < sizeof(ext) ? size : sizeof(ext);
+        ext.read_cnt = disk.read_cnt;
+        ext.write_cnt = disk.write_cnt;
+        ext.seek_cnt = disk.seek_cnt;
+        memcpy(arg, &ext, ext.size);            /* 旧版本的调用方只拿到它认识的前缀 */
+        break;
+    case IOC_REQ_DEVICE_REGION_MAP:                   /* Region Map */
+        map = (struct ddriver_region_map *)arg;
+        if (map->count > DDRIVER_MAX_REGIONS) {
+            return -EINVAL;
+        }
+        for (i = 0; i < map->count; i++) {
+            if (map->regions[i].type >= DDRIVER_REGION_TYPES) {
+                return -EINVAL;
+            }
+        }
+        disk.regions.count = 0;
+        memcpy(disk.regions.regions, map->regions, map->count * sizeof(struct ddriver_region));
+        disk.regions.count = map->count;
+        break;
     default:
         break;
     }
@@ -14,8 +14,56 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_STATE_EXT_VERSION   1       /* ddriver_state_ext的当前版本 */
+#define DDRIVER_QDEPTH_BUCKETS      8       /* 队列深度直方图：深度1..7各一桶，>=8合为最后一桶 */
+#define DDRIVER_MAX_REGIONS         64      /* 区域表最多登记的区域数 */
+
+enum ddriver_region_type                    /* 区域类型，访问次数和设备时间按类型汇总 */
+{
+    DDRIVER_REGION_OTHER,                   /* 未登记的区域 */
+    DDRIVER_REGION_SUPER,                   /* 超级块、组描述符等 */
+    DDRIVER_REGION_BITMAP,
+    DDRIVER_REGION_INODE,
+    DDRIVER_REGION_DATA,
+    DDRIVER_REGION_TYPES
+};
+
+struct ddriver_region
+{
+    unsigned int offset;                    /* 起始字节偏移 */
+    unsigned int size;                      /* 字节数 */
+    unsigned int type;                      /* enum ddriver_region_type */
+};
+
+struct ddriver_region_map                   /* 文件系统挂载时登记，count为0时清空 */
+{
+    unsigned int          count;
+    struct ddriver_region regions[DDRIVER_MAX_REGIONS];
+};
+
+struct ddriver_state_ext
+{
+    unsigned int       version;             /* 调用方填DDRIVER_STATE_EXT_VERSION，驱动写回自己的版本 */
+    unsigned int       size;                /* 调用方填sizeof(struct ddriver_state_ext)，驱动最多写这么多字节 */
+    unsigned long long read_cnt;
+    unsigned long long write_cnt;
+    unsigned long long seek_cnt;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long seek_distance;       /* 磁头移动的总字节数 */
+    unsigned long long rotate_ns;           /* 模拟寻道（旋转）延迟的总时间 */
+    unsigned long long read_ns;             /* 模拟读延迟的总时间 */
+    unsigned long long write_ns;            /* 模拟写延迟的总时间 */
+    unsigned long long qdepth_hist[DDRIVER_QDEPTH_BUCKETS];   /* 每次读写开始时在途的请求数（含自己） */
+    unsigned long long region_reads[DDRIVER_REGION_TYPES];
+    unsigned long long region_writes[DDRIVER_REGION_TYPES];
+    unsigned long long region_ns[DDRIVER_REGION_TYPES];       /* 读写延迟及寻道到该区域的延迟 */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_STATE_EXT    _IOWR(IOC_MAGIC, 4, struct ddriver_state_ext)
+#define IOC_REQ_DEVICE_REGION_MAP   _IOW(IOC_MAGIC, 5, struct ddriver_region_map)
 #endif
\ No newline at end of file
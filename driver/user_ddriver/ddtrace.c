@@ -0,0 +1,451 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "string.h"
+#include "errno.h"
+#include <time.h>
+#include "include/ddriver_ctl_user.h"
+#include "include/ddriver_trace.h"
+/******************************************************************************
+* SECTION: ddtrace - ddriver追踪文件的分析与回放
+*
+* ddtrace stat <trace>
+*     请求统计、寻道距离分布、顺序性、按区域汇总、热点块及热力图
+* ddtrace replay [-p profile]... [-i image] <trace>
+*     在全新的镜像上按序重放全部请求，并用每个延迟模型算出设备时间。
+*     模型按记录逐条计算、不睡眠，同一追踪和模型的结果总是相同。
+*     profile: trace（录制时的参数，默认）| hdd | ssd | nvme | <读us>,<写us>,<转一圈us>
+*******************************************************************************/
+#define HEAT_CELLS      64                  /* 热力图把设备分成的格数 */
+#define HOT_BLOCKS      10                  /* 列出的热点块数 */
+#define MAX_PROFILES    8
+#define DIST_BUCKETS    33                  /* 寻道距离按2的幂分桶 */
+
+struct profile
+{
+    const char *name;
+    unsigned    read_us;
+    unsigned    write_us;
+    unsigned    seek_us;                    /* 转一圈（一个磁道）的时间 */
+    double      rotate_ns;                  /* 以下为回放结果 */
+    double      read_ns;
+    double      write_ns;
+    double      region_ns[DDRIVER_REGION_TYPES];
+};
+
+static const struct profile builtin_profiles[] = {
+    { .name = "hdd",  .read_us = 2000, .write_us = 1000, .seek_us = 8333 },    /* 7200rpm */
+    { .name = "ssd",  .read_us =  100, .write_us =  300, .seek_us =    0 },
+    { .name = "nvme", .read_us =   20, .write_us =   40, .seek_us =    0 },
+};
+
+static const char *op_names[DDRIVER_TRACE_OPS] = { "seek", "read", "write" };
+static const char *region_names[DDRIVER_REGION_TYPES] = {
+    "other", "super", "bitmap", "inode", "data"
+};
+
+struct ddriver_trace_hdr  hdr;
+struct ddriver_trace_rec *recs;
+uint64_t                  nrecs;
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static void usage() {
+    fprintf(stderr, "usage: ddtrace stat <trace>\n"
+                    "       ddtrace replay [-p trace|hdd|ssd|nvme|<r_us>,<w_us>,<seek_us>]... "
+                    "[-i image] <trace>\n");
+    exit(2);
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief 一次读入从槽slot起的n条记录
+ *
+ * @return uint64_t 完整读到的记录数
+ */
+static uint64_t read_slots(int fd, struct ddriver_trace_rec *dst, uint64_t slot, uint64_t n) {
+    ssize_t ret = n ? pread(fd, dst, n * sizeof(*dst), sizeof(hdr) + slot * sizeof(*dst)) : 0;
+    return ret > 0 ? (uint64_t)ret / sizeof(*dst) : 0;
+}
+
+/**
+ * @brief 读入追踪文件，按时间顺序展开环上的记录：从最旧的槽读到环尾，再从环头读剩下的，共两次读
+ *
+ * @param path
+ * @return int
+ */
+static int load_trace(const char *path) {
+    uint64_t first, part, got;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "ddtrace: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != DDRIVER_TRACE_MAGIC) {
+        fprintf(stderr, "ddtrace: %s: not a ddriver trace\n", path);
+        close(fd);
+        return -1;
+    }
+    if (hdr.version != DDRIVER_TRACE_VERSION || hdr.rec_size != sizeof(struct ddriver_trace_rec)) {
+        fprintf(stderr, "ddtrace: %s: unsupported trace version %u\n", path, hdr.version);
+        close(fd);
+        return -1;
+    }
+
+    nrecs = hdr.total < hdr.capacity ? hdr.total : hdr.capacity;
+    first = hdr.total < hdr.capacity ? 0 : hdr.total % hdr.capacity;
+    recs  = (struct ddriver_trace_rec *)malloc((nrecs ? nrecs : 1) * sizeof(struct ddriver_trace_rec));
+    part  = nrecs < hdr.capacity - first ? nrecs : hdr.capacity - first;
+    got   = read_slots(fd, recs, first, part);
+    if (got == part) {
+        got += read_slots(fd, recs + part, 0, nrecs - part);
+    }
+    if (got < nrecs) {
+        fprintf(stderr, "ddtrace: %s: truncated at record %llu\n", path, (unsigned long long)got);
+        nrecs = got;
+    }
+    close(fd);
+    if (hdr.total > hdr.capacity) {
+        printf("ring wrapped: %llu records written, last %llu kept\n",
+               (unsigned long long)hdr.total, (unsigned long long)nrecs);
+    }
+    return 0;
+}
+
+static void print_bar(double frac, int width) {
+    int n = (int)(frac * width + 0.5);
+    while (n-- > 0) {
+        putchar('#');
+    }
+    putchar('\n');
+}
+
+/**
+ * @brief 一行热力图，每格一个字符，按最大值归一化
+ */
+static void print_heat(const char *name, const uint64_t *cells, uint64_t max) {
+    static const char shades[] = " .:-=+*#%@";
+    int i, level;
+
+    printf("  %-6s |", name);
+    for (i = 0; i < HEAT_CELLS; i++) {
+        level = (cells[i] == 0 || max == 0) ? 0 :
+                1 + (int)((cells[i] - 1) * (sizeof(shades) - 2) / max);
+        putchar(shades[level]);
+    }
+    printf("|\n");
+}
+/******************************************************************************
+* SECTION: stat
+*******************************************************************************/
+static int do_stat() {
+    uint64_t op_cnt[DDRIVER_TRACE_OPS] = {0}, op_bytes[DDRIVER_TRACE_OPS] = {0};
+    double   op_ns[DDRIVER_TRACE_OPS] = {0};
+    uint64_t dist[DIST_BUCKETS] = {0}, region_rd[DDRIVER_REGION_TYPES] = {0},
+             region_wr[DDRIVER_REGION_TYPES] = {0};
+    uint64_t heat_rd[HEAT_CELLS] = {0}, heat_wr[HEAT_CELLS] = {0}, heat_max = 0;
+    uint64_t seq = 0, rw = 0, runs = 0, moves = 0, total_dist = 0, max_dist_cnt = 0;
+    uint64_t *blk_cnt, i, d;
+    unsigned nblks = hdr.disk_size / hdr.block_size, cell_sz = hdr.disk_size / HEAT_CELLS;
+    int64_t  prev_end = -1;
+    int      b, k, top;
+    struct ddriver_trace_rec *r;
+
+    blk_cnt = (uint64_t *)calloc(nblks, sizeof(uint64_t));
+    for (i = 0; i < nrecs; i++) {
+        r = &recs[i];
+        if (r->op >= DDRIVER_TRACE_OPS) {
+            continue;
+        }
+        op_cnt[r->op]++;
+        op_bytes[r->op] += r->len;
+        op_ns[r->op] += r->lat_ns;
+        if (r->op == DDRIVER_TRACE_SEEK) {
+            d = r->offset > r->from ? r->offset - r->from : r->from - r->offset;
+            total_dist += d;
+            moves += d != 0;
+            dist[d == 0 ? 0 : 64 - __builtin_clzll(d)]++;
+            continue;
+        }
+        rw++;
+        if ((int64_t)r->offset == prev_end) {
+            seq++;
+        }
+        else {
+            runs++;
+        }
+        prev_end = r->offset + r->len;
+        if (r->region < DDRIVER_REGION_TYPES) {
+            (r->op == DDRIVER_TRACE_READ ? region_rd : region_wr)[r->region]++;
+        }
+        if (r->offset < hdr.disk_size) {
+            (r->op == DDRIVER_TRACE_READ ? heat_rd : heat_wr)[r->offset / cell_sz]++;
+            blk_cnt[r->offset / hdr.block_size]++;
+        }
+    }
+
+    printf("records %llu, span %.1f ms, device %u KiB, io unit %u B\n\n",
+           (unsigned long long)nrecs, nrecs ? (recs[nrecs - 1].ts_ns - recs[0].ts_ns) / 1e6 : 0.0,
+           hdr.disk_size / 1024, hdr.block_size);
+    printf("%-8s %10s %12s %12s %10s\n", "op", "count", "bytes", "total_ms", "mean_us");
+    for (k = 0; k < DDRIVER_TRACE_OPS; k++) {
+        printf("%-8s %10llu %12llu %12.1f %10.1f\n", op_names[k], (unsigned long long)op_cnt[k],
+               (unsigned long long)op_bytes[k], op_ns[k] / 1e6,
+               op_cnt[k] ? op_ns[k] / 1e3 / op_cnt[k] : 0.0);
+    }
+
+    printf("\nseek distance: %llu seeks, %llu moved the head, %.1f KiB on average\n",
+           (unsigned long long)op_cnt[DDRIVER_TRACE_SEEK], (unsigned long long)moves,
+           moves ? total_dist / 1024.0 / moves : 0.0);
+    for (b = 0; b < DIST_BUCKETS; b++) {
+        max_dist_cnt = dist[b] > max_dist_cnt ? dist[b] : max_dist_cnt;
+    }
+    for (b = 0; b < DIST_BUCKETS; b++) {
+        if (dist[b] == 0) {
+            continue;
+        }
+        if (b == 0) {
+            printf("  %12s %8llu ", "0", (unsigned long long)dist[b]);
+        }
+        else {
+            printf("  < %8llu B %8llu ", 1ULL << b, (unsigned long long)dist[b]);
+        }
+        print_bar((double)dist[b] / max_dist_cnt, 40);
+    }
+
+    printf("\nsequentiality: %llu of %llu reads/writes continue the previous one (%.1f%%), "
+           "%llu runs, %.1f requests per run\n",
+           (unsigned long long)seq, (unsigned long long)rw, rw ? seq * 100.0 / rw : 0.0,
+           (unsigned long long)runs, runs ? (double)rw / runs : 0.0);
+
+    printf("\n%-8s %10s %10s\n", "region", "reads", "writes");
+    for (k = 0; k < DDRIVER_REGION_TYPES; k++) {
+        printf("%-8s %10llu %10llu\n", region_names[k],
+               (unsigned long long)region_rd[k], (unsigned long long)region_wr[k]);
+    }
+
+    printf("\nhot blocks (%u B):\n", hdr.block_size);
+    for (top = 0; top < HOT_BLOCKS; top++) {
+        uint64_t best = 0;
+        unsigned best_blk = 0, j;
+        for (j = 0; j < nblks; j++) {
+            if (blk_cnt[j] > best) {
+                best = blk_cnt[j];
+                best_blk = j;
+            }
+        }
+        if (best == 0) {
+            break;
+        }
+        printf("  offset %8u %8llu accesses\n", best_blk * hdr.block_size, (unsigned long long)best);
+        blk_cnt[best_blk] = 0;
+    }
+
+    for (b = 0; b < HEAT_CELLS; b++) {
+        heat_max = heat_rd[b] > heat_max ? heat_rd[b] : heat_max;
+        heat_max = heat_wr[b] > heat_max ? heat_wr[b] : heat_max;
+    }
+    printf("\nheatmap (%u KiB per cell, max %llu):\n", cell_sz / 1024, (unsigned long long)heat_max);
+    print_heat("reads", heat_rd, heat_max);
+    print_heat("writes", heat_wr, heat_max);
+    free(blk_cnt);
+    return 0;
+}
+/******************************************************************************
+* SECTION: replay
+*******************************************************************************/
+/**
+ * @brief 解析延迟模型
+ *
+ * @param arg
+ * @param p
+ * @return int
+ */
+static int parse_profile(const char *arg, struct profile *p) {
+    unsigned i;
+
+    memset(p, 0, sizeof(*p));
+    p->name = arg;
+    if (strcmp(arg, "trace") == 0) {
+        p->read_us  = hdr.read_lat_us;
+        p->write_us = hdr.write_lat_us;
+        p->seek_us  = hdr.seek_lat_us;
+        return 0;
+    }
+    for (i = 0; i < sizeof(builtin_profiles) / sizeof(builtin_profiles[0]); i++) {
+        if (strcmp(arg, builtin_profiles[i].name) == 0) {
+            *p = builtin_profiles[i];
+            return 0;
+        }
+    }
+    if (sscanf(arg, "%u,%u,%u", &p->read_us, &p->write_us, &p->seek_us) == 3) {
+        return 0;
+    }
+    fprintf(stderr, "ddtrace: unknown profile %s\n", arg);
+    return -1;
+}
+
+/**
+ * @brief 按模型累计一条请求的设备时间，与ddriver的模拟方式一致：
+ * 寻道按移动距离在磁道内的余数折算旋转时间，读写各有固定延迟
+ */
+static void model(struct profile *p, const struct ddriver_trace_rec *r, uint64_t head) {
+    uint64_t bytes_per_track = hdr.disk_size / hdr.track_num;
+    uint64_t d;
+    double   ns;
+    int      region = r->region < DDRIVER_REGION_TYPES ? r->region : DDRIVER_REGION_OTHER;
+
+    switch (r->op) {
+    case DDRIVER_TRACE_SEEK:
+        d  = r->offset > head ? r->offset - head : head - r->offset;
+        ns = (double)(d % bytes_per_track) * p->seek_us * 1000 / bytes_per_track;
+        p->rotate_ns += ns;
+        break;
+    case DDRIVER_TRACE_READ:
+        ns = p->read_us * 1000.0;
+        p->read_ns += ns;
+        break;
+    default:
+        ns = p->write_us * 1000.0;
+        p->write_ns += ns;
+        break;
+    }
+    p->region_ns[region] += ns;
+}
+
+static int do_replay(struct profile *profiles, int nprof, const char *image) {
+    char     tmp[] = "/tmp/ddtrace.XXXXXX", buf[UINT16_MAX];    /* 容得下任意一条记录的len */
+    uint64_t head = 0, i;
+    double   recorded = 0, start;
+    int      fd, k, j;
+    struct ddriver_trace_rec *r;
+
+    fd = image ? open(image, O_CREAT | O_TRUNC | O_RDWR, 0644) : mkstemp(tmp);
+    if (fd < 0) {
+        fprintf(stderr, "ddtrace: can't create image: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!image) {
+        unlink(tmp);
+    }
+    if (ftruncate(fd, hdr.disk_size) < 0) {
+        fprintf(stderr, "ddtrace: can't size image: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+    memset(buf, 0, sizeof(buf));
+
+    start = now_ms();
+    for (i = 0; i < nrecs; i++) {
+        r = &recs[i];
+        recorded += r->lat_ns;
+        for (k = 0; k < nprof; k++) {
+            model(&profiles[k], r, head);
+        }
+        switch (r->op) {
+        case DDRIVER_TRACE_SEEK:
+            head = r->offset;
+            break;
+        case DDRIVER_TRACE_READ:
+            if (pread(fd, buf, r->len, r->offset) < 0) {
+                fprintf(stderr, "ddtrace: replay read at %u: %s\n", r->offset, strerror(errno));
+                close(fd);
+                return 1;
+            }
+            head = r->offset + r->len;
+            break;
+        case DDRIVER_TRACE_WRITE:
+            if (pwrite(fd, buf, r->len, r->offset) != r->len) {
+                fprintf(stderr, "ddtrace: replay write at %u: %s\n", r->offset, strerror(errno));
+                close(fd);
+                return 1;
+            }
+            head = r->offset + r->len;
+            break;
+        default:
+            break;
+        }
+    }
+    fsync(fd);
+    close(fd);
+
+    printf("replayed %llu requests in %.1f ms, recorded driver time %.1f ms\n\n",
+           (unsigned long long)nrecs, now_ms() - start, recorded / 1e6);
+    printf("%-16s %10s %10s %10s %10s", "profile", "total_ms", "rotate_ms", "read_ms", "write_ms");
+    for (j = 0; j < DDRIVER_REGION_TYPES; j++) {
+        printf(" %9s", region_names[j]);
+    }
+    printf("\n");
+    for (k = 0; k < nprof; k++) {
+        struct profile *p = &profiles[k];
+        printf("%-16s %10.1f %10.1f %10.1f %10.1f", p->name,
+               (p->rotate_ns + p->read_ns + p->write_ns) / 1e6,
+               p->rotate_ns / 1e6, p->read_ns / 1e6, p->write_ns / 1e6);
+        for (j = 0; j < DDRIVER_REGION_TYPES; j++) {
+            printf(" %9.1f", p->region_ns[j] / 1e6);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+/******************************************************************************
+* SECTION: main
+*******************************************************************************/
+int main(int argc, char **argv) {
+    struct profile profiles[MAX_PROFILES];
+    const char *names[MAX_PROFILES], *image = NULL;
+    int nprof = 0, opt, k;
+
+    if (argc < 3) {
+        usage();
+    }
+    if (strcmp(argv[1], "stat") == 0) {
+        if (load_trace(argv[2]) < 0) {
+            return 1;
+        }
+        return do_stat();
+    }
+    if (strcmp(argv[1], "replay") != 0) {
+        usage();
+    }
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "p:i:")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (nprof == MAX_PROFILES) {
+                fprintf(stderr, "ddtrace: at most %d profiles\n", MAX_PROFILES);
+                return 2;
+            }
+            names[nprof++] = optarg;
+            break;
+        case 'i':
+            image = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+    if (load_trace(argv[optind]) < 0) {
+        return 1;
+    }
+    if (nprof == 0) {
+        names[nprof++] = "trace";
+    }
+    for (k = 0; k < nprof; k++) {
+        if (parse_profile(names[k], &profiles[k]) < 0) {
+            return 2;
+        }
+    }
+    return do_replay(profiles, nprof, image);
+}
@@ -0,0 +1,54 @@
+#ifndef _DDRIVER_TRACE_H_
+#define _DDRIVER_TRACE_H_
+
+#include <stdint.h>
+/******************************************************************************
+* SECTION: Trace file format
+*
+* 设置环境变量 DDRIVER_TRACE=<文件> 后，ddriver_open 开启追踪，每次 seek/read/write
+* 追加一条定长记录。文件是一个环：头部之后是 capacity 个记录槽，第 i 条记录
+* （从0开始）写在槽 i % capacity，头部的 total 是写过的记录总数。
+*
+* | ddriver_trace_hdr | rec[0] | rec[1] | ... | rec[capacity - 1] |
+*******************************************************************************/
+#define DDRIVER_TRACE_MAGIC         0x52544444      /* "DDTR" */
+#define DDRIVER_TRACE_VERSION       1
+#define DDRIVER_TRACE_ENV           "DDRIVER_TRACE"             /* 追踪文件路径 */
+#define DDRIVER_TRACE_RECORDS_ENV   "DDRIVER_TRACE_RECORDS"     /* 环的记录数 */
+#define DDRIVER_TRACE_RECORDS       (1 << 20)                   /* 默认1M条，24MiB */
+
+enum ddriver_trace_op
+{
+    DDRIVER_TRACE_SEEK,
+    DDRIVER_TRACE_READ,
+    DDRIVER_TRACE_WRITE,
+    DDRIVER_TRACE_OPS
+};
+
+struct ddriver_trace_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_size;                      /* sizeof(struct ddriver_trace_rec) */
+    uint32_t capacity;                      /* 记录槽数 */
+    uint64_t total;                         /* 写过的记录总数，超过capacity时只保留最近的capacity条 */
+    uint32_t disk_size;                     /* 以下为录制时的设备参数，回放的默认延迟模型 */
+    uint32_t block_size;
+    uint32_t track_num;
+    uint32_t read_lat_us;
+    uint32_t write_lat_us;
+    uint32_t seek_lat_us;                   /* 转一圈（一个磁道）的时间 */
+};
+
+struct ddriver_trace_rec
+{
+    uint64_t ts_ns;                         /* 距开启追踪的时间 */
+    uint32_t offset;                        /* seek: 目标位置; read/write: 起始位置 */
+    uint32_t from;                          /* seek: 原磁头位置; read/write: 未用 */
+    uint32_t lat_ns;                        /* 本次请求在驱动内的耗时（含模拟延迟） */
+    uint16_t len;                           /* read/write的字节数 */
+    uint8_t  op;                            /* enum ddriver_trace_op */
+    uint8_t  region;                        /* enum ddriver_region_type */
+};
+
+#endif /* _DDRIVER_TRACE_H_ */
@@ -0,0 +1,144 @@
+#ifndef FS_BITMAP_H
+#define FS_BITMAP_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+Bitmap primitives shared by the filesystems under fs/, header only so every call inlines.
+
+A bitmap is a plain byte array: bit n is bit (n % 8) of byte n / 8, the layout newfs (SFS_BITMAP_SET) and mfs-fuse keep on disk.
+Scans read it 64 bits at a time and find bits with ctz; 'nbits' bounds every call and bits past it are never reported.
+*/
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FS_BITMAP_LE64(x) __builtin_bswap64(x)
+#else
+#define FS_BITMAP_LE64(x) (x)
+#endif
+
+/*
+Bits 64 * w to 64 * w + 63 of the bitmap, bit n of the bitmap as bit n % 64 of the result. Bits past 'nbits' read as 0
+*/
+static inline uint64_t fs_bitmap_word(const uint8_t * map, uint64_t nbits, uint64_t w){
+    uint64_t bytes = (nbits + 7) / 8, off = w * 8, word = 0, i;
+    if(off + 8 <= bytes){
+        memcpy(&word, map + off, sizeof(word));
+        word = FS_BITMAP_LE64(word);
+    }
+    else{
+        for(i = 0; off + i < bytes; i++){
+            word |= (uint64_t)map[off + i] << (8 * i);
+        }
+    }
+    if(nbits - w * 64 < 64){
+        word &= (1ULL << (nbits - w * 64)) - 1;
+    }
+    return word;
+}
+
+static inline int fs_bitmap_test(const uint8_t * map, uint64_t bit){
+    return (map[bit / 8] >> (bit % 8)) & 1;
+}
+
+static inline void fs_bitmap_set(uint8_t * map, uint64_t bit){
+    map[bit / 8] |= (uint8_t)(1U << (bit % 8));
+}
+
+static inline void fs_bitmap_clear(uint8_t * map, uint64_t bit){
+    map[bit / 8] &= (uint8_t)~(1U << (bit % 8));
+}
+
+/*
+Sets ('value' 1) or clears ('value' 0) the 'len' bits from 'start': partial bytes at either end bit by bit, whole bytes with memset
+*/
+static inline void fs_bitmap_fill(uint8_t * map, uint64_t start, uint64_t len, int value){
+    uint64_t end = start + len;
+    uint8_t mask;
+    if(len == 0){
+        return;
+    }
+    if(start / 8 == (end - 1) / 8){
+        mask = (uint8_t)(((1U << (end - start)) - 1) << (start % 8));
+        map[start / 8] = value ? (map[start / 8] | mask) : (map[start / 8] & ~mask);
+        return;
+    }
+    if(start % 8){
+        mask = (uint8_t)(0xff << (start % 8));
+        map[start / 8] = value ? (map[start / 8] | mask) : (map[start / 8] & ~mask);
+        start += 8 - start % 8;
+    }
+    if(end % 8){
+        mask = (uint8_t)((1U << (end % 8)) - 1);
+        map[end / 8] = value ? (map[end / 8] | mask) : (map[end / 8] & ~mask);
+        end -= end % 8;
+    }
+    memset(map + start / 8, value ? 0xff : 0, (end - start) / 8);
+}
+
+static inline void fs_bitmap_set_range(uint8_t * map, uint64_t start, uint64_t len){
+    fs_bitmap_fill(map, start, len, 1);
+}
+
+static inline void fs_bitmap_clear_range(uint8_t * map, uint64_t start, uint64_t len){
+    fs_bitmap_fill(map, start, len, 0);
+}
+
+/*
+Number of set bits among the first 'nbits', for used / free space accounting
+*/
+static inline uint64_t fs_bitmap_count(const uint8_t * map, uint64_t nbits){
+    uint64_t w, count = 0;
+    for(w = 0; w * 64 < nbits; w++){
+        count += __builtin_popcountll(fs_bitmap_word(map, nbits, w));
+    }
+    return count;
+}
+
+/*
+First bit in [from, to) equal to 'value', 'nbits' if there is none. 'to' must not exceed 'nbits'
+*/
+static inline uint64_t fs_bitmap_scan(const uint8_t * map, uint64_t nbits, uint64_t from, uint64_t to, int value){
+    uint64_t w = from / 64, word, bit;
+    if(from >= to){
+        return nbits;
+    }
+    word = fs_bitmap_word(map, nbits, w);
+    word = (value ? word : ~word) & (~0ULL << (from % 64));
+    for(;;){
+        if(word != 0){
+            bit = w * 64 + __builtin_ctzll(word);
+            return bit < to ? bit : nbits;
+        }
+        if(++w * 64 >= to){
+            return nbits;
+        }
+        word = fs_bitmap_word(map, nbits, w);
+        word = value ? word : ~word;
+    }
+}
+
+/*
+First set bit at or after 'from', 'nbits' if there is none
+*/
+static inline uint64_t fs_bitmap_find_set(const uint8_t * map, uint64_t nbits, uint64_t from){
+    return fs_bitmap_scan(map, nbits, from, nbits, 1);
+}
+
+/*
+First clear bit at or after 'hint', wrapping around to the start of the bitmap; 'nbits' if every bit is set.
+An allocator that keeps 'hint' at or below its lowest free bit gets first fit without rescanning the full prefix
+*/
+static inline uint64_t fs_bitmap_find_zero(const uint8_t * map, uint64_t nbits, uint64_t hint){
+    uint64_t bit;
+    if(hint >= nbits){
+        hint = 0;
+    }
+    bit = fs_bitmap_scan(map, nbits, hint, nbits, 0);
+    if(bit == nbits && hint > 0){
+        bit = fs_bitmap_scan(map, nbits, 0, hint, 0);
+    }
+    return bit;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _FS_BLKIO_H_
+#define _FS_BLKIO_H_
+/******************************************************************************
+ * fs_blkio：newfs、simplefs和模板共用的块设备层，建在ddriver之上。
+ * - 按字节偏移读写，首尾不足一个IO单位的部分读-改-写，中间整单位直接读写调用者的缓冲，不经中转
+ * - 记录磁头位置，顺序访问不再重复seek
+ * - 可选的写穿透缓冲缓存（CLOCK替换），以IO单位为粒度，缓存元数据等小块访问
+ * - 批量提交：一批请求按偏移排序后从当前磁头位置起单向扫一遍（C-SCAN）
+ * 所有访问在设备锁内进行，多线程FUSE下seek与读写不会交错
+ *******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define FS_BLK_NOCACHE_UNITS  16          /* 超过这么多IO单位的请求不进缓存，避免顺序大IO冲掉元数据 */
+#define FS_BLK_POS_UNKNOWN    UINT64_MAX  /* 磁头位置未知，下一次访问必须seek */
+
+struct fs_blk_req {
+    uint64_t             offset;          /* 设备上的字节偏移 */
+    void*                buf;
+    size_t               size;
+    int                  write;           /* 1写，0读 */
+    int                  nocache;         /* 1则不为该请求占用缓存槽，用于调用者自己缓存的文件数据 */
+};
+
+struct fs_blkdev {
+    int                  fd;              /* ddriver_open返回的设备，由调用者打开和关闭 */
+    int                  io_sz;           /* 设备IO单位 */
+    uint64_t             pos;             /* 磁头位置 */
+    uint8_t*             unit;            /* 首尾单位读-改-写的暂存，2*io_sz字节 */
+    pthread_mutex_t      lock;
+
+    int                  cache_cnt;       /* 缓存的单位数，0不缓存 */
+    uint8_t*             cache_mem;       /* cache_cnt个单位的数据 */
+    uint64_t*            cache_tag;       /* 各槽缓存的单位号+1，0为空槽 */
+    uint8_t*             cache_ref;       /* CLOCK引用位 */
+    int*                 cache_next;      /* 哈希链 */
+    int*                 cache_head;      /* 哈希桶，cache_mask+1个 */
+    uint32_t             cache_mask;
+    int                  cache_hand;      /* CLOCK指针 */
+
+    uint64_t             hits;            /* 缓存命中的单位数 */
+    uint64_t             misses;          /* 从设备读入的单位数 */
+    uint64_t             writes;          /* 写到设备的单位数 */
+    uint64_t             seeks;           /* 实际发出的seek */
+    uint64_t             seeks_saved;     /* 磁头已在目标位置而省去的seek */
+};
+
+/**
+ * @brief 在已打开的设备上建立块设备层
+ *
+ * @param dev
+ * @param fd ddriver设备
+ * @param io_sz 设备IO单位（IOC_REQ_DEVICE_IO_SZ）
+ * @param cache_cnt 缓冲缓存的单位数，0不缓存
+ * @return int 0成功，-ENOMEM
+ */
+int  fs_blk_open(struct fs_blkdev* dev, int fd, int io_sz, int cache_cnt);
+/**
+ * @brief 释放缓存，不关闭设备。缓存是写穿透的，没有待写回的数据
+ *
+ * @param dev
+ */
+void fs_blk_close(struct fs_blkdev* dev);
+/**
+ * @brief 从设备的offset处读size字节，对齐的整单位直接读入buf
+ *
+ * @param dev
+ * @param offset 字节偏移，可不对齐
+ * @param buf
+ * @param size
+ * @return int 0成功，-EIO
+ */
+int  fs_blk_read(struct fs_blkdev* dev, uint64_t offset, void* buf, size_t size);
+/**
+ * @brief 向设备的offset处写size字节：整单位直接从buf写出，只有首尾不满的单位需要先读
+ *
+ * @param dev
+ * @param offset 字节偏移，可不对齐
+ * @param buf
+ * @param size
+ * @return int 0成功，-EIO
+ */
+int  fs_blk_write(struct fs_blkdev* dev, uint64_t offset, const void* buf, size_t size);
+/**
+ * @brief 批量提交：reqs按偏移重排后从磁头位置起单向扫描执行，首尾相接的请求之间不seek。
+ * 同一批内的请求不应重叠（重排后先后顺序不定）
+ *
+ * @param dev
+ * @param reqs 请求数组，返回时已按偏移排序
+ * @param cnt
+ * @return int 0成功，-EIO（之后的请求不再执行）
+ */
+int  fs_blk_submit(struct fs_blkdev* dev, struct fs_blk_req* reqs, int cnt);
+
+#endif /* _FS_BLKIO_H_ */
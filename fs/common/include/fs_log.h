@@ -0,0 +1,38 @@
+#ifndef _FS_LOG_H_
+#define _FS_LOG_H_
+/******************************************************************************
+ * fs_log：newfs和mfs-fuse共用的日志环形缓冲。
+ * - 每个线程一个环，属主线程写日志不加锁，满了覆盖最旧的记录
+ * - 每条记录带序号，fs_log_flush据此跳过读的同时被覆盖的记录
+ * - 线程退出时环归还空闲链表，留给新线程复用
+ * 级别的名字和编译期消去由各项目的宏决定（SFS_ERR、FS_ERROR等），这里只存取记录
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+
+#define FS_LOG_ERROR          0       /* 立即输出 */
+#define FS_LOG_WARN           1
+#define FS_LOG_INFO           2
+#define FS_LOG_DEBUG          3
+#define FS_LOG_TRACE          4
+
+#define FS_LOG_RING           256     /* 每线程环形缓冲的记录数，2的幂 */
+#define FS_LOG_MSG_SZ         240     /* 单条记录的长度，超出部分截断 */
+
+/**
+ * @brief 写一条日志到本线程的环；FS_LOG_ERROR立即输出
+ *
+ * @param level FS_LOG_ERROR ~ FS_LOG_TRACE
+ * @param tag 输出时的前缀，须是字符串常量，记录里只保存指针
+ * @param fmt printf格式
+ */
+void fs_log(int level, const char* tag, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+/**
+ * @brief 按线程依次输出所有环中尚未输出的记录，被覆盖的记录只计数
+ *
+ * @param out 输出
+ * @return int 输出的记录数
+ */
+int  fs_log_flush(FILE* out);
+
+#endif /* _FS_LOG_H_ */
@@ -0,0 +1,338 @@
+#include "fs_blkio.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "ddriver.h"
+
+#define FS_BLK_MEM(dev, slot)   ((dev)->cache_mem + (size_t)(slot) * (dev)->io_sz)
+#define FS_BLK_HASH(dev, u)     ((uint32_t)(((u) * 0x9E3779B97F4A7C15ULL) >> 32) & (dev)->cache_mask)
+
+/**
+ * @brief 查找缓存中的单位
+ *
+ * @param dev
+ * @param u 单位号
+ * @return int 槽号，-1未缓存
+ */
+static int fs_blk_find(struct fs_blkdev* dev, uint64_t u) {
+    int slot;
+
+    if (dev->cache_cnt == 0) {
+        return -1;
+    }
+    for (slot = dev->cache_head[FS_BLK_HASH(dev, u)]; slot >= 0; slot = dev->cache_next[slot]) {
+        if (dev->cache_tag[slot] == u + 1) {
+            return slot;
+        }
+    }
+    return -1;
+}
+/**
+ * @brief 用CLOCK选一个槽给单位u：跳过并清除引用位为1的槽，淘汰第一个引用位为0的槽
+ *
+ * @param dev
+ * @param u 单位号，调用者保证未缓存
+ * @return int 槽号
+ */
+static int fs_blk_alloc(struct fs_blkdev* dev, uint64_t u) {
+    int  slot, *link;
+
+    for (;;) {
+        slot           = dev->cache_hand;
+        dev->cache_hand = (dev->cache_hand + 1) % dev->cache_cnt;
+        if (dev->cache_tag[slot] == 0 || !dev->cache_ref[slot]) {
+            break;
+        }
+        dev->cache_ref[slot] = 0;
+    }
+    if (dev->cache_tag[slot] != 0) {                  /* 从旧单位的哈希链上摘下 */
+        link = &dev->cache_head[FS_BLK_HASH(dev, dev->cache_tag[slot] - 1)];
+        while (*link != slot) {
+            link = &dev->cache_next[*link];
+        }
+        *link = dev->cache_next[slot];
+    }
+    dev->cache_tag[slot]  = u + 1;
+    dev->cache_ref[slot]  = 1;
+    dev->cache_next[slot] = dev->cache_head[FS_BLK_HASH(dev, u)];
+    dev->cache_head[FS_BLK_HASH(dev, u)] = slot;
+    return slot;
+}
+/**
+ * @brief 把单位u的新内容放进缓存：已缓存则更新，否则仅在fill时占一个槽
+ *
+ * @param dev
+ * @param u 单位号
+ * @param data io_sz字节
+ * @param fill
+ */
+static void fs_blk_cache_put(struct fs_blkdev* dev, uint64_t u, const uint8_t* data, int fill) {
+    int slot = fs_blk_find(dev, u);
+
+    if (slot < 0 && fill) {
+        slot = fs_blk_alloc(dev, u);
+    }
+    if (slot >= 0) {
+        memcpy(FS_BLK_MEM(dev, slot), data, dev->io_sz);
+        dev->cache_ref[slot] = 1;
+    }
+}
+/**
+ * @brief 读或写一个IO单位，磁头不在该单位时先seek
+ *
+ * @param dev
+ * @param u 单位号
+ * @param data io_sz字节
+ * @param write
+ * @return int 0成功，-EIO
+ */
+static int fs_blk_unit_io(struct fs_blkdev* dev, uint64_t u, uint8_t* data, int write) {
+    uint64_t ofs = u * dev->io_sz;
+
+    if (dev->pos != ofs) {
+        if (ddriver_seek(dev->fd, (off_t)ofs, SEEK_SET) < 0) {
+            dev->pos = FS_BLK_POS_UNKNOWN;
+            return -EIO;
+        }
+        dev->seeks++;
+        dev->pos = ofs;
+    }
+    if ((write ? ddriver_write(dev->fd, (char*)data, dev->io_sz)
+               : ddriver_read(dev->fd, (char*)data, dev->io_sz)) < 0) {
+        dev->pos = FS_BLK_POS_UNKNOWN;
+        return -EIO;
+    }
+    dev->pos += dev->io_sz;
+    if (write) {
+        dev->writes++;
+    }
+    else {
+        dev->misses++;
+    }
+    return 0;
+}
+/**
+ * @brief 单位u的当前内容读到out：先查缓存，未命中读设备并按fill放入缓存
+ *
+ * @param dev
+ * @param u 单位号
+ * @param out io_sz字节
+ * @param fill
+ * @return int 0成功，-EIO
+ */
+static int fs_blk_unit_get(struct fs_blkdev* dev, uint64_t u, uint8_t* out, int fill) {
+    int slot = fs_blk_find(dev, u);
+
+    if (slot >= 0) {
+        memcpy(out, FS_BLK_MEM(dev, slot), dev->io_sz);
+        dev->cache_ref[slot] = 1;
+        dev->hits++;
+        return 0;
+    }
+    if (fs_blk_unit_io(dev, u, out, 0) < 0) {
+        return -EIO;
+    }
+    if (fill) {
+        fs_blk_cache_put(dev, u, out, 1);
+    }
+    return 0;
+}
+/**
+ * @brief 请求开始时磁头已在起点的，计一次省去的seek
+ *
+ * @param dev
+ * @param offset 请求的起点
+ */
+static void fs_blk_count_seek(struct fs_blkdev* dev, uint64_t offset) {
+    if (dev->pos == offset - offset % dev->io_sz) {
+        dev->seeks_saved++;
+    }
+}
+
+/**
+ * @brief 读，调用者持有设备锁
+ *
+ * @param dev
+ * @param offset
+ * @param buf
+ * @param size
+ * @param cache 0则未缓存的单位读后不进缓存
+ * @return int 0成功，-EIO
+ */
+static int fs_blk_do_read(struct fs_blkdev* dev, uint64_t offset, uint8_t* buf, size_t size, int cache) {
+    uint64_t u     = offset / dev->io_sz;
+    uint64_t units = (offset + size + dev->io_sz - 1) / dev->io_sz - u;
+    int      fill  = cache && dev->cache_cnt > 0 && units <= FS_BLK_NOCACHE_UNITS;
+    size_t   done  = 0, bias, len;
+
+    fs_blk_count_seek(dev, offset);
+    for (; done < size; u++) {
+        bias = done == 0 ? offset % dev->io_sz : 0;
+        len  = dev->io_sz - bias < size - done ? dev->io_sz - bias : size - done;
+        if (len == (size_t)dev->io_sz) {              /* 整单位直接读入调用者的缓冲 */
+            if (fs_blk_unit_get(dev, u, buf + done, fill) < 0) {
+                return -EIO;
+            }
+        }
+        else {
+            if (fs_blk_unit_get(dev, u, dev->unit, fill) < 0) {
+                return -EIO;
+            }
+            memcpy(buf + done, dev->unit + bias, len);
+        }
+        done += len;
+    }
+    return 0;
+}
+
+/**
+ * @brief 写，调用者持有设备锁。已缓存的单位总是同步更新
+ *
+ * @param dev
+ * @param offset
+ * @param buf
+ * @param size
+ * @param cache 0则未缓存的单位写后不进缓存
+ * @return int 0成功，-EIO
+ */
+static int fs_blk_do_write(struct fs_blkdev* dev, uint64_t offset, const uint8_t* buf, size_t size, int cache) {
+    uint64_t first = offset / dev->io_sz;
+    uint64_t last  = (offset + size - 1) / dev->io_sz;
+    size_t   head  = offset % dev->io_sz;
+    size_t   tail  = (offset + size) % dev->io_sz;
+    int      fill  = cache && dev->cache_cnt > 0 && last - first + 1 <= FS_BLK_NOCACHE_UNITS;
+    uint8_t* head_buf = NULL, *tail_buf = NULL, *src;
+    uint64_t u;
+
+    fs_blk_count_seek(dev, offset);
+    if (head != 0 || (first == last && tail != 0)) {  /* 首单位不满：读出旧内容再合并 */
+        head_buf = dev->unit;
+        if (fs_blk_unit_get(dev, first, head_buf, 0) < 0) {
+            return -EIO;
+        }
+        memcpy(head_buf + head, buf, first == last ? size : dev->io_sz - head);
+    }
+    if (last != first && tail != 0) {                 /* 尾单位不满 */
+        tail_buf = dev->unit + dev->io_sz;
+        if (fs_blk_unit_get(dev, last, tail_buf, 0) < 0) {
+            return -EIO;
+        }
+        memcpy(tail_buf, buf + size - tail, tail);
+    }
+    for (u = first; u <= last; u++) {                 /* 之后一次seek顺序写完 */
+        if (u == first && head_buf != NULL) {
+            src = head_buf;
+        }
+        else if (u == last && tail_buf != NULL) {
+            src = tail_buf;
+        }
+        else {
+            src = (uint8_t*)buf + (u * dev->io_sz - offset);
+        }
+        if (fs_blk_unit_io(dev, u, src, 1) < 0) {
+            return -EIO;
+        }
+        fs_blk_cache_put(dev, u, src, fill);
+    }
+    return 0;
+}
+
+int fs_blk_open(struct fs_blkdev* dev, int fd, int io_sz, int cache_cnt) {
+    int i;
+
+    memset(dev, 0, sizeof(struct fs_blkdev));
+    dev->fd        = fd;
+    dev->io_sz     = io_sz;
+    dev->pos       = FS_BLK_POS_UNKNOWN;
+    dev->unit      = (uint8_t*)malloc(2 * io_sz);     /* 首、尾各一个单位 */
+    dev->cache_cnt = cache_cnt > 0 ? cache_cnt : 0;
+    if (dev->cache_cnt > 0) {
+        for (dev->cache_mask = 1; dev->cache_mask < (uint32_t)dev->cache_cnt; dev->cache_mask <<= 1);
+        dev->cache_mask--;
+        dev->cache_mem  = (uint8_t*)malloc((size_t)dev->cache_cnt * io_sz);
+        dev->cache_tag  = (uint64_t*)calloc(dev->cache_cnt, sizeof(uint64_t));
+        dev->cache_ref  = (uint8_t*)calloc(dev->cache_cnt, sizeof(uint8_t));
+        dev->cache_next = (int*)malloc(sizeof(int) * dev->cache_cnt);
+        dev->cache_head = (int*)malloc(sizeof(int) * (dev->cache_mask + 1));
+        if (dev->cache_head != NULL) {
+            for (i = 0; i <= (int)dev->cache_mask; i++) {
+                dev->cache_head[i] = -1;
+            }
+        }
+    }
+    if (dev->unit == NULL || (dev->cache_cnt > 0 && (dev->cache_mem == NULL || dev->cache_tag == NULL ||
+        dev->cache_ref == NULL || dev->cache_next == NULL || dev->cache_head == NULL))) {
+        fs_blk_close(dev);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&dev->lock, NULL);
+    return 0;
+}
+
+void fs_blk_close(struct fs_blkdev* dev) {
+    free(dev->unit);
+    free(dev->cache_mem);
+    free(dev->cache_tag);
+    free(dev->cache_ref);
+    free(dev->cache_next);
+    free(dev->cache_head);
+    dev->unit       = NULL;
+    dev->cache_mem  = NULL;
+    dev->cache_tag  = NULL;
+    dev->cache_ref  = NULL;
+    dev->cache_next = NULL;
+    dev->cache_head = NULL;
+    dev->cache_cnt  = 0;
+}
+
+int fs_blk_read(struct fs_blkdev* dev, uint64_t offset, void* buf, size_t size) {
+    int ret;
+
+    if (size == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&dev->lock);
+    ret = fs_blk_do_read(dev, offset, (uint8_t*)buf, size, 1);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+int fs_blk_write(struct fs_blkdev* dev, uint64_t offset, const void* buf, size_t size) {
+    int ret;
+
+    if (size == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&dev->lock);
+    ret = fs_blk_do_write(dev, offset, (const uint8_t*)buf, size, 1);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+static int fs_blk_cmp_req(const void* a, const void* b) {
+    const struct fs_blk_req* ra = (const struct fs_blk_req*)a;
+    const struct fs_blk_req* rb = (const struct fs_blk_req*)b;
+
+    return ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+}
+
+int fs_blk_submit(struct fs_blkdev* dev, struct fs_blk_req* reqs, int cnt) {
+    struct fs_blk_req* req;
+    int start, i, ret = 0;
+
+    qsort(reqs, cnt, sizeof(struct fs_blk_req), fs_blk_cmp_req);
+    pthread_mutex_lock(&dev->lock);
+    for (start = 0; start < cnt && reqs[start].offset < dev->pos; start++);
+    for (i = 0; i < cnt && ret == 0; i++) {           /* 从磁头处向后，到尾再绕回开头 */
+        req = &reqs[(start + i) % cnt];
+        if (req->size == 0) {
+            continue;
+        }
+        ret = req->write ? fs_blk_do_write(dev, req->offset, (const uint8_t*)req->buf, req->size, !req->nocache)
+                         : fs_blk_do_read(dev, req->offset, (uint8_t*)req->buf, req->size, !req->nocache);
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
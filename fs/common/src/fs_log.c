@@ -0,0 +1,130 @@
+#include "fs_log.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* 一条日志记录，seq在写入期间为0，写完后为序号+1，读者据此判断记录是否正被覆盖 */
+struct fs_log_rec {
+    uint64_t               seq;
+    const char*            tag;
+    char                   msg[FS_LOG_MSG_SZ];
+};
+
+/* 每个线程一个环：head只由属主线程推进，tail只由fs_log_flush推进，写日志不加锁 */
+struct fs_log_ring {
+    uint64_t               head;          /* 已写入的记录数 */
+    uint64_t               tail;          /* 已输出的记录数 */
+    struct fs_log_ring*    next;          /* 所有线程的环串成链表，只增不减 */
+    struct fs_log_ring*    free_next;     /* 属主线程退出后挂在空闲链表上，留给新线程复用 */
+    struct fs_log_rec      recs[FS_LOG_RING];
+};
+
+static struct fs_log_ring*          fs_log_rings;
+static struct fs_log_ring*          fs_log_free;     /* 空闲的环，由fs_log_flush_lock保护 */
+static __thread struct fs_log_ring* fs_log_ring;
+static pthread_mutex_t              fs_log_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t                fs_log_key;      /* 线程退出时归还环 */
+static pthread_once_t               fs_log_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 线程退出时的析构：输出本线程环中剩余的记录，把环放回空闲链表。
+ * 环仍留在fs_log_rings上，fs_log_flush不会访问已释放的内存
+ *
+ * @param arg 退出线程的环
+ */
+static void fs_log_ring_put(void* arg) {
+    struct fs_log_ring* ring = (struct fs_log_ring*)arg;
+
+    fs_log_flush(stdout);
+    fs_log_ring = NULL;
+    pthread_mutex_lock(&fs_log_flush_lock);
+    ring->free_next = fs_log_free;
+    fs_log_free     = ring;
+    pthread_mutex_unlock(&fs_log_flush_lock);
+}
+
+static void fs_log_key_init() {
+    pthread_key_create(&fs_log_key, fs_log_ring_put);
+}
+/**
+ * @brief 本线程的环，首次使用时优先复用已退出线程的环，没有才分配并无锁地挂到链表头
+ *
+ * @return struct fs_log_ring*
+ */
+static struct fs_log_ring* fs_log_ring_get() {
+    struct fs_log_ring* ring = fs_log_ring;
+
+    if (ring == NULL) {
+        pthread_once(&fs_log_once, fs_log_key_init);
+        pthread_mutex_lock(&fs_log_flush_lock);
+        if ((ring = fs_log_free) != NULL) {
+            fs_log_free = ring->free_next;          /* 已输出完，head == tail，从原序号接着写 */
+        }
+        pthread_mutex_unlock(&fs_log_flush_lock);
+        if (ring == NULL) {
+            ring       = (struct fs_log_ring*)calloc(1, sizeof(struct fs_log_ring));
+            ring->next = __atomic_load_n(&fs_log_rings, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(&fs_log_rings, &ring->next, ring, 1,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        }
+        pthread_setspecific(fs_log_key, ring);
+        fs_log_ring = ring;
+    }
+    return ring;
+}
+
+void fs_log(int level, const char* tag, const char* fmt, ...) {
+    struct fs_log_ring* ring = fs_log_ring_get();
+    uint64_t            seq  = ring->head;
+    struct fs_log_rec*  rec  = &ring->recs[seq % FS_LOG_RING];
+    va_list             ap;
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);          /* 读者先看到seq失效，再看到新内容 */
+    rec->tag = tag;
+    va_start(ap, fmt);
+    vsnprintf(rec->msg, FS_LOG_MSG_SZ, fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, seq + 1, __ATOMIC_RELEASE);
+
+    if (level == FS_LOG_ERROR) {
+        fs_log_flush(stdout);
+    }
+}
+
+int fs_log_flush(FILE* out) {
+    struct fs_log_ring* ring;
+    struct fs_log_rec   rec;
+    uint64_t            head, seq;
+    int                 cnt = 0, dropped = 0;
+
+    pthread_mutex_lock(&fs_log_flush_lock);
+    for (ring = __atomic_load_n(&fs_log_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - ring->tail > FS_LOG_RING) {
+            dropped   += head - ring->tail - FS_LOG_RING;
+            ring->tail = head - FS_LOG_RING;
+        }
+        for (; ring->tail < head; ring->tail++) {
+            struct fs_log_rec* cur = &ring->recs[ring->tail % FS_LOG_RING];
+            seq = __atomic_load_n(&cur->seq, __ATOMIC_ACQUIRE);
+            memcpy(&rec, cur, sizeof(struct fs_log_rec));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (seq != ring->tail + 1 || __atomic_load_n(&cur->seq, __ATOMIC_RELAXED) != seq) {
+                dropped++;                                  /* 读的同时被属主线程覆盖 */
+                continue;
+            }
+            rec.msg[FS_LOG_MSG_SZ - 1] = '\0';
+            fprintf(out, "%s: %s", rec.tag, rec.msg);
+            cnt++;
+        }
+    }
+    if (dropped) {
+        fprintf(out, "fs_log: %d log records dropped\n", dropped);
+    }
+    fflush(out);
+    pthread_mutex_unlock(&fs_log_flush_lock);
+    return cnt;
+}
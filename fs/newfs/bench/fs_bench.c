@@ -0,0 +1,868 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+/******************************************************************************
+* SECTION: fs_bench - 经挂载点运行的文件系统基准
+*
+* 每个负载都在全新的设备上单独挂载一次：格式化 -> 挂载 -> 准备 -> [重新挂载]
+* -> 计时阶段 -> 卸载。计时阶段逐个操作记录延迟，结果以JSON输出，便于跨提交比较。
+* 文件系统提供 /.newfs_stats 时，计时阶段前后各读一次，差值即本阶段的
+* ddriver读/写/寻道次数；否则device为null。
+* 文件系统不支持的操作（ENOSYS/EOPNOTSUPP）不算失败，该负载记为unsupported。
+* 格式化会清空设备文件，设备非空时必须显式给出--format。
+*******************************************************************************/
+#define BENCH_STATS_NAME    ".newfs_stats"
+#define BENCH_MOUNT_WAIT_MS 10000
+#define BENCH_PATH_LEN      4096
+#define BENCH_UNSUPPORTED   (-2)            /* 负载返回值：文件系统不支持其中的操作 */
+
+struct bench_params
+{
+    int      files;                         /* 元数据负载的文件数 */
+    int      depth;                         /* 深目录树的层数 */
+    int      dir_entries;                   /* 大目录的项数 */
+    int      rounds;                        /* 重复类负载的轮数 */
+    int      file_kb;                       /* 读写负载的文件大小 */
+    int      seq_files;                     /* 顺序读写的文件数 */
+    int      chunk;                         /* 读写请求的字节数 */
+    int      rand_ops;                      /* 随机读写的请求数 */
+    int      small_kb;                      /* 小文件复制的文件大小 */
+    unsigned seed;                          /* 随机负载的种子，固定以便复现 */
+};
+
+struct bench_dev
+{
+    long long reads;
+    long long writes;
+    long long seeks;
+};
+
+struct bench_result
+{
+    const char*      name;
+    long             ops;
+    double           seconds;
+    uint64_t*        lat;                   /* 每个操作的耗时（ns） */
+    int              has_dev;
+    int              unsupported;           /* 文件系统不支持该负载 */
+    struct bench_dev dev;
+};
+
+struct bench_ctx
+{
+    const char*         fs_bin;
+    const char*         mnt;
+    const char*         device;
+    const char*         log;
+    int                 format;             /* 允许清空非空的设备 */
+    char**              mount_args;
+    int                 mount_argc;
+    pid_t               fs_pid;
+    struct bench_params p;
+    struct bench_result* cur;               /* 当前计时阶段 */
+    long                cap;
+    uint64_t            rng;
+};
+
+struct bench_workload
+{
+    const char* name;
+    int         (*setup)(struct bench_ctx*);
+    int         (*run)(struct bench_ctx*);
+    int         remount;                    /* 准备后重新挂载，读请求不命中缓存 */
+};
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static uint64_t bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief xorshift64，负载之间互不影响，同一种子结果相同
+ */
+static uint64_t bench_rand(struct bench_ctx* ctx) {
+    ctx->rng ^= ctx->rng << 13;
+    ctx->rng ^= ctx->rng >> 7;
+    ctx->rng ^= ctx->rng << 17;
+    return ctx->rng;
+}
+
+static char* bench_path(struct bench_ctx* ctx, char* buf, const char* fmt, int a, int b) {
+    int len = snprintf(buf, BENCH_PATH_LEN, "%s/", ctx->mnt);
+    snprintf(buf + len, BENCH_PATH_LEN - len, fmt, a, b);
+    return buf;
+}
+
+/**
+ * @brief 记录一次操作的耗时
+ */
+static void bench_op(struct bench_ctx* ctx, uint64_t start) {
+    struct bench_result* res = ctx->cur;
+    if (res == NULL) {
+        return;
+    }
+    if (res->ops == ctx->cap) {
+        ctx->cap = ctx->cap ? ctx->cap * 2 : 1024;
+        res->lat = (uint64_t*)realloc(res->lat, ctx->cap * sizeof(uint64_t));
+    }
+    res->lat[res->ops++] = bench_now() - start;
+}
+
+#define BENCH_IS_UNSUPPORTED(err) ((err) == ENOSYS || (err) == EOPNOTSUPP)
+
+#define BENCH_CHECK(expr, what)                                                 \
+    do {                                                                        \
+        if ((expr) < 0) {                                                       \
+            if (BENCH_IS_UNSUPPORTED(errno)) {                                  \
+                return BENCH_UNSUPPORTED;                                       \
+            }                                                                   \
+            fprintf(stderr, "fs_bench: %s: %s\n", what, strerror(errno));       \
+            return -1;                                                          \
+        }                                                                       \
+    } while (0)
+
+static int bench_mkdir(struct bench_ctx* ctx, const char* name) {
+    char path[BENCH_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", ctx->mnt, name);
+    BENCH_CHECK(mkdir(path, 0755), path);
+    return 0;
+}
+
+static int bench_create(const char* path, const char* buf, int size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644), done = 0, ret;
+    BENCH_CHECK(fd, path);
+    while (done < size) {
+        ret = write(fd, buf + done, size - done);
+        if (ret <= 0) {
+            close(fd);
+            BENCH_CHECK(-1, path);
+        }
+        done += ret;
+    }
+    BENCH_CHECK(fsync(fd), path);
+    BENCH_CHECK(close(fd), path);
+    return 0;
+}
+
+static int bench_create_files(struct bench_ctx* ctx, const char* fmt, int n, int size) {
+    char path[BENCH_PATH_LEN], *buf = (char*)calloc(1, size ? size : 1);
+    int i, ret = 0;
+    memset(buf, 'b', size);
+    for (i = 0; i < n && ret == 0; i++) {
+        ret = bench_create(bench_path(ctx, path, fmt, i, 0), buf, size);
+    }
+    free(buf);
+    return ret;
+}
+/******************************************************************************
+* SECTION: Mount
+*******************************************************************************/
+static int bench_is_mounted(const char* mnt) {
+    char        parent[BENCH_PATH_LEN];
+    struct stat st, pst;
+    snprintf(parent, sizeof(parent), "%s/..", mnt);
+    return stat(mnt, &st) == 0 && stat(parent, &pst) == 0 && st.st_dev != pst.st_dev;
+}
+
+/**
+ * @brief 前台启动文件系统进程，等到挂载点换了设备号为止
+ */
+static int bench_mount(struct bench_ctx* ctx) {
+    char   device_opt[BENCH_PATH_LEN];
+    char** argv = (char**)calloc(ctx->mount_argc + 5, sizeof(char*));
+    int    argc = 0, i, fd, status;
+
+    snprintf(device_opt, sizeof(device_opt), "--device=%s", ctx->device);
+    argv[argc++] = (char*)ctx->fs_bin;
+    argv[argc++] = "-f";
+    argv[argc++] = device_opt;
+    for (i = 0; i < ctx->mount_argc; i++) {
+        argv[argc++] = ctx->mount_args[i];
+    }
+    argv[argc++] = (char*)ctx->mnt;
+
+    ctx->fs_pid = fork();
+    if (ctx->fs_pid == 0) {
+        fd = open(ctx->log, O_CREAT | O_WRONLY | O_APPEND, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execv(ctx->fs_bin, argv);
+        _exit(127);
+    }
+    free(argv);
+    BENCH_CHECK(ctx->fs_pid, "fork");
+
+    for (i = 0; i < BENCH_MOUNT_WAIT_MS; i += 10) {
+        if (bench_is_mounted(ctx->mnt)) {
+            return 0;
+        }
+        if (waitpid(ctx->fs_pid, &status, WNOHANG) == ctx->fs_pid) {
+            fprintf(stderr, "fs_bench: %s exited before mounting, see %s\n", ctx->fs_bin, ctx->log);
+            return -1;
+        }
+        usleep(10000);
+    }
+    fprintf(stderr, "fs_bench: mount timed out\n");
+    kill(ctx->fs_pid, SIGTERM);
+    waitpid(ctx->fs_pid, &status, 0);
+    return -1;
+}
+
+static int bench_umount(struct bench_ctx* ctx) {
+    int   status;
+    pid_t pid = fork();
+    if (pid == 0) {
+        execlp("fusermount", "fusermount", "-u", ctx->mnt, (char*)NULL);
+        _exit(127);
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "fs_bench: fusermount -u %s failed\n", ctx->mnt);
+        kill(ctx->fs_pid, SIGTERM);
+    }
+    waitpid(ctx->fs_pid, &status, 0);                  /* 等文件系统回写完退出 */
+    return 0;
+}
+
+/**
+ * @brief 格式化：清空设备文件，文件系统挂载时发现没有幻数便重新布局
+ */
+static int bench_format(struct bench_ctx* ctx) {
+    int fd = open(ctx->device, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    BENCH_CHECK(fd, ctx->device);
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief 开始前检查设备：已有内容（可能是用户自己的文件系统）而没有--format时拒绝运行
+ */
+static int bench_check_device(struct bench_ctx* ctx) {
+    struct stat st;
+    if (ctx->format || stat(ctx->device, &st) < 0 || st.st_size == 0) {
+        return 0;
+    }
+    fprintf(stderr, "fs_bench: %s is not empty and every workload formats it; "
+                    "pass --format to wipe it\n", ctx->device);
+    return -1;
+}
+
+/**
+ * @brief 从/.newfs_stats读出ddriver的读/写/寻道次数
+ */
+static int bench_read_dev(struct bench_ctx* ctx, struct bench_dev* dev) {
+    char  path[BENCH_PATH_LEN], *buf = (char*)malloc(65536), *line;
+    int   fd, len = 0, ret, found = 0;
+
+    snprintf(path, sizeof(path), "%s/" BENCH_STATS_NAME, ctx->mnt);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(buf);
+        return -1;
+    }
+    while (len < 65535 && (ret = read(fd, buf + len, 65535 - len)) > 0) {
+        len += ret;
+    }
+    close(fd);
+    buf[len] = '\0';
+    for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+        found += sscanf(line, "dev_reads %lld", &dev->reads);
+        found += sscanf(line, "dev_writes %lld", &dev->writes);
+        found += sscanf(line, "dev_seeks %lld", &dev->seeks);
+    }
+    free(buf);
+    return found == 3 ? 0 : -1;
+}
+/******************************************************************************
+* SECTION: Workloads
+*******************************************************************************/
+static int setup_dir(struct bench_ctx* ctx) {
+    return bench_mkdir(ctx, "d");
+}
+
+static int setup_files(struct bench_ctx* ctx) {
+    if (bench_mkdir(ctx, "d") < 0) {
+        return -1;
+    }
+    return bench_create_files(ctx, "d/f%d", ctx->p.files, 0);
+}
+
+static int run_create(struct bench_ctx* ctx) {
+    char     path[BENCH_PATH_LEN];
+    uint64_t start;
+    int      i, fd;
+    for (i = 0; i < ctx->p.files; i++) {
+        bench_path(ctx, path, "d/f%d", i, 0);
+        start = bench_now();
+        fd = open(path, O_CREAT | O_WRONLY, 0644);
+        BENCH_CHECK(fd, path);
+        close(fd);
+        bench_op(ctx, start);
+    }
+    return 0;
+}
+
+static int run_stat(struct bench_ctx* ctx) {
+    char        path[BENCH_PATH_LEN];
+    struct stat st;
+    uint64_t    start;
+    int         i;
+    for (i = 0; i < ctx->p.files; i++) {
+        bench_path(ctx, path, "d/f%d", i, 0);
+        start = bench_now();
+        BENCH_CHECK(stat(path, &st), path);
+        bench_op(ctx, start);
+    }
+    return 0;
+}
+
+static int run_unlink(struct bench_ctx* ctx) {
+    char     path[BENCH_PATH_LEN];
+    uint64_t start;
+    int      i;
+    for (i = 0; i < ctx->p.files; i++) {
+        bench_path(ctx, path, "d/f%d", i, 0);
+        start = bench_now();
+        BENCH_CHECK(unlink(path), path);
+        bench_op(ctx, start);
+    }
+    return 0;
+}
+
+static char* bench_deep_path(struct bench_ctx* ctx, char* path, int depth) {
+    int len = snprintf(path, BENCH_PATH_LEN, "%s", ctx->mnt), d;
+    for (d = 0; d < depth; d++) {
+        len += snprintf(path + len, BENCH_PATH_LEN - len, "/d%d", d);
+    }
+    return path;
+}
+
+static int run_deep_mkdir(struct bench_ctx* ctx) {
+    char     path[BENCH_PATH_LEN];
+    uint64_t start;
+    int      d;
+    for (d = 1; d <= ctx->p.depth; d++) {
+        bench_deep_path(ctx, path, d);
+        start = bench_now();
+        BENCH_CHECK(mkdir(path, 0755), path);
+        bench_op(ctx, start);
+    }
+    return 0;
+}
+
+static int setup_deep(struct bench_ctx* ctx) {
+    char path[BENCH_PATH_LEN];
+    int  len;
+    struct bench_result* cur = ctx->cur;
+
+    ctx->cur = NULL;
+    if (run_deep_mkdir(ctx) < 0) {
+        return -1;
+    }
+    ctx->cur = cur;
+    len = strlen(bench_deep_path(ctx, path, ctx->p.depth));
+    snprintf(path + len, BENCH_PATH_LEN - len, "/leaf");
+    return bench_create(path, "", 0);
+}
+
+static int run_deep_stat(struct bench_ctx* ctx) {
+    char        path[BENCH_PATH_LEN];
+    struct stat st;
+    uint64_t    start;
+    int         i, len = strlen(bench_deep_path(ctx, path, ctx->p.depth));
+
+    snprintf(path + len, BENCH_PATH_LEN - len, "/leaf");
+    for (i = 0; i < ctx->p.files; i++) {
+        start = bench_now();
+        BENCH_CHECK(stat(path, &st), path);
+        bench_op(ctx, start);
+    }
+    return 0;
+}
+
+static int setup_large_dir(struct bench_ctx* ctx) {
+    if (bench_mkdir(ctx, "d") < 0) {
+        return -1;
+    }
+    return bench_create_files(ctx, "d/entry_with_a_longer_name_%d", ctx->p.dir_entries, 0);
+}
+
+static int run_readdir(struct bench_ctx* ctx) {
+    char           path[BENCH_PATH_LEN];
+    DIR*           dir;
+    struct dirent* de;
+    uint64_t       start;
+    int            r, n;
+
+    bench_path(ctx, path, "d", 0, 0);
+    for (r = 0; r < ctx->p.rounds; r++) {
+        start = bench_now();
+        dir = opendir(path);
+        if (dir == NULL) {
+            BENCH_CHECK(-1, path);
+        }
+        for (n = 0; (de = readdir(dir)) != NULL; n++) {
+            ;
+        }
+        closedir(dir);
+        bench_op(ctx, start);
+        if (n < ctx->p.dir_entries) {
+            fprintf(stderr, "fs_bench: readdir saw %d of %d entries\n", n, ctx->p.dir_entries);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 顺序写seq_files个文件，每次chunk字节，每个文件末尾fsync
+ */
+static int run_seq_write(struct bench_ctx* ctx) {
+    char     path[BENCH_PATH_LEN], *buf = (char*)malloc(ctx->p.chunk);
+    uint64_t start;
+    int      f, fd, off, size = ctx->p.file_kb * 1024;
+
+    memset(buf, 's', ctx->p.chunk);
+    for (f = 0; f < ctx->p.seq_files; f++) {
+        fd = open(bench_path(ctx, path, "s%d", f, 0), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        BENCH_CHECK(fd, path);
+        for (off = 0; off < size; off += ctx->p.chunk) {
+            start = bench_now();
+            BENCH_CHECK(write(fd, buf, ctx->p.chunk), path);
+            bench_op(ctx, start);
+        }
+        BENCH_CHECK(fsync(fd), path);
+        close(fd);
+    }
+    free(buf);
+    return 0;
+}
+
+static int setup_seq(struct bench_ctx* ctx) {
+    struct bench_result* cur = ctx->cur;
+    int ret;
+    ctx->cur = NULL;
+    ret = run_seq_write(ctx);
+    ctx->cur = cur;
+    return ret;
+}
+
+static int run_seq_read(struct bench_ctx* ctx) {
+    char     path[BENCH_PATH_LEN], *buf = (char*)malloc(ctx->p.chunk);
+    uint64_t start;
+    int      f, fd, ret;
+
+    for (f = 0; f < ctx->p.seq_files; f++) {
+        fd = open(bench_path(ctx, path, "s%d", f, 0), O_RDONLY);
+        BENCH_CHECK(fd, path);
+        do {
+            start = bench_now();
+            ret = read(fd, buf, ctx->p.chunk);
+            BENCH_CHECK(ret, path);
+            bench_op(ctx, start);
+        } while (ret > 0);
+        close(fd);
+    }
+    free(buf);
+    return 0;
+}
+
+static int setup_rand(struct bench_ctx* ctx) {
+    char path[BENCH_PATH_LEN], *buf = (char*)malloc(ctx->p.file_kb * 1024);
+    int  ret;
+    memset(buf, 'r', ctx->p.file_kb * 1024);
+    ret = bench_create(bench_path(ctx, path, "r", 0, 0), buf, ctx->p.file_kb * 1024);
+    free(buf);
+    return ret;
+}
+
+static int bench_rand_io(struct bench_ctx* ctx, int is_write) {
+    char     path[BENCH_PATH_LEN], *buf = (char*)malloc(ctx->p.chunk);
+    uint64_t start;
+    int      i, fd, slots = ctx->p.file_kb * 1024 / ctx->p.chunk;
+    off_t    off;
+
+    memset(buf, 'w', ctx->p.chunk);
+    fd = open(bench_path(ctx, path, "r", 0, 0), is_write ? O_WRONLY : O_RDONLY);
+    BENCH_CHECK(fd, path);
+    for (i = 0; i < ctx->p.rand_ops; i++) {
+        off   = (off_t)(bench_rand(ctx) % (slots ? slots : 1)) * ctx->p.chunk;
+        start = bench_now();
+        BENCH_CHECK(is_write ? pwrite(fd, buf, ctx->p.chunk, off) : pread(fd, buf, ctx->p.chunk, off), path);
+        bench_op(ctx, start);
+    }
+    if (is_write) {
+        BENCH_CHECK(fsync(fd), path);
+    }
+    close(fd);
+    free(buf);
+    return 0;
+}
+
+static int run_rand_write(struct bench_ctx* ctx) {
+    return bench_rand_io(ctx, 1);
+}
+
+static int run_rand_read(struct bench_ctx* ctx) {
+    return bench_rand_io(ctx, 0);
+}
+
+static int setup_small(struct bench_ctx* ctx) {
+    if (bench_mkdir(ctx, "src") < 0 || bench_mkdir(ctx, "dst") < 0) {
+        return -1;
+    }
+    return bench_create_files(ctx, "src/f%d", ctx->p.files, ctx->p.small_kb * 1024);
+}
+
+/**
+ * @brief 逐个复制小文件：读源文件，创建目标文件并写入
+ */
+static int run_small_copy(struct bench_ctx* ctx) {
+    char     src[BENCH_PATH_LEN], dst[BENCH_PATH_LEN], *buf = (char*)malloc(ctx->p.small_kb * 1024 + 1);
+    uint64_t start;
+    int      i, in, out, len;
+
+    for (i = 0; i < ctx->p.files; i++) {
+        bench_path(ctx, src, "src/f%d", i, 0);
+        bench_path(ctx, dst, "dst/f%d", i, 0);
+        start = bench_now();
+        in = open(src, O_RDONLY);
+        BENCH_CHECK(in, src);
+        len = read(in, buf, ctx->p.small_kb * 1024 + 1);
+        close(in);
+        BENCH_CHECK(len, src);
+        out = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        BENCH_CHECK(out, dst);
+        BENCH_CHECK(write(out, buf, len), dst);
+        close(out);
+        bench_op(ctx, start);
+    }
+    free(buf);
+    return 0;
+}
+
+static int setup_rename(struct bench_ctx* ctx) {
+    if (bench_mkdir(ctx, "a") < 0 || bench_mkdir(ctx, "b") < 0) {
+        return -1;
+    }
+    return bench_create_files(ctx, "a/f%d", ctx->p.files, 0);
+}
+
+/**
+ * @brief 每轮把所有文件从a/移到b/并改名，再移回来
+ */
+static int run_rename(struct bench_ctx* ctx) {
+    char     from[BENCH_PATH_LEN], to[BENCH_PATH_LEN];
+    uint64_t start;
+    int      r, i;
+
+    for (r = 0; r < ctx->p.rounds; r++) {
+        for (i = 0; i < ctx->p.files; i++) {
+            bench_path(ctx, from, "a/f%d", i, 0);
+            bench_path(ctx, to, "b/g%d", i, 0);
+            start = bench_now();
+            BENCH_CHECK(rename(from, to), from);
+            bench_op(ctx, start);
+        }
+        for (i = 0; i < ctx->p.files; i++) {
+            bench_path(ctx, from, "b/g%d", i, 0);
+            bench_path(ctx, to, "a/f%d", i, 0);
+            start = bench_now();
+            BENCH_CHECK(rename(from, to), from);
+            bench_op(ctx, start);
+        }
+    }
+    return 0;
+}
+
+static const struct bench_workload workloads[] = {
+    { "create",     setup_dir,       run_create,     0 },
+    { "stat",       setup_files,     run_stat,       1 },
+    { "unlink",     setup_files,     run_unlink,     1 },
+    { "deep_mkdir", NULL,            run_deep_mkdir, 0 },
+    { "deep_stat",  setup_deep,      run_deep_stat,  1 },
+    { "readdir",    setup_large_dir, run_readdir,    1 },
+    { "seq_write",  NULL,            run_seq_write,  0 },
+    { "seq_read",   setup_seq,       run_seq_read,   1 },
+    { "rand_write", setup_rand,      run_rand_write, 1 },
+    { "rand_read",  setup_rand,      run_rand_read,  1 },
+    { "small_copy", setup_small,     run_small_copy, 1 },
+    { "rename",     setup_rename,    run_rename,     1 },
+};
+#define BENCH_WORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+/******************************************************************************
+* SECTION: Runner
+*******************************************************************************/
+static int bench_cmp(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double bench_pct(const struct bench_result* res, double p) {
+    long idx = (long)(p * res->ops + 0.999999) - 1;
+    if (res->ops == 0) {
+        return 0;
+    }
+    idx = idx < 0 ? 0 : idx;
+    return res->lat[idx] / 1000.0;
+}
+
+/**
+ * @brief 跑一个负载：格式化、挂载、准备、计时、卸载
+ */
+static int bench_run(struct bench_ctx* ctx, const struct bench_workload* w, struct bench_result* res) {
+    struct bench_dev before, after;
+    uint64_t start;
+    int      ret = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->name = w->name;
+    ctx->cur  = NULL;
+    ctx->cap  = 0;
+    ctx->rng  = ctx->p.seed ? ctx->p.seed : 1;
+
+    if (bench_format(ctx) < 0 || bench_mount(ctx) < 0) {
+        return -1;
+    }
+    if (w->setup && (ret = w->setup(ctx)) == 0 && w->remount) {
+        bench_umount(ctx);
+        if (bench_mount(ctx) < 0) {
+            return -1;
+        }
+    }
+    if (ret == 0) {
+        res->has_dev = bench_read_dev(ctx, &before) == 0;
+        ctx->cur = res;
+        start = bench_now();
+        ret = w->run(ctx);
+        res->seconds = (bench_now() - start) / 1e9;
+        ctx->cur = NULL;
+        if (res->has_dev && bench_read_dev(ctx, &after) == 0) {
+            res->dev.reads  = after.reads - before.reads;
+            res->dev.writes = after.writes - before.writes;
+            res->dev.seeks  = after.seeks - before.seeks;
+        }
+        else {
+            res->has_dev = 0;
+        }
+    }
+    bench_umount(ctx);
+    qsort(res->lat, res->ops, sizeof(uint64_t), bench_cmp);
+    return ret;
+}
+
+static void bench_json_str(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void bench_json(struct bench_ctx* ctx, FILE* out, struct bench_result* res, int n) {
+    char  commit[64] = "";
+    FILE* git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    int   i;
+
+    if (git) {
+        if (fgets(commit, sizeof(commit), git)) {
+            commit[strcspn(commit, "\n")] = '\0';
+        }
+        pclose(git);
+    }
+    fprintf(out, "{\n  \"fs\": ");
+    bench_json_str(out, ctx->fs_bin);
+    fprintf(out, ",\n  \"commit\": ");
+    bench_json_str(out, commit);
+    fprintf(out, ",\n  \"timestamp\": %ld,\n  \"mount_args\": [", (long)time(NULL));
+    for (i = 0; i < ctx->mount_argc; i++) {
+        fprintf(out, i ? ", " : "");
+        bench_json_str(out, ctx->mount_args[i]);
+    }
+    fprintf(out, "],\n  \"params\": {\"files\": %d, \"depth\": %d, \"dir_entries\": %d, \"rounds\": %d, "
+                 "\"file_kb\": %d, \"seq_files\": %d, \"chunk\": %d, \"rand_ops\": %d, \"small_kb\": %d, "
+                 "\"seed\": %u},\n  \"results\": [\n",
+            ctx->p.files, ctx->p.depth, ctx->p.dir_entries, ctx->p.rounds, ctx->p.file_kb,
+            ctx->p.seq_files, ctx->p.chunk, ctx->p.rand_ops, ctx->p.small_kb, ctx->p.seed);
+    for (i = 0; i < n; i++) {
+        if (res[i].unsupported) {
+            fprintf(out, "    {\"workload\": \"%s\", \"unsupported\": true}", res[i].name);
+            fprintf(out, i + 1 < n ? ",\n" : "\n");
+            continue;
+        }
+        fprintf(out, "    {\"workload\": \"%s\", \"ops\": %ld, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                     "\"lat_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}, ",
+                res[i].name, res[i].ops, res[i].seconds,
+                res[i].seconds > 0 ? res[i].ops / res[i].seconds : 0.0,
+                res[i].ops ? res[i].seconds * 1e6 / res[i].ops : 0.0,
+                bench_pct(&res[i], 0.50), bench_pct(&res[i], 0.90), bench_pct(&res[i], 0.99),
+                bench_pct(&res[i], 1.0));
+        if (res[i].has_dev) {
+            fprintf(out, "\"device\": {\"reads\": %lld, \"writes\": %lld, \"seeks\": %lld}}",
+                    res[i].dev.reads, res[i].dev.writes, res[i].dev.seeks);
+        }
+        else {
+            fprintf(out, "\"device\": null}");
+        }
+        fprintf(out, i + 1 < n ? ",\n" : "\n");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void bench_usage() {
+    int i;
+    fprintf(stderr,
+            "usage: fs_bench --fs <binary> [options] [-- mount args...]\n"
+            "  --mnt <dir>          mountpoint (./mnt)\n"
+            "  --device <file>      ddriver device ($HOME/ddriver)\n"
+            "  --format             allow wiping a non-empty device (each workload formats it)\n"
+            "  --json <file>        write JSON results here (stdout)\n"
+            "  --log <file>         filesystem output (/dev/null)\n"
+            "  --only <w1,w2,...>   run only these workloads\n"
+            "  --files N --depth N --dir-entries N --rounds N --file-kb N\n"
+            "  --seq-files N --chunk N --rand-ops N --small-kb N --seed N\n"
+            "workloads:");
+    for (i = 0; i < BENCH_WORKLOADS; i++) {
+        fprintf(stderr, " %s", workloads[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+static int bench_selected(const char* only, const char* name) {
+    size_t len = strlen(name);
+    const char* p = only;
+    if (only == NULL) {
+        return 1;
+    }
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == only || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    static const struct option opts[] = {
+        { "fs", 1, 0, 'F' }, { "mnt", 1, 0, 'm' }, { "device", 1, 0, 'D' }, { "json", 1, 0, 'j' },
+        { "log", 1, 0, 'l' }, { "only", 1, 0, 'o' }, { "files", 1, 0, 'f' }, { "depth", 1, 0, 'd' },
+        { "dir-entries", 1, 0, 'e' }, { "rounds", 1, 0, 'r' }, { "file-kb", 1, 0, 'k' },
+        { "seq-files", 1, 0, 'S' }, { "chunk", 1, 0, 'c' }, { "rand-ops", 1, 0, 'R' },
+        { "small-kb", 1, 0, 's' }, { "seed", 1, 0, 'x' }, { "format", 0, 0, 'W' }, { "help", 0, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    struct bench_ctx     ctx;
+    struct bench_result  res[BENCH_WORKLOADS];
+    const char*          json = NULL, *only = NULL;
+    char                 device[BENCH_PATH_LEN];
+    FILE*                out = stdout;
+    int                  opt, i, n = 0, failed = 0, ret;
+
+    memset(&ctx, 0, sizeof(ctx));
+    snprintf(device, sizeof(device), "%s/ddriver", getenv("HOME") ? getenv("HOME") : ".");
+    ctx.mnt    = "./mnt";
+    ctx.device = device;
+    ctx.log    = "/dev/null";
+    ctx.p      = (struct bench_params){ .files = 200, .depth = 20, .dir_entries = 400, .rounds = 20,
+                                        .file_kb = 128, .seq_files = 4, .chunk = 4096, .rand_ops = 512,
+                                        .small_kb = 2, .seed = 42 };
+    while ((opt = getopt_long(argc, argv, "h", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'F': ctx.fs_bin = optarg; break;
+        case 'm': ctx.mnt = optarg; break;
+        case 'D': ctx.device = optarg; break;
+        case 'j': json = optarg; break;
+        case 'l': ctx.log = optarg; break;
+        case 'o': only = optarg; break;
+        case 'f': ctx.p.files = atoi(optarg); break;
+        case 'd': ctx.p.depth = atoi(optarg); break;
+        case 'e': ctx.p.dir_entries = atoi(optarg); break;
+        case 'r': ctx.p.rounds = atoi(optarg); break;
+        case 'k': ctx.p.file_kb = atoi(optarg); break;
+        case 'S': ctx.p.seq_files = atoi(optarg); break;
+        case 'c': ctx.p.chunk = atoi(optarg); break;
+        case 'R': ctx.p.rand_ops = atoi(optarg); break;
+        case 's': ctx.p.small_kb = atoi(optarg); break;
+        case 'x': ctx.p.seed = strtoul(optarg, NULL, 0); break;
+        case 'W': ctx.format = 1; break;
+        default:  bench_usage();
+        }
+    }
+    if (ctx.fs_bin == NULL || ctx.p.chunk <= 0) {
+        bench_usage();
+    }
+    ctx.mount_args = argv + optind;
+    ctx.mount_argc = argc - optind;
+    mkdir(ctx.mnt, 0755);
+    if (bench_is_mounted(ctx.mnt)) {
+        fprintf(stderr, "fs_bench: %s is already mounted\n", ctx.mnt);
+        return 1;
+    }
+    if (bench_check_device(&ctx) < 0) {
+        return 1;
+    }
+
+    fprintf(stderr, "%-12s %8s %10s %10s %10s %10s %10s %8s %8s %8s\n", "workload", "ops", "ops/s",
+            "p50_us", "p90_us", "p99_us", "max_us", "dev_rd", "dev_wr", "dev_seek");
+    for (i = 0; i < BENCH_WORKLOADS; i++) {
+        if (!bench_selected(only, workloads[i].name)) {
+            continue;
+        }
+        ret = bench_run(&ctx, &workloads[i], &res[n]);
+        if (ret == BENCH_UNSUPPORTED) {
+            res[n].unsupported = 1;
+            fprintf(stderr, "%-12s %8s\n", res[n].name, "unsupported");
+            n++;
+            continue;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "fs_bench: workload %s failed\n", workloads[i].name);
+            failed = 1;
+        }
+        fprintf(stderr, "%-12s %8ld %10.1f %10.1f %10.1f %10.1f %10.1f", res[n].name, res[n].ops,
+                res[n].seconds > 0 ? res[n].ops / res[n].seconds : 0.0, bench_pct(&res[n], 0.50),
+                bench_pct(&res[n], 0.90), bench_pct(&res[n], 0.99), bench_pct(&res[n], 1.0));
+        if (res[n].has_dev) {
+            fprintf(stderr, " %8lld %8lld %8lld\n", res[n].dev.reads, res[n].dev.writes, res[n].dev.seeks);
+        }
+        else {
+            fprintf(stderr, " %8s %8s %8s\n", "-", "-", "-");
+        }
+        n++;
+    }
+
+    if (json && (out = fopen(json, "w")) == NULL) {
+        fprintf(stderr, "fs_bench: %s: %s\n", json, strerror(errno));
+        return 1;
+    }
+    bench_json(&ctx, out, res, n);
+    if (out != stdout) {
+        fclose(out);
+        fprintf(stderr, "results written to %s\n", json);
+    }
+    for (i = 0; i < n; i++) {
+        free(res[i].lat);
+    }
+    return failed;
+}
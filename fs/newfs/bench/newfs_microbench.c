@@ -0,0 +1,336 @@
+#include "../include/newfs_core.h"
+#include <regex.h>
+/******************************************************************************
+* SECTION: newfs_microbench - 进程内直接调用newfs核心的微基准
+*
+* 不经过FUSE和内核，只链接newfs_core和ddriver，测量查找、分配、目录项插入/删除、
+* 读写和sync这些热点路径本身。用法与输出格式仿照Google Benchmark：
+*   newfs_microbench [--benchmark_filter=<regex>] [--benchmark_min_time=<秒>]
+*                    [--device=<ddriver设备>] [--verbose]
+* 每个基准在重新格式化的设备上挂载一次，准备好数据后，迭代次数逐步放大，
+* 直到一次运行超过min_time。设备文件会被清空。
+*******************************************************************************/
+#define MB_MAX_ITERS        1000000000L
+#define MB_ENTRIES          256             /* 大目录基准的目录项数 */
+#define MB_PATH_LEN         1024
+
+extern struct newfs_super newfs_super;
+
+struct mb_state
+{
+    long                 iterations;
+    int                  arg;               /* 基准参数，如路径深度、目录项数 */
+    char                 path[MB_PATH_LEN]; /* 准备阶段生成的路径 */
+    struct newfs_dentry* dir;               /* 准备阶段生成的目录 */
+    struct newfs_dentry* file;              /* 准备阶段生成的文件 */
+    uint8_t*             buf;
+};
+
+struct mb_bench
+{
+    const char* name;
+    int         arg;
+    int         (*setup)(struct mb_state*);
+    void        (*run)(struct mb_state*);
+};
+
+static int mb_verbose = 0;
+static FILE* mb_out;                        /* 结果输出，stdout被重定向时仍指向终端 */
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+static double mb_clock(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 与newfs_mknod / newfs_mkdir相同：查找父目录，新建dentry和inode并挂到父目录下
+ *
+ * @param path
+ * @param ftype
+ * @return struct newfs_dentry*
+ */
+static struct newfs_dentry* mb_create(const char* path, FILE_TYPE ftype) {
+    boolean is_find, is_root;
+    struct newfs_dentry* parent = fs_lookup(path, &is_find, &is_root);
+    struct newfs_dentry* dentry;
+
+    if (is_find) {
+        return parent;
+    }
+    dentry = new_dentry(fs_get_fname(path), ftype);
+    dentry->parent = parent;
+    if (fs_alloc_inode(dentry) == NULL) {
+        free(dentry);
+        return NULL;
+    }
+    fs_alloc_dentry(parent->inode, dentry);
+    return dentry;
+}
+
+static int mb_populate(const char* dir, int n) {
+    char path[MB_PATH_LEN];
+    int  i;
+    if (mb_create(dir, FS_DIR) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/entry_%d", dir, i);
+        if (mb_create(path, FS_FILE) == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 清空设备并重新挂载，基准之间互不影响
+ */
+static int mb_mount(const char* device) {
+    struct custom_options options;
+    int fd;
+
+    fs_umount();
+    fd = open(device, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "newfs_microbench: %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    close(fd);
+    memset(&options, 0, sizeof(options));
+    options.device = device;
+    return fs_mount(options) == SFS_ERROR_NONE ? 0 : -1;
+}
+/******************************************************************************
+* SECTION: Benchmarks
+*******************************************************************************/
+static int setup_deep(struct mb_state* st) {
+    int len = 0, d;
+    for (d = 0; d < st->arg; d++) {
+        len += snprintf(st->path + len, MB_PATH_LEN - len, "/d%d", d);
+        if (mb_create(st->path, FS_DIR) == NULL) {
+            return -1;
+        }
+    }
+    snprintf(st->path + len, MB_PATH_LEN - len, "/leaf");
+    return mb_create(st->path, FS_FILE) ? 0 : -1;
+}
+
+static void bm_lookup(struct mb_state* st) {
+    boolean is_find, is_root;
+    long    i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_lookup(st->path, &is_find, &is_root);
+    }
+}
+
+static int setup_dir(struct mb_state* st) {
+    if (mb_populate("/dir", st->arg) < 0) {
+        return -1;
+    }
+    snprintf(st->path, MB_PATH_LEN, "/dir/missing");
+    st->dir  = mb_create("/dir", FS_DIR);
+    st->file = new_dentry("inserted", FS_FILE);
+    st->file->parent = st->dir;
+    return fs_alloc_inode(st->file) ? 0 : -1;
+}
+
+static void bm_dir_insert_delete(struct mb_state* st) {
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_alloc_dentry(st->dir->inode, st->file);
+        fs_drop_dentry(st->dir->inode, st->file);
+    }
+}
+
+static void bm_alloc_inode(struct mb_state* st) {
+    struct newfs_dentry* dentry;
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        dentry = new_dentry("x", FS_FILE);
+        dentry->parent = st->dir;
+        fs_alloc_inode(dentry);
+        fs_drop_inode(dentry->inode);
+        free(dentry);
+    }
+}
+
+static void bm_alloc_data(struct mb_state* st) {
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_free_data(fs_alloc_data());
+    }
+}
+
+/**
+ * @brief 建一个arg字节的文件并写回，读写基准都在它上面做
+ */
+static int setup_file(struct mb_state* st) {
+    st->dir  = mb_create("/dir", FS_DIR);
+    st->file = mb_create("/dir/file", FS_FILE);
+    st->buf  = (uint8_t*)malloc(st->arg);
+    memset(st->buf, 'm', st->arg);
+    if (st->file == NULL || fs_write_file(st->file->inode, st->buf, st->arg, 0) != st->arg) {
+        return -1;
+    }
+    return fs_sync_inode(st->file->inode) < 0 ? -1 : 0;
+}
+
+static void bm_write_file(struct mb_state* st) {
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_write_file(st->file->inode, st->buf, st->arg, 0);
+    }
+}
+
+static void bm_read_file(struct mb_state* st) {
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_read_file(st->file->inode, st->buf, st->arg, 0);
+    }
+}
+
+static void bm_sync_inode(struct mb_state* st) {
+    long i;
+    for (i = 0; i < st->iterations; i++) {
+        fs_write_file(st->file->inode, st->buf, st->arg, 0);
+        fs_sync_inode(st->file->inode);
+    }
+}
+
+static int setup_parent(struct mb_state* st) {
+    st->dir = mb_create("/dir", FS_DIR);
+    return st->dir ? 0 : -1;
+}
+
+static const struct mb_bench benches[] = {
+    { "BM_lookup/depth:1",                1,           setup_deep,   bm_lookup },
+    { "BM_lookup/depth:8",                8,           setup_deep,   bm_lookup },
+    { "BM_lookup/depth:16",               16,          setup_deep,   bm_lookup },
+    { "BM_lookup_miss/entries:256",       MB_ENTRIES,  setup_dir,    bm_lookup },
+    { "BM_dir_insert_delete/entries:0",   0,           setup_dir,    bm_dir_insert_delete },
+    { "BM_dir_insert_delete/entries:256", MB_ENTRIES,  setup_dir,    bm_dir_insert_delete },
+    { "BM_alloc_inode",                   0,           setup_parent, bm_alloc_inode },
+    { "BM_alloc_data",                    0,           setup_parent, bm_alloc_data },
+    { "BM_write_file/bytes:1024",         1024,        setup_file,   bm_write_file },
+    { "BM_write_file/bytes:16384",        16384,       setup_file,   bm_write_file },
+    { "BM_read_file/bytes:1024",          1024,        setup_file,   bm_read_file },
+    { "BM_read_file/bytes:16384",         16384,       setup_file,   bm_read_file },
+    { "BM_sync_inode/bytes:1024",         1024,        setup_file,   bm_sync_inode },
+};
+#define MB_BENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+/******************************************************************************
+* SECTION: Runner
+*******************************************************************************/
+static void mb_device_state(struct ddriver_state_ext* dev) {
+    memset(dev, 0, sizeof(*dev));
+    dev->version = DDRIVER_STATE_EXT_VERSION;
+    dev->size    = sizeof(*dev);
+    ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_STATE_EXT, dev);
+}
+
+/**
+ * @brief 迭代次数按上一次的耗时放大（最多10倍），直到一次运行超过min_time
+ */
+static int mb_run(const struct mb_bench* b, const char* device, double min_time) {
+    struct mb_state          st;
+    struct ddriver_state_ext before, after;
+    double wall = 0, cpu = 0, t0, c0, mult;
+    long   iters = 1;
+
+    memset(&st, 0, sizeof(st));
+    st.arg = b->arg;
+    if (mb_mount(device) < 0 || (b->setup && b->setup(&st) < 0)) {
+        fprintf(mb_out, "%-36s ERROR OCCURRED: setup failed\n", b->name);
+        free(st.buf);
+        return -1;
+    }
+    for (;;) {
+        st.iterations = iters;
+        mb_device_state(&before);
+        t0 = mb_clock(CLOCK_MONOTONIC);
+        c0 = mb_clock(CLOCK_PROCESS_CPUTIME_ID);
+        b->run(&st);
+        cpu  = mb_clock(CLOCK_PROCESS_CPUTIME_ID) - c0;
+        wall = mb_clock(CLOCK_MONOTONIC) - t0;
+        mb_device_state(&after);
+        if (wall >= min_time || iters >= MB_MAX_ITERS) {
+            break;
+        }
+        mult  = wall > 0 ? min_time * 1.4 / wall : 10;
+        mult  = mult > 10 ? 10 : mult;
+        iters = (long)(iters * mult) > iters ? (long)(iters * mult) : iters + 1;
+        iters = iters > MB_MAX_ITERS ? MB_MAX_ITERS : iters;
+    }
+
+    fprintf(mb_out, "%-36s %10.1f ns %12.1f ns %12ld", b->name,
+            wall * 1e9 / iters, cpu * 1e9 / iters, iters);
+    if (after.read_cnt != before.read_cnt || after.write_cnt != before.write_cnt) {
+        fprintf(mb_out, " dev_reads=%.1f dev_writes=%.1f dev_seeks=%.1f",
+                (double)(after.read_cnt - before.read_cnt) / iters,
+                (double)(after.write_cnt - before.write_cnt) / iters,
+                (double)(after.seek_cnt - before.seek_cnt) / iters);
+    }
+    fprintf(mb_out, "\n");
+    fflush(mb_out);
+    free(st.buf);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    char        device[MB_PATH_LEN];
+    double      min_time = 0.5;
+    regex_t     re;
+    int         i, failed = 0, devnull;
+
+    snprintf(device, sizeof(device), "%s/ddriver", getenv("HOME") ? getenv("HOME") : ".");
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--benchmark_filter=", 19) == 0) {
+            filter = argv[i] + 19;
+        }
+        else if (strncmp(argv[i], "--benchmark_min_time=", 21) == 0) {
+            min_time = atof(argv[i] + 21);
+        }
+        else if (strncmp(argv[i], "--device=", 9) == 0) {
+            snprintf(device, sizeof(device), "%s", argv[i] + 9);
+        }
+        else if (strcmp(argv[i], "--verbose") == 0) {
+            mb_verbose = 1;
+        }
+        else {
+            fprintf(stderr, "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<sec>] "
+                            "[--device=<file>] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (filter && regcomp(&re, filter, REG_EXTENDED | REG_NOSUB) != 0) {
+        fprintf(stderr, "newfs_microbench: bad filter %s\n", filter);
+        return 2;
+    }
+
+    mb_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!mb_verbose) {                                /* 挂载/卸载时的SFS_DBG不混进结果 */
+        fflush(stdout);
+        devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+    fprintf(mb_out, "%s\n%-36s %13s %15s %12s\n%s\n",
+            "---------------------------------------------------------------------------------",
+            "Benchmark", "Time", "CPU", "Iterations",
+            "---------------------------------------------------------------------------------");
+    for (i = 0; i < MB_BENCHES; i++) {
+        if (filter && regexec(&re, benches[i].name, 0, NULL, 0) != 0) {
+            continue;
+        }
+        failed |= mb_run(&benches[i], device, min_time) < 0;
+    }
+    fs_umount();
+    if (filter) {
+        regfree(&re);
+    }
+    return failed;
+}
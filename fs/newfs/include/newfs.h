@@ -2,23 +2,11 @@
 #define _NEWFS_H_
 
 #define FUSE_USE_VERSION 26
-#include "stdio.h"
-#include "stdlib.h"
-#include <unistd.h>
-#include "fcntl.h"
-#include "string.h"
 #include "fuse.h"
-#include <stddef.h>
-#include "ddriver.h"
-#include "errno.h"
-#include "types.h"
+#include "newfs_core.h"
 
 #define NEWFS_MAGIC                  /* TODO: Define by yourself */
 #define NEWFS_DEFAULT_PERM    0777   /* 全权限打开 */
-/******************************************************************************
- * SECTION: macro debug
- *******************************************************************************/
-#define SFS_DBG(fmt, ...) do { printf("SFS_DBG: " fmt, ##__VA_ARGS__); } while(0)
 /******************************************************************************
  * SECTION: newfs.c
  *******************************************************************************/
@@ -31,6 +19,9 @@ int   			   newfs_readdir(const char *, void *, fuse_fill_dir_t, off_t,
 int   			   newfs_mknod(const char *, mode_t, dev_t);
 int   			   newfs_write(const char *, const char *, size_t, off_t,
 					                  struct fuse_file_info *);
+int   			   newfs_write_buf(const char *, struct fuse_bufvec *, off_t,
+						              struct fuse_file_info *);
+int   			   newfs_write_bufvec(struct newfs_inode *, struct fuse_bufvec *, off_t);
 int   			   newfs_read(const char *, char *, size_t, off_t,
 					                 struct fuse_file_info *);
 int   			   newfs_access(const char *, int);
@@ -39,27 +30,25 @@ int   			   newfs_rmdir(const char *);
 int   			   newfs_rename(const char *, const char *);
 int   			   newfs_utimens(const char *, const struct timespec tv[2]);
 int   			   newfs_truncate(const char *, off_t);
+int   			   newfs_fallocate(const char *, int, off_t, off_t,
+					                 struct fuse_file_info *);
+int   			   newfs_ioctl(const char *, int, void *, struct fuse_file_info *,
+					             unsigned int, void *);
 			
 int   			   newfs_open(const char *, struct fuse_file_info *);
+int   			   newfs_create(const char *, mode_t, struct fuse_file_info *);
+int   			   newfs_fgetattr(const char *, struct stat *, struct fuse_file_info *);
+int   			   newfs_ftruncate(const char *, off_t, struct fuse_file_info *);
+int   			   newfs_flush(const char *, struct fuse_file_info *);
+int   			   newfs_release(const char *, struct fuse_file_info *);
+int   			   newfs_fsync(const char *, int, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
+void 			   newfs_fill_stat(struct newfs_dentry *, struct stat *);
+void 			   newfs_init_conn(struct fuse_conn_info *);
+void 			   newfs_stats_attr(struct stat *);
+struct newfs_file* newfs_stats_open();
 /******************************************************************************
-* SECTION: newfs_utils.c
+* SECTION: newfs_ll.c
 *******************************************************************************/
-int 				fs_driver_read(int offset, uint8_t *out_content, int size);
-int 				fs_driver_write(int offset, uint8_t *in_content, int size);
-int 				fs_mount(struct custom_options options);
-int 				fs_umount();
-char* 				fs_get_fname(const char* path);
-int 				fs_calc_lvl(const char * path);
-int 				fs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry);
-int 				fs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
-struct newfs_inode* fs_alloc_inode(struct newfs_dentry * dentry);
-int 				fs_sync_inode(struct newfs_inode * inode);
-int 				fs_drop_inode(struct newfs_inode * inode);
-struct newfs_inode* fs_read_inode(struct newfs_dentry * dentry, int ino);
-struct newfs_dentry* fs_get_dentry(struct newfs_inode * inode, int dir);
-struct newfs_dentry* fs_lookup(const char * path, boolean* is_find, boolean* is_root);
-int 				fs_free_data(int data_num);
-int 				fs_alloc_data();
-void 				fs_dump_map();
-#endif  /* _newfs_H_ */
\ No newline at end of file
+int   			   newfs_ll_main(struct fuse_args *);
+#endif  /* _newfs_H_ */
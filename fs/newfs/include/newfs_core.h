@@ -0,0 +1,102 @@
+#ifndef _NEWFS_CORE_H_
+#define _NEWFS_CORE_H_
+/******************************************************************************
+ * newfs核心：布局、inode/数据块分配、目录项、块缓存与文件读写。
+ * 不依赖FUSE，newfs.c / newfs_ll.c两个前端和进程内基准都只通过这里调用。
+ *******************************************************************************/
+#include "stdio.h"
+#include "stdlib.h"
+#include <unistd.h>
+#include "fcntl.h"
+#include "string.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <linux/falloc.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "ddriver.h"
+#include "fs_blkio.h"
+#include "fs_log.h"
+#include "errno.h"
+#include "types.h"
+
+#ifndef SEEK_DATA                    /* 未定义_GNU_SOURCE时补齐 */
+#define SEEK_DATA             3
+#define SEEK_HOLE             4
+#endif
+/******************************************************************************
+ * SECTION: macro debug
+ * 日志分级：级别高于SFS_LOG_LEVEL的调用在编译期消去（参数也不求值），
+ * 保留的级别写入本线程的环形缓冲（../common的fs_log），挂载、卸载和出错时才输出到stdout
+ *******************************************************************************/
+#ifndef SFS_LOG_LEVEL
+#define SFS_LOG_LEVEL         FS_LOG_INFO
+#endif
+
+#define SFS_LOG(level, tag, fmt, ...) do { if ((level) <= SFS_LOG_LEVEL) fs_log(level, tag, fmt, ##__VA_ARGS__); } while(0)
+#define SFS_ERR(fmt, ...)     SFS_LOG(FS_LOG_ERROR, "SFS_ERR", fmt, ##__VA_ARGS__)
+#define SFS_WARN(fmt, ...)    SFS_LOG(FS_LOG_WARN, "SFS_WARN", fmt, ##__VA_ARGS__)
+#define SFS_INFO(fmt, ...)    SFS_LOG(FS_LOG_INFO, "SFS_INFO", fmt, ##__VA_ARGS__)
+#define SFS_DBG(fmt, ...)     SFS_LOG(FS_LOG_DEBUG, "SFS_DBG", fmt, ##__VA_ARGS__)
+/******************************************************************************
+* SECTION: newfs_utils.c
+*******************************************************************************/
+int 				fs_driver_read(int offset, uint8_t *out_content, int size);
+int 				fs_driver_write(int offset, uint8_t *in_content, int size);
+int 				fs_mount(struct custom_options options);
+int 				fs_umount();
+char* 				fs_get_fname(const char* path);
+int 				fs_calc_lvl(const char * path);
+struct newfs_inode* fs_lock_inode(struct newfs_inode* inode);
+void 				fs_unlock_inode(struct newfs_inode* inode);
+void 				fs_inode_scope_end(struct newfs_inode** scope);
+int 				fs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry);
+int 				fs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
+struct newfs_inode* fs_alloc_inode(struct newfs_dentry * dentry);
+int 				fs_sync_inode(struct newfs_inode * inode);
+void 				fs_touch_inode(struct newfs_inode * inode, int flags);
+void 				fs_utimens(struct newfs_inode * inode, const struct timespec tv[2]);
+int 				fs_drop_inode(struct newfs_inode * inode);
+struct newfs_inode* fs_read_inode(struct newfs_dentry * dentry, int ino);
+struct newfs_inode* fs_dentry_inode(struct newfs_dentry * dentry);
+int 				fs_prefetch_dir(struct newfs_inode* inode, int start, int cnt);
+struct newfs_dentry* fs_get_dentry(struct newfs_inode * inode, int dir);
+struct newfs_dentry* fs_find_dentry(struct newfs_inode* inode, const char* fname);
+int 				fs_create_dentry(struct newfs_dentry* parent, const char* fname, FILE_TYPE ftype,
+                                     struct newfs_dentry** dentry);
+struct newfs_dentry* fs_lookup(const char * path, boolean* is_find, boolean* is_root);
+int 				fs_free_data(int data_num);
+int 				fs_alloc_data();
+int 				fs_alloc_data_near(int goal, int want, int* got);
+int 				fs_release_prealloc(struct newfs_inode* inode);
+int 				fs_count_extents(struct newfs_inode* inode);
+void 				fs_frag_report(struct newfs_frag_stat* stat);
+int 				fs_load_block(struct newfs_inode* inode, int blk);
+int 				fs_readahead(struct newfs_inode* inode, int blk, int cnt, int ahead_from);
+int 				fs_file_readahead(struct newfs_file* file, off_t offset, int size);
+int 				fs_map_block(struct newfs_inode* inode, int blk);
+int 				fs_delay_block(struct newfs_inode* inode, int blk);
+int 				fs_writeback_inode(struct newfs_inode* inode);
+int 				fs_unmap_block(struct newfs_inode* inode, int blk);
+int 				fs_read_file(struct newfs_inode* inode, uint8_t* out_content, int size, off_t offset);
+int 				fs_read_iov(struct newfs_inode* inode, off_t offset, int size, struct iovec* iov, int max_iov);
+int 				fs_write_file(struct newfs_inode* inode, const uint8_t* in_content, int size, off_t offset);
+int 				fs_write_begin(struct newfs_inode* inode, int blk);
+int 				fs_write_end(struct newfs_inode* inode, int offset, int done);
+int 				fs_punch_hole(struct newfs_inode* inode, off_t offset, off_t len);
+int 				fs_fallocate(struct newfs_inode* inode, off_t offset, off_t len, boolean keep_size);
+int 				fs_truncate_file(struct newfs_inode* inode, off_t size);
+int 				fs_seek_hole_data(struct newfs_inode* inode, off_t offset, int whence);
+int 				fs_dump_map(char* buf, int size);
+/******************************************************************************
+* SECTION: newfs_stats.c
+*******************************************************************************/
+uint64_t 			fs_stat_now();
+void 				fs_stat_record(int id, uint64_t ns);
+void 				fs_stat_scope_end(struct newfs_stat_scope* scope);
+void 				fs_stat_count(int id, uint64_t n);
+void 				fs_stat_reset();
+int 				fs_stat_dump(char* buf, int size);
+#endif  /* _NEWFS_CORE_H_ */
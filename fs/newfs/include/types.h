@@ -14,6 +14,45 @@ typedef enum file_type
     FS_DIR   // 目录文件
 } FILE_TYPE;
 
+typedef enum newfs_stat_id
+{
+    /* FUSE操作，路径接口和low-level接口共用 */
+    SFS_OP_LOOKUP,
+    SFS_OP_FORGET,
+    SFS_OP_GETATTR,
+    SFS_OP_SETATTR,      // truncate / ftruncate / utimens / low-level setattr
+    SFS_OP_READDIR,
+    SFS_OP_MKDIR,
+    SFS_OP_MKNOD,        // create分别计入mknod和open
+    SFS_OP_OPEN,         // open / opendir / low-level open
+    SFS_OP_RELEASE,      // flush / release / releasedir
+    SFS_OP_READ,
+    SFS_OP_WRITE,        // write / write_buf
+    SFS_OP_FSYNC,
+    SFS_OP_FALLOCATE,
+    SFS_OP_IOCTL,
+    /* 内部阶段 */
+    SFS_STAGE_LOOKUP,    // fs_lookup路径解析
+    SFS_STAGE_READ_INODE,
+    SFS_STAGE_ALLOC_INODE,
+    SFS_STAGE_ALLOC_DATA,
+    SFS_STAGE_WRITEBACK,
+    SFS_STAGE_DRIVER_READ,
+    SFS_STAGE_DRIVER_WRITE,
+    SFS_STAT_HISTS
+} NEWFS_STAT_ID;
+
+typedef enum newfs_stat_cnt
+{
+    SFS_CNT_BLOCK_HIT,     // 数据块缓存命中
+    SFS_CNT_BLOCK_MISS,
+    SFS_CNT_INODE_HIT,     // inode缓存命中
+    SFS_CNT_INODE_MISS,
+    SFS_CNT_DRIVER_RD_BYTES,
+    SFS_CNT_DRIVER_WR_BYTES,
+    SFS_STAT_CNTS
+} NEWFS_STAT_CNT;
+
 /******************************************************************************
 * SECTION: Macro
 *******************************************************************************/
@@ -22,7 +61,7 @@ typedef enum file_type
 #define UINT32_BITS             32
 #define UINT8_BITS              8
 
-#define SFS_MAGIC_NUM           0x52415453  
+#define SFS_MAGIC_NUM           0x52415455      /* 块组布局，inode含时间戳；磁盘格式每变一次加一 */
 #define SFS_SUPER_OFS           0
 #define SFS_ROOT_INO            0
 
@@ -36,17 +75,45 @@ typedef enum file_type
 #define SFS_ERROR_UNSUPPORTED   ENXIO
 #define SFS_ERROR_IO            EIO     /* Error Input/Output */
 #define SFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define SFS_ERROR_FBIG          EFBIG   /* 超出块映射表能表示的文件大小 */
+#define SFS_ERROR_NOTSUP        EOPNOTSUPP
+#define SFS_ERROR_NODATA        ENXIO   /* SEEK_DATA/SEEK_HOLE越过文件末尾 */
 
 #define SFS_MAX_FILE_NAME       128
 #define SFS_INODE_PER_FILE      1
-#define SFS_DATA_PER_FILE       6
+#define SFS_DATA_PER_FILE       6       /* 估算布局时每个文件平均占用的数据块数 */
+#define SFS_MAX_DATA_PER_FILE   128     /* 每个inode块映射表的长度 */
 #define SFS_DEFAULT_PERM        0777
 
+#define SFS_DATA_HOLE           (-1)    /* 块映射表中未分配（空洞）的表项 */
+#define SFS_PREALLOC_BLKS       8       /* 顺序写时每次为文件预留的连续块数 */
+#define SFS_DELAY_FLUSH_BLKS    64      /* 文件中延迟分配的块超过该数量时，写路径回写该文件 */
+#define SFS_GROUP_BLKS          512     /* 格式化时每个块组的目标块数（含组内位图和inode表） */
+#define SFS_RA_MIN_BLKS         4       /* 顺序读时的初始预读窗口（块） */
+#define SFS_RA_MAX_BLKS         32      /* 预读窗口上限，每次命中顺序读后翻倍直到上限 */
+
 #define SFS_IOC_MAGIC           'S'
 #define SFS_IOC_SEEK            _IO(SFS_IOC_MAGIC, 0)
+#define SFS_IOC_SEEK_DATA       _IOWR(SFS_IOC_MAGIC, 1, off_t)  /* lseek(SEEK_DATA)，FUSE 2.x无lseek回调 */
+#define SFS_IOC_SEEK_HOLE       _IOWR(SFS_IOC_MAGIC, 2, off_t)  /* lseek(SEEK_HOLE) */
 
 #define SFS_FLAG_BUF_DIRTY      0x1
 #define SFS_FLAG_BUF_OCCUPY     0x2
+#define SFS_FLAG_BUF_DELAY      0x4     /* 数据只在内存中，回写时才分配数据块 */
+#define SFS_FLAG_BUF_AHEAD      0x8     /* 预读进来、尚未被读请求访问过的块 */
+
+#define SFS_BLKIO_CACHE         256     /* 块设备层缓冲缓存的IO单位数，缓存超级块、位图和inode所在的单位 */
+
+#define SFS_TIME_ATIME          0x1     /* fs_touch_inode：更新访问时间 */
+#define SFS_TIME_MTIME          0x2     /* 更新修改时间 */
+#define SFS_TIME_CTIME          0x4     /* 更新状态改变时间 */
+
+#define SFS_STATS_NAME          ".newfs_stats"  /* 根目录下只读的统计文件，不出现在readdir中 */
+#define SFS_STATS_DUMP_SZ       8192    /* 统计文本的最大长度 */
+#define SFS_MAP_DUMP_RUNS       8       /* 统计文件中每张位图列出的区间数 */
+#define SFS_HIST_SUB_BITS       3       /* 每个2的幂区间再等分为8个桶，相对误差不超过1/8 */
+#define SFS_HIST_MAX_BITS       40      /* 可记录的最大延迟约2^40ns（18分钟），更大的值记在最后一个桶 */
+#define SFS_HIST_BUCKETS        ((SFS_HIST_MAX_BITS - SFS_HIST_SUB_BITS + 1) << SFS_HIST_SUB_BITS)
 /******************************************************************************
 * SECTION: Macro Function
 *******************************************************************************/
@@ -57,23 +124,63 @@ typedef enum file_type
 
 #define SFS_ROUND_DOWN(value, round)    (value % round == 0 ? value : (value / round) * round)
 #define SFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round)
+#define SFS_MIN(a, b)                   ((a) < (b) ? (a) : (b))
+#define SFS_MAX(a, b)                   ((a) > (b) ? (a) : (b))
 
-#define SFS_BLKS_SZ(blks)               (blks * SFS_BLOCK_SZ())
+#define SFS_BLKS_SZ(blks)               ((blks) * SFS_BLOCK_SZ())
+#define SFS_MAX_FILE_SZ()               ((off_t)SFS_BLKS_SZ(SFS_MAX_DATA_PER_FILE))
 #define SFS_ASSIGN_FNAME(pnewfs_dentry, _fname) memcpy(pnewfs_dentry->fname, _fname, strlen(_fname))
-#define SFS_INO_OFS(ino)                (newfs_super.inode_offset + ino * SFS_BLOCK_SZ())
-#define SFS_DATA_OFS(ino)               (newfs_super.data_offset + ino * SFS_BLOCK_SZ())
+#define SFS_INO_GROUP(ino)              ((ino) / newfs_super.inodes_per_group)
+#define SFS_DATA_GROUP(dno)             ((dno) / newfs_super.data_per_group)
+#define SFS_INO_OFS(ino)                (newfs_super.groups[SFS_INO_GROUP(ino)].inode_offset + \
+                                         ((ino) % newfs_super.inodes_per_group) * SFS_BLOCK_SZ())
+#define SFS_DATA_OFS(dno)               (newfs_super.groups[SFS_DATA_GROUP(dno)].data_offset + \
+                                         ((dno) % newfs_super.data_per_group) * SFS_BLOCK_SZ())
+#define SFS_DATA_ADJACENT(prev, dno)    ((dno) == (prev) + 1 && SFS_DATA_GROUP(prev) == SFS_DATA_GROUP(dno))
+
+#define SFS_BITMAP_TEST(map, n)         ((map)[(n) / UINT8_BITS] & (0x1 << ((n) % UINT8_BITS)))
+#define SFS_BITMAP_SET(map, n)          ((map)[(n) / UINT8_BITS] |= (0x1 << ((n) % UINT8_BITS)))
+#define SFS_BITMAP_CLEAR(map, n)        ((map)[(n) / UINT8_BITS] &= (uint8_t)(~(0x1 << ((n) % UINT8_BITS))))
+
+#define SFS_TIME_BEFORE(a, b)          ((a).tv_sec < (b).tv_sec || \
+                                         ((a).tv_sec == (b).tv_sec && (a).tv_nsec <= (b).tv_nsec))
+
+#define SFS_BLK_IDX(ofs)                ((ofs) / SFS_BLOCK_SZ())
+#define SFS_BLK_BIAS(ofs)               ((ofs) % SFS_BLOCK_SZ())
+#define SFS_IS_HOLE(pinode, blk)        ((pinode)->block_pointer[blk] == SFS_DATA_HOLE)
+#define SFS_IS_DELAY(pinode, blk)       ((pinode)->block_flags[blk] & SFS_FLAG_BUF_DELAY)
+#define SFS_IS_SPARSE(pinode, blk)      (SFS_IS_HOLE(pinode, blk) && !SFS_IS_DELAY(pinode, blk))
+#define SFS_IS_DIRTY(pinode, blk)       (!SFS_IS_HOLE(pinode, blk) && (pinode)->data[blk] != NULL && \
+                                         ((pinode)->block_flags[blk] & SFS_FLAG_BUF_DIRTY))
+#define SFS_DENTRY_PER_BLK()            (SFS_BLOCK_SZ() / sizeof(struct newfs_dentry_d))
+#define SFS_MAX_DENTRY_PER_DIR()        ((int)(SFS_MAX_DATA_PER_FILE * SFS_DENTRY_PER_BLK()))  /* 目录项数上限 */
 
 #define SFS_IS_DIR(pinode)              (pinode->dentry->ftype == FS_DIR)
 #define SFS_IS_FILE(pinode)              (pinode->dentry->ftype == FS_FILE)
+#define SFS_FILE(fi)                    ((struct newfs_file *)(uintptr_t)(fi)->fh)   /* open保存的文件句柄 */
+#define SFS_STAT_SCOPE(id)              struct newfs_stat_scope stat_scope                  \
+                                        __attribute__((cleanup(fs_stat_scope_end))) =       \
+                                        { (id), fs_stat_now() }   /* 离开作用域时把耗时记入直方图 */
+#define SFS_INODE_SCOPE(pinode)         struct newfs_inode* inode_scope                     \
+                                        __attribute__((cleanup(fs_inode_scope_end))) =      \
+                                        fs_lock_inode(pinode)     /* 持有inode锁直到离开作用域 */
 
 struct custom_options {
 	const char*        device;
+	int                lowlevel;   // --lowlevel: 使用FUSE low-level接口，按inode号而不是路径访问
+	double             entry_timeout;    // -o entry_timeout=: 内核缓存目录项的时间（秒）
+	double             attr_timeout;     // -o attr_timeout=: 内核缓存属性的时间（秒）
+	double             negative_timeout; // -o negative_timeout=: 内核缓存“不存在”结果的时间（秒）
+	int                kernel_cache;     // -o kernel_cache: 打开文件时保留内核页缓存
+	int                auto_cache;       // -o auto_cache: mtime/大小未变时保留内核页缓存
+	int                writeback_cache;  // -o writeback_cache: 内核回写缓存，FUSE 2.x下退化为kernel_cache
 };
 /******************************************************************************
 * SECTION: FS Specific Structure - In memory structure
 *******************************************************************************/
 struct newfs_super {
     int         driver_fd; // 磁盘对应的文件描述符
+    struct fs_blkdev blkdev; // driver_fd之上的块设备层，fs_driver_read/write经由它访问磁盘
     /* TODO: Define yourself */
     int         max_ino; // 所能容纳的最大文件数量
 
@@ -81,34 +188,58 @@ struct newfs_super {
     int         sz_block; // 文件系统的块大小
     int         sz_disk; // 磁盘的容量大小
 
-    uint8_t     *map_inode; // inode位图
-    uint8_t     *map_data;  // data位图
-    int         map_inode_blks; // inode 位图占用的块数
-    int         map_inode_offset; // inode 位图在磁盘上的偏移
-
-    int         map_data_blks; // data 位图占用的块数
-    int         map_data_offset; // data 位图在磁盘上的偏移
+    uint8_t     *map_inode; // inode位图，各块组的位图片段依次拼接
+    uint8_t     *map_data;  // data位图，各块组的位图片段依次拼接
+    int         map_inode_blks; // 内存中 inode 位图占用的块数
+    int         map_data_blks; // 内存中 data 位图占用的块数
 
     struct newfs_dentry *root_dentry; // 根目录dentry
 
-    int inode_offset; // inode块在磁盘上的偏移
-    int data_offset;  // data块在磁盘上的偏移
+    int group_cnt; // 块组数
+    int group_blks; // 每个块组占用的块数
+    int inodes_per_group; // 每个块组的inode数
+    int data_per_group; // 每个块组的数据块数
+    int gdt_offset; // 组描述符表在磁盘上的偏移
+    struct newfs_group *groups; // 组描述符表
+
+    int max_data; // 数据区的块数
+    int delay_blks; // 已写入内存、尚未分配数据块的块数，原子更新
+
+    int sz_usage; // 已用空间，分配时原子更新
+    uint8_t *zero_blk; // 全零块，零拷贝读空洞时引用
 
-    int sz_usage; // 已用空间
+    int ra_blks; // 文件预读读入的块数
+    int ra_hits; // 其中随后被读请求访问到的块数，ra_blks - ra_hits为浪费
+    int ra_inodes; // readdir预取的inode数
+    int ra_inode_hits; // 其中随后被lookup访问到的inode数
 
     boolean is_mounted;
 };
 
 struct newfs_inode {
     /* TODO: Define yourself */
+    pthread_mutex_t lock;   // 可重入锁，保护目录项链表和dir_cnt、大小、块缓存和标志、预留窗口、延迟计数，
+                            // 以及各句柄的预读状态
     int ino;                // 在inode位图中的下标
     int size;               // 文件已占用空间
     int dir_cnt;            // 目录项数量
     struct newfs_dentry *dentry;  // 指向该inode的dentry
     struct newfs_dentry *dentrys; // 所有目录项
-    int block_pointer[6];   // 数据块指针
-    uint8_t* data[6];       // 对应数据块中存储的内容
-    
+    int block_pointer[SFS_MAX_DATA_PER_FILE];   // 数据块指针，SFS_DATA_HOLE表示空洞
+    uint8_t* data[SFS_MAX_DATA_PER_FILE];       // 对应数据块中存储的内容，按需读入
+    flag16 block_flags[SFS_MAX_DATA_PER_FILE];  // 数据块缓存状态，SFS_FLAG_BUF_*
+
+    int prealloc_start;     // 预留窗口的起始数据块号
+    int prealloc_lblk;      // 预留窗口对应的逻辑块号
+    int prealloc_len;       // 预留窗口中剩余的块数，最后一个句柄关闭或文件删除时归还
+
+    int delay_blks;         // 该文件已写入内存、尚未分配数据块的块数
+    int open_cnt;           // 打开该文件的句柄数，最后一个句柄关闭时归还预留窗口
+    boolean ra_ahead;       // 由readdir预取、尚未被lookup访问过
+
+    struct timespec atime;  // 访问时间
+    struct timespec mtime;  // 内容修改时间
+    struct timespec ctime;  // 属性改变时间
 };
 
 struct newfs_dentry {
@@ -133,6 +264,55 @@ static inline struct newfs_dentry* new_dentry(char * fname, FILE_TYPE ftype) {
     dentry->brother = NULL;
     return dentry;                                    
 }
+struct newfs_group {
+    pthread_mutex_t lock;   // 保护本组位图片段和下面的计数，各块组可并行分配
+    int inode_map_offset;   // 本组 inode 位图片段在磁盘上的偏移
+    int data_map_offset;    // 本组 data 位图片段在磁盘上的偏移
+    int inode_offset;       // 本组 inode 表在磁盘上的偏移
+    int data_offset;        // 本组数据区在磁盘上的偏移
+    int free_inodes;        // 空闲inode数
+    int free_data;          // 空闲数据块数
+    int dirs;               // 目录数，创建目录时用于分散目录
+};
+
+struct newfs_file {
+    struct newfs_dentry* dentry;    // open/create时解析到的dentry，之后的读写不再查路径
+    struct newfs_inode*  inode;     // 对应的inode，open_cnt计入本句柄
+    off_t ra_next;                  // 预读状态：顺序读时下一次读的期望偏移
+    int ra_seq;                     // 预读状态：连续顺序读的次数，随机读时清零
+    int ra_win;                     // 预读状态：当前预读窗口（块），随机读时清零
+    int ra_blk;                     // 预读状态：已经预读到的逻辑块号（不含）
+    char* stats;                    // 打开SFS_STATS_NAME时的统计快照，普通文件为NULL
+    int stats_len;                  // 快照长度
+};
+
+struct newfs_ll_node {
+    struct newfs_dentry* dentry;    // low-level接口中inode号对应的dentry，NULL表示内核未持有
+    uint64_t nlookup;               // 内核持有的lookup计数，forget减到0时移出表
+};
+
+struct newfs_hist {
+    uint64_t cnt;           // 样本数
+    uint64_t sum;           // 耗时总和（ns）
+    uint64_t max;           // 最大耗时（ns）
+    uint64_t bucket[SFS_HIST_BUCKETS];  // 对数-线性分桶（HDR风格）
+};
+
+struct newfs_stats {
+    struct newfs_hist hist[SFS_STAT_HISTS];
+    uint64_t cnt[SFS_STAT_CNTS];
+};
+
+struct newfs_stat_scope {
+    int      id;            // 记入的直方图
+    uint64_t start;         // 开始时间（ns）
+};
+
+struct newfs_frag_stat {
+    int files;              // 至少占用一个数据块的文件数
+    int blocks;             // 文件数据块总数
+    int extents;            // 物理连续的区段总数
+};
 /******************************************************************************
  * SECTION: FS Specific Structure - Disk structure
  *******************************************************************************/
@@ -142,25 +322,36 @@ struct newfs_super_d
 
     int         max_ino; // 最多支持的文件数
 
-    int         map_inode_blks; // inode 位图占用的块数
-    int         map_inode_offset; // inode 位图在磁盘上的偏移
-
-    int         map_data_blks; // data 位图占用的块数
-    int         map_data_offset; // data 位图在磁盘上的偏移
-
-    int         inode_offset; // inode块在磁盘上的偏移
-    int         data_offset; // data块在磁盘上的偏移
+    int         group_cnt; // 块组数
+    int         group_blks; // 每个块组占用的块数
+    int         inodes_per_group; // 每个块组的inode数，8的倍数
+    int         data_per_group; // 每个块组的数据块数，8的倍数
+    int         gdt_offset; // 组描述符表在磁盘上的偏移
 
     int         sz_usage; // 已用空间
 };
 
+struct newfs_group_d
+{
+    int         inode_map_offset;   // 本组 inode 位图片段在磁盘上的偏移
+    int         data_map_offset;    // 本组 data 位图片段在磁盘上的偏移
+    int         inode_offset;       // 本组 inode 表在磁盘上的偏移
+    int         data_offset;        // 本组数据区在磁盘上的偏移
+    int         free_inodes;        // 空闲inode数
+    int         free_data;          // 空闲数据块数
+    int         dirs;               // 目录数
+};
+
 struct newfs_inode_d
 {
     uint32_t    ino;                // 在 inode 位图中的下标
     int         size;               // 文件已占用空间
     FILE_TYPE   ftype;              // 文件类型（目录类型、普通文件类型）
     int         dir_cnt;            // 如果是目录类型文件，下面有几个目录项
-    int         block_pointer[6];   // 数据块指针（可固定分配）
+    int         block_pointer[SFS_MAX_DATA_PER_FILE];   // 数据块指针，SFS_DATA_HOLE表示空洞
+    struct timespec atime;          // 访问时间
+    struct timespec mtime;          // 内容修改时间
+    struct timespec ctime;          // 属性改变时间
 };
 
 struct newfs_dentry_d
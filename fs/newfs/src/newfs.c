@@ -3,16 +3,24 @@
 * SECTION: 宏定义
 *******************************************************************************/
 #define OPTION(t, p)        { t, offsetof(struct custom_options, p), 1 }
+#define NEWFS_IS_STATS(path) ((path) != NULL && strcmp((path), "/" SFS_STATS_NAME) == 0)
 
 /******************************************************************************
 * SECTION: 全局变量
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--lowlevel", lowlevel),
+	OPTION("entry_timeout=%lf", entry_timeout),
+	OPTION("attr_timeout=%lf", attr_timeout),
+	OPTION("negative_timeout=%lf", negative_timeout),
+	OPTION("kernel_cache", kernel_cache),
+	OPTION("auto_cache", auto_cache),
+	OPTION("writeback_cache", writeback_cache),
 	FUSE_OPT_END
 };
 struct custom_options newfs_options;			 /* 全局选项 */
-struct newfs_super newfs_super; 
+extern struct newfs_super newfs_super;
 /******************************************************************************
 * SECTION: FUSE操作定义
 *******************************************************************************/
@@ -23,36 +31,100 @@ static struct fuse_operations operations = {
 	.getattr = newfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
 	.readdir = newfs_readdir,				 /* 填充dentrys */
 	.mknod = newfs_mknod,					 /* 创建文件，touch相关 */
-	.write = NULL,								  	 /* 写入文件 */
-	.read = NULL,								  	 /* 读文件 */
-	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
-	.truncate = NULL,						  		 /* 改变文件大小 */
+	.write = newfs_write,					 /* 写入文件 */
+	.write_buf = newfs_write_buf,			 /* 写入文件，数据从FUSE缓冲直接拷进块缓存 */
+	.read = newfs_read,						 /* 读文件 */
+	.utimens = newfs_utimens,				 /* 修改时间 */
+	.truncate = newfs_truncate,				 /* 改变文件大小 */
+	.fallocate = newfs_fallocate,			 /* 预分配 / 打洞 */
+	.ioctl = newfs_ioctl,					 /* SEEK_DATA / SEEK_HOLE */
 	.unlink = NULL,							  		 /* 删除文件 */
 	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
 	.rename = NULL,							  		 /* 重命名，mv */
 
-	.open = NULL,							
-	.opendir = NULL,
-	.access = NULL
+	.open = newfs_open,						 /* 打开文件，句柄保存在fi->fh */
+	.create = newfs_create,					 /* 创建并打开文件 */
+	.fgetattr = newfs_fgetattr,				 /* 按句柄获取属性，fstat */
+	.ftruncate = newfs_ftruncate,			 /* 按句柄改变文件大小 */
+	.flush = newfs_flush,					 /* close时调用 */
+	.release = newfs_release,				 /* 关闭文件，归还预留块 */
+	.fsync = newfs_fsync,					 /* 回写文件，延迟分配的块在此落盘 */
+	.opendir = newfs_opendir,				 /* 打开目录，句柄保存在fi->fh */
+	.releasedir = newfs_release,			 /* 关闭目录 */
+	.access = NULL,
+
+	.flag_nullpath_ok = 1,					 /* 带句柄的操作不需要路径 */
+	.flag_nopath = 1,						 /* 带句柄的操作FUSE不再计算路径 */
+	.flag_utime_omit_ok = 1					 /* utimens自己处理UTIME_NOW / UTIME_OMIT */
 };
 /******************************************************************************
+* SECTION: 文件句柄
+*******************************************************************************/
+/**
+ * @brief 取得操作对象：有句柄时直接使用open解析好的dentry，否则按路径查找
+ * 
+ * @param path 相对于挂载点的路径，flag_nopath下带句柄的操作为NULL
+ * @param fi 文件信息，可为NULL
+ * @return struct newfs_dentry* 找不到时为NULL
+ */
+static struct newfs_dentry* newfs_resolve(const char* path, struct fuse_file_info* fi) {
+	boolean is_find, is_root;
+	struct newfs_dentry *dentry;
+
+	if (fi != NULL && fi->fh != 0)
+	{
+		return SFS_FILE(fi)->dentry;
+	}
+	if (path == NULL)
+	{
+		return NULL;
+	}
+	dentry = fs_lookup(path, &is_find, &is_root);
+	return is_find ? dentry : NULL;
+}
+/******************************************************************************
 * SECTION: 必做函数实现
 *******************************************************************************/
 /**
  * @brief 挂载（mount）文件系统
  * 
- * @param conn_info 可忽略，一些建立连接相关的信息 
+ * @param conn_info 建立连接相关的信息，用于申请writeback_cache
  * @return void*
  */
 void* newfs_init(struct fuse_conn_info * conn_info) {
 	if (fs_mount(newfs_options) != SFS_ERROR_NONE) {
-        SFS_DBG("[%s] mount error\n", __func__);
+        SFS_ERR("[%s] mount error\n", __func__);
 		fuse_exit(fuse_get_context()->fuse);
 		return NULL;
 	} 
+	newfs_init_conn(conn_info);
 	return NULL;
 }
 
+/**
+ * @brief 向内核申请连接能力（big_writes，按挂载选项申请writeback_cache），路径接口和low-level接口共用
+ * 
+ * max_write由libfuse默认取通道缓冲大小（128KiB），可用-o max_write=调小
+ * 
+ * @param conn_info 连接信息
+ */
+void newfs_init_conn(struct fuse_conn_info * conn_info) {
+	if (conn_info == NULL)
+	{
+		return;
+	}
+	if (conn_info->capable & FUSE_CAP_BIG_WRITES)	 /* 否则内核按页（4KiB）拆分写请求 */
+	{
+		conn_info->want |= FUSE_CAP_BIG_WRITES;
+	}
+#ifdef FUSE_CAP_WRITEBACK_CACHE
+	if (newfs_options.writeback_cache)				 /* 小写入由内核页缓存合并后再下发 */
+	{
+		conn_info->want |= FUSE_CAP_WRITEBACK_CACHE;
+	}
+#endif
+}
+
 /**
  * @brief 卸载（umount）文件系统
  * 
@@ -61,7 +133,7 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
  */
 void newfs_destroy(void* p) {
 	if (fs_umount() != SFS_ERROR_NONE) {
-		SFS_DBG("[%s] unmount error\n", __func__);
+		SFS_ERR("[%s] unmount error\n", __func__);
 		fuse_exit(fuse_get_context()->fuse);
 		return;
 	}
@@ -76,13 +148,12 @@ void newfs_destroy(void* p) {
  * @return int 0成功，否则失败
  */
 int newfs_mkdir(const char* path, mode_t mode) {
+	SFS_STAT_SCOPE(SFS_OP_MKDIR);
 	/* TODO: 解析路径，创建目录 */
 	(void)mode;
 	boolean is_find, is_root;
-	char *fname;
 	struct newfs_dentry *last_dentry = fs_lookup(path, &is_find, &is_root);
 	struct newfs_dentry *dentry;
-	struct newfs_inode *inode;
 
 	if (is_find)
 	{
@@ -94,13 +165,7 @@ int newfs_mkdir(const char* path, mode_t mode) {
 		return -SFS_ERROR_UNSUPPORTED;
 	}
 
-	fname = fs_get_fname(path);
-	dentry = new_dentry(fname, FS_DIR);
-	dentry->parent = last_dentry;
-	inode = fs_alloc_inode(dentry);
-	fs_alloc_dentry(last_dentry->inode, dentry);
-
-	return SFS_ERROR_NONE;
+	return fs_create_dentry(last_dentry, fs_get_fname(path), FS_DIR, &dentry);
 }
 
 /**
@@ -111,14 +176,34 @@ int newfs_mkdir(const char* path, mode_t mode) {
  * @return int 0成功，否则失败
  */
 int newfs_getattr(const char* path, struct stat * newfs_stat) {
+	SFS_STAT_SCOPE(SFS_OP_GETATTR);
 	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
 	boolean is_find, is_root;
-	struct newfs_dentry *dentry = fs_lookup(path, &is_find, &is_root);
+	struct newfs_dentry *dentry;
+
+	if (NEWFS_IS_STATS(path))
+	{
+		newfs_stats_attr(newfs_stat);
+		return SFS_ERROR_NONE;
+	}
+	dentry = fs_lookup(path, &is_find, &is_root);
 	if (is_find == FALSE)
 	{
 		return -SFS_ERROR_NOTFOUND;
 	}
 
+	newfs_fill_stat(dentry, newfs_stat);
+	return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 按dentry填充文件属性，路径接口和low-level接口共用
+ * 
+ * @param dentry 已读入inode的dentry
+ * @param newfs_stat 返回状态
+ */
+void newfs_fill_stat(struct newfs_dentry* dentry, struct stat * newfs_stat) {
+	SFS_INODE_SCOPE(dentry->inode);
 	if (SFS_IS_DIR(dentry->inode))
 	{
 		newfs_stat->st_mode = S_IFDIR | SFS_DEFAULT_PERM;
@@ -133,17 +218,51 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	newfs_stat->st_nlink = 1;
 	newfs_stat->st_uid = getuid();
 	newfs_stat->st_gid = getgid();
-	newfs_stat->st_atime = time(NULL);
-	newfs_stat->st_mtime = time(NULL);
+	newfs_stat->st_atim = dentry->inode->atime;
+	newfs_stat->st_mtim = dentry->inode->mtime;
+	newfs_stat->st_ctim = dentry->inode->ctime;
 	newfs_stat->st_blksize = SFS_IO_SZ();
 
-	if (is_root)
+	if (dentry == newfs_super.root_dentry)
 	{
 		newfs_stat->st_size = newfs_super.sz_usage;
 		newfs_stat->st_blocks = SFS_DISK_SZ() / SFS_BLOCK_SZ();
 		newfs_stat->st_nlink = 2; /* !特殊，根目录link数为2 */
 	}
-	return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 统计文件的属性：只读普通文件，大小为0，内容在open时生成（direct_io，读到EOF为止）
+ * 
+ * @param newfs_stat 返回状态
+ */
+void newfs_stats_attr(struct stat * newfs_stat) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	memset(newfs_stat, 0, sizeof(struct stat));
+	newfs_stat->st_mode = S_IFREG | 0444;
+	newfs_stat->st_nlink = 1;
+	newfs_stat->st_uid = getuid();
+	newfs_stat->st_gid = getgid();
+	newfs_stat->st_atim = now;
+	newfs_stat->st_mtim = now;
+	newfs_stat->st_ctim = now;
+	newfs_stat->st_blksize = SFS_IO_SZ();
+}
+
+/**
+ * @brief 打开统计文件：生成一份统计快照放在句柄里，之后的read都读这份快照
+ * 
+ * @return struct newfs_file* 
+ */
+struct newfs_file* newfs_stats_open() {
+	struct newfs_file *file = (struct newfs_file *)calloc(1, sizeof(struct newfs_file));
+
+	file->stats = (char *)malloc(SFS_STATS_DUMP_SZ);
+	file->stats_len = fs_stat_dump(file->stats, SFS_STATS_DUMP_SZ);
+	file->stats_len += fs_dump_map(file->stats + file->stats_len, SFS_STATS_DUMP_SZ - file->stats_len);
+	return file;
 }
 
 /**
@@ -161,26 +280,32 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
  * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
  * 
  * @param offset 第几个目录项？
- * @param fi 可忽略
+ * @param fi 文件信息，fi->fh为open保存的句柄
  * @return int 0成功，否则失败
  */
 int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    		 struct fuse_file_info * fi) {
+	SFS_STAT_SCOPE(SFS_OP_READDIR);
     /* TODO: 解析路径，获取目录的Inode，并读取目录项，利用filler填充到buf，可参考/fs/simplefs/sfs.c的sfs_readdir()函数实现 */
-	boolean is_find, is_root;
 	int cur_dir = offset;
 
-	struct newfs_dentry *dentry = fs_lookup(path, &is_find, &is_root);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
 	struct newfs_dentry *sub_dentry;
 	struct newfs_inode *inode;
-	if (is_find)
+	if (dentry != NULL)
 	{
 		inode = dentry->inode;
+		if (cur_dir % SFS_RA_MAX_BLKS == 0)		 /* 每批目录项开始时预取其inode */
+		{
+			fs_prefetch_dir(inode, cur_dir, SFS_RA_MAX_BLKS);
+		}
+		fs_lock_inode(inode);
 		sub_dentry = fs_get_dentry(inode, cur_dir);
 		if (sub_dentry)
 		{
 			filler(buf, sub_dentry->fname, NULL, ++offset);
 		}
+		fs_unlock_inode(inode);
 		return SFS_ERROR_NONE;
 	}
 	return -SFS_ERROR_NOTFOUND;
@@ -195,45 +320,39 @@ int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t o
  */
 int newfs_mknod(const char *path, mode_t mode, dev_t dev)
 {
+	SFS_STAT_SCOPE(SFS_OP_MKNOD);
 	/* TODO: 解析路径，并创建相应的文件 */
 	boolean is_find, is_root;
 
 	struct newfs_dentry *last_dentry = fs_lookup(path, &is_find, &is_root);
 	struct newfs_dentry *dentry;
-	struct newfs_inode *inode;
-	char *fname;
 
 	if (is_find == TRUE)
 	{
 		return -SFS_ERROR_EXISTS;
 	}
 
-	fname = fs_get_fname(path);
-
-	if (S_ISREG(mode))
-	{
-		dentry = new_dentry(fname, FS_FILE);
-	}
-	else if (S_ISDIR(mode))
-	{
-		dentry = new_dentry(fname, FS_DIR);
-	}
-	dentry->parent = last_dentry;
-	inode = fs_alloc_inode(dentry);
-	fs_alloc_dentry(last_dentry->inode, dentry);
-
-	return SFS_ERROR_NONE;
+	return fs_create_dentry(last_dentry, fs_get_fname(path), S_ISDIR(mode) ? FS_DIR : FS_FILE, &dentry);
 }
 
 /**
- * @brief 修改时间，为了不让touch报错 
+ * @brief 修改访问时间和修改时间，随inode写回磁盘
  * 
  * @param path 相对于挂载点的路径
- * @param tv 实践
+ * @param tv tv[0]为访问时间，tv[1]为修改时间，可为UTIME_NOW / UTIME_OMIT
  * @return int 0成功，否则失败
  */
 int newfs_utimens(const char* path, const struct timespec tv[2]) {
-	(void)path;
+	SFS_STAT_SCOPE(SFS_OP_SETATTR);
+	boolean is_find, is_root;
+	struct newfs_dentry *dentry = fs_lookup(path, &is_find, &is_root);
+
+	if (is_find == FALSE)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	fs_utimens(dentry->inode, tv);
 	return SFS_ERROR_NONE;
 }
 /******************************************************************************
@@ -246,13 +365,113 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
  * @param buf 写入的内容
  * @param size 写入的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi 文件信息，fi->fh为open保存的句柄
  * @return int 写入大小
  */
 int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-	/* 选做 */
-	return size;
+	SFS_STAT_SCOPE(SFS_OP_WRITE);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+	struct newfs_inode *inode;
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+
+	if (SFS_IS_DIR(inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	return fs_write_file(inode, (const uint8_t *)buf, size, offset);
+}
+
+/**
+ * @brief 以fuse_bufvec写入文件，逐块从buf拷进块缓存：buf为内存时没有额外的中间缓冲，
+ * 为管道（splice_read）时直接从管道读入块缓存
+ * 
+ * @param path 相对于挂载点的路径，可能为NULL
+ * @param buf 写入的内容
+ * @param offset 相对文件的偏移
+ * @param fi 文件信息，fi->fh为open保存的句柄
+ * @return int 写入大小
+ */
+int newfs_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset,
+					struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_WRITE);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	return newfs_write_bufvec(dentry->inode, buf, offset);
+}
+
+/**
+ * @brief 把bufvec中的数据写入文件，路径接口和low-level接口共用
+ * 
+ * @param inode 
+ * @param buf 写入的内容
+ * @param offset 相对文件的偏移
+ * @return int 写入大小，负数为错误码
+ */
+int newfs_write_bufvec(struct newfs_inode* inode, struct fuse_bufvec* buf, off_t offset) {
+	SFS_INODE_SCOPE(inode);						 /* fs_write_begin到fs_write_end之间持有inode锁 */
+	struct fuse_bufvec dst = FUSE_BUFVEC_INIT(0);
+	int size = fuse_buf_size(buf);
+	int done = 0, blk, bias, len, ret = SFS_ERROR_NONE;
+	ssize_t copied;
+
+	if (offset < 0)
+	{
+		return -SFS_ERROR_INVAL;
+	}
+	if (offset > SFS_MAX_FILE_SZ() || size > SFS_MAX_FILE_SZ() - offset)
+	{
+		return -SFS_ERROR_FBIG;
+	}
+	while (done < size)
+	{
+		blk  = SFS_BLK_IDX(offset + done);
+		bias = SFS_BLK_BIAS(offset + done);
+		len  = SFS_MIN(SFS_BLOCK_SZ() - bias, size - done);
+		ret  = fs_write_begin(inode, blk);
+		if (ret != SFS_ERROR_NONE)
+		{
+			break;
+		}
+		dst.buf[0].mem  = inode->data[blk] + bias;
+		dst.buf[0].size = len;
+		dst.idx = 0;
+		dst.off = 0;
+		copied = fuse_buf_copy(&dst, buf, 0);	 /* buf的游标随拷贝前进 */
+		if (copied <= 0)
+		{
+			ret = copied < 0 ? copied : -SFS_ERROR_IO;
+			break;
+		}
+		done += copied;
+		if (copied < len)
+		{
+			break;
+		}
+	}
+	if (done == 0 && size != 0)
+	{
+		return ret;
+	}
+	ret = fs_write_end(inode, offset, done);
+	return ret != SFS_ERROR_NONE ? ret : done;
 }
 
 /**
@@ -262,13 +481,46 @@ int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
  * @param buf 读取的内容
  * @param size 读取的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi 文件信息，fi->fh为open保存的句柄
  * @return int 读取大小
  */
 int newfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	/* 选做 */
-	return size;			   
+	SFS_STAT_SCOPE(SFS_OP_READ);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+	struct newfs_inode *inode;
+	struct newfs_file *file = fi != NULL ? SFS_FILE(fi) : NULL;
+	int ret;
+
+	if (file != NULL && file->stats != NULL)	 /* 统计文件：读open时的快照 */
+	{
+		if (offset >= file->stats_len)
+		{
+			return 0;
+		}
+		ret = SFS_MIN((int)size, file->stats_len - (int)offset);
+		memcpy(buf, file->stats + offset, ret);
+		return ret;
+	}
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+
+	if (SFS_IS_DIR(inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	if (file != NULL)							 /* 顺序读时连同后续窗口一起读入 */
+	{
+		fs_file_readahead(file, offset, size);
+	}
+	ret = fs_read_file(inode, (uint8_t *)buf, size, offset);
+	return ret;
 }
 
 /**
@@ -312,28 +564,174 @@ int newfs_rename(const char* from, const char* to) {
 }
 
 /**
- * @brief 打开文件，可以在这里维护fi的信息，例如，fi->fh可以理解为一个64位指针，可以把自己想保存的数据结构
- * 保存在fh中
+ * @brief 打开文件：只在这里解析一次路径，把句柄（struct newfs_file）保存在fi->fh中，
+ * 之后的read/write/fgetattr/ftruncate/flush/release都直接使用句柄
  * 
  * @param path 相对于挂载点的路径
  * @param fi 文件信息
  * @return int 0成功，否则失败
  */
 int newfs_open(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+	SFS_STAT_SCOPE(SFS_OP_OPEN);
+	boolean is_find, is_root;
+	struct newfs_dentry *dentry;
+	struct newfs_file *file;
+
+	if (NEWFS_IS_STATS(path))
+	{
+		if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		{
+			return -SFS_ERROR_ACCESS;
+		}
+		fi->direct_io = 1;						 /* 大小报告为0，不能经过页缓存 */
+		fi->fh = (uint64_t)(uintptr_t)newfs_stats_open();
+		return SFS_ERROR_NONE;
+	}
+	dentry = fs_lookup(path, &is_find, &is_root);
+	if (is_find == FALSE)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	file = (struct newfs_file *)calloc(1, sizeof(struct newfs_file));
+	file->dentry = dentry;
+	file->inode = dentry->inode;
+	__sync_fetch_and_add(&file->inode->open_cnt, 1);
+	fi->fh = (uint64_t)(uintptr_t)file;
+	return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 创建并打开文件
+ * 
+ * @param path 相对于挂载点的路径
+ * @param mode 创建文件的模式
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_create(const char* path, mode_t mode, struct fuse_file_info* fi) {
+	int ret = newfs_mknod(path, mode, 0);
+
+	if (ret != SFS_ERROR_NONE)
+	{
+		return ret;
+	}
+	return newfs_open(path, fi);
+}
+
+/**
+ * @brief 按句柄获取文件属性
+ * 
+ * @param path 相对于挂载点的路径，可能为NULL
+ * @param newfs_stat 返回状态
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_fgetattr(const char* path, struct stat * newfs_stat, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_GETATTR);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+
+	if (fi != NULL && fi->fh != 0 && SFS_FILE(fi)->stats != NULL)
+	{
+		newfs_stats_attr(newfs_stat);
+		return SFS_ERROR_NONE;
+	}
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	newfs_fill_stat(dentry, newfs_stat);
+	return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 关闭文件描述符时调用，延迟分配的数据仍留到fsync、回写阈值或卸载时落盘
+ * 
+ * @param path 相对于挂载点的路径，可能为NULL
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_flush(const char* path, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_RELEASE);
+	if (fi != NULL && SFS_FILE(fi) != NULL && SFS_FILE(fi)->stats != NULL)
+	{
+		return SFS_ERROR_NONE;					 /* 统计文件没有dentry，也没有要写回的数据 */
+	}
+	if (newfs_resolve(path, fi) == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+	return SFS_ERROR_NONE;
 }
 
 /**
- * @brief 打开目录文件
+ * @brief 关闭文件或目录，释放句柄；文件的最后一个句柄关闭时归还预留窗口中未使用的数据块
+ * 
+ * @param path 相对于挂载点的路径，可能为NULL
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_release(const char* path, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_RELEASE);
+	struct newfs_file *file = SFS_FILE(fi);
+
+	if (file == NULL)
+	{
+		return SFS_ERROR_NONE;
+	}
+
+	if (file->stats != NULL)
+	{
+		free(file->stats);
+	}
+	else if (__sync_sub_and_fetch(&file->inode->open_cnt, 1) == 0 && SFS_IS_FILE(file->inode))
+	{
+		fs_release_prealloc(file->inode);
+	}
+	free(file);
+	fi->fh = 0;
+	return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 同步文件：为延迟分配的块分配数据块，并把数据和索引节点写回磁盘
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 非零时只需回写数据（这里仍一并写回索引节点）
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_FSYNC);
+	struct newfs_dentry *dentry;
+
+	if (fi != NULL && SFS_FILE(fi) != NULL && SFS_FILE(fi)->stats != NULL)
+	{
+		return SFS_ERROR_NONE;					 /* 统计文件只读，同newfs_flush */
+	}
+	dentry = newfs_resolve(path, fi);
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	if (!SFS_IS_FILE(dentry->inode))
+	{
+		return SFS_ERROR_NONE;
+	}
+	return fs_sync_inode(dentry->inode);
+}
+
+/**
+ * @brief 打开目录文件，与文件一样保存句柄，readdir不再查路径
  * 
  * @param path 相对于挂载点的路径
  * @param fi 文件信息
  * @return int 0成功，否则失败
  */
 int newfs_opendir(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+	return newfs_open(path, fi);
 }
 
 /**
@@ -344,10 +742,140 @@ int newfs_opendir(const char* path, struct fuse_file_info* fi) {
  * @return int 0成功，否则失败
  */
 int newfs_truncate(const char* path, off_t offset) {
-	/* 选做 */
-	return 0;
+	SFS_STAT_SCOPE(SFS_OP_SETATTR);
+	boolean is_find, is_root;
+	struct newfs_dentry *dentry = fs_lookup(path, &is_find, &is_root);
+	struct newfs_inode *inode;
+
+	if (is_find == FALSE)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+
+	if (SFS_IS_DIR(inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	return fs_truncate_file(inode, offset);
+}
+
+/**
+ * @brief 按句柄改变文件大小
+ * 
+ * @param path 相对于挂载点的路径，可能为NULL
+ * @param offset 改变后文件大小
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_ftruncate(const char* path, off_t offset, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_SETATTR);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	return fs_truncate_file(dentry->inode, offset);
+}
+
+/**
+ * @brief 预分配或打洞
+ * 
+ * 支持mode = 0、FALLOC_FL_KEEP_SIZE，以及FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE，
+ * 打洞释放的数据块通过fs_free_data归还
+ * 
+ * @param path 相对于挂载点的路径
+ * @param mode FALLOC_FL_*
+ * @param offset 起始偏移
+ * @param length 长度
+ * @param fi 文件信息，fi->fh为open保存的句柄
+ * @return int 0成功，否则失败
+ */
+int newfs_fallocate(const char* path, int mode, off_t offset, off_t length,
+					struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_FALLOCATE);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+	struct newfs_inode *inode;
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+
+	if (SFS_IS_DIR(inode))
+	{
+		return -SFS_ERROR_ISDIR;
+	}
+
+	if (mode & FALLOC_FL_PUNCH_HOLE)
+	{
+		if (!(mode & FALLOC_FL_KEEP_SIZE))
+		{
+			return -SFS_ERROR_NOTSUP;
+		}
+		return fs_punch_hole(inode, offset, length);
+	}
+
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+	{
+		return -SFS_ERROR_NOTSUP;
+	}
+	return fs_fallocate(inode, offset, length, mode & FALLOC_FL_KEEP_SIZE);
 }
 
+/**
+ * @brief ioctl，FUSE 2.x没有lseek回调，SEEK_DATA / SEEK_HOLE通过SFS_IOC_SEEK_*提供
+ * 
+ * @param path 相对于挂载点的路径
+ * @param cmd SFS_IOC_SEEK_DATA或SFS_IOC_SEEK_HOLE
+ * @param arg 可忽略
+ * @param fi 文件信息，fi->fh为open保存的句柄
+ * @param flags 可忽略
+ * @param data 输入起始偏移，输出找到的偏移（off_t）
+ * @return int 0成功，否则失败
+ */
+int newfs_ioctl(const char* path, int cmd, void* arg, struct fuse_file_info* fi,
+				unsigned int flags, void* data) {
+	SFS_STAT_SCOPE(SFS_OP_IOCTL);
+	struct newfs_dentry *dentry = newfs_resolve(path, fi);
+	off_t *offset = (off_t *)data;
+	int ret;
+
+	if (dentry == NULL)
+	{
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	switch ((unsigned int)cmd)
+	{
+	case SFS_IOC_SEEK_DATA:
+		ret = fs_seek_hole_data(dentry->inode, *offset, SEEK_DATA);
+		break;
+	case SFS_IOC_SEEK_HOLE:
+		ret = fs_seek_hole_data(dentry->inode, *offset, SEEK_HOLE);
+		break;
+	default:
+		return -ENOTTY;
+	}
+
+	if (ret < 0)
+	{
+		return ret;
+	}
+	*offset = ret;
+	return SFS_ERROR_NONE;
+}
 
 /**
  * @brief 访问文件，因为读写文件时需要查看权限
@@ -368,17 +896,51 @@ int newfs_access(const char* path, int type) {
 /******************************************************************************
 * SECTION: FUSE入口
 *******************************************************************************/
+/**
+ * @brief 缓存选项已被option_spec取走，路径接口由libfuse实现这些选项，需要原样交还；
+ * low-level接口在newfs_ll.c中自行使用newfs_options
+ * 
+ * @param args 命令行参数
+ */
+static void newfs_cache_args(struct fuse_args* args) {
+	char opt[128];
+
+	snprintf(opt, sizeof(opt), "-oentry_timeout=%g,attr_timeout=%g,negative_timeout=%g",
+			 newfs_options.entry_timeout, newfs_options.attr_timeout,
+			 newfs_options.negative_timeout);
+	fuse_opt_add_arg(args, opt);
+	if (newfs_options.kernel_cache)
+		fuse_opt_add_arg(args, "-okernel_cache");
+	if (newfs_options.auto_cache)
+		fuse_opt_add_arg(args, "-oauto_cache");
+}
+
 int main(int argc, char **argv)
 {
     int ret;
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	newfs_options.device = strdup("/home/students/200110526/ddriver");
+	newfs_options.entry_timeout = 1.0;				 /* 与libfuse的默认值一致 */
+	newfs_options.attr_timeout = 1.0;
+	newfs_options.negative_timeout = 0.0;
 
 	if (fuse_opt_parse(&args, &newfs_options, option_spec, NULL) == -1)
 		return -1;
+#ifndef FUSE_CAP_WRITEBACK_CACHE
+	if (newfs_options.writeback_cache)				 /* FUSE 2.x没有回写缓存，写入仍直达，读取保留页缓存 */
+	{
+		SFS_WARN("writeback_cache needs libfuse 3, falling back to kernel_cache\n");
+		newfs_options.kernel_cache = 1;
+	}
+#endif
+	if (!newfs_options.lowlevel)
+		newfs_cache_args(&args);
 	
-	ret = fuse_main(args.argc, args.argv, &operations, NULL);
+	if (newfs_options.lowlevel)
+		ret = newfs_ll_main(&args);
+	else
+		ret = fuse_main(args.argc, args.argv, &operations, NULL);
 	fuse_opt_free_args(&args);
 	return ret;
 }
\ No newline at end of file
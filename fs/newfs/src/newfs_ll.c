@@ -0,0 +1,719 @@
+#include "../include/newfs.h"
+#include "fuse_lowlevel.h"
+/******************************************************************************
+* SECTION: 宏定义
+*******************************************************************************/
+#define NEWFS_LL_INO(ino)       ((fuse_ino_t)(ino) + 1)   /* 根目录ino为0，FUSE_ROOT_ID为1 */
+#define NEWFS_LL_NODE(lino)     (&newfs_ll_nodes[(lino) - 1])
+#define NEWFS_LL_STATS_INO      ((fuse_ino_t)newfs_super.max_ino + 1)   /* 统计文件，不占用真实的inode号 */
+/******************************************************************************
+* SECTION: 全局变量
+*******************************************************************************/
+extern struct custom_options newfs_options;
+extern struct newfs_super newfs_super;
+
+static struct newfs_ll_node* newfs_ll_nodes;      /* ino -> 内存中的dentry / inode */
+static pthread_mutex_t       newfs_ll_nodes_lock = PTHREAD_MUTEX_INITIALIZER;  /* 登记与forget互斥，lookup计数不丢失 */
+static struct fuse_session*  newfs_ll_session;
+/******************************************************************************
+* SECTION: 辅助函数
+*******************************************************************************/
+/**
+ * @brief 由内核给出的inode号取得dentry，并保证其inode已读入内存
+ *
+ * @param lino FUSE inode号
+ * @return struct newfs_dentry* 内核未持有该inode号时为NULL
+ */
+static struct newfs_dentry* newfs_ll_dentry(fuse_ino_t lino) {
+	struct newfs_dentry* dentry;
+
+	if (lino < FUSE_ROOT_ID || lino > (fuse_ino_t)newfs_super.max_ino)
+	{
+		return NULL;
+	}
+	dentry = __atomic_load_n(&NEWFS_LL_NODE(lino)->dentry, __ATOMIC_ACQUIRE);
+	if (dentry != NULL)
+	{
+		fs_dentry_inode(dentry);
+	}
+	return dentry;
+}
+
+/**
+ * @brief 在父目录中查找一个目录项（只比较本级文件名，不解析路径）
+ *
+ * @param parent 父目录dentry
+ * @param name 文件名
+ * @return struct newfs_dentry*
+ */
+static struct newfs_dentry* newfs_ll_find(struct newfs_dentry* parent, const char* name) {
+	struct newfs_dentry* dentry;
+
+	fs_lock_inode(parent->inode);
+	dentry = fs_find_dentry(parent->inode, name);
+	fs_unlock_inode(parent->inode);
+	if (dentry != NULL)
+	{
+		fs_dentry_inode(dentry);
+	}
+	return dentry;
+}
+
+/**
+ * @brief 把dentry登记到inode号表，lookup计数加一，并回复entry
+ *
+ * @param req
+ * @param dentry
+ */
+static void newfs_ll_reply_entry(fuse_req_t req, struct newfs_dentry* dentry) {
+	struct fuse_entry_param e;
+	struct newfs_ll_node*   node = NEWFS_LL_NODE(NEWFS_LL_INO(dentry->ino));
+
+	pthread_mutex_lock(&newfs_ll_nodes_lock);
+	__atomic_store_n(&node->dentry, dentry, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&node->nlookup, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&newfs_ll_nodes_lock);
+
+	memset(&e, 0, sizeof(e));
+	e.ino = NEWFS_LL_INO(dentry->ino);
+	e.attr_timeout = newfs_options.attr_timeout;
+	e.entry_timeout = newfs_options.entry_timeout;
+	newfs_fill_stat(dentry, &e.attr);
+	e.attr.st_ino = e.ino;
+	fuse_reply_entry(req, &e);
+}
+
+/**
+ * @brief 在父目录下新建文件或目录
+ *
+ * @param req
+ * @param parent 父目录inode号
+ * @param name 文件名
+ * @param ftype
+ */
+static void newfs_ll_make(fuse_req_t req, fuse_ino_t parent, const char* name, FILE_TYPE ftype) {
+	struct newfs_dentry *last_dentry = newfs_ll_dentry(parent);
+	struct newfs_dentry *dentry;
+	int ret;
+
+	if (last_dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_FILE(last_dentry->inode))
+	{
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+	ret = fs_create_dentry(last_dentry, name, ftype, &dentry);
+	if (ret != SFS_ERROR_NONE)
+	{
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	newfs_ll_reply_entry(req, dentry);
+}
+/******************************************************************************
+* SECTION: low-level操作实现
+*******************************************************************************/
+/**
+ * @brief 挂载文件系统，建立inode号表，根目录始终在表中
+ *
+ * @param userdata 可忽略
+ * @param conn 连接信息，用于申请writeback_cache
+ */
+static void newfs_ll_init(void* userdata, struct fuse_conn_info* conn) {
+	if (fs_mount(newfs_options) != SFS_ERROR_NONE)
+	{
+		SFS_ERR("[%s] mount error\n", __func__);
+		fuse_session_exit(newfs_ll_session);
+		return;
+	}
+	newfs_ll_nodes = (struct newfs_ll_node *)calloc(newfs_super.max_ino, sizeof(struct newfs_ll_node));
+	NEWFS_LL_NODE(FUSE_ROOT_ID)->dentry = newfs_super.root_dentry;
+	NEWFS_LL_NODE(FUSE_ROOT_ID)->nlookup = 1;
+	newfs_init_conn(conn);
+}
+
+/**
+ * @brief 卸载文件系统
+ *
+ * @param userdata 可忽略
+ */
+static void newfs_ll_destroy(void* userdata) {
+	if (fs_umount() != SFS_ERROR_NONE)
+	{
+		SFS_ERR("[%s] unmount error\n", __func__);
+	}
+	free(newfs_ll_nodes);
+	newfs_ll_nodes = NULL;
+}
+
+/**
+ * @brief 在父目录中查找name，只需扫描父目录的目录项；
+ * 找不到且设置了negative_timeout时回复ino为0的entry，让内核缓存“不存在”
+ *
+ * @param req
+ * @param parent 父目录inode号
+ * @param name 文件名
+ */
+static void newfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+	SFS_STAT_SCOPE(SFS_OP_LOOKUP);
+	struct newfs_dentry *last_dentry = newfs_ll_dentry(parent);
+	struct newfs_dentry *dentry;
+	struct fuse_entry_param e;
+
+	if (last_dentry == NULL || SFS_IS_FILE(last_dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (parent == FUSE_ROOT_ID && strcmp(name, SFS_STATS_NAME) == 0)
+	{
+		memset(&e, 0, sizeof(e));
+		e.ino = NEWFS_LL_STATS_INO;
+		e.entry_timeout = newfs_options.entry_timeout;
+		newfs_stats_attr(&e.attr);
+		e.attr.st_ino = e.ino;
+		fuse_reply_entry(req, &e);
+		return;
+	}
+	dentry = newfs_ll_find(last_dentry, name);
+	if (dentry == NULL && newfs_options.negative_timeout > 0)
+	{
+		memset(&e, 0, sizeof(e));
+		e.entry_timeout = newfs_options.negative_timeout;
+		fuse_reply_entry(req, &e);
+		return;
+	}
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	newfs_ll_reply_entry(req, dentry);
+}
+
+/**
+ * @brief 内核释放nlookup次lookup，计数减到0时把inode号移出表
+ *
+ * @param req
+ * @param ino
+ * @param nlookup
+ */
+static void newfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+	SFS_STAT_SCOPE(SFS_OP_FORGET);
+	struct newfs_ll_node* node;
+	uint64_t cnt;
+
+	if (ino > FUSE_ROOT_ID && ino <= (fuse_ino_t)newfs_super.max_ino)
+	{
+		node = NEWFS_LL_NODE(ino);
+		pthread_mutex_lock(&newfs_ll_nodes_lock);
+		cnt = __atomic_load_n(&node->nlookup, __ATOMIC_RELAXED);
+		cnt = cnt > nlookup ? cnt - nlookup : 0;
+		__atomic_store_n(&node->nlookup, cnt, __ATOMIC_RELAXED);
+		if (cnt == 0)
+		{
+			__atomic_store_n(&node->dentry, NULL, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&newfs_ll_nodes_lock);
+	}
+	fuse_reply_none(req);
+}
+
+/**
+ * @brief 获取文件或目录的属性
+ *
+ * @param req
+ * @param ino
+ * @param fi 可忽略
+ */
+static void newfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_GETATTR);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	struct stat newfs_stat;
+
+	if (ino == NEWFS_LL_STATS_INO)
+	{
+		newfs_stats_attr(&newfs_stat);
+		newfs_stat.st_ino = ino;
+		fuse_reply_attr(req, &newfs_stat, 0);
+		return;
+	}
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	memset(&newfs_stat, 0, sizeof(newfs_stat));
+	newfs_fill_stat(dentry, &newfs_stat);
+	newfs_stat.st_ino = ino;
+	fuse_reply_attr(req, &newfs_stat, newfs_options.attr_timeout);
+}
+
+/**
+ * @brief 修改属性，支持改变文件大小和访问/修改时间，其余属性忽略
+ *
+ * @param req
+ * @param ino
+ * @param attr
+ * @param to_set FUSE_SET_ATTR_*
+ * @param fi 可忽略
+ */
+static void newfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat* attr, int to_set,
+							 struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_SETATTR);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	struct timespec tv[2];
+	int ret;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (to_set & FUSE_SET_ATTR_SIZE)
+	{
+		if (SFS_IS_DIR(dentry->inode))
+		{
+			fuse_reply_err(req, SFS_ERROR_ISDIR);
+			return;
+		}
+		ret = fs_truncate_file(dentry->inode, attr->st_size);
+		if (ret < 0)
+		{
+			fuse_reply_err(req, -ret);
+			return;
+		}
+	}
+	if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))
+	{
+		tv[0].tv_nsec = UTIME_OMIT;
+		tv[1].tv_nsec = UTIME_OMIT;
+		if (to_set & FUSE_SET_ATTR_ATIME)
+		{
+			tv[0] = attr->st_atim;
+			if (to_set & FUSE_SET_ATTR_ATIME_NOW)
+				tv[0].tv_nsec = UTIME_NOW;
+		}
+		if (to_set & FUSE_SET_ATTR_MTIME)
+		{
+			tv[1] = attr->st_mtim;
+			if (to_set & FUSE_SET_ATTR_MTIME_NOW)
+				tv[1].tv_nsec = UTIME_NOW;
+		}
+		fs_utimens(dentry->inode, tv);
+	}
+	newfs_ll_getattr(req, ino, fi);
+}
+
+/**
+ * @brief 创建文件
+ */
+static void newfs_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char* name,
+						   mode_t mode, dev_t rdev) {
+	SFS_STAT_SCOPE(SFS_OP_MKNOD);
+	newfs_ll_make(req, parent, name, S_ISDIR(mode) ? FS_DIR : FS_FILE);
+}
+
+/**
+ * @brief 创建目录
+ */
+static void newfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode) {
+	SFS_STAT_SCOPE(SFS_OP_MKDIR);
+	newfs_ll_make(req, parent, name, FS_DIR);
+}
+
+/**
+ * @brief 打开文件，句柄保存在fi->fh中记录顺序读状态；kernel_cache / auto_cache时保留内核页缓存。
+ * 文件只能经由本挂载点修改，且修改时内核会自己失效对应页，因此auto_cache等同kernel_cache
+ */
+static void newfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_OPEN);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	struct newfs_file *file;
+
+	if (ino == NEWFS_LL_STATS_INO)				 /* 统计文件：open时生成快照 */
+	{
+		if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		{
+			fuse_reply_err(req, SFS_ERROR_ACCESS);
+			return;
+		}
+		file = newfs_stats_open();
+		fi->fh = (uint64_t)(uintptr_t)file;
+		fi->direct_io = 1;
+		if (fuse_reply_open(req, fi) == -ENOENT)
+		{
+			free(file->stats);
+			free(file);
+		}
+		return;
+	}
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_ISDIR);
+		return;
+	}
+	file = (struct newfs_file *)calloc(1, sizeof(struct newfs_file));
+	file->dentry = dentry;
+	file->inode = dentry->inode;
+	__sync_fetch_and_add(&file->inode->open_cnt, 1);
+	fi->fh = (uint64_t)(uintptr_t)file;
+	fi->keep_cache = newfs_options.kernel_cache || newfs_options.auto_cache;
+	if (fuse_reply_open(req, fi) == -ENOENT)	 /* open被中断，内核不会再release */
+	{
+		__sync_fetch_and_sub(&file->inode->open_cnt, 1);
+		free(file);
+	}
+}
+
+/**
+ * @brief 读取文件，直接以块缓存（空洞为全零块）组成bufvec回复，不拷贝到中间缓冲
+ *
+ * 从fs_read_iov到fuse_reply_data返回一直持有inode锁，期间并发的写、打洞、截断
+ * 不能改写或释放bufvec指向的块缓存；fuse_reply_data返回时数据已写入/dev/fuse
+ */
+static void newfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+						  struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_READ);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	struct iovec iov[SFS_MAX_DATA_PER_FILE];
+	struct fuse_bufvec *bufv;
+	struct newfs_file *file = fi != NULL ? SFS_FILE(fi) : NULL;
+	int cnt, i;
+
+	if (file != NULL && file->stats != NULL)
+	{
+		off = SFS_MIN(off, file->stats_len);
+		fuse_reply_buf(req, file->stats + off, SFS_MIN((off_t)size, file->stats_len - off));
+		return;
+	}
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_ISDIR);
+		return;
+	}
+	fs_lock_inode(dentry->inode);
+	if (file != NULL)							 /* 顺序读时连同后续窗口一起读入 */
+	{
+		fs_file_readahead(file, off, size);
+	}
+	cnt = fs_read_iov(dentry->inode, off, size, iov, SFS_MAX_DATA_PER_FILE);
+	if (cnt < 0)
+	{
+		fs_unlock_inode(dentry->inode);
+		fuse_reply_err(req, -cnt);
+		return;
+	}
+	bufv = (struct fuse_bufvec *)calloc(1, sizeof(struct fuse_bufvec) + 
+										SFS_MAX(cnt - 1, 0) * sizeof(struct fuse_buf));
+	bufv->count = cnt;
+	for (i = 0; i < cnt; i++)
+	{
+		bufv->buf[i].mem  = iov[i].iov_base;
+		bufv->buf[i].size = iov[i].iov_len;
+	}
+	fuse_reply_data(req, bufv, 0);				 /* 块缓存仍在使用，不能移交页面 */
+	fs_unlock_inode(dentry->inode);
+	free(bufv);
+}
+
+/**
+ * @brief 写入文件
+ */
+static void newfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char* buf, size_t size,
+						   off_t off, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_WRITE);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	int ret;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_ISDIR);
+		return;
+	}
+	ret = fs_write_file(dentry->inode, (const uint8_t *)buf, size, off);
+	if (ret < 0)
+	{
+		fuse_reply_err(req, -ret);
+	}
+	else
+	{
+		fuse_reply_write(req, ret);
+	}
+}
+
+/**
+ * @brief 以fuse_bufvec写入文件，数据从FUSE缓冲直接拷进块缓存
+ */
+static void newfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec* bufv,
+							   off_t off, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_WRITE);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	int ret;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_ISDIR);
+		return;
+	}
+	ret = newfs_write_bufvec(dentry->inode, bufv, off);
+	if (ret < 0)
+	{
+		fuse_reply_err(req, -ret);
+	}
+	else
+	{
+		fuse_reply_write(req, ret);
+	}
+}
+
+/**
+ * @brief 关闭文件，最后一个句柄关闭时归还预留块
+ */
+static void newfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_RELEASE);
+	struct newfs_file *file = fi != NULL ? SFS_FILE(fi) : NULL;
+
+	if (file != NULL && file->stats != NULL)
+	{
+		free(file->stats);
+		free(file);
+	}
+	else if (file != NULL)
+	{
+		if (__sync_sub_and_fetch(&file->inode->open_cnt, 1) == 0)
+		{
+			fs_release_prealloc(file->inode);
+		}
+		free(file);
+	}
+	fuse_reply_err(req, SFS_ERROR_NONE);
+}
+
+/**
+ * @brief 回写文件
+ */
+static void newfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+						   struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_FSYNC);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+
+	if (fi != NULL && SFS_FILE(fi) != NULL && SFS_FILE(fi)->stats != NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NONE);	 /* 统计文件没有dentry，也没有要写回的数据 */
+		return;
+	}
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	fuse_reply_err(req, SFS_IS_FILE(dentry->inode) ? -fs_sync_inode(dentry->inode) : SFS_ERROR_NONE);
+}
+
+/**
+ * @brief 遍历目录项，从第off个目录项开始尽量填满size字节
+ */
+static void newfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+							 struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_READDIR);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	struct newfs_dentry *sub_dentry;
+	struct stat newfs_stat;
+	char *buf;
+	size_t pos = 0, len;
+	off_t start = off;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_FILE(dentry->inode))
+	{
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+
+	buf = (char *)malloc(size);
+	memset(&newfs_stat, 0, sizeof(newfs_stat));
+	fs_lock_inode(dentry->inode);
+	for (sub_dentry = fs_get_dentry(dentry->inode, off); sub_dentry != NULL;
+		 sub_dentry = sub_dentry->brother)
+	{
+		newfs_stat.st_ino  = NEWFS_LL_INO(sub_dentry->ino);
+		newfs_stat.st_mode = sub_dentry->ftype == FS_DIR ? S_IFDIR : S_IFREG;
+		len = fuse_add_direntry(req, buf + pos, size - pos, sub_dentry->fname, &newfs_stat, ++off);
+		if (len > size - pos)
+		{
+			break;
+		}
+		pos += len;
+	}
+	fs_unlock_inode(dentry->inode);
+	fuse_reply_buf(req, buf, pos);
+	free(buf);
+	fs_prefetch_dir(dentry->inode, start, off - start);	 /* 内核随后会逐个lookup这批目录项 */
+}
+
+/**
+ * @brief 预分配或打洞，mode的含义同newfs_fallocate
+ */
+static void newfs_ll_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset,
+							   off_t length, struct fuse_file_info* fi) {
+	SFS_STAT_SCOPE(SFS_OP_FALLOCATE);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	int ret;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (SFS_IS_DIR(dentry->inode))
+	{
+		fuse_reply_err(req, SFS_ERROR_ISDIR);
+		return;
+	}
+
+	if (mode & FALLOC_FL_PUNCH_HOLE)
+	{
+		ret = (mode & FALLOC_FL_KEEP_SIZE) ? fs_punch_hole(dentry->inode, offset, length)
+										   : -SFS_ERROR_NOTSUP;
+	}
+	else if (mode & ~FALLOC_FL_KEEP_SIZE)
+	{
+		ret = -SFS_ERROR_NOTSUP;
+	}
+	else
+	{
+		ret = fs_fallocate(dentry->inode, offset, length, mode & FALLOC_FL_KEEP_SIZE);
+	}
+	fuse_reply_err(req, -ret);
+}
+
+/**
+ * @brief ioctl，SFS_IOC_SEEK_DATA / SFS_IOC_SEEK_HOLE，输入输出均为off_t
+ */
+static void newfs_ll_ioctl(fuse_req_t req, fuse_ino_t ino, int cmd, void* arg,
+						   struct fuse_file_info* fi, unsigned flags, const void* in_buf,
+						   size_t in_bufsz, size_t out_bufsz) {
+	SFS_STAT_SCOPE(SFS_OP_IOCTL);
+	struct newfs_dentry *dentry = newfs_ll_dentry(ino);
+	off_t offset;
+	int ret;
+
+	if (dentry == NULL)
+	{
+		fuse_reply_err(req, SFS_ERROR_NOTFOUND);
+		return;
+	}
+	if (((unsigned int)cmd != SFS_IOC_SEEK_DATA && (unsigned int)cmd != SFS_IOC_SEEK_HOLE))
+	{
+		fuse_reply_err(req, ENOTTY);
+		return;
+	}
+	if (in_bufsz < sizeof(off_t) || out_bufsz < sizeof(off_t))
+	{
+		fuse_reply_err(req, SFS_ERROR_INVAL);
+		return;
+	}
+
+	memcpy(&offset, in_buf, sizeof(off_t));
+	ret = fs_seek_hole_data(dentry->inode, offset,
+							(unsigned int)cmd == SFS_IOC_SEEK_DATA ? SEEK_DATA : SEEK_HOLE);
+	if (ret < 0)
+	{
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	offset = ret;
+	fuse_reply_ioctl(req, 0, &offset, sizeof(off_t));
+}
+/******************************************************************************
+* SECTION: FUSE low-level操作定义
+*******************************************************************************/
+static struct fuse_lowlevel_ops ll_operations = {
+	.init = newfs_ll_init,					 /* mount文件系统 */
+	.destroy = newfs_ll_destroy,			 /* umount文件系统 */
+	.lookup = newfs_ll_lookup,				 /* 父目录inode号 + 文件名 -> inode号 */
+	.forget = newfs_ll_forget,				 /* 内核释放inode号 */
+	.getattr = newfs_ll_getattr,			 /* 获取文件属性 */
+	.setattr = newfs_ll_setattr,			 /* truncate等 */
+	.mknod = newfs_ll_mknod,				 /* 创建文件 */
+	.mkdir = newfs_ll_mkdir,				 /* 建目录 */
+	.open = newfs_ll_open,					 /* 打开文件，决定是否保留页缓存 */
+	.read = newfs_ll_read,					 /* 读文件 */
+	.write = newfs_ll_write,				 /* 写入文件 */
+	.write_buf = newfs_ll_write_buf,		 /* 写入文件，数据直接拷进块缓存 */
+	.release = newfs_ll_release,			 /* 关闭文件，归还预留块 */
+	.fsync = newfs_ll_fsync,				 /* 回写文件 */
+	.readdir = newfs_ll_readdir,			 /* 填充dentry */
+	.ioctl = newfs_ll_ioctl,				 /* SEEK_DATA / SEEK_HOLE */
+	.fallocate = newfs_ll_fallocate,		 /* 预分配 / 打洞 */
+};
+/******************************************************************************
+* SECTION: low-level入口
+*******************************************************************************/
+/**
+ * @brief 以low-level接口挂载并运行FUSE会话
+ *
+ * @param args 已去掉newfs自定义参数的命令行
+ * @return int 0成功，否则失败
+ */
+int newfs_ll_main(struct fuse_args* args) {
+	struct fuse_chan *ch;
+	char *mountpoint;
+	int multithreaded, foreground;
+	int err = -1;
+
+	if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) == -1)
+	{
+		return 1;
+	}
+
+	ch = fuse_mount(mountpoint, args);
+	if (ch != NULL)
+	{
+		newfs_ll_session = fuse_lowlevel_new(args, &ll_operations, sizeof(ll_operations), NULL);
+		if (newfs_ll_session != NULL)
+		{
+			if (fuse_set_signal_handlers(newfs_ll_session) != -1 && fuse_daemonize(foreground) != -1)
+			{
+				fuse_session_add_chan(newfs_ll_session, ch);
+				err = multithreaded ? fuse_session_loop_mt(newfs_ll_session)
+									: fuse_session_loop(newfs_ll_session);
+				fuse_remove_signal_handlers(newfs_ll_session);
+				fuse_session_remove_chan(ch);
+			}
+			fuse_session_destroy(newfs_ll_session);
+		}
+		fuse_unmount(mountpoint, ch);
+	}
+	free(mountpoint);
+	return err ? 1 : 0;
+}
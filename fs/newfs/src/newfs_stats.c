@@ -0,0 +1,218 @@
+#include "../include/newfs_core.h"
+extern struct newfs_super newfs_super;
+
+struct newfs_stats newfs_stats;                 /* 各操作/阶段的延迟直方图和计数器 */
+
+static const char* fs_stat_hist_names[SFS_STAT_HISTS] = {
+    [SFS_OP_LOOKUP]         = "lookup",
+    [SFS_OP_FORGET]         = "forget",
+    [SFS_OP_GETATTR]        = "getattr",
+    [SFS_OP_SETATTR]        = "setattr",
+    [SFS_OP_READDIR]        = "readdir",
+    [SFS_OP_MKDIR]          = "mkdir",
+    [SFS_OP_MKNOD]          = "mknod",
+    [SFS_OP_OPEN]           = "open",
+    [SFS_OP_RELEASE]        = "release",
+    [SFS_OP_READ]           = "read",
+    [SFS_OP_WRITE]          = "write",
+    [SFS_OP_FSYNC]          = "fsync",
+    [SFS_OP_FALLOCATE]      = "fallocate",
+    [SFS_OP_IOCTL]          = "ioctl",
+    [SFS_STAGE_LOOKUP]      = "stage.lookup",
+    [SFS_STAGE_READ_INODE]  = "stage.read_inode",
+    [SFS_STAGE_ALLOC_INODE] = "stage.alloc_inode",
+    [SFS_STAGE_ALLOC_DATA]  = "stage.alloc_data",
+    [SFS_STAGE_WRITEBACK]   = "stage.writeback",
+    [SFS_STAGE_DRIVER_READ] = "stage.driver_read",
+    [SFS_STAGE_DRIVER_WRITE]= "stage.driver_write",
+};
+
+static const char* fs_stat_cnt_names[SFS_STAT_CNTS] = {
+    [SFS_CNT_BLOCK_HIT]       = "block_cache_hit",
+    [SFS_CNT_BLOCK_MISS]      = "block_cache_miss",
+    [SFS_CNT_INODE_HIT]       = "inode_cache_hit",
+    [SFS_CNT_INODE_MISS]      = "inode_cache_miss",
+    [SFS_CNT_DRIVER_RD_BYTES] = "driver_read_bytes",
+    [SFS_CNT_DRIVER_WR_BYTES] = "driver_write_bytes",
+};
+
+static const char* fs_stat_region_names[DDRIVER_REGION_TYPES] = {
+    [DDRIVER_REGION_OTHER]  = "other",
+    [DDRIVER_REGION_SUPER]  = "super",
+    [DDRIVER_REGION_BITMAP] = "bitmap",
+    [DDRIVER_REGION_INODE]  = "inode",
+    [DDRIVER_REGION_DATA]   = "data",
+};
+
+/**
+ * @brief 单调时钟，单位ns
+ *
+ * @return uint64_t
+ */
+uint64_t fs_stat_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/**
+ * @brief 取值对应的桶：小于2^SFS_HIST_SUB_BITS的值各占一个桶，
+ * 之后每个2的幂区间[2^k, 2^(k+1))等分为2^SFS_HIST_SUB_BITS个桶
+ *
+ * @param value
+ * @return int
+ */
+static int fs_stat_bucket(uint64_t value) {
+    int msb, shift, bucket;
+    if (value < (1ULL << SFS_HIST_SUB_BITS)) {
+        return (int)value;
+    }
+    msb    = 63 - __builtin_clzll(value);
+    shift  = msb - SFS_HIST_SUB_BITS;
+    bucket = ((shift + 1) << SFS_HIST_SUB_BITS) +
+             (int)((value >> shift) & ((1 << SFS_HIST_SUB_BITS) - 1));
+    return SFS_MIN(bucket, SFS_HIST_BUCKETS - 1);
+}
+/**
+ * @brief 桶所代表区间的中点
+ *
+ * @param bucket
+ * @return uint64_t
+ */
+static uint64_t fs_stat_bucket_value(int bucket) {
+    int      shift;
+    uint64_t low;
+    if (bucket < (1 << SFS_HIST_SUB_BITS)) {
+        return bucket;
+    }
+    shift = (bucket >> SFS_HIST_SUB_BITS) - 1;
+    low   = (uint64_t)((1 << SFS_HIST_SUB_BITS) + (bucket & ((1 << SFS_HIST_SUB_BITS) - 1))) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+/**
+ * @brief 记录一次耗时，多线程下原子更新
+ *
+ * @param id 直方图
+ * @param ns 耗时
+ */
+void fs_stat_record(int id, uint64_t ns) {
+    struct newfs_hist* hist = &newfs_stats.hist[id];
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    __sync_fetch_and_add(&hist->bucket[fs_stat_bucket(ns)], 1);
+    __sync_fetch_and_add(&hist->cnt, 1);
+    __sync_fetch_and_add(&hist->sum, ns);
+    while (ns > max && !__sync_bool_compare_and_swap(&hist->max, max, ns)) {
+        max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    }
+}
+/**
+ * @brief SFS_STAT_SCOPE的清理函数
+ *
+ * @param scope
+ */
+void fs_stat_scope_end(struct newfs_stat_scope* scope) {
+    fs_stat_record(scope->id, fs_stat_now() - scope->start);
+}
+/**
+ * @brief 计数器加n
+ *
+ * @param id 计数器
+ * @param n
+ */
+void fs_stat_count(int id, uint64_t n) {
+    __sync_fetch_and_add(&newfs_stats.cnt[id], n);
+}
+/**
+ * @brief 清空统计，挂载时调用
+ */
+void fs_stat_reset() {
+    memset(&newfs_stats, 0, sizeof(newfs_stats));
+}
+/**
+ * @brief 直方图的p分位数（ns）
+ *
+ * @param hist
+ * @param p 0~1
+ * @return uint64_t
+ */
+static uint64_t fs_stat_percentile(const struct newfs_hist* hist, double p) {
+    uint64_t want = (uint64_t)(p * hist->cnt + 0.999999), seen = 0;
+    int      b;
+    if (want == 0) {
+        want = 1;
+    }
+    for (b = 0; b < SFS_HIST_BUCKETS; b++) {
+        seen += hist->bucket[b];
+        if (seen >= want) {
+            return SFS_MIN(fs_stat_bucket_value(b), hist->max);
+        }
+    }
+    return hist->max;
+}
+/**
+ * @brief 把统计渲染成文本：每个有样本的操作/阶段一行（单位us），之后是计数器，
+ * 驱动支持扩展状态时最后是设备侧的统计（按挂载时登记的区域归类）
+ *
+ * @param buf 输出
+ * @param size buf的大小
+ * @return int 文本长度（不含结尾的'\0'）
+ */
+int fs_stat_dump(char* buf, int size) {
+    const struct newfs_hist* hist;
+    struct ddriver_state_ext dev;
+    int len = 0, i;
+
+#define SFS_STAT_PRINT(...) \
+    len += snprintf(buf + SFS_MIN(len, size), size - SFS_MIN(len, size), __VA_ARGS__)
+
+    SFS_STAT_PRINT("%-20s %10s %10s %10s %10s %10s %10s\n",
+                   "op", "count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+    for (i = 0; i < SFS_STAT_HISTS; i++) {
+        hist = &newfs_stats.hist[i];
+        if (hist->cnt == 0) {
+            continue;
+        }
+        SFS_STAT_PRINT("%-20s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", fs_stat_hist_names[i],
+                       (unsigned long long)hist->cnt, hist->sum / 1000.0 / hist->cnt,
+                       fs_stat_percentile(hist, 0.50) / 1000.0, fs_stat_percentile(hist, 0.90) / 1000.0,
+                       fs_stat_percentile(hist, 0.99) / 1000.0, hist->max / 1000.0);
+    }
+    for (i = 0; i < SFS_STAT_CNTS; i++) {
+        SFS_STAT_PRINT("%-20s %10llu\n", fs_stat_cnt_names[i], (unsigned long long)newfs_stats.cnt[i]);
+    }
+    SFS_STAT_PRINT("%-20s %10d\n", "readahead_blocks", newfs_super.ra_blks);
+    SFS_STAT_PRINT("%-20s %10d\n", "readahead_hits", newfs_super.ra_hits);
+    SFS_STAT_PRINT("%-20s %10d\n", "prefetch_inodes", newfs_super.ra_inodes);
+    SFS_STAT_PRINT("%-20s %10d\n", "prefetch_inode_hits", newfs_super.ra_inode_hits);
+    SFS_STAT_PRINT("%-20s %10llu\n", "blkio_hits", (unsigned long long)newfs_super.blkdev.hits);
+    SFS_STAT_PRINT("%-20s %10llu\n", "blkio_misses", (unsigned long long)newfs_super.blkdev.misses);
+    SFS_STAT_PRINT("%-20s %10llu\n", "blkio_seeks", (unsigned long long)newfs_super.blkdev.seeks);
+    SFS_STAT_PRINT("%-20s %10llu\n", "blkio_seeks_saved", (unsigned long long)newfs_super.blkdev.seeks_saved);
+
+    memset(&dev, 0, sizeof(dev));
+    dev.version = DDRIVER_STATE_EXT_VERSION;
+    dev.size    = sizeof(dev);
+    if (ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_STATE_EXT, &dev) == 0) {
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_reads", (unsigned long long)dev.read_cnt);
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_writes", (unsigned long long)dev.write_cnt);
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_seeks", (unsigned long long)dev.seek_cnt);
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_read_bytes", (unsigned long long)dev.bytes_read);
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_write_bytes", (unsigned long long)dev.bytes_written);
+        SFS_STAT_PRINT("%-20s %10llu\n", "dev_seek_distance", (unsigned long long)dev.seek_distance);
+        SFS_STAT_PRINT("%-20s %10.1f\n", "dev_rotate_ms", dev.rotate_ns / 1e6);
+        SFS_STAT_PRINT("%-20s %10.1f\n", "dev_read_ms", dev.read_ns / 1e6);
+        SFS_STAT_PRINT("%-20s %10.1f\n", "dev_write_ms", dev.write_ns / 1e6);
+        SFS_STAT_PRINT("%-20s", "dev_qdepth");
+        for (i = 0; i < DDRIVER_QDEPTH_BUCKETS; i++) {
+            SFS_STAT_PRINT(" %llu", (unsigned long long)dev.qdepth_hist[i]);
+        }
+        SFS_STAT_PRINT("\n%-20s %10s %10s %10s\n", "region", "reads", "writes", "dev_ms");
+        for (i = 0; i < DDRIVER_REGION_TYPES; i++) {
+            SFS_STAT_PRINT("%-20s %10llu %10llu %10.1f\n", fs_stat_region_names[i],
+                           (unsigned long long)dev.region_reads[i],
+                           (unsigned long long)dev.region_writes[i], dev.region_ns[i] / 1e6);
+        }
+    }
+#undef SFS_STAT_PRINT
+    return SFS_MIN(len, size - 1);
+}
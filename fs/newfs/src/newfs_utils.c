@@ -1,9 +1,9 @@
-#include "../include/newfs.h"
-extern struct newfs_super newfs_super;
-extern struct custom_options newfs_options;
+#include "../include/newfs_core.h"
+struct newfs_super newfs_super;                 /* 全局超级块，两个前端共用 */
 
 /**
- * @brief 驱动读
+ * @brief 驱动读，经块设备层（fs_blkio）：只读涉及的IO单位，对齐的整单位直接读入out_content，
+ * 超级块、位图、inode等小块读可命中缓冲缓存
  * 
  * @param offset 
  * @param out_content 
@@ -11,26 +11,17 @@ extern struct custom_options newfs_options;
  * @return int 
  */
 int fs_driver_read(int offset, uint8_t *out_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_BLOCK_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_BLOCK_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_read(SFS_DRIVER(), (char*)cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    SFS_STAT_SCOPE(SFS_STAGE_DRIVER_READ);
+    int bias = offset % SFS_IO_SZ();
+    fs_stat_count(SFS_CNT_DRIVER_RD_BYTES, SFS_ROUND_UP((size + bias), SFS_IO_SZ()));
+    if (fs_blk_read(&newfs_super.blkdev, offset, out_content, size) != 0) {
+        SFS_ERR("[%s] io error at %d\n", __func__, offset);
+        return -SFS_ERROR_IO;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
     return SFS_ERROR_NONE;
 }
 /**
- * @brief 驱动写
+ * @brief 驱动写，经块设备层：只有首尾不满的IO单位需要先读出合并，其余直接从in_content写出
  * 
  * @param offset 
  * @param in_content 
@@ -38,37 +29,129 @@ int fs_driver_read(int offset, uint8_t *out_content, int size) {
  * @return int 
  */
 int fs_driver_write(int offset, uint8_t *in_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_BLOCK_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_BLOCK_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    fs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-    
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_write(SFS_DRIVER(), (char*)cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    SFS_STAT_SCOPE(SFS_STAGE_DRIVER_WRITE);
+    int bias = offset % SFS_IO_SZ();
+    fs_stat_count(SFS_CNT_DRIVER_WR_BYTES, SFS_ROUND_UP((size + bias), SFS_IO_SZ()));
+    if (fs_blk_write(&newfs_super.blkdev, offset, in_content, size) != 0) {
+        SFS_ERR("[%s] io error at %d\n", __func__, offset);
+        return -SFS_ERROR_IO;
     }
+    return SFS_ERROR_NONE;
+}
+
+/**
+ * @brief 读入组描述符表和各块组的位图片段
+ * 
+ * @return int 
+ */
+static int fs_read_groups() {
+    struct newfs_group_d* group_d;
+    int ipg_bytes = newfs_super.inodes_per_group / UINT8_BITS;
+    int dpg_bytes = newfs_super.data_per_group / UINT8_BITS;
+    int g;
 
-    free(temp_content);
+    group_d = (struct newfs_group_d *)malloc(newfs_super.group_cnt * sizeof(struct newfs_group_d));
+    if (fs_driver_read(newfs_super.gdt_offset, (uint8_t *)group_d, 
+                       newfs_super.group_cnt * sizeof(struct newfs_group_d)) != SFS_ERROR_NONE) {
+        free(group_d);
+        return -SFS_ERROR_IO;
+    }
+    for (g = 0; g < newfs_super.group_cnt; g++) {
+        newfs_super.groups[g].inode_map_offset = group_d[g].inode_map_offset;
+        newfs_super.groups[g].data_map_offset  = group_d[g].data_map_offset;
+        newfs_super.groups[g].inode_offset     = group_d[g].inode_offset;
+        newfs_super.groups[g].data_offset      = group_d[g].data_offset;
+        newfs_super.groups[g].free_inodes      = group_d[g].free_inodes;
+        newfs_super.groups[g].free_data        = group_d[g].free_data;
+        newfs_super.groups[g].dirs             = group_d[g].dirs;
+        if (fs_driver_read(newfs_super.groups[g].inode_map_offset, 
+                           newfs_super.map_inode + g * ipg_bytes, ipg_bytes) != SFS_ERROR_NONE ||
+            fs_driver_read(newfs_super.groups[g].data_map_offset, 
+                           newfs_super.map_data + g * dpg_bytes, dpg_bytes) != SFS_ERROR_NONE) {
+            free(group_d);
+            return -SFS_ERROR_IO;
+        }
+    }
+    free(group_d);
     return SFS_ERROR_NONE;
 }
+/**
+ * @brief 写回组描述符表和各块组的位图片段
+ * 
+ * @return int 
+ */
+static int fs_write_groups() {
+    struct newfs_group_d* group_d;
+    int ipg_bytes = newfs_super.inodes_per_group / UINT8_BITS;
+    int dpg_bytes = newfs_super.data_per_group / UINT8_BITS;
+    int g, ret = SFS_ERROR_NONE;
+
+    group_d = (struct newfs_group_d *)calloc(newfs_super.group_cnt, sizeof(struct newfs_group_d));
+    for (g = 0; g < newfs_super.group_cnt; g++) {
+        group_d[g].inode_map_offset = newfs_super.groups[g].inode_map_offset;
+        group_d[g].data_map_offset  = newfs_super.groups[g].data_map_offset;
+        group_d[g].inode_offset     = newfs_super.groups[g].inode_offset;
+        group_d[g].data_offset      = newfs_super.groups[g].data_offset;
+        group_d[g].free_inodes      = newfs_super.groups[g].free_inodes;
+        group_d[g].free_data        = newfs_super.groups[g].free_data;
+        group_d[g].dirs             = newfs_super.groups[g].dirs;
+        if (fs_driver_write(group_d[g].inode_map_offset, 
+                            newfs_super.map_inode + g * ipg_bytes, ipg_bytes) != SFS_ERROR_NONE ||
+            fs_driver_write(group_d[g].data_map_offset, 
+                            newfs_super.map_data + g * dpg_bytes, dpg_bytes) != SFS_ERROR_NONE) {
+            ret = -SFS_ERROR_IO;
+            break;
+        }
+    }
+    if (ret == SFS_ERROR_NONE &&
+        fs_driver_write(newfs_super.gdt_offset, (uint8_t *)group_d, 
+                        newfs_super.group_cnt * sizeof(struct newfs_group_d)) != SFS_ERROR_NONE) {
+        ret = -SFS_ERROR_IO;
+    }
+    free(group_d);
+    return ret;
+}
+/**
+ * @brief 向驱动登记磁盘布局，扩展设备状态按超级块/位图/inode表/数据区分别统计访问和设备时间
+ * 
+ * 块组太多、区域表放不下时，后面的块组不登记（计入DDRIVER_REGION_OTHER）
+ */
+static void fs_register_regions() {
+    struct ddriver_region_map map;
+    struct newfs_group* group;
+    int g;
 
+#define SFS_REGION(ofs, sz, t)  do { map.regions[map.count].offset = (ofs);          \
+                                     map.regions[map.count].size   = (sz);           \
+                                     map.regions[map.count].type   = (t);            \
+                                     map.count++; } while (0)
+
+    map.count = 0;
+    SFS_REGION(SFS_SUPER_OFS, newfs_super.groups[0].inode_map_offset, DDRIVER_REGION_SUPER);
+    for (g = 0; g < newfs_super.group_cnt && map.count + 3 <= DDRIVER_MAX_REGIONS; g++) {
+        group = &newfs_super.groups[g];
+        SFS_REGION(group->inode_map_offset, SFS_BLKS_SZ(2), DDRIVER_REGION_BITMAP);
+        SFS_REGION(group->inode_offset, SFS_BLKS_SZ(newfs_super.inodes_per_group), DDRIVER_REGION_INODE);
+        SFS_REGION(group->data_offset, SFS_BLKS_SZ(newfs_super.data_per_group), DDRIVER_REGION_DATA);
+    }
+#undef SFS_REGION
+    if (ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_REGION_MAP, &map) != 0) {
+        SFS_WARN("[%s] driver does not accept a region map\n", __func__);
+    }
+}
 /**
  * @brief 挂载sfs, Layout 如下
  * 
  * Layout
- * | Super(1) | Inode Map(1) | DATA Map(4) | DATA(*) |
+ * | Super(1) | GDT(*) | Group 0 | Group 1 | ... | Group N-1 |
+ * 
+ * Group
+ * | Inode Map(1) | DATA Map(1) | Inodes(inodes_per_group) | DATA(data_per_group) |
  * 
  * IO_SZ * 2 = BLOCK_SZ
  * 
- * 每个Inode占用一个Blk
+ * 每个Inode占用一个Blk，ino与数据块号都是全局编号，
+ * 按inodes_per_group / data_per_group换算出所在块组
  * @param options 
  * @return int 
  */
@@ -80,13 +163,20 @@ int fs_mount(struct custom_options options){
     struct newfs_inode*   root_inode;
 
     int                 inode_num;
-    int                 map_inode_blks;
-    int                 map_data_blks;
+    int                 data_num;
+    int                 disk_blks;
+    int                 gdt_sz;
+    int                 gdt_blks;
+    int                 group_cnt;
+    int                 group_blks;
+    int                 group_ofs;
+    int                 g;
     
     int                 super_blks;
     boolean             is_init = FALSE;
 
     newfs_super.is_mounted = FALSE;
+    fs_stat_reset();
 
     // driver_fd = open(options.device, O_RDWR);
     driver_fd = ddriver_open((char*)options.device);
@@ -99,8 +189,13 @@ int fs_mount(struct custom_options options){
     ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &newfs_super.sz_disk);
     ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &newfs_super.sz_io);
     newfs_super.sz_block = 2* newfs_super.sz_io;
-    SFS_DBG("disk size: %d\n", newfs_super.sz_disk);
-    SFS_DBG("io size: %d\n", newfs_super.sz_io);
+    if (fs_blk_open(&newfs_super.blkdev, SFS_DRIVER(), SFS_IO_SZ(), SFS_BLKIO_CACHE) != 0) {
+        ddriver_close(SFS_DRIVER());
+        return -ENOMEM;
+    }
+    newfs_super.zero_blk = (uint8_t *)calloc(1, SFS_BLOCK_SZ());
+    SFS_INFO("disk size: %d\n", newfs_super.sz_disk);
+    SFS_INFO("io size: %d\n", newfs_super.sz_io);
     
     root_dentry = new_dentry("/", FS_DIR);
 
@@ -112,45 +207,68 @@ int fs_mount(struct custom_options options){
     if (newfs_super_d.magic_num != SFS_MAGIC_NUM) {     /* 幻数无 */
                                                       /* 估算各部分大小 */
         super_blks = SFS_ROUND_UP(sizeof(struct newfs_super_d), SFS_BLOCK_SZ()) / SFS_BLOCK_SZ();
+        disk_blks  = SFS_DISK_SZ() / SFS_BLOCK_SZ();
 
-        inode_num  =  SFS_DISK_SZ() / ((SFS_DATA_PER_FILE + SFS_INODE_PER_FILE) * SFS_BLOCK_SZ());
-
-        map_inode_blks = SFS_ROUND_UP(SFS_ROUND_UP(inode_num, UINT32_BITS), SFS_BLOCK_SZ()) 
-                         / SFS_BLOCK_SZ();
-
-        map_data_blks = SFS_ROUND_UP(SFS_DISK_SZ() / SFS_BLOCK_SZ(),SFS_BLOCK_SZ())/SFS_BLOCK_SZ();
+        group_cnt  = SFS_MAX((disk_blks - super_blks - 1) / SFS_GROUP_BLKS, 1);
+        gdt_sz     = group_cnt * sizeof(struct newfs_group_d);
+        gdt_blks   = SFS_ROUND_UP(gdt_sz, SFS_BLOCK_SZ()) / SFS_BLOCK_SZ();
+        group_blks = (disk_blks - super_blks - gdt_blks) / group_cnt;
+                                                      /* 组内两个位图各占一块，inode与数据块数取8的倍数 */
+        inode_num  = (group_blks - 2) / (SFS_DATA_PER_FILE + SFS_INODE_PER_FILE);
+        inode_num  = SFS_MIN(inode_num - inode_num % UINT8_BITS, SFS_BLOCK_SZ() * UINT8_BITS);
+        data_num   = group_blks - 2 - inode_num;
+        data_num   = SFS_MIN(data_num - data_num % UINT8_BITS, SFS_BLOCK_SZ() * UINT8_BITS);
         
         /* 布局layout */
-        newfs_super.max_ino = (inode_num - super_blks - map_inode_blks - map_data_blks); 
-        newfs_super_d.map_inode_offset = SFS_SUPER_OFS + SFS_BLKS_SZ(super_blks);
-        newfs_super_d.map_data_offset =  newfs_super_d.map_inode_offset + SFS_BLKS_SZ(map_inode_blks);
-        newfs_super_d.inode_offset = newfs_super_d.map_data_offset + SFS_BLKS_SZ(map_data_blks);
-        newfs_super_d.data_offset = newfs_super_d.map_inode_offset + SFS_BLKS_SZ(inode_num);
-        newfs_super_d.map_inode_blks  = map_inode_blks;
-        newfs_super_d.map_data_blks = map_data_blks;
-        SFS_DBG("inode map blocks: %d\n", map_inode_blks);
-        SFS_DBG("data map blocks: %d\n", map_data_blks);
+        newfs_super_d.max_ino = inode_num * group_cnt; 
+        newfs_super_d.group_cnt = group_cnt;
+        newfs_super_d.group_blks = group_blks;
+        newfs_super_d.inodes_per_group = inode_num;
+        newfs_super_d.data_per_group = data_num;
+        newfs_super_d.gdt_offset = SFS_SUPER_OFS + SFS_BLKS_SZ(super_blks);
+        newfs_super_d.sz_usage = 0;
+        SFS_INFO("groups: %d x %d blocks\n", group_cnt, group_blks);
+        SFS_INFO("inodes per group: %d, data blocks per group: %d\n", inode_num, data_num);
         is_init = TRUE;
     }
     
-    newfs_super.map_inode = (uint8_t *)malloc(SFS_BLKS_SZ(newfs_super_d.map_inode_blks));
-    newfs_super.map_data = (uint8_t *)malloc(SFS_BLKS_SZ(newfs_super_d.map_data_blks));
-    newfs_super.map_inode_blks = newfs_super_d.map_inode_blks;
-    newfs_super.map_inode_offset = newfs_super_d.map_inode_offset;
-    newfs_super.map_data_blks = newfs_super_d.map_data_blks;
-    newfs_super.map_data_offset = newfs_super_d.map_data_offset;
-    newfs_super.data_offset = newfs_super_d.data_offset;
-    newfs_super.inode_offset = newfs_super_d.inode_offset;
+    newfs_super.group_cnt = newfs_super_d.group_cnt;
+    newfs_super.group_blks = newfs_super_d.group_blks;
+    newfs_super.inodes_per_group = newfs_super_d.inodes_per_group;
+    newfs_super.data_per_group = newfs_super_d.data_per_group;
+    newfs_super.gdt_offset = newfs_super_d.gdt_offset;
     newfs_super.sz_usage = newfs_super_d.sz_usage;
+    newfs_super.max_ino = newfs_super_d.max_ino;
+    newfs_super.max_data = newfs_super.group_cnt * newfs_super.data_per_group;
+    newfs_super.delay_blks = 0;
+    newfs_super.map_inode_blks = SFS_ROUND_UP(newfs_super.max_ino / UINT8_BITS, SFS_BLOCK_SZ()) / SFS_BLOCK_SZ();
+    newfs_super.map_data_blks = SFS_ROUND_UP(newfs_super.max_data / UINT8_BITS, SFS_BLOCK_SZ()) / SFS_BLOCK_SZ();
+    newfs_super.map_inode = (uint8_t *)calloc(1, SFS_BLKS_SZ(newfs_super.map_inode_blks));
+    newfs_super.map_data = (uint8_t *)calloc(1, SFS_BLKS_SZ(newfs_super.map_data_blks));
+    newfs_super.groups = (struct newfs_group *)calloc(newfs_super.group_cnt, sizeof(struct newfs_group));
+    for (g = 0; g < newfs_super.group_cnt; g++) {
+        pthread_mutex_init(&newfs_super.groups[g].lock, NULL);
+    }
 
-    if (fs_driver_read(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
-                        SFS_BLKS_SZ(newfs_super_d.map_inode_blks)) != SFS_ERROR_NONE) {
-        return -SFS_ERROR_IO;
+    if (is_init) {                                    /* 划分块组，位图全空 */
+        gdt_sz = newfs_super.group_cnt * sizeof(struct newfs_group_d);
+        group_ofs = newfs_super.gdt_offset + SFS_ROUND_UP(gdt_sz, SFS_BLOCK_SZ());
+        for (g = 0; g < newfs_super.group_cnt; g++) {
+            newfs_super.groups[g].inode_map_offset = group_ofs;
+            newfs_super.groups[g].data_map_offset  = group_ofs + SFS_BLOCK_SZ();
+            newfs_super.groups[g].inode_offset     = group_ofs + SFS_BLKS_SZ(2);
+            newfs_super.groups[g].data_offset      = newfs_super.groups[g].inode_offset + 
+                                                     SFS_BLKS_SZ(newfs_super.inodes_per_group);
+            newfs_super.groups[g].free_inodes      = newfs_super.inodes_per_group;
+            newfs_super.groups[g].free_data        = newfs_super.data_per_group;
+            newfs_super.groups[g].dirs             = 0;
+            group_ofs += SFS_BLKS_SZ(newfs_super.group_blks);
+        }
     }
-    if (fs_driver_read(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
-                        SFS_BLKS_SZ(newfs_super_d.map_data_blks)) != SFS_ERROR_NONE) {
+    else if (fs_read_groups() != SFS_ERROR_NONE) {
         return -SFS_ERROR_IO;
     }
+    fs_register_regions();
 
     if (is_init) {                                    /* 分配根节点 */
         root_inode = fs_alloc_inode(root_dentry);
@@ -159,10 +277,11 @@ int fs_mount(struct custom_options options){
     
     root_inode            = fs_read_inode(root_dentry, SFS_ROOT_INO);
     root_dentry->inode      = root_inode;
+    root_dentry->ino        = SFS_ROOT_INO;
     newfs_super.root_dentry = root_dentry;
     newfs_super.is_mounted  = TRUE;
 
-    fs_dump_map();
+    fs_log_flush(stdout);
     return ret;
 }
 /**
@@ -172,21 +291,34 @@ int fs_mount(struct custom_options options){
  */
 int fs_umount() {
     struct newfs_super_d  newfs_super_d; 
+    struct newfs_frag_stat frag_stat;
+    struct ddriver_state  device_state;
+    char*                 stats;
+    char*                 line;
+    int                   g;
 
     if (!newfs_super.is_mounted) {
         return SFS_ERROR_NONE;
     }
 
     fs_sync_inode(newfs_super.root_dentry->inode);     /* 从根节点向下刷写节点 */
+
+    fs_frag_report(&frag_stat);
+    SFS_INFO("readahead: %d blocks, %d hits, %d wasted; readdir prefetch: %d inodes, %d hits, %d wasted\n",
+            newfs_super.ra_blks, newfs_super.ra_hits, newfs_super.ra_blks - newfs_super.ra_hits,
+            newfs_super.ra_inodes, newfs_super.ra_inode_hits, 
+            newfs_super.ra_inodes - newfs_super.ra_inode_hits);
+    SFS_INFO("fragmentation: %d files, %d blocks, %d extents, %.2f extents per file\n",
+            frag_stat.files, frag_stat.blocks, frag_stat.extents,
+            frag_stat.files ? (double)frag_stat.extents / frag_stat.files : 0.0);
                                                     
     newfs_super_d.magic_num           = SFS_MAGIC_NUM;
-    newfs_super_d.map_inode_blks      = newfs_super.map_inode_blks;
-    newfs_super_d.map_inode_offset    = newfs_super.map_inode_offset;
-    newfs_super_d.map_data_blks      = newfs_super.map_data_blks;
-    newfs_super_d.map_data_offset    = newfs_super.map_data_offset;
-    newfs_super_d.data_offset         = newfs_super.data_offset;
-    newfs_super_d.inode_offset         = newfs_super.inode_offset;
     newfs_super_d.max_ino             = newfs_super.max_ino;
+    newfs_super_d.group_cnt           = newfs_super.group_cnt;
+    newfs_super_d.group_blks          = newfs_super.group_blks;
+    newfs_super_d.inodes_per_group    = newfs_super.inodes_per_group;
+    newfs_super_d.data_per_group      = newfs_super.data_per_group;
+    newfs_super_d.gdt_offset          = newfs_super.gdt_offset;
     newfs_super_d.sz_usage            = newfs_super.sz_usage;
 
     if (fs_driver_write(SFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
@@ -194,17 +326,30 @@ int fs_umount() {
         return -SFS_ERROR_IO;
     }
 
-    if (fs_driver_write(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
-                         SFS_BLKS_SZ(newfs_super_d.map_inode_blks)) != SFS_ERROR_NONE) {
-        return -SFS_ERROR_IO;
-    }
-    if (fs_driver_write(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
-                         SFS_BLKS_SZ(newfs_super_d.map_data_blks)) != SFS_ERROR_NONE) {
+    if (fs_write_groups() != SFS_ERROR_NONE) {
         return -SFS_ERROR_IO;
     }
 
+    for (g = 0; g < newfs_super.group_cnt; g++) {
+        pthread_mutex_destroy(&newfs_super.groups[g].lock);
+    }
     free(newfs_super.map_inode);
     free(newfs_super.map_data);
+    free(newfs_super.groups);
+    free(newfs_super.zero_blk);
+
+    ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_STATE, &device_state);
+    SFS_INFO("device: %d reads, %d writes, %d seeks\n",
+            device_state.read_cnt, device_state.write_cnt, device_state.seek_cnt);
+    stats = (char *)malloc(SFS_STATS_DUMP_SZ);
+    fs_stat_dump(stats, SFS_STATS_DUMP_SZ);
+    SFS_INFO("stats:\n");
+    for (line = strtok(stats, "\n"); line; line = strtok(NULL, "\n")) {
+        SFS_INFO("%s\n", line);
+    }
+    free(stats);
+    fs_log_flush(stdout);
+    fs_blk_close(&newfs_super.blkdev);
     ddriver_close(SFS_DRIVER());
 
     return SFS_ERROR_NONE;
@@ -245,6 +390,45 @@ int fs_calc_lvl(const char * path) {
     }
     return lvl;
 }
+/**
+ * @brief 初始化inode锁。锁可重入：入口函数加锁后调用的其他加锁函数不会自锁
+ * 
+ * @param inode 
+ */
+static void fs_init_inode_lock(struct newfs_inode* inode) {
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&inode->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+/**
+ * @brief 锁住inode。同时持有父目录和子项的锁时，总是先锁父目录
+ * 
+ * @param inode 
+ * @return struct newfs_inode* inode本身，供SFS_INODE_SCOPE使用
+ */
+struct newfs_inode* fs_lock_inode(struct newfs_inode* inode) {
+    pthread_mutex_lock(&inode->lock);
+    return inode;
+}
+/**
+ * @brief 释放fs_lock_inode持有的inode锁
+ * 
+ * @param inode 
+ */
+void fs_unlock_inode(struct newfs_inode* inode) {
+    pthread_mutex_unlock(&inode->lock);
+}
+/**
+ * @brief SFS_INODE_SCOPE离开作用域时释放inode锁
+ * 
+ * @param scope 
+ */
+void fs_inode_scope_end(struct newfs_inode** scope) {
+    pthread_mutex_unlock(&(*scope)->lock);
+}
 /**
  * @brief 为一个inode分配dentry，采用头插法
  * 
@@ -253,10 +437,9 @@ int fs_calc_lvl(const char * path) {
  * @return int 
  */
 int fs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
-    if (inode->dentrys == NULL) {
+    SFS_INODE_SCOPE(inode);
+    if (inode->dentrys == NULL) {                   /* 目录块在fs_sync_inode时按需分配 */
         inode->dentrys = dentry;
-        inode->block_pointer[0] = fs_alloc_data();
-        inode->data[0] = (uint8_t *)malloc(SFS_BLOCK_SZ());
     }
     else {
         dentry->brother = inode->dentrys;
@@ -273,6 +456,7 @@ int fs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
  * @return int 
  */
 int fs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry) {
+    SFS_INODE_SCOPE(inode);
     boolean is_find = FALSE;
     struct newfs_dentry* dentry_cursor;
     dentry_cursor = inode->dentrys;
@@ -298,325 +482,1351 @@ int fs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry) {
     inode->dir_cnt--;
     return inode->dir_cnt;
 }
+static int          fs_next_group = 0;            /* 为新线程轮流指定块组 */
+static __thread int fs_thread_group = -1;         /* 当前线程的亲和块组 */
+
+/**
+ * @brief 当前线程的亲和块组，线程第一次分配时按轮转指定
+ * 
+ * @return int 
+ */
+static int fs_my_group() {
+    if (fs_thread_group < 0) {
+        fs_thread_group = __sync_fetch_and_add(&fs_next_group, 1) % newfs_super.group_cnt;
+    }
+    return fs_thread_group;
+}
+/**
+ * @brief 锁住首选块组；首选块组正被其他线程持有时改用本线程的亲和块组，
+ * 使并行的分配落在不同的块组上
+ * 
+ * @param group 首选块组
+ * @return int 实际锁住的块组
+ */
+static int fs_lock_group(int group) {
+    if (pthread_mutex_trylock(&newfs_super.groups[group].lock) != 0) {
+        group = fs_my_group();
+        pthread_mutex_lock(&newfs_super.groups[group].lock);
+    }
+    return group;
+}
+/**
+ * @brief 为新inode选择首选块组
+ * 
+ * 子目录分散到空闲inode和空闲数据块都不少于平均值、目录数最少的块组；
+ * 普通文件放在父目录所在的块组。计数不加锁读取，只作为启发
+ * 
+ * @param dentry 
+ * @return int 块组号
+ */
+static int fs_find_group(struct newfs_dentry* dentry) {
+    struct newfs_dentry* parent = dentry->parent;
+    struct newfs_group*  groups = newfs_super.groups;
+    int group_cnt = newfs_super.group_cnt;
+    int avg_inodes = 0, avg_data = 0;
+    int g, best = -1;
+
+    if (parent != NULL && dentry->ftype == FS_DIR) {
+        for (g = 0; g < group_cnt; g++) {
+            avg_inodes += groups[g].free_inodes;
+            avg_data   += groups[g].free_data;
+        }
+        avg_inodes /= group_cnt;
+        avg_data   /= group_cnt;
+        for (g = 0; g < group_cnt; g++) {
+            if (groups[g].free_inodes == 0 || groups[g].free_inodes < avg_inodes ||
+                groups[g].free_data < avg_data) {
+                continue;
+            }
+            if (best < 0 || groups[g].dirs < groups[best].dirs) {
+                best = g;
+            }
+        }
+        if (best >= 0) {
+            return best;
+        }
+    }
+    return parent != NULL ? SFS_INO_GROUP(parent->ino) : 0;
+}
+/**
+ * @brief 在已锁住的块组中占用一个空闲inode
+ * 
+ * @param group 
+ * @param ftype 
+ * @return int ino，负数为错误码
+ */
+static int fs_take_ino(int group, FILE_TYPE ftype) {
+    int ipg = newfs_super.inodes_per_group;
+    int ino_cursor;
+
+    if (newfs_super.groups[group].free_inodes == 0) {
+        return -SFS_ERROR_NOSPACE;
+    }
+    for (ino_cursor = group * ipg; ino_cursor < (group + 1) * ipg; ino_cursor++) {
+        if (!SFS_BITMAP_TEST(newfs_super.map_inode, ino_cursor)) {
+            break;                                    /* 当前ino_cursor位置空闲 */
+        }
+    }
+    if (ino_cursor == (group + 1) * ipg) {
+        return -SFS_ERROR_NOSPACE;
+    }
+    SFS_BITMAP_SET(newfs_super.map_inode, ino_cursor);
+    newfs_super.groups[group].free_inodes--;
+    if (ftype == FS_DIR) {
+        newfs_super.groups[group].dirs++;
+    }
+    return ino_cursor;
+}
 /**
  * @brief 分配一个inode，占用位图
  * 
+ * 先在fs_find_group选出的块组（被占用时为本线程的块组）中分配，
+ * 该块组已满时依次从其他块组窃取
+ * 
  * @param dentry 该dentry指向分配的inode
  * @return sfs_inode
  */
 struct newfs_inode* fs_alloc_inode(struct newfs_dentry * dentry) {
+    SFS_STAT_SCOPE(SFS_STAGE_ALLOC_INODE);
     struct newfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    boolean is_find_free_entry = FALSE;
+    int group       = fs_lock_group(fs_find_group(dentry));
+    int ino_cursor  = fs_take_ino(group, dentry->ftype);
+    int i, g;
 
-    for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_inode_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((newfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                newfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
+    pthread_mutex_unlock(&newfs_super.groups[group].lock);
+    for (i = 1; ino_cursor < 0 && i < newfs_super.group_cnt; i++) {
+        g = (group + i) % newfs_super.group_cnt;
+        pthread_mutex_lock(&newfs_super.groups[g].lock);
+        ino_cursor = fs_take_ino(g, dentry->ftype);
+        pthread_mutex_unlock(&newfs_super.groups[g].lock);
     }
-
-    if (!is_find_free_entry || ino_cursor == newfs_super.max_ino)
+    if (ino_cursor < 0)
         // return -SFS_ERROR_NOSPACE;
         return NULL;
 
     inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    fs_init_inode_lock(inode);
     inode->ino  = ino_cursor; 
     inode->size = 0;
                                                       /* dentry指向inode */
-    // dentry->inode = inode;
+    dentry->inode = inode;
     dentry->ino   = inode->ino;
                                                       /* inode指回dentry */
     inode->dentry = dentry;
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
-    
-    if (SFS_IS_FILE(inode)) {
-        for (int i=0;i<SFS_DATA_PER_FILE;i++) {
-            inode->block_pointer[i] = fs_alloc_data();
-            inode->data[i] = (uint8_t*)malloc(SFS_BLOCK_SZ());
-        }
+                                                      /* 数据块在写入时才分配，初始全为空洞 */
+    for (int i = 0; i < SFS_MAX_DATA_PER_FILE; i++) {
+        inode->block_pointer[i] = SFS_DATA_HOLE;
+        inode->data[i] = NULL;
+        inode->block_flags[i] = 0;
+    }
+    inode->prealloc_start = 0;
+    inode->prealloc_lblk = 0;
+    inode->prealloc_len = 0;
+    inode->delay_blks = 0;
+    inode->open_cnt = 0;
+    inode->ra_ahead = FALSE;
+    fs_touch_inode(inode, SFS_TIME_ATIME | SFS_TIME_MTIME | SFS_TIME_CTIME);
+    if (dentry->parent != NULL && dentry->parent->inode != NULL) {
+        fs_lock_inode(dentry->parent->inode);
+        fs_touch_inode(dentry->parent->inode, SFS_TIME_MTIME | SFS_TIME_CTIME);
+        fs_unlock_inode(dentry->parent->inode);
     }
-    // else if (SFS_IS_DIR(inode)) {
-    //     inode->block_pointer[0] = fs_alloc_data();
-    //     inode->data[0] = (uint8_t *)malloc(SFS_BLOCK_SZ());
-    // }
 
     return inode;
 }
 /**
- * @brief 分配一个数据块，占用位图
- * @return data block对应的编号
+ * @brief 把inode的时间戳更新为当前时间，随inode在fs_sync_inode时写回
+ * 
+ * @param inode 
+ * @param flags SFS_TIME_*的组合
  */
-int fs_alloc_data() {
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int data_cursor  = 0;
-    boolean is_find_free_entry = FALSE;
+void fs_touch_inode(struct newfs_inode * inode, int flags) {
+    struct timespec now;
 
-    for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_data_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((newfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                newfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            data_cursor++;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (flags & SFS_TIME_ATIME) {
+        inode->atime = now;
+    }
+    if (flags & SFS_TIME_MTIME) {
+        inode->mtime = now;
+    }
+    if (flags & SFS_TIME_CTIME) {
+        inode->ctime = now;
+    }
+}
+/**
+ * @brief 设置访问时间和修改时间，支持UTIME_NOW / UTIME_OMIT，状态改变时间更新为当前时间
+ * 
+ * @param inode 
+ * @param tv tv[0]为访问时间，tv[1]为修改时间；为NULL时都取当前时间
+ */
+void fs_utimens(struct newfs_inode * inode, const struct timespec tv[2]) {
+    SFS_INODE_SCOPE(inode);
+    struct timespec* times[2] = { &inode->atime, &inode->mtime };
+    int i;
+
+    fs_touch_inode(inode, SFS_TIME_CTIME);
+    for (i = 0; i < 2; i++) {
+        if (tv == NULL || tv[i].tv_nsec == UTIME_NOW) {
+            *times[i] = inode->ctime;
         }
-        if (is_find_free_entry) {
-            break;
+        else if (tv[i].tv_nsec != UTIME_OMIT) {
+            *times[i] = tv[i];
         }
     }
-
-    if (!is_find_free_entry || (byte_cursor == SFS_BLKS_SZ(newfs_super.map_data_blks) && (bit_cursor == UINT8_BITS)))
+}
+/**
+ * @brief 先占后查：从延迟分配的额度中为n个块占位，已用块加上所有占位不超过数据区，
+ * 延迟写入的块回写时因此一定有空间。分配完成后由调用者归还占位
+ * 
+ * @param n 块数
+ * @return int 
+ */
+static int fs_reserve_data(int n) {
+    if (n > 0 && __sync_add_and_fetch(&newfs_super.delay_blks, n) +
+        __atomic_load_n(&newfs_super.sz_usage, __ATOMIC_RELAXED) / SFS_BLOCK_SZ() > newfs_super.max_data) {
+        __sync_fetch_and_sub(&newfs_super.delay_blks, n);
         return -SFS_ERROR_NOSPACE;
-    
-    return data_cursor;
+    }
+    return SFS_ERROR_NONE;
 }
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 延迟分配的块已分配数据块或被释放，从文件和全局的延迟计数中扣除
  * 
  * @param inode 
- * @return int 
+ * @param blk 逻辑块号
  */
-int fs_sync_inode(struct newfs_inode * inode) {
-    struct newfs_inode_d inode_d;
-    struct newfs_dentry*  dentry_cursor;
-    struct newfs_dentry_d dentry_d;
-    int ino             = inode->ino;
-    inode_d.ino         = ino;
-    inode_d.size        = inode->size;
-    // memcpy(inode_d.target_path, inode->target_path, SFS_MAX_FILE_NAME);
-    inode_d.ftype       = inode->dentry->ftype;
-    inode_d.dir_cnt     = inode->dir_cnt;
-    int offset;
+static inline void fs_undelay_block(struct newfs_inode* inode, int blk) {
+    inode->block_flags[blk] &= ~SFS_FLAG_BUF_DELAY;
+    inode->delay_blks--;
+    __sync_fetch_and_sub(&newfs_super.delay_blks, 1);
+}
+/**
+ * @brief 分配一个数据块，占用位图，不动用延迟写入已预留的空间
+ * @return data block对应的编号
+ */
+int fs_alloc_data() {
+    int got, start;
+    if (fs_reserve_data(1) != SFS_ERROR_NONE) {
+        return -SFS_ERROR_NOSPACE;
+    }
+    start = fs_alloc_data_near(0, 1, &got);
+    __sync_fetch_and_sub(&newfs_super.delay_blks, 1);
+    return start;
+}
+/**
+ * @brief 在已锁住的块组中，从goal开始向后（到组末尾后回绕到组开头）查找空闲区段，
+ * 分配最长的连续区段，最多want块
+ * 
+ * 找到长度达到want的区段即停止，因此返回的区段是离goal最近的足够长的区段；
+ * 组内没有这么长的区段时，返回组内最长区段
+ * 
+ * @param group 
+ * @param goal 期望的起始数据块号，不在本组时从组开头找
+ * @param want 
+ * @param got 
+ * @return int 区段的起始数据块号，负数为错误码
+ */
+static int fs_take_data(int group, int goal, int want, int* got) {
+    int dpg        = newfs_super.data_per_group;
+    int first      = group * dpg;
+    int cursor, scanned;
+    int run_start  = 0, run_len = 0;
+    int best_start = 0, best_len = 0;
 
-    if (fs_driver_write(SFS_INO_OFS(ino), (uint8_t *)&inode_d,
-                        sizeof(struct newfs_inode_d)) != SFS_ERROR_NONE)
-    {
-        SFS_DBG("[%s] io error\n", __func__);
-        return -SFS_ERROR_IO;
+    *got = 0;
+    if (newfs_super.groups[group].free_data == 0) {
+        return -SFS_ERROR_NOSPACE;
     }
-                                                      /* Cycle 1: 写 INODE */
-                                                      /* Cycle 2: 写 数据 */
-    if (SFS_IS_DIR(inode)) {                          
-        dentry_cursor = inode->dentrys;
-        offset        = SFS_DATA_OFS(inode->block_pointer[0]);
-        while (dentry_cursor != NULL)
-        {
-            memcpy(dentry_d.fname, dentry_cursor->fname, SFS_MAX_FILE_NAME);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-            if (fs_driver_write(offset, (uint8_t *)&dentry_d, 
-                                 sizeof(struct newfs_dentry_d)) != SFS_ERROR_NONE) {
-                SFS_DBG("[%s] io error\n", __func__);
-                return -SFS_ERROR_IO;                     
+    if (goal < first || goal >= first + dpg) {
+        goal = first;
+    }
+    cursor = goal;
+    for (scanned = 0; scanned < dpg; scanned++) {
+        if (cursor == first) {                        /* 区段不跨越回绕点 */
+            run_len = 0;
+        }
+        if (SFS_BITMAP_TEST(newfs_super.map_data, cursor)) {
+            run_len = 0;
+        }
+        else {
+            if (run_len == 0) {
+                run_start = cursor;
             }
-            
-            if (dentry_cursor->inode != NULL) {
-                fs_sync_inode(dentry_cursor->inode);
+            run_len++;
+            if (run_len > best_len) {
+                best_start = run_start;
+                best_len   = run_len;
+                if (best_len >= want) {
+                    break;
+                }
             }
-
-            dentry_cursor = dentry_cursor->brother;
-            offset += sizeof(struct newfs_dentry_d);
-            if(offset > SFS_BLOCK_SZ())
-                SFS_DBG("[%s] io error\n", __func__);
         }
+        cursor = (cursor + 1 == first + dpg) ? first : cursor + 1;
     }
-    else if (SFS_IS_FILE(inode)) {
-        for (int i=0;i<SFS_DATA_PER_FILE;i++) {
-            if (fs_driver_write(SFS_DATA_OFS(inode->block_pointer[i]), inode->data[i], SFS_BLKS_SZ(SFS_DATA_PER_FILE)) !=SFS_ERROR_NONE) {
-                SFS_DBG("[%s] io error\n", __func__);
-                return -SFS_ERROR_IO;
-            }
-        }
-        
+
+    if (best_len == 0) {
+        return -SFS_ERROR_NOSPACE;
     }
-    return SFS_ERROR_NONE;
+    for (cursor = best_start; cursor < best_start + best_len; cursor++) {
+        SFS_BITMAP_SET(newfs_super.map_data, cursor);
+    }
+    newfs_super.groups[group].free_data -= best_len;
+    __sync_fetch_and_add(&newfs_super.sz_usage, SFS_BLKS_SZ(best_len));
+    *got = best_len;
+    return best_start;
 }
 /**
- * @brief 删除内存中的一个inode， 暂时不释放
- * Case 1: Reg File
- * 
- *                  Inode
- *                /      \
- *            Dentry -> Dentry (Reg Dentry)
- *                       |
- *                      Inode  (Reg File)
+ * @brief 在goal附近分配最多want块的连续区段，区段总在同一个块组内，保证物理连续
  * 
- *  1) Step 1. Erase Bitmap     
- *  2) Step 2. Free Inode                      (Function of sfs_drop_inode)
- * ------------------------------------------------------------------------
- *  3) *Setp 3. Free Dentry belonging to Inode (Outsider)
- * ========================================================================
- * Case 2: Dir
- *                  Inode
- *                /      \
- *            Dentry -> Dentry (Dir Dentry)
- *                       |
- *                      Inode  (Dir)
- *                    /     \
- *                Dentry -> Dentry
+ * goal所在块组正被其他线程占用时改在本线程的亲和块组分配，
+ * 该块组已满时依次从其他块组窃取
  * 
- *   Recursive
- * @param inode 
- * @return int 
+ * @param goal 期望的起始数据块号，例如文件最后一个块之后
+ * @param want 期望的块数
+ * @param got 实际分配的块数
+ * @return int 区段的起始数据块号，负数为错误码
  */
-int fs_drop_inode(struct newfs_inode * inode) {
-    struct newfs_dentry*  dentry_cursor;
-    struct newfs_dentry*  dentry_to_free;
-    struct newfs_inode*   inode_cursor;
-
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    boolean is_find = FALSE;
+int fs_alloc_data_near(int goal, int want, int* got) {
+    SFS_STAT_SCOPE(SFS_STAGE_ALLOC_DATA);
+    int group, g, i, start;
 
-    if (inode == newfs_super.root_dentry->inode) {
-        return SFS_ERROR_INVAL;
+    if (goal < 0 || goal >= newfs_super.max_data) {
+        goal = 0;
     }
+    group = fs_lock_group(SFS_DATA_GROUP(goal));
+    start = fs_take_data(group, goal, want, got);
+    pthread_mutex_unlock(&newfs_super.groups[group].lock);
 
-    if (SFS_IS_DIR(inode)) {
-        dentry_cursor = inode->dentrys;
-                                                      /* 递归向下drop */
-        while (dentry_cursor)
-        {   
-            inode_cursor = dentry_cursor->inode;
-            fs_drop_inode(inode_cursor);
-            fs_drop_dentry(inode, dentry_cursor);
-            dentry_to_free = dentry_cursor;
-            dentry_cursor = dentry_cursor->brother;
-            free(dentry_to_free);
-        }
-    }
-    else if (SFS_IS_FILE(inode)) {
-        for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_inode_blks); 
-            byte_cursor++)                            /* 调整inodemap */
-        {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if (ino_cursor == inode->ino) {
-                     newfs_super.map_inode[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                     is_find = TRUE;
-                     break;
-                }
-                ino_cursor++;
-            }
-            if (is_find == TRUE) {
-                break;
-            }
-        }
-        for(int i=0;i<SFS_DATA_PER_FILE;i++) {
-            if (inode->data[i])
-                free(inode->data[i]);
-            if (inode->block_pointer[i]) {
-                fs_free_data(inode->block_pointer[i]);
-            }
-        }
-        
-        free(inode);
+    for (i = 1; start < 0 && i < newfs_super.group_cnt; i++) {
+        g = (group + i) % newfs_super.group_cnt;
+        pthread_mutex_lock(&newfs_super.groups[g].lock);
+        start = fs_take_data(g, g * newfs_super.data_per_group, want, got);
+        pthread_mutex_unlock(&newfs_super.groups[g].lock);
     }
-    return SFS_ERROR_NONE;
+    return start;
 }
 /**
- * @brief 在数据位图中修改被释放的数据块的标识
- * @param data_num 数据块的编号 
+ * @brief 归还inode预留窗口中尚未使用的数据块
+ * 
+ * @param inode 
  * @return int 
  */
-int fs_free_data(int data_num) {
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    boolean is_find = FALSE;
-    for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_data_blks); 
-            byte_cursor++)                            /* 调整datamap */
-        {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if (ino_cursor == data_num) {
-                     newfs_super.map_data[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                     is_find = TRUE;
-                     break;
-                }
-                ino_cursor++;
-            }
-            if (is_find == TRUE) {
-                break;
-            }
-        }
+int fs_release_prealloc(struct newfs_inode* inode) {
+    SFS_INODE_SCOPE(inode);
+    while (inode->prealloc_len > 0) {
+        fs_free_data(inode->prealloc_start);
+        inode->prealloc_start++;
+        inode->prealloc_len--;
+    }
     return SFS_ERROR_NONE;
 }
 /**
- * @brief 
+ * @brief 为文件的第blk个逻辑块选择目标数据块：紧跟在前一个已映射块之后，
+ * 没有则紧邻后一个已映射块，再没有则靠近同组父目录的目录块，最后是inode所在块组的数据区开头
  * 
- * @param dentry dentry指向ino，读取该inode
- * @param ino inode唯一编号
- * @return struct sfs_inode* 
+ * @param inode 
+ * @param blk 
+ * @return int 
  */
-struct newfs_inode* fs_read_inode(struct newfs_dentry * dentry, int ino) {
-    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+static int fs_goal_data(struct newfs_inode* inode, int blk) {
+    struct newfs_dentry* parent = inode->dentry->parent;
+    int i;
+    for (i = blk - 1; i >= 0; i--) {
+        if (!SFS_IS_HOLE(inode, i)) {
+            return inode->block_pointer[i] + (blk - i);
+        }
+    }
+    for (i = blk + 1; i < SFS_MAX_DATA_PER_FILE; i++) {
+        if (!SFS_IS_HOLE(inode, i)) {
+            return SFS_MAX(inode->block_pointer[i] - (i - blk), 0);
+        }
+    }
+    if (parent != NULL && parent->inode != NULL && !SFS_IS_HOLE(parent->inode, 0) &&
+        SFS_DATA_GROUP(parent->inode->block_pointer[0]) == SFS_INO_GROUP(inode->ino)) {
+        return parent->inode->block_pointer[0];
+    }
+    return SFS_INO_GROUP(inode->ino) * newfs_super.data_per_group;
+}
+/**
+ * @brief 为文件从第blk个逻辑块起的cnt个块分配物理连续的数据块，优先使用预留窗口，
+ * 窗口不连续时归还旧窗口，并在目标附近多预留SFS_PREALLOC_BLKS - 1个连续块作为新窗口。
+ * 不是延迟写入的块（以及新窗口）要先占额度，不能挤占延迟写入已预留的空间，空间紧张时不留窗口
+ * 
+ * @param inode 
+ * @param blk 
+ * @param cnt 需要的块数
+ * @param reserved 这些块是延迟写入的块，已在fs_delay_block中占过额度
+ * @param got 实际分配的块数，空间零散时可能少于cnt
+ * @return int 起始数据块号，负数为错误码
+ */
+static int fs_alloc_data_for(struct newfs_inode* inode, int blk, int cnt, boolean reserved, int* got) {
+    int need, extra, avail, start;
+
+    if (inode->prealloc_len > 0 && inode->prealloc_lblk == blk) {
+        start = inode->prealloc_start;
+        *got  = SFS_MIN(cnt, inode->prealloc_len);
+        inode->prealloc_start += *got;
+        inode->prealloc_lblk  += *got;
+        inode->prealloc_len   -= *got;
+        return start;
+    }
+    fs_release_prealloc(inode);
+
+    need  = reserved ? 0 : cnt;
+    extra = SFS_IS_FILE(inode) ? SFS_MIN(SFS_PREALLOC_BLKS - 1, SFS_MAX_DATA_PER_FILE - blk - cnt) : 0;
+    if (fs_reserve_data(need + extra) != SFS_ERROR_NONE) {
+        extra = 0;
+        if (fs_reserve_data(need) != SFS_ERROR_NONE) {
+            return -SFS_ERROR_NOSPACE;
+        }
+    }
+    start = fs_alloc_data_near(fs_goal_data(inode, blk), cnt + extra, &avail);
+    __sync_fetch_and_sub(&newfs_super.delay_blks, need + extra);
+    if (start < 0) {
+        return start;
+    }
+    *got = SFS_MIN(avail, cnt);
+    inode->prealloc_start = start + *got;
+    inode->prealloc_lblk  = blk + *got;
+    inode->prealloc_len   = avail - *got;
+    return start;
+}
+/**
+ * @brief 统计文件的区段数，物理块号连续的相邻逻辑块属于同一区段
+ * 
+ * @param inode 
+ * @return int 
+ */
+int fs_count_extents(struct newfs_inode* inode) {
+    int blk, extents = 0;
+    int prev = SFS_DATA_HOLE;
+    for (blk = 0; blk < SFS_MAX_DATA_PER_FILE; blk++) {
+        if (!SFS_IS_HOLE(inode, blk) && 
+            (prev == SFS_DATA_HOLE || !SFS_DATA_ADJACENT(prev, inode->block_pointer[blk]))) {
+            extents++;
+        }
+        prev = inode->block_pointer[blk];
+    }
+    return extents;
+}
+/**
+ * @brief 递归统计内存中已加载文件的碎片情况
+ * 
+ * @param dentry 
+ * @param stat 
+ */
+static void fs_frag_walk(struct newfs_dentry* dentry, struct newfs_frag_stat* stat) {
+    struct newfs_inode*  inode = dentry->inode;
+    struct newfs_dentry* dentry_cursor;
+    int blk, extents;
+
+    if (inode == NULL) {
+        return;
+    }
+    SFS_INODE_SCOPE(inode);
+    if (SFS_IS_DIR(inode)) {
+        for (dentry_cursor = inode->dentrys; dentry_cursor; dentry_cursor = dentry_cursor->brother) {
+            fs_frag_walk(dentry_cursor, stat);
+        }
+        return;
+    }
+    extents = fs_count_extents(inode);
+    if (extents == 0) {
+        return;
+    }
+    stat->files++;
+    stat->extents += extents;
+    for (blk = 0; blk < SFS_MAX_DATA_PER_FILE; blk++) {
+        if (!SFS_IS_HOLE(inode, blk)) {
+            stat->blocks++;
+        }
+    }
+}
+/**
+ * @brief 碎片报告：文件数、数据块数、区段数，平均每文件区段数为extents / files
+ * 
+ * @param stat 
+ */
+void fs_frag_report(struct newfs_frag_stat* stat) {
+    memset(stat, 0, sizeof(struct newfs_frag_stat));
+    fs_frag_walk(newfs_super.root_dentry, stat);
+}
+/**
+ * @brief 将内存inode及其下方结构全部刷回磁盘
+ * 
+ * 目录项按块打包写入，目录块在此时按需分配；文件只写回脏块，空洞不产生任何IO
+ * 
+ * @param inode 
+ * @return int 
+ */
+int fs_sync_inode(struct newfs_inode * inode) {
+    SFS_INODE_SCOPE(inode);
     struct newfs_inode_d inode_d;
+    struct newfs_dentry*  dentry_cursor;
+    struct newfs_dentry_d* dentry_d;
+    int ino             = inode->ino;
+    int per_blk         = SFS_DENTRY_PER_BLK();
+    int blk_cnt, blk, dir_idx, data_num, got;
+    uint8_t* blk_buf;
+                                                      /* Cycle 1: 写 数据 */
+    if (SFS_IS_DIR(inode)) {
+        blk_cnt       = SFS_MIN((inode->dir_cnt + per_blk - 1) / per_blk, SFS_MAX_DATA_PER_FILE);
+        blk_buf       = (uint8_t *)malloc(SFS_BLOCK_SZ());
+        dentry_cursor = inode->dentrys;
+        for (blk = 0; blk < blk_cnt; blk++) {
+            if (SFS_IS_HOLE(inode, blk)) {            /* 目录块在fs_create_dentry中已占额度 */
+                data_num = fs_alloc_data_for(inode, blk, 1, SFS_IS_DELAY(inode, blk) != 0, &got);
+                if (data_num < 0) {
+                    free(blk_buf);
+                    return data_num;
+                }
+                inode->block_pointer[blk] = data_num;
+                if (SFS_IS_DELAY(inode, blk)) {
+                    fs_undelay_block(inode, blk);
+                }
+            }
+            memset(blk_buf, 0, SFS_BLOCK_SZ());
+            dentry_d = (struct newfs_dentry_d *)blk_buf;
+            for (dir_idx = 0; dir_idx < per_blk && dentry_cursor != NULL; dir_idx++) {
+                memcpy(dentry_d[dir_idx].fname, dentry_cursor->fname, SFS_MAX_FILE_NAME);
+                dentry_d[dir_idx].ftype = dentry_cursor->ftype;
+                dentry_d[dir_idx].ino   = dentry_cursor->ino;
+                if (dentry_cursor->inode != NULL) {
+                    fs_sync_inode(dentry_cursor->inode);
+                }
+                dentry_cursor = dentry_cursor->brother;
+            }
+            if (fs_driver_write(SFS_DATA_OFS(inode->block_pointer[blk]), blk_buf, 
+                                SFS_BLOCK_SZ()) != SFS_ERROR_NONE) {
+                SFS_ERR("[%s] io error\n", __func__);
+                free(blk_buf);
+                return -SFS_ERROR_IO;
+            }
+        }
+        for (; blk < SFS_MAX_DATA_PER_FILE; blk++) {  /* 目录缩小后多余的块归还 */
+            fs_unmap_block(inode, blk);
+        }
+        free(blk_buf);
+    }
+    else if (SFS_IS_FILE(inode)) {
+        if (fs_writeback_inode(inode) != SFS_ERROR_NONE) {
+            SFS_ERR("[%s] writeback error\n", __func__);
+            return -SFS_ERROR_IO;
+        }
+        if (inode->open_cnt == 0) {                   /* 没有句柄会再追加，窗口不带到磁盘上 */
+            fs_release_prealloc(inode);
+        }
+    }
+                                                      /* Cycle 2: 写 INODE */
+    memset(&inode_d, 0, sizeof(struct newfs_inode_d));
+    inode_d.ino         = ino;
+    inode_d.size        = inode->size;
+    inode_d.ftype       = inode->dentry->ftype;
+    inode_d.dir_cnt     = inode->dir_cnt;
+    memcpy(inode_d.block_pointer, inode->block_pointer, sizeof(inode_d.block_pointer));
+    inode_d.atime       = inode->atime;
+    inode_d.mtime       = inode->mtime;
+    inode_d.ctime       = inode->ctime;
+
+    if (fs_driver_write(SFS_INO_OFS(ino), (uint8_t *)&inode_d,
+                        sizeof(struct newfs_inode_d)) != SFS_ERROR_NONE)
+    {
+        SFS_ERR("[%s] io error\n", __func__);
+        return -SFS_ERROR_IO;
+    }
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 删除内存中的一个inode，归还inode位图、数据块和内存
+ * Case 1: Reg File
+ * 
+ *                  Inode
+ *                /      \
+ *            Dentry -> Dentry (Reg Dentry)
+ *                       |
+ *                      Inode  (Reg File)
+ * 
+ *  1) Step 1. Erase Bitmap     
+ *  2) Step 2. Free Inode                      (Function of sfs_drop_inode)
+ * ------------------------------------------------------------------------
+ *  3) *Setp 3. Free Dentry belonging to Inode (Outsider)
+ * ========================================================================
+ * Case 2: Dir
+ *                  Inode
+ *                /      \
+ *            Dentry -> Dentry (Dir Dentry)
+ *                       |
+ *                      Inode  (Dir)
+ *                    /     \
+ *                Dentry -> Dentry
+ * 
+ *   Recursive，之后同Case 1，另外从块组的目录数中减去
+ * @param inode 
+ * @return int 
+ */
+int fs_drop_inode(struct newfs_inode * inode) {
+    struct newfs_dentry*  dentry_cursor;
+    struct newfs_dentry*  dentry_to_free;
+    struct newfs_inode*   inode_cursor;
+    int group = SFS_INO_GROUP(inode->ino);
+
+    if (inode == newfs_super.root_dentry->inode) {
+        return SFS_ERROR_INVAL;
+    }
+
+    fs_lock_inode(inode);
+    if (SFS_IS_DIR(inode)) {
+        dentry_cursor = inode->dentrys;
+                                                      /* 递归向下drop，未加载的子项先读入 */
+        while (dentry_cursor)
+        {   
+            inode_cursor = fs_dentry_inode(dentry_cursor);
+            if (inode_cursor != NULL) {
+                fs_drop_inode(inode_cursor);
+            }
+            fs_drop_dentry(inode, dentry_cursor);
+            dentry_to_free = dentry_cursor;
+            dentry_cursor = dentry_cursor->brother;
+            free(dentry_to_free);
+        }
+    }
+    pthread_mutex_lock(&newfs_super.groups[group].lock);
+    SFS_BITMAP_CLEAR(newfs_super.map_inode, inode->ino);   /* 调整inodemap */
+    newfs_super.groups[group].free_inodes++;
+    if (SFS_IS_DIR(inode)) {
+        newfs_super.groups[group].dirs--;             /* 与fs_take_ino对应 */
+    }
+    pthread_mutex_unlock(&newfs_super.groups[group].lock);
+    fs_release_prealloc(inode);
+    for (int i = 0; i < SFS_MAX_DATA_PER_FILE; i++) {
+        fs_unmap_block(inode, i);                     /* 目录的目录项块同样归还 */
+    }
+    fs_unlock_inode(inode);
+    pthread_mutex_destroy(&inode->lock);
+    free(inode);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 在数据位图中修改被释放的数据块的标识
+ * @param data_num 数据块的编号 
+ * @return int 
+ */
+int fs_free_data(int data_num) {
+    if (data_num < 0 || data_num >= newfs_super.max_data) {
+        return -SFS_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&newfs_super.groups[SFS_DATA_GROUP(data_num)].lock);
+    if (newfs_super.map_data[data_num / UINT8_BITS] & (0x1 << (data_num % UINT8_BITS))) {
+        newfs_super.map_data[data_num / UINT8_BITS] &= (uint8_t)(~(0x1 << (data_num % UINT8_BITS)));
+        newfs_super.groups[SFS_DATA_GROUP(data_num)].free_data++;
+        __sync_fetch_and_sub(&newfs_super.sz_usage, SFS_BLOCK_SZ());
+    }
+    pthread_mutex_unlock(&newfs_super.groups[SFS_DATA_GROUP(data_num)].lock);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 将文件的第blk个逻辑块读入内存缓存。以下块缓存操作都由调用者持有inode锁
+ * 
+ * @param inode 
+ * @param blk 逻辑块号
+ * @return int 
+ */
+int fs_load_block(struct newfs_inode* inode, int blk) {
+    if (inode->data[blk] != NULL) {
+        fs_stat_count(SFS_CNT_BLOCK_HIT, 1);
+        return SFS_ERROR_NONE;
+    }
+    fs_stat_count(SFS_CNT_BLOCK_MISS, 1);
+    inode->data[blk] = (uint8_t *)calloc(1, SFS_BLOCK_SZ());
+    if (SFS_IS_HOLE(inode, blk)) {
+        return SFS_ERROR_NONE;
+    }
+    if (fs_driver_read(SFS_DATA_OFS(inode->block_pointer[blk]), inode->data[blk], 
+                       SFS_BLOCK_SZ()) != SFS_ERROR_NONE) {
+        SFS_ERR("[%s] io error\n", __func__);
+        return -SFS_ERROR_IO;
+    }
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 把[blk, blk + cnt)中尚未缓存的块读入内存，物理连续的一段只seek一次、顺序读完
+ * 
+ * ahead_from及之后的块是为后续读请求预读的，标记SFS_FLAG_BUF_AHEAD并计入预读统计
+ * 
+ * @param inode 
+ * @param blk 起始逻辑块号
+ * @param cnt 块数，超出文件大小的部分忽略
+ * @param ahead_from 预读部分的起始逻辑块号
+ * @return int 从磁盘读入的块数，负数为错误码
+ */
+int fs_readahead(struct newfs_inode* inode, int blk, int cnt, int ahead_from) {
+    int      end = SFS_MIN(SFS_MIN(blk + cnt, SFS_MAX_DATA_PER_FILE), 
+                           SFS_BLK_IDX(inode->size + SFS_BLOCK_SZ() - 1));
+    int      done = 0, ahead = 0, i, j, k;
+    uint8_t* buf;
+
+    for (i = blk; i < end; i = j) {
+        if (inode->data[i] != NULL || SFS_IS_SPARSE(inode, i)) {
+            j = i + 1;
+            continue;
+        }
+        for (j = i + 1; j < end && inode->data[j] == NULL && !SFS_IS_HOLE(inode, j) &&
+             SFS_DATA_ADJACENT(inode->block_pointer[j - 1], inode->block_pointer[j]); j++);
+        buf = (uint8_t *)malloc(SFS_BLKS_SZ(j - i));
+        if (fs_driver_read(SFS_DATA_OFS(inode->block_pointer[i]), buf, 
+                           SFS_BLKS_SZ(j - i)) != SFS_ERROR_NONE) {
+            SFS_ERR("[%s] io error\n", __func__);
+            free(buf);
+            return -SFS_ERROR_IO;
+        }
+        for (k = i; k < j; k++) {
+            inode->data[k] = (uint8_t *)malloc(SFS_BLOCK_SZ());
+            memcpy(inode->data[k], buf + SFS_BLKS_SZ(k - i), SFS_BLOCK_SZ());
+            if (k >= ahead_from) {
+                inode->block_flags[k] |= SFS_FLAG_BUF_AHEAD;
+                ahead++;
+            }
+        }
+        free(buf);
+        done += j - i;
+    }
+    if (ahead > 0) {
+        __sync_fetch_and_add(&newfs_super.ra_blks, ahead);
+    }
+    return done;
+}
+/**
+ * @brief 按句柄的访问模式预读：读请求接着上一次读的末尾时认为是顺序读，
+ * 窗口从SFS_RA_MIN_BLKS开始每次翻倍直到SFS_RA_MAX_BLKS，随机读时清零不预读。
+ * 
+ * 在读请求之前调用，把本次要读的块和之后一个窗口放在同一批驱动读里；
+ * 已预读的部分还剩不到半个窗口时才发起下一批，避免每次读都去检查整个窗口
+ * 
+ * @param file 打开文件的句柄
+ * @param offset 本次读的偏移
+ * @param size 本次读的大小
+ * @return int 从磁盘读入的块数，负数为错误码
+ */
+int fs_file_readahead(struct newfs_file* file, off_t offset, int size) {
+    struct newfs_inode* inode = file->inode;
+    SFS_INODE_SCOPE(inode);                           /* 同一句柄的预读状态也在inode锁内 */
+    int    blk, next;
+
+    if (offset == file->ra_next) {
+        file->ra_seq++;
+        file->ra_win = SFS_MIN(file->ra_win ? file->ra_win * 2 : SFS_RA_MIN_BLKS, SFS_RA_MAX_BLKS);
+    }
+    else {
+        file->ra_seq = 0;
+        file->ra_win = 0;
+        file->ra_blk = 0;
+    }
+    file->ra_next = offset + size;
+    if (file->ra_win == 0 || offset < 0 || offset >= inode->size || size <= 0) {
+        return 0;
+    }
+
+    blk  = SFS_BLK_IDX((int)offset);
+    next = SFS_BLK_IDX((int)SFS_MIN(offset + size, inode->size) - 1) + 1;
+    if (file->ra_blk - next >= file->ra_win / 2) {
+        return 0;
+    }
+    file->ra_blk = next + file->ra_win;
+    return fs_readahead(inode, blk, file->ra_blk - blk, next);
+}
+/**
+ * @brief 保证文件的第blk个逻辑块已映射到物理块，空洞块分配后以全零内容置脏
+ * 
+ * @param inode 
+ * @param blk 逻辑块号
+ * @return int 
+ */
+int fs_map_block(struct newfs_inode* inode, int blk) {
+    int data_num, got;
+    if (!SFS_IS_HOLE(inode, blk)) {
+        return fs_load_block(inode, blk);
+    }
+    data_num = fs_alloc_data_for(inode, blk, 1, SFS_IS_DELAY(inode, blk) != 0, &got);
+    if (data_num < 0) {
+        return data_num;
+    }
+    inode->block_pointer[blk] = data_num;
+    if (SFS_IS_DELAY(inode, blk)) {                   /* 保留已缓存的数据 */
+        fs_undelay_block(inode, blk);
+    }
+    else if (inode->data[blk] == NULL) {
+        inode->data[blk] = (uint8_t *)calloc(1, SFS_BLOCK_SZ());
+    }
+    else {
+        memset(inode->data[blk], 0, SFS_BLOCK_SZ());
+    }
+    inode->block_flags[blk] |= SFS_FLAG_BUF_DIRTY;
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 延迟分配：为空洞块准备全零的内存缓存并置脏，数据块留到回写时再分配
+ * 
+ * @param inode 
+ * @param blk 逻辑块号
+ * @return int 
+ */
+int fs_delay_block(struct newfs_inode* inode, int blk) {
+    if (!SFS_IS_SPARSE(inode, blk)) {
+        return fs_load_block(inode, blk);
+    }
+    if (fs_reserve_data(1) != SFS_ERROR_NONE) {       /* 占位保留到回写分配之后 */
+        return -SFS_ERROR_NOSPACE;
+    }
+    if (inode->data[blk] == NULL) {
+        inode->data[blk] = (uint8_t *)calloc(1, SFS_BLOCK_SZ());
+    }
+    else {
+        memset(inode->data[blk], 0, SFS_BLOCK_SZ());
+    }
+    inode->block_flags[blk] |= SFS_FLAG_BUF_DELAY | SFS_FLAG_BUF_DIRTY;
+    inode->delay_blks++;
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 回写文件数据
+ * 
+ * Pass 1: 延迟分配的块按逻辑连续的区段整段分配数据块，先用预留窗口，区段之后再留一个窗口，
+ *         窗口跨回写保留，追加写下一次回写时仍紧接在这次之后
+ * Pass 2: 脏块作为一批请求直接从inode->data提交给块设备层，按物理位置排序后一趟写完，
+ *         物理连续的块之间不再seek，也不再拷贝到中转缓冲
+ * 
+ * @param inode 
+ * @return int 
+ */
+int fs_writeback_inode(struct newfs_inode* inode) {
+    SFS_STAT_SCOPE(SFS_STAGE_WRITEBACK);
+    int blk, end, start, got, i, cnt;
+    struct fs_blk_req* reqs;
+
+    for (blk = 0; blk < SFS_MAX_DATA_PER_FILE; ) {    /* Pass 1 */
+        if (!SFS_IS_DELAY(inode, blk)) {
+            blk++;
+            continue;
+        }
+        for (end = blk; end < SFS_MAX_DATA_PER_FILE && SFS_IS_DELAY(inode, end); end++);
+        while (blk < end) {
+            start = fs_alloc_data_for(inode, blk, end - blk, TRUE, &got);
+            if (start < 0) {
+                return start;
+            }
+            for (i = 0; i < got; i++, blk++) {
+                inode->block_pointer[blk] = start + i;
+                fs_undelay_block(inode, blk);
+            }
+        }
+    }
+
+    reqs = (struct fs_blk_req *)malloc(sizeof(struct fs_blk_req) * SFS_MAX_DATA_PER_FILE);
+    for (blk = 0, cnt = 0; blk < SFS_MAX_DATA_PER_FILE; blk++) {    /* Pass 2 */
+        if (!SFS_IS_DIRTY(inode, blk)) {
+            continue;
+        }
+        reqs[cnt].offset  = SFS_DATA_OFS(inode->block_pointer[blk]);
+        reqs[cnt].buf     = inode->data[blk];
+        reqs[cnt].size    = SFS_BLOCK_SZ();
+        reqs[cnt].write   = 1;
+        reqs[cnt].nocache = 1;                        /* 文件数据已缓存在inode->data中 */
+        cnt++;
+    }
+    if (cnt > 0) {
+        SFS_STAT_SCOPE(SFS_STAGE_DRIVER_WRITE);
+        fs_stat_count(SFS_CNT_DRIVER_WR_BYTES, SFS_BLKS_SZ(cnt));
+        if (fs_blk_submit(&newfs_super.blkdev, reqs, cnt) != 0) {
+            SFS_ERR("[%s] io error\n", __func__);
+            free(reqs);
+            return -SFS_ERROR_IO;                     /* 块仍是脏的，下次fsync或卸载时重试 */
+        }
+    }
+    for (blk = 0; blk < SFS_MAX_DATA_PER_FILE && cnt > 0; blk++) {  /* 写成功后才清脏位 */
+        if (SFS_IS_DIRTY(inode, blk)) {
+            inode->block_flags[blk] &= ~SFS_FLAG_BUF_DIRTY;
+        }
+    }
+    free(reqs);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 释放文件的第blk个逻辑块，使其重新成为空洞
+ * 
+ * @param inode 
+ * @param blk 逻辑块号
+ * @return int 
+ */
+int fs_unmap_block(struct newfs_inode* inode, int blk) {
+    if (SFS_IS_DELAY(inode, blk)) {
+        fs_undelay_block(inode, blk);
+    }
+    if (!SFS_IS_HOLE(inode, blk)) {
+        fs_free_data(inode->block_pointer[blk]);
+        inode->block_pointer[blk] = SFS_DATA_HOLE;
+    }
+    if (inode->data[blk] != NULL) {
+        free(inode->data[blk]);
+        inode->data[blk] = NULL;
+    }
+    inode->block_flags[blk] = 0;
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 读请求访问到预读进来的块时计一次命中
+ * 
+ * @param inode 
+ * @param blk 
+ */
+static inline void fs_readahead_hit(struct newfs_inode* inode, int blk) {
+    if (inode->block_flags[blk] & SFS_FLAG_BUF_AHEAD) {
+        inode->block_flags[blk] &= ~SFS_FLAG_BUF_AHEAD;
+        __sync_fetch_and_add(&newfs_super.ra_hits, 1);
+    }
+}
+/**
+ * @brief 读文件，空洞部分直接填零，不访问磁盘
+ * 
+ * @param inode 
+ * @param out_content 
+ * @param size 
+ * @param offset 
+ * @return int 实际读出的字节数，负数为错误码
+ */
+int fs_read_file(struct newfs_inode* inode, uint8_t* out_content, int size, off_t offset) {
+    SFS_INODE_SCOPE(inode);
+    int done = 0, blk, bias, len;
+
+    if (offset < 0 || offset >= inode->size) {
+        return 0;
+    }
+    size = SFS_MIN(size, inode->size - (int)offset);
+    while (done < size) {
+        blk  = SFS_BLK_IDX(offset + done);
+        bias = SFS_BLK_BIAS(offset + done);
+        len  = SFS_MIN(SFS_BLOCK_SZ() - bias, size - done);
+        if (SFS_IS_SPARSE(inode, blk)) {
+            memset(out_content + done, 0, len);
+        }
+        else {
+            if (fs_load_block(inode, blk) != SFS_ERROR_NONE) {
+                return -SFS_ERROR_IO;
+            }
+            fs_readahead_hit(inode, blk);
+            memcpy(out_content + done, inode->data[blk] + bias, len);
+        }
+        done += len;
+    }
+    if (SFS_TIME_BEFORE(inode->atime, inode->mtime)) {  /* relatime：只在修改后的第一次读时更新 */
+        fs_touch_inode(inode, SFS_TIME_ATIME);
+    }
+    return done;
+}
+/**
+ * @brief 读文件但不拷贝：把[offset, offset + size)所在的块缓存依次填入iov，空洞指向全零块
+ * 
+ * iov中的指针在该文件下一次被修改之前有效，供FUSE直接从块缓存回复读请求；
+ * 调用者持有inode锁直到不再使用iov
+ * 
+ * @param inode 
+ * @param offset 
+ * @param size 
+ * @param iov 输出
+ * @param max_iov iov的容量
+ * @return int 填入的iov项数，负数为错误码
+ */
+int fs_read_iov(struct newfs_inode* inode, off_t offset, int size, struct iovec* iov, int max_iov) {
+    int done = 0, cnt = 0, blk, bias, len;
+
+    if (offset < 0 || offset >= inode->size) {
+        return 0;
+    }
+    size = SFS_MIN(size, inode->size - (int)offset);
+    while (done < size && cnt < max_iov) {
+        blk  = SFS_BLK_IDX(offset + done);
+        bias = SFS_BLK_BIAS(offset + done);
+        len  = SFS_MIN(SFS_BLOCK_SZ() - bias, size - done);
+        if (SFS_IS_SPARSE(inode, blk)) {
+            iov[cnt].iov_base = newfs_super.zero_blk;
+        }
+        else {
+            if (fs_load_block(inode, blk) != SFS_ERROR_NONE) {
+                return -SFS_ERROR_IO;
+            }
+            fs_readahead_hit(inode, blk);
+            iov[cnt].iov_base = inode->data[blk] + bias;
+        }
+        iov[cnt].iov_len = len;
+        cnt++;
+        done += len;
+    }
+    if (SFS_TIME_BEFORE(inode->atime, inode->mtime)) {
+        fs_touch_inode(inode, SFS_TIME_ATIME);
+    }
+    return cnt;
+}
+/**
+ * @brief 写文件，只为被写到的块分配空间，越过EOF的中间区域保持为空洞
+ * 
+ * @param inode 
+ * @param in_content 
+ * @param size 
+ * @param offset 
+ * @return int 实际写入的字节数，负数为错误码
+ */
+int fs_write_file(struct newfs_inode* inode, const uint8_t* in_content, int size, off_t offset) {
+    SFS_INODE_SCOPE(inode);
+    int done = 0, blk, bias, len, ret = SFS_ERROR_NONE;
+
+    if (offset < 0 || size < 0) {
+        return -SFS_ERROR_INVAL;
+    }
+    if (offset > SFS_MAX_FILE_SZ() || size > SFS_MAX_FILE_SZ() - offset) {
+        return -SFS_ERROR_FBIG;
+    }
+    while (done < size) {
+        blk  = SFS_BLK_IDX(offset + done);
+        bias = SFS_BLK_BIAS(offset + done);
+        len  = SFS_MIN(SFS_BLOCK_SZ() - bias, size - done);
+        ret  = fs_write_begin(inode, blk);
+        if (ret != SFS_ERROR_NONE) {
+            break;
+        }
+        memcpy(inode->data[blk] + bias, in_content + done, len);
+        done += len;
+    }
+    if (done == 0 && size != 0) {
+        return ret;
+    }
+    ret = fs_write_end(inode, (int)offset, done);
+    return ret != SFS_ERROR_NONE ? ret : done;
+}
+/**
+ * @brief 准备写入文件的第blk个逻辑块：预留空间并置脏，调用者随后直接写inode->data[blk]
+ * 
+ * 写入方可以从任意来源（内存、FUSE管道）把数据直接拷进块缓存，不需要中间缓冲；
+ * 从fs_write_begin到fs_write_end调用者一直持有inode锁
+ * 
+ * @param inode 
+ * @param blk 逻辑块号
+ * @return int 
+ */
+int fs_write_begin(struct newfs_inode* inode, int blk) {
+    int ret = fs_delay_block(inode, blk);
+
+    if (ret == SFS_ERROR_NONE) {
+        inode->block_flags[blk] |= SFS_FLAG_BUF_DIRTY;
+    }
+    return ret;
+}
+/**
+ * @brief 结束一次写入：更新文件大小和时间戳，该文件延迟分配的块过多时回写该文件
+ * 
+ * @param inode 
+ * @param offset 本次写入的起始偏移
+ * @param done 实际写入的字节数
+ * @return int 回写失败时的错误码
+ */
+int fs_write_end(struct newfs_inode* inode, int offset, int done) {
+    inode->size = SFS_MAX(inode->size, offset + done);
+    fs_touch_inode(inode, SFS_TIME_MTIME | SFS_TIME_CTIME);
+    if (inode->delay_blks > SFS_DELAY_FLUSH_BLKS) {
+        return fs_writeback_inode(inode);
+    }
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 在文件中打洞：完整覆盖的块归还给数据位图，部分覆盖的块填零
+ * 
+ * @param inode 
+ * @param offset 
+ * @param len 超出块映射表的部分忽略
+ * @return int 
+ */
+int fs_punch_hole(struct newfs_inode* inode, off_t offset, off_t len) {
+    SFS_INODE_SCOPE(inode);
+    int cur, end, blk, bias, n;
+
+    if (offset < 0 || len <= 0) {
+        return -SFS_ERROR_INVAL;
+    }
+    if (offset >= SFS_MAX_FILE_SZ()) {
+        return SFS_ERROR_NONE;
+    }
+    cur = (int)offset;                                      /* 先在64位下截断，再转成块内偏移 */
+    end = (int)(len > SFS_MAX_FILE_SZ() - offset ? SFS_MAX_FILE_SZ() : offset + len);
+    while (cur < end) {
+        blk  = SFS_BLK_IDX(cur);
+        bias = SFS_BLK_BIAS(cur);
+        n    = SFS_MIN(SFS_BLOCK_SZ() - bias, end - cur);
+        if (!SFS_IS_SPARSE(inode, blk)) {
+            if (n == SFS_BLOCK_SZ()) {
+                fs_unmap_block(inode, blk);
+            }
+            else {
+                if (fs_load_block(inode, blk) != SFS_ERROR_NONE) {
+                    return -SFS_ERROR_IO;
+                }
+                memset(inode->data[blk] + bias, 0, n);
+                inode->block_flags[blk] |= SFS_FLAG_BUF_DIRTY;
+            }
+        }
+        cur += n;
+    }
+    fs_touch_inode(inode, SFS_TIME_MTIME | SFS_TIME_CTIME);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 为[offset, offset + len)预分配数据块
+ * 
+ * @param inode 
+ * @param offset 
+ * @param len 
+ * @param keep_size 为TRUE时不改变文件大小
+ * @return int 
+ */
+int fs_fallocate(struct newfs_inode* inode, off_t offset, off_t len, boolean keep_size) {
+    SFS_INODE_SCOPE(inode);
+    int blk, end, ret;
+
+    if (offset < 0 || len <= 0) {
+        return -SFS_ERROR_INVAL;
+    }
+    if (offset > SFS_MAX_FILE_SZ() || len > SFS_MAX_FILE_SZ() - offset) {
+        return -SFS_ERROR_FBIG;
+    }
+    end = (int)(offset + len);
+    for (blk = SFS_BLK_IDX((int)offset); SFS_BLKS_SZ(blk) < end; blk++) {
+        ret = fs_map_block(inode, blk);
+        if (ret != SFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+    if (!keep_size) {
+        inode->size = SFS_MAX(inode->size, end);
+    }
+    fs_touch_inode(inode, SFS_TIME_MTIME | SFS_TIME_CTIME);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 改变文件大小，截断部分的数据块被释放
+ * 
+ * @param inode 
+ * @param size 
+ * @return int 
+ */
+int fs_truncate_file(struct newfs_inode* inode, off_t size) {
+    SFS_INODE_SCOPE(inode);
+    int old_end = SFS_BLKS_SZ(SFS_BLK_IDX(inode->size + SFS_BLOCK_SZ() - 1));
+    int ret;
+
+    if (size < 0) {
+        return -SFS_ERROR_INVAL;
+    }
+    if (size > SFS_MAX_FILE_SZ()) {
+        return -SFS_ERROR_FBIG;
+    }
+    if (size < inode->size) {
+        ret = fs_punch_hole(inode, size, old_end - size);
+        if (ret != SFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+    inode->size = (int)size;
+    fs_touch_inode(inode, SFS_TIME_MTIME | SFS_TIME_CTIME);
+    return SFS_ERROR_NONE;
+}
+/**
+ * @brief 实现lseek的SEEK_DATA/SEEK_HOLE语义
+ * 
+ * @param inode 
+ * @param offset 起始偏移
+ * @param whence SEEK_DATA或SEEK_HOLE
+ * @return int 找到的偏移，越过文件末尾时返回-SFS_ERROR_NODATA
+ */
+int fs_seek_hole_data(struct newfs_inode* inode, off_t offset, int whence) {
+    SFS_INODE_SCOPE(inode);
+    int blk;
+
+    if (offset < 0 || offset >= inode->size) {              /* 文件不超过int，之后的转换不会截断 */
+        return -SFS_ERROR_NODATA;
+    }
+    for (blk = SFS_BLK_IDX((int)offset); blk * SFS_BLOCK_SZ() < inode->size; blk++) {
+        if (SFS_IS_SPARSE(inode, blk) == (whence == SEEK_HOLE)) {
+            return SFS_MAX((int)offset, blk * SFS_BLOCK_SZ());
+        }
+    }
+    return whence == SEEK_HOLE ? inode->size : -SFS_ERROR_NODATA;
+}
+/**
+ * @brief 
+ * 
+ * @param dentry dentry指向ino，读取该inode
+ * @param ino inode唯一编号
+ * @return struct sfs_inode* 
+ */
+static struct newfs_inode* fs_build_inode(struct newfs_dentry * dentry, 
+                                          const struct newfs_inode_d* inode_d) {
+    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
     struct newfs_dentry* sub_dentry;
-    struct newfs_dentry_d dentry_d;
+    struct newfs_dentry_d* dentry_d;
+    int    per_blk = SFS_DENTRY_PER_BLK();
     int    dir_cnt = 0, i;
-    if (fs_driver_read(SFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                        sizeof(struct newfs_inode_d)) != SFS_ERROR_NONE) {
-        SFS_DBG("[%s] io error\n", __func__);
-        return NULL;                    
-    }
+    uint8_t* blk_buf;
+    fs_init_inode_lock(inode);
     inode->dir_cnt = 0;
-    inode->ino = inode_d.ino;
-    inode->size = inode_d.size;
-    // memcpy(inode->target_path, inode_d.target_path, SFS_MAX_FILE_NAME);
+    inode->ino = inode_d->ino;
+    inode->size = inode_d->size;
     inode->dentry = dentry;
     inode->dentrys = NULL;
+    memcpy(inode->block_pointer, inode_d->block_pointer, sizeof(inode->block_pointer));
+    memset(inode->data, 0, sizeof(inode->data));      /* 文件数据按需读入 */
+    memset(inode->block_flags, 0, sizeof(inode->block_flags));
+    inode->prealloc_start = 0;
+    inode->prealloc_lblk = 0;
+    inode->prealloc_len = 0;
+    inode->delay_blks = 0;
+    inode->open_cnt = 0;
+    inode->ra_ahead = FALSE;
+    inode->atime = inode_d->atime;
+    inode->mtime = inode_d->mtime;
+    inode->ctime = inode_d->ctime;
     if (SFS_IS_DIR(inode)) {
-        dir_cnt = inode_d.dir_cnt;
+        dir_cnt = SFS_MIN(inode_d->dir_cnt, SFS_MAX_DENTRY_PER_DIR());   /* 损坏的dir_cnt不越过块映射表 */
+        blk_buf = (uint8_t *)malloc(SFS_BLOCK_SZ());
+        dentry_d = (struct newfs_dentry_d *)blk_buf;
         for (i = 0; i < dir_cnt; i++)
         {
-            if (fs_driver_read(SFS_DATA_OFS(inode_d.block_pointer[0]) + i * sizeof(struct newfs_dentry_d),
-                               (uint8_t *)&dentry_d,
-                               sizeof(struct newfs_dentry_d)) != SFS_ERROR_NONE)
+            if (i % per_blk == 0 &&
+                fs_driver_read(SFS_DATA_OFS(inode->block_pointer[i / per_blk]), blk_buf,
+                               SFS_BLOCK_SZ()) != SFS_ERROR_NONE)
             {
-                SFS_DBG("[%s] io error\n", __func__);
+                SFS_ERR("[%s] io error\n", __func__);
+                free(blk_buf);
                 return NULL;
             }
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
+            sub_dentry = new_dentry(dentry_d[i % per_blk].fname, dentry_d[i % per_blk].ftype);
             sub_dentry->parent = inode->dentry;
-            sub_dentry->ino    = dentry_d.ino; 
+            sub_dentry->ino    = dentry_d[i % per_blk].ino; 
             fs_alloc_dentry(inode, sub_dentry);
         }
+        free(blk_buf);
     }
-    else if (SFS_IS_FILE(inode)) {
-        for(int i=0;i<SFS_DATA_PER_FILE;i++) {
-            inode->data[i] = (uint8_t *)malloc(SFS_BLOCK_SZ());
-            if (fs_driver_read(SFS_DATA_OFS(inode_d.block_pointer[0]), (uint8_t *)inode->data, 
-                                SFS_BLOCK_SZ()) != SFS_ERROR_NONE) {
-                SFS_DBG("[%s] io error\n", __func__);
-                return NULL;                    
+    return inode;
+}
+/**
+ * @brief 
+ * 
+ * @param dentry 
+ * @param ino 
+ * @return struct newfs_inode* 
+ */
+struct newfs_inode* fs_read_inode(struct newfs_dentry * dentry, int ino) {
+    SFS_STAT_SCOPE(SFS_STAGE_READ_INODE);
+    struct newfs_inode_d inode_d;
+    if (fs_driver_read(SFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+                        sizeof(struct newfs_inode_d)) != SFS_ERROR_NONE) {
+        SFS_ERR("[%s] io error\n", __func__);
+        return NULL;                    
+    }
+    return fs_build_inode(dentry, &inode_d);
+}
+/**
+ * @brief 取得dentry对应的inode，不在内存中时从磁盘读入；命中readdir预取的inode时计数
+ * 
+ * 读入在父目录的锁内进行并再次检查，并发访问同一个dentry时只建一个内存inode
+ * 
+ * @param dentry 
+ * @return struct newfs_inode* 
+ */
+struct newfs_inode* fs_dentry_inode(struct newfs_dentry * dentry) {
+    struct newfs_inode* parent = dentry->parent != NULL ? dentry->parent->inode : NULL;
+    struct newfs_inode* inode;
+
+    if (dentry->inode == NULL) {
+        if (parent != NULL) {
+            fs_lock_inode(parent);
+        }
+        if (dentry->inode == NULL) {
+            fs_stat_count(SFS_CNT_INODE_MISS, 1);
+            inode = fs_read_inode(dentry, dentry->ino);
+            __sync_synchronize();                     /* 先建好再发布，不加锁的读者看不到半个inode */
+            dentry->inode = inode;
+        }
+        if (parent != NULL) {
+            fs_unlock_inode(parent);
+        }
+        return dentry->inode;
+    }
+    fs_stat_count(SFS_CNT_INODE_HIT, 1);
+    if (dentry->inode->ra_ahead && __sync_bool_compare_and_swap(&dentry->inode->ra_ahead, TRUE, FALSE)) {
+        __sync_fetch_and_add(&newfs_super.ra_inode_hits, 1);
+    }
+    return dentry->inode;
+}
+static int fs_cmp_dentry_ino(const void* a, const void* b) {
+    return (int)(*(struct newfs_dentry* const*)a)->ino - (int)(*(struct newfs_dentry* const*)b)->ino;
+}
+/**
+ * @brief readdir时预取目录中第start个起的cnt个目录项的inode（子目录连同其目录项块）
+ * 
+ * 按ino排序后，同一块组内ino连续的inode一次seek顺序读入，之后的lookup/getattr直接命中内存
+ * 
+ * @param inode 目录
+ * @param start 起始目录项下标
+ * @param cnt 目录项个数
+ * @return int 预取的inode数，负数为错误码
+ */
+int fs_prefetch_dir(struct newfs_inode* inode, int start, int cnt) {
+    SFS_INODE_SCOPE(inode);                           /* 与fs_dentry_inode一样在父目录锁内读入 */
+    struct newfs_dentry*  dentry_cursor = fs_get_dentry(inode, start);
+    struct newfs_inode*   sub_inode;
+    struct newfs_dentry** todo = (struct newfs_dentry**)malloc(sizeof(struct newfs_dentry*) * SFS_MAX(cnt, 1));
+    uint8_t* buf;
+    int      todo_cnt = 0, done = 0, i, j, k;
+
+    for (; dentry_cursor != NULL && cnt > 0; dentry_cursor = dentry_cursor->brother, cnt--) {
+        if (dentry_cursor->inode == NULL) {
+            todo[todo_cnt++] = dentry_cursor;
+        }
+    }
+    qsort(todo, todo_cnt, sizeof(struct newfs_dentry*), fs_cmp_dentry_ino);
+
+    buf = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_RA_MAX_BLKS));
+    for (i = 0; i < todo_cnt; i = j) {
+        for (j = i + 1; j < todo_cnt && j - i < SFS_RA_MAX_BLKS &&
+             todo[j]->ino == todo[j - 1]->ino + 1 &&
+             SFS_INO_GROUP(todo[j]->ino) == SFS_INO_GROUP(todo[i]->ino); j++);
+        if (fs_driver_read(SFS_INO_OFS(todo[i]->ino), buf, SFS_BLKS_SZ(j - i)) != SFS_ERROR_NONE) {
+            SFS_ERR("[%s] io error\n", __func__);
+            done = -SFS_ERROR_IO;
+            break;
+        }
+        for (k = i; k < j; k++) {
+            sub_inode = fs_build_inode(todo[k], (struct newfs_inode_d *)(buf + SFS_BLKS_SZ(k - i)));
+            if (sub_inode != NULL) {
+                sub_inode->ra_ahead = TRUE;
+                __sync_synchronize();
+                todo[k]->inode = sub_inode;
+                done++;
             }
         }
     }
-    return inode;
+    free(buf);
+    free(todo);
+    if (done > 0) {
+        __sync_fetch_and_add(&newfs_super.ra_inodes, done);
+    }
+    return done;
 }
 /**
  * @brief 
  * 
- * @param inode 
+ * @param inode 调用者持有inode锁
  * @param dir [0...]
  * @return struct sfs_dentry* 
  */
@@ -633,6 +1843,71 @@ struct newfs_dentry* fs_get_dentry(struct newfs_inode * inode, int dir) {
     }
     return NULL;
 }
+/**
+ * @brief 在目录中按文件名查找目录项（只比较本级文件名，不解析路径）
+ * 
+ * @param inode 目录，调用者持有inode锁
+ * @param fname 
+ * @return struct newfs_dentry* 没有时为NULL
+ */
+struct newfs_dentry* fs_find_dentry(struct newfs_inode* inode, const char* fname) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+
+    while (dentry_cursor)
+    {
+        if (strcmp(dentry_cursor->fname, fname) == 0) {
+            return dentry_cursor;
+        }
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return NULL;
+}
+/**
+ * @brief 在parent目录下新建文件或目录：查重、分配inode和插入目录项都在父目录的锁内，
+ * 并发创建同名文件时只有一个成功。目录项落入新的目录块时先为该块占额度（记为延迟分配），
+ * 同步时才分配，延迟写入的数据占满磁盘时目录块不会无处可放
+ * 
+ * @param parent 父目录dentry，inode已读入
+ * @param fname 
+ * @param ftype 
+ * @param dentry 输出新建的dentry
+ * @return int -SFS_ERROR_EXISTS，-SFS_ERROR_NOSPACE（inode用完或目录已满）
+ */
+int fs_create_dentry(struct newfs_dentry* parent, const char* fname, FILE_TYPE ftype,
+                     struct newfs_dentry** dentry) {
+    SFS_INODE_SCOPE(parent->inode);
+    struct newfs_inode*  dir = parent->inode;
+    struct newfs_dentry* new_one;
+    int blk = dir->dir_cnt / SFS_DENTRY_PER_BLK();
+    boolean reserved = FALSE;
+
+    if (fs_find_dentry(dir, fname) != NULL) {
+        return -SFS_ERROR_EXISTS;
+    }
+    if (dir->dir_cnt >= SFS_MAX_DENTRY_PER_DIR()) {
+        return -SFS_ERROR_NOSPACE;
+    }
+    if (SFS_IS_SPARSE(dir, blk)) {
+        if (fs_reserve_data(1) != SFS_ERROR_NONE) {
+            return -SFS_ERROR_NOSPACE;
+        }
+        dir->block_flags[blk] |= SFS_FLAG_BUF_DELAY;
+        dir->delay_blks++;
+        reserved = TRUE;
+    }
+    new_one = new_dentry((char *)fname, ftype);
+    new_one->parent = parent;
+    if (fs_alloc_inode(new_one) == NULL) {
+        free(new_one);
+        if (reserved) {
+            fs_undelay_block(dir, blk);
+        }
+        return -SFS_ERROR_NOSPACE;
+    }
+    fs_alloc_dentry(dir, new_one);
+    *dentry = new_one;
+    return SFS_ERROR_NONE;
+}
 /**
  * @brief 
  * path: /qwe/ad  total_lvl = 2,
@@ -649,14 +1924,15 @@ struct newfs_dentry* fs_get_dentry(struct newfs_inode * inode, int dir) {
  * @return struct sfs_inode* 
  */
 struct newfs_dentry* fs_lookup(const char * path, boolean* is_find, boolean* is_root) {
+    SFS_STAT_SCOPE(SFS_STAGE_LOOKUP);
     struct newfs_dentry* dentry_cursor = newfs_super.root_dentry;
     struct newfs_dentry* dentry_ret = NULL;
     struct newfs_inode*  inode; 
     int   total_lvl = fs_calc_lvl(path);
     int   lvl = 0;
-    boolean is_hit;
     char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
+    char* save = NULL;
+    char* path_cpy = (char*)malloc(strlen(path) + 1);
     *is_root = FALSE;
     strcpy(path_cpy, path);
 
@@ -665,15 +1941,11 @@ struct newfs_dentry* fs_lookup(const char * path, boolean* is_find, boolean* is_
         *is_root = TRUE;
         dentry_ret = newfs_super.root_dentry;
     }
-    fname = strtok(path_cpy, "/");       
+    fname = strtok_r(path_cpy, "/", &save);       /* 多线程FUSE下strtok的静态状态会串 */
     while (fname)
     {   
         lvl++;
-        if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            fs_read_inode(dentry_cursor, dentry_cursor->ino);
-        }
-
-        inode = dentry_cursor->inode;
+        inode = fs_dentry_inode(dentry_cursor);       /* Cache机制 */
 
         if (SFS_IS_FILE(inode) && lvl < total_lvl) {
             SFS_DBG("[%s] not a dir\n", __func__);
@@ -681,103 +1953,82 @@ struct newfs_dentry* fs_lookup(const char * path, boolean* is_find, boolean* is_
             break;
         }
         if (SFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = FALSE;
-
-            while (dentry_cursor)
-            {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
+            fs_lock_inode(inode);                     /* 逐级只锁当前目录 */
+            dentry_cursor = fs_find_dentry(inode, fname);
+            fs_unlock_inode(inode);
             
-            if (!is_hit) {
+            if (dentry_cursor == NULL) {
                 *is_find = FALSE;
                 SFS_DBG("[%s] not found %s\n", __func__, fname);
                 dentry_ret = inode->dentry;
                 break;
             }
 
-            if (is_hit && lvl == total_lvl) {
+            if (lvl == total_lvl) {
                 *is_find = TRUE;
                 dentry_ret = dentry_cursor;
                 break;
             }
         }
-        fname = strtok(NULL, "/"); 
+        fname = strtok_r(NULL, "/", &save); 
     }
 
-    if (dentry_ret->inode == NULL) {
-        dentry_ret->inode = fs_read_inode(dentry_ret, dentry_ret->ino);
-    }
+    fs_dentry_inode(dentry_ret);
     
+    free(path_cpy);
     return dentry_ret;
 }
 
-void fs_dump_map()
-{
-    int byte_cursor = 0;
-    int bit_cursor = 0;
-
-    printf("inode map:\n");
-
-    for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_inode_blks);
-         byte_cursor += 4)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\t");
+/**
+ * @brief 一张位图的摘要：已用/空闲位数、连续区间数和前SFS_MAP_DUMP_RUNS个区间
+ * 
+ * @param buf 输出
+ * @param size buf的大小
+ * @param name 位图名
+ * @param map 位图
+ * @param bits 有效位数
+ * @return int 文本长度（可能超过size，由调用者截断）
+ */
+static int fs_dump_bitmap(char* buf, int size, const char* name, uint8_t* map, int bits) {
+    int len = 0, used = 0, runs = 0, start, bit, cur;
 
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_inode[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\t");
+#define SFS_MAP_PRINT(...) \
+    len += snprintf(buf + SFS_MIN(len, size), size - SFS_MIN(len, size), __VA_ARGS__)
 
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_inode[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);
+    for (bit = 0; bit < bits; bit++) {
+        cur   = SFS_BITMAP_TEST(map, bit) ? 1 : 0;
+        used += cur;
+        if (bit == 0 || cur != (SFS_BITMAP_TEST(map, bit - 1) ? 1 : 0)) {
+            runs++;
         }
-        printf("\t");
-
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_inode[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\n");
     }
+    SFS_MAP_PRINT("%-20s %10d used %10d free %10d runs", name, used, bits - used, runs);
+    runs = 0;
+    for (start = 0; start < bits && runs < SFS_MAP_DUMP_RUNS; start = bit, runs++) {
+        cur = SFS_BITMAP_TEST(map, start) ? 1 : 0;
+        for (bit = start + 1; bit < bits && (SFS_BITMAP_TEST(map, bit) ? 1 : 0) == cur; bit++);
+        SFS_MAP_PRINT(" %d-%d:%s", start, bit - 1, cur ? "used" : "free");
+    }
+    SFS_MAP_PRINT("%s\n", start < bits ? " ..." : "");
+#undef SFS_MAP_PRINT
+    return len;
+}
+/**
+ * @brief inode位图和data位图的摘要，由统计文件按需生成，不再在挂载时逐位打印
+ * 
+ * @param buf 输出
+ * @param size buf的大小
+ * @return int 文本长度（不含结尾的'\0'）
+ */
+int fs_dump_map(char* buf, int size) {
+    int len = 0;
 
-    printf("data map:\n");
-
-    for (byte_cursor = 0; byte_cursor < SFS_BLKS_SZ(newfs_super.map_data_blks);
-         byte_cursor += 4)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\t");
-
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_data[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\t");
-
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_data[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\t");
-
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-        {
-            printf("%d ", (newfs_super.map_data[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);
-        }
-        printf("\n");
+    if (size <= 0) {
+        return 0;
     }
-}
\ No newline at end of file
+    buf[0] = '\0';
+    len += fs_dump_bitmap(buf, size, "inode_map", newfs_super.map_inode, newfs_super.max_ino);
+    len += fs_dump_bitmap(buf + SFS_MIN(len, size), size - SFS_MIN(len, size), "data_map",
+                          newfs_super.map_data, newfs_super.max_data);
+    return SFS_MIN(len, size - 1);
+}
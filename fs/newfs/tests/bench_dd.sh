@@ -0,0 +1,59 @@
+#!/bin/bash
+# 大请求吞吐基准：dd bs=1M 经挂载点顺序写/读
+# 用法: ./bench_dd.sh [文件数] [每个文件KiB] [额外挂载参数...]
+#
+# 对比两种挂载：max_write=4096（相当于没有big_writes，内核按页拆分写请求）
+# 与默认（big_writes，单个请求最多128KiB）。newfs单个文件最大128KiB，
+# 因此每个文件用一次count_bytes的dd写满。
+
+FILES=${1:-16}
+FILE_KB=${2:-128}
+shift $(($# < 2 ? $# : 2))
+EXTRA=("$@")
+MNTPOINT='./mnt'
+ROOT_PATH=$(dirname "$(realpath "$0")")
+BIN="$ROOT_PATH"/../build/newfs
+
+function now_ns() {
+    date +%s%N
+}
+
+function bench() {
+    local mode=$1
+    shift
+
+    rm ~/ddriver -f
+    touch ~/ddriver
+    mkdir -p "$MNTPOINT"
+    if ! "$BIN" --device="$HOME"/ddriver "$@" "${EXTRA[@]}" "$MNTPOINT"; then
+        echo "mount failed: $mode"
+        exit 1
+    fi
+
+    local start end wr_ns rd_ns
+    start=$(now_ns)
+    for ((f = 0; f < FILES; f++)); do
+        dd if=/dev/zero of="$MNTPOINT/f$f" bs=1M count=$((FILE_KB * 1024)) \
+           iflag=count_bytes conv=fsync status=none
+    done
+    end=$(now_ns)
+    wr_ns=$((end - start))
+
+    # 重新挂载，读请求不会命中内核页缓存
+    fusermount -u "$MNTPOINT"
+    "$BIN" --device="$HOME"/ddriver "$@" "${EXTRA[@]}" "$MNTPOINT"
+
+    start=$(now_ns)
+    for ((f = 0; f < FILES; f++)); do
+        dd if="$MNTPOINT/f$f" of=/dev/null bs=1M status=none
+    done
+    end=$(now_ns)
+    rd_ns=$((end - start))
+
+    fusermount -u "$MNTPOINT"
+    local kib=$((FILES * FILE_KB))
+    echo "$mode: $kib KiB, write $((kib * 1000000 / (wr_ns / 1000))) KiB/s, read $((kib * 1000000 / (rd_ns / 1000))) KiB/s"
+}
+
+bench "max_write=4096" -o max_write=4096
+bench "big_writes    "
@@ -0,0 +1,52 @@
+#!/bin/bash
+# 深路径stat基准：比较路径接口（默认）与 --lowlevel 接口
+# 用法: ./bench_deep_stat.sh [目录深度] [文件数] [轮数]
+#
+# 每轮之间等待内核entry/attr缓存（1s）过期，因此每轮都会重新下发
+# LOOKUP/GETATTR；计时只包含stat本身。
+
+DEPTH=${1:-12}
+FILES=${2:-40}
+ROUNDS=${3:-10}
+MNTPOINT='./mnt'
+ROOT_PATH=$(dirname "$(realpath "$0")")
+BIN="$ROOT_PATH"/../build/newfs
+
+function bench() {
+    local mode=$1
+    shift
+
+    rm ~/ddriver -f
+    touch ~/ddriver
+    mkdir -p "$MNTPOINT"
+    if ! "$BIN" --device="$HOME"/ddriver "$@" "$MNTPOINT"; then
+        echo "mount failed: $mode"
+        exit 1
+    fi
+
+    local dir="$MNTPOINT"
+    for ((d = 0; d < DEPTH; d++)); do
+        dir="$dir/d$d"
+        mkdir "$dir"
+    done
+    local files=()
+    for ((f = 0; f < FILES; f++)); do
+        touch "$dir/f$f"
+        files+=("$dir/f$f")
+    done
+
+    local total=0 start end
+    for ((r = 0; r < ROUNDS; r++)); do
+        sleep 1.1
+        start=$(date +%s%N)
+        stat -c %s "${files[@]}" > /dev/null
+        end=$(date +%s%N)
+        total=$((total + end - start))
+    done
+
+    fusermount -u "$MNTPOINT"
+    echo "$mode: depth $DEPTH, $((FILES * ROUNDS)) stats, $((total / FILES / ROUNDS / 1000)) us/stat"
+}
+
+bench "path     "
+bench "lowlevel " --lowlevel
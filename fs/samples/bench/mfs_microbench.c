@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <regex.h>
+#include "../include/fstree.h"
+#include "../include/fsdisk.h"
+
+/*
+In-process microbenchmarks of the mfs-fuse metadata tree, no FUSE mount and no disk files.
+
+Usage and output follow Google Benchmark:
+    mfs_microbench [--benchmark_filter=<regex>] [--benchmark_min_time=<sec>] [--verbose]
+Each benchmark builds a fresh tree in memory, then runs with a growing iteration count until one run takes longer than min_time.
+*/
+
+/*
+Upper bound on the iteration count of one run
+*/
+#define MB_MAX_ITERS 1000000000L
+
+/*
+Longest path built by the benchmarks
+*/
+#define MB_PATH_LEN 1024
+
+/*
+State shared by the setup and the timed loop of a benchmark
+*/
+struct mb_state{
+    long iterations;
+    int arg;                        // Benchmark argument: path depth or number of entries
+    char path[MB_PATH_LEN];         // Path looked up by the timed loop
+    char to[MB_PATH_LEN];           // Path the timed loop renames 'path' to and back
+};
+
+/*
+A benchmark: its name, argument, setup and timed loop
+*/
+struct mb_bench{
+    const char * name;
+    int arg;
+    int (* setup)(struct mb_state *);
+    void (* run)(struct mb_state *);
+};
+
+/*
+Results go here, so they still reach the terminal when stdout is silenced
+*/
+static FILE * mb_out;
+
+static double mb_clock(clockid_t id){
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+Starts every benchmark from an empty tree holding only the root
+*/
+static void mb_reset(){
+    root = NULL;
+    insert_node("/");
+}
+
+/*
+Builds "/d0/d1/.../d<arg-1>/leaf" and looks up the leaf
+*/
+static int setup_deep(struct mb_state * st){
+    int len = 0, d;
+    for(d = 0; d < st->arg; d++){
+        len += snprintf(st->path + len, MB_PATH_LEN - len, "/d%d", d);
+        insert_node(st->path);
+    }
+    snprintf(st->path + len, MB_PATH_LEN - len, "/leaf");
+    insert_file(st->path);
+    return search_node(st->path) ? 0 : -1;
+}
+
+/*
+Same tree as setup_deep, but looks up a name missing from the deepest directory
+*/
+static int setup_deep_miss(struct mb_state * st){
+    if(setup_deep(st) < 0){
+        return -1;
+    }
+    strcpy(strrchr(st->path, '/'), "/missing");
+    return search_node(st->path) ? -1 : 0;
+}
+
+/*
+Builds "/dir" holding arg files and looks up the last one created
+*/
+static int setup_wide(struct mb_state * st){
+    int i;
+    insert_node("/dir");
+    for(i = 0; i < st->arg; i++){
+        snprintf(st->path, MB_PATH_LEN, "/dir/entry_%d", i);
+        insert_file(st->path);
+    }
+    return search_node(st->path) ? 0 : -1;
+}
+
+/*
+Builds "/src" holding arg directories of one file each, renamed to "/dst" and back
+*/
+static int setup_subtree(struct mb_state * st){
+    int i;
+    insert_node("/src");
+    for(i = 0; i < st->arg; i++){
+        snprintf(st->path, MB_PATH_LEN, "/src/d%d", i);
+        insert_node(st->path);
+        snprintf(st->path, MB_PATH_LEN, "/src/d%d/f", i);
+        insert_file(st->path);
+    }
+    strcpy(st->path, "/src");
+    strcpy(st->to, "/dst");
+    return search_node("/src/d0/f") ? 0 : -1;
+}
+
+/*
+A data bitmap of BITMAP_SIZE bytes with its first arg blocks in use, the state of a disk filled from the start
+*/
+static int setup_bitmap(struct mb_state * st){
+    static uint8_t map[BITMAP_SIZE];
+    memset(map, 0, sizeof(map));
+    fs_bitmap_set_range(map, 0, st->arg);
+    datamap = map;
+    datamap_size = BITMAP_SIZE;
+    return find_free_block(datamap, datamap_size) == (unsigned long int)st->arg ? 0 : -1;
+}
+
+static void bm_search_node(struct mb_state * st){
+    long i;
+    for(i = 0; i < st->iterations; i++){
+        search_node(st->path);
+    }
+}
+
+static void bm_find_file(struct mb_state * st){
+    long i;
+    for(i = 0; i < st->iterations; i++){
+        find_file(st->path);
+    }
+}
+
+static void bm_move_node(struct mb_state * st){
+    long i;
+    for(i = 0; i < st->iterations; i++){
+        move_node(st->path, st->to);
+        move_node(st->to, st->path);
+    }
+}
+
+static void bm_find_free_block(struct mb_state * st){
+    long i;
+    for(i = 0; i < st->iterations; i++){
+        free_block(datamap, find_free_block(datamap, datamap_size));
+    }
+}
+
+static const struct mb_bench benches[] = {
+    { "BM_search_node/depth:1",          1,   setup_deep,      bm_search_node },
+    { "BM_search_node/depth:8",          8,   setup_deep,      bm_search_node },
+    { "BM_search_node/depth:20",         20,  setup_deep,      bm_search_node },
+    { "BM_search_node_miss/depth:20",    20,  setup_deep_miss, bm_search_node },
+    { "BM_search_node/entries:256",      256, setup_wide,      bm_search_node },
+    { "BM_find_file/depth:20",           20,  setup_deep,      bm_find_file },
+    { "BM_move_node/subtree:1",          1,   setup_subtree,   bm_move_node },
+    { "BM_move_node/subtree:1024",       1024, setup_subtree,  bm_move_node },
+    { "BM_find_free_block/used:30000",   30000, setup_bitmap,  bm_find_free_block },
+};
+
+/*
+Number of benchmarks in 'benches'
+*/
+#define MB_BENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+
+/*
+Runs one benchmark, growing the iteration count by the last run's time (at most 10x) until a run exceeds min_time
+*/
+static int mb_run(const struct mb_bench * b, double min_time){
+    struct mb_state st;
+    double wall = 0, cpu = 0, t0, c0, mult;
+    long iters = 1;
+
+    memset(&st, 0, sizeof(st));
+    st.arg = b->arg;
+    mb_reset();
+    if(b->setup && b->setup(&st) < 0){
+        fprintf(mb_out, "%-36s ERROR OCCURRED: setup failed\n", b->name);
+        return -1;
+    }
+    for(;;){
+        st.iterations = iters;
+        t0 = mb_clock(CLOCK_MONOTONIC);
+        c0 = mb_clock(CLOCK_PROCESS_CPUTIME_ID);
+        b->run(&st);
+        cpu = mb_clock(CLOCK_PROCESS_CPUTIME_ID) - c0;
+        wall = mb_clock(CLOCK_MONOTONIC) - t0;
+        if(wall >= min_time || iters >= MB_MAX_ITERS){
+            break;
+        }
+        mult = wall > 0 ? min_time * 1.4 / wall : 10;
+        mult = mult > 10 ? 10 : mult;
+        iters = (long)(iters * mult) > iters ? (long)(iters * mult) : iters + 1;
+        iters = iters > MB_MAX_ITERS ? MB_MAX_ITERS : iters;
+    }
+    fprintf(mb_out, "%-36s %10.1f ns %12.1f ns %12ld\n", b->name, wall * 1e9 / iters, cpu * 1e9 / iters, iters);
+    fflush(mb_out);
+    return 0;
+}
+
+int main(int argc, char * argv[]){
+    const char * filter = NULL;
+    double min_time = 0.5;
+    regex_t re;
+    int i, failed = 0, verbose = 0, devnull;
+
+    for(i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--benchmark_filter=", 19) == 0){
+            filter = argv[i] + 19;
+        }
+        else if(strncmp(argv[i], "--benchmark_min_time=", 21) == 0){
+            min_time = atof(argv[i] + 21);
+        }
+        else if(strcmp(argv[i], "--verbose") == 0){
+            verbose = 1;
+        }
+        else{
+            fprintf(stderr, "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<sec>] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(filter && regcomp(&re, filter, REG_EXTENDED | REG_NOSUB) != 0){
+        fprintf(stderr, "mfs_microbench: bad filter %s\n", filter);
+        return 2;
+    }
+
+    mb_out = fdopen(dup(STDOUT_FILENO), "w");
+    if(!verbose){
+        // keep the log output of the tree functions out of the results
+        fflush(stdout);
+        devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+    fprintf(mb_out, "%s\n%-36s %13s %15s %12s\n%s\n",
+            "---------------------------------------------------------------------------------",
+            "Benchmark", "Time", "CPU", "Iterations",
+            "---------------------------------------------------------------------------------");
+    for(i = 0; i < MB_BENCHES; i++){
+        if(filter && regexec(&re, benches[i].name, 0, NULL, 0) != 0){
+            continue;
+        }
+        failed |= mb_run(&benches[i], min_time) < 0;
+    }
+    if(filter){
+        regfree(&re);
+    }
+    return failed;
+}
@@ -4,8 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <math.h>
 #include <errno.h>
+#include "fs_bitmap.h"
 
 /*
 Create a bitmap with bitmap_size bits. The bitmap is stored in `bitmap` and the size, in bytes, is stores in `bitmap_size`, however, the function call will contain bits.
@@ -13,7 +13,12 @@ Create a bitmap with bitmap_size bits. The bitmap is stored in `bitmap` and the
 int create_bitmap(uint8_t ** bitmap, uint64_t * bitmap_size);
 
 /*
-Print the bitmap to stdout.
+Number of runs listed by print_bitmap
+*/
+#define PRINT_RUNS 16
+
+/*
+Print a summary of the bitmap to stdout: used and free bit counts, and the first PRINT_RUNS runs of equal bits.
 */
 void print_bitmap(uint8_t * bitmap, uint64_t bitmap_size);
 
@@ -25,21 +30,33 @@ int free_bitmap(uint8_t ** bitmap);
 /*
 Clear the bit at `bitno` of bitmap, i.e, set it to 0. If `bitno` is greated than size of the bitmap, undefined behaviour occurs.
 */
-int clear_bit(uint8_t ** bitmap, uint64_t bitno);
+static inline int clear_bit(uint8_t ** bitmap, uint64_t bitno){
+    fs_bitmap_clear(* bitmap, bitno);
+    return 0;
+}
 
 /*
 Set the bit at `bitno` of bitmap, i.e, set it to 1. If `bitno` is greated than size of the bitmap, undefined behaviour occurs.
 */
-int set_bit(uint8_t ** bitmap, uint64_t bitno);
+static inline int set_bit(uint8_t ** bitmap, uint64_t bitno){
+    fs_bitmap_set(* bitmap, bitno);
+    return 0;
+}
 
 /*
-Get the first bit of `bitmap` that is set to 1.
+Get the first bit of `bitmap` that is set to 1, -1 if there is none. `bitmap_size` is in bytes.
 */
-uint64_t get_first_set_bit(uint8_t * bitmap, uint64_t bitmap_size);
+static inline uint64_t get_first_set_bit(uint8_t * bitmap, uint64_t bitmap_size){
+    uint64_t bit = fs_bitmap_find_set(bitmap, bitmap_size * 8, 0);
+    return bit < bitmap_size * 8 ? bit : (uint64_t)-1;
+}
 
 /*
-Get the first bit of `bitmap` that is unset, i.e, set to 0.
+Get the first bit of `bitmap` that is unset, i.e, set to 0, -1 if there is none. `bitmap_size` is in bytes.
 */
-uint64_t get_first_unset_bit(uint8_t * bitmap, uint64_t bitmap_size); 
+static inline uint64_t get_first_unset_bit(uint8_t * bitmap, uint64_t bitmap_size){
+    uint64_t bit = fs_bitmap_find_zero(bitmap, bitmap_size * 8, 0);
+    return bit < bitmap_size * 8 ? bit : (uint64_t)-1;
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -10,8 +10,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <errno.h>
-#include <math.h>
+#include <sys/statvfs.h>
+#include "fslog.h"
 #include "fstree.h"
 #include "bitmap.h"
 
@@ -25,6 +27,26 @@ Block size of the metadata disk file
 */
 #define BLOCK_SIZE 4096
 
+/*
+Size in bytes of the bitmap kept in block 0 of the data and metadata disk files
+*/
+#define BITMAP_SIZE BLOCK_SIZE
+
+/*
+Length of the mapping of a disk file: every block its bitmap can address. The file itself grows with ftruncate as blocks are used
+*/
+#define STORE_MAP_SIZE ((off_t)BITMAP_SIZE * 8 * BLOCK_SIZE)
+
+/*
+Number of updates to the mapped disk files between two asynchronous flushes
+*/
+#define SYNC_BATCH 64
+
+/*
+Returned by find_free_block when the bitmap is full. Block 0 holds the bitmap itself, so it is never allocated
+*/
+#define NO_FREE_BLOCK 0
+
 /*
 Open marker - Defines the beginning of a node in the metadata disk file
 */
@@ -35,6 +57,74 @@ Close marker - Defines the end of a node in the metadata disk file
 */
 #define CLOSE_MARKER "}\n"
 
+/*
+Magic number at the start of a metadata node record ("MFSN")
+*/
+#define REC_MAGIC 0x4e53464d
+
+/*
+Magic number at the start of a metadata continuation block ("MFSC")
+*/
+#define REC_CONT_MAGIC 0x4353464d
+
+/*
+Version of the metadata node record layout. Version 0 is the legacy tagged text format ("{\nPATH=...\0\n...}\n"), version 1 stored the full path of the node instead of its name
+*/
+#define REC_VERSION 2
+
+/*
+Node types stored in a metadata node record
+*/
+#define REC_TYPE_FILE 0
+#define REC_TYPE_DIR 1
+
+/*
+Fixed header of a metadata node record, at the start of the node's block in the metadata disk file.
+
+It is followed by the payload: 'path_len' bytes of the node's name, zero padded to the next multiple of 8 (so at least one terminator), then 'num_children' child block numbers and 'num_data' data block numbers (uint64_t each).
+A payload that does not fit in the block continues in the block 'next_block', which starts with a 'struct rec_cont' header, and so on.
+*/
+struct rec_hdr{
+    uint32_t magic;                 // REC_MAGIC
+    uint16_t version;               // REC_VERSION
+    uint16_t type;                  // REC_TYPE_FILE or REC_TYPE_DIR
+    uint64_t inode;                 // Block number of this record
+    uint64_t parent;                // Block number of the parent record
+    uint64_t next_block;            // First continuation block, 0 if none
+    uint32_t permissions;
+    uint32_t user_id;
+    uint32_t group_id;
+    uint32_t path_len;
+    int64_t a_time;
+    int64_t m_time;
+    int64_t c_time;
+    int64_t b_time;
+    int64_t size;
+    uint32_t num_children;
+    uint32_t num_data;
+};
+
+/*
+Header of a continuation block of a metadata node record
+*/
+struct rec_cont{
+    uint32_t magic;                 // REC_CONT_MAGIC
+    uint32_t reserved;
+    uint64_t next_block;            // Next continuation block, 0 if none
+};
+
+/*
+A metadata node record decoded into memory. 'path', 'children' and 'data' point into one allocation released by free_record
+*/
+struct rec_node{
+    struct rec_hdr hdr;
+    char * path;                    // Terminated name of the node (full path in version 1)
+    uint64_t * children;            // Child block numbers
+    uint64_t * data;                // Data block numbers
+    uint64_t * chain;               // Continuation block numbers
+    uint32_t num_chain;
+};
+
 /* 
 Data file descriptor
 */
@@ -75,50 +165,55 @@ FSfile Typedef to maintain consistency across files
 */
 typedef struct FSfile FSfile;
 
-/* 
-Reset data file descriptor - signifies that data file is closed 
+/*
+Records an update of the mapped disk files. Every SYNC_BATCH updates they are flushed with an asynchronous msync
 */
-void resetdatafd();
+void mark_dirty();
 
 /*
-Reset metadata file descriptor - signifies that metadata file is closed
+Flushes both mapped disk files, waiting for the writes to complete if 'wait' is set
 */
-void resetmetafd();
+void sync_disk(int wait);
 
 /*
-Writes the given bitmap to the file corresponding to the file descriptor 'fd'
+Creates the metadata and data disk files if not present, else, loads the metadata into memory. Both files stay open and mapped until closedisk
 */
-void writebitmap(int fd, uint8_t * bitmap, uint64_t bitmap_size);
+int createdisk();
 
 /*
-Loads the bitmap corresponding to the file given by 'fd' into memory
+Flushes, unmaps and closes the metadata and data disk files
 */
-void loadbitmap(int fd, uint8_t ** bitmap, uint64_t * bitmap_size);
+void closedisk();
 
 /*
-Creates the metadata and data disk files if not present, else, loads the metadata into memory
+Finds and marks the first available block in the bitmap given by 'bitmap' (datamap or metamap), NO_FREE_BLOCK if it is full. The search starts at the lowest block freed since, not at block 0
 */
-int createdisk();
+unsigned long int find_free_block(uint8_t * bitmap, uint64_t bitmap_size);
 
 /*
-Finds the first available block in the bitmap given by 'bitmap'
+Marks 'blocknumber' available in the bitmap given by 'bitmap' (datamap or metamap)
 */
-unsigned long int find_free_block(uint8_t * bitmap, uint64_t bitmap_size);
+void free_block(uint8_t * bitmap, unsigned long int blocknumber);
+
+/*
+Fills 'st' with the size and free space of the data disk file (in data chunks) and the number of free metadata records, counted from the bitmaps
+*/
+int statfs_disk(struct statvfs * st);
 
 /*
-Writes a tree node, 'node', to the diskfile given by file descriptor 'fd' using the 'bitmap' of that file
+Writes a tree node, 'node', to the diskfile given by file descriptor 'fd' using the 'bitmap' of that file. Returns 0, or -ENOSPC with nothing allocated
 */
-void write_diskfile(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node);
+int write_diskfile(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node);
 
 /*
-Preprocesses information pertaining to the tree node 'temp' and passes it to write_diskfile along with other parameters known to this file
+Preprocesses information pertaining to the tree node 'temp' and passes it to write_diskfile along with other parameters known to this file. Returns 0 or -ENOSPC
 */
-void serialize_metadata(FStree * temp);
+int serialize_metadata(FStree * temp);
 
 /*
 Wrapper function for 'serialize_metadata'. Acts as an interface to the disk as the only parameter is the tree node and nothing else.
 */
-void serialize_metadata_wrapper(FStree * node);
+int serialize_metadata_wrapper(FStree * node);
 
 /*
 Fetches the block number of the parent node of a given node, 'node'
@@ -131,19 +226,49 @@ Gets the next metadata block number for chained data
 unsigned long int get_chained_meta_block(int fd, unsigned long int parent_blocknumber, unsigned long int child_blocknumber);
 
 /*
-Updates a given tree node, given by 'node' in the disk and mode signifies that the datablocks should be updated as well
+Rewrites the record of a given tree node, given by 'node', in the disk. Its data blocks are written in place by write_file_data and truncate_file_data. Returns 0, or -ENOSPC with the old record left in place
+*/
+int update_node(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node);
+
+/*
+Wrapper function for update_node. Acts as an interface as the only parameter to this is the tree node 'node'
+*/
+int update_node_wrapper(FStree * node);
+
+/*
+Adds 'node' to the dirty node set: its record is rewritten by the next flush_dirty_nodes (or update_node) instead of on every write
 */
-int update_node(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node, int mode);
+void mark_node_dirty(FStree * node);
 
 /*
-Wrapper function for update_node. Acts as an interface as the only parameter to this is the tree node 'node' and mode signifies that the datablocks should be updated as well
+Rewrites the record of every node in the dirty node set
 */
-int update_node_wrapper(FStree * node, int mode);
+void flush_dirty_nodes();
 
 /*
-Load the metadata from disk into memory starting at blocknumber 'blknumber' (usually the root block)
+Reads the metadata node record at block 'blocknumber' (and its continuation blocks). Returns 0 on success, -1 if the block does not hold a valid record
 */
-void deserialize_metadata(unsigned long int blknumber);
+int read_record(unsigned long int blocknumber, struct rec_node * rec);
+
+/*
+Releases the memory of a record filled by read_record
+*/
+void free_record(struct rec_node * rec);
+
+/*
+Writes 'rec' as the record at block 'blocknumber', allocating continuation blocks from 'bitmap' when the payload does not fit. Returns 0, or -ENOSPC with no block written or allocated
+*/
+int write_record(uint8_t * bitmap, uint64_t bitmap_size, unsigned long int blocknumber, struct rec_node * rec);
+
+/*
+Rewrites every record of the legacy tagged text format in the metadata disk file as a binary node record, in place. Returns the number of records converted
+*/
+int convert_legacy_metadata();
+
+/*
+Load the metadata from disk into memory starting at blocknumber 'blknumber' (usually the root block), as a child of 'parent' (NULL for the root)
+*/
+void deserialize_metadata(unsigned long int blknumber, FStree * parent);
 
 /*
 Wrapper function for deserialize_metadata. Acts as an interface as no parameters are required for the same.
@@ -151,9 +276,9 @@ Wrapper function for deserialize_metadata. Acts as an interface as no parameters
 void deserialize_metadata_wrapper();
 
 /*
-Deletes a block from the disk file given by the inode number 'blocknumber'
+Deletes the metadata block of 'node' from the disk file, along with the data blocks of a file
 */
-void delete_metadata_block(char * type,unsigned long int blocknumber);
+void delete_metadata_block(FStree * node);
 
 /*
 Checks if a given block is valid, i.e if the data in the block is deleted / exists in the FS
@@ -161,28 +286,23 @@ Checks if a given block is valid, i.e if the data in the block is deleted / exis
 int check_validity_block(unsigned long int blocknumber);
 
 /*
-Writes the data of a node given by 'node' to the data disk file
-*/
-void write_data(int fd, uint8_t * bitmap, uint64_t bitmap_size,unsigned long int inode,char * data,FStree * node);
-
-/*
-Serialises file data i.e writes the data corresponding to a given file to the data disk file
+Fetch the block number of data block 'index' of a file from its block list, 0 if the file has no such block
 */
-void serialize_filedata(unsigned long int inode,char * data,FStree * node);
+unsigned long int find_data_block(FStree * node, unsigned long int index);
 
 /*
-Wrapper function for serialize_filedata. Acts as an interface for the same
+Copies at most 'size' bytes of the data of file 'node' from 'offset' to 'buf', straight from the mapped data blocks. Returns the number of bytes copied, 0 at or past the end of the file
 */
-void serialize_filedata_wrapper(unsigned long int inode,char * data,FStree * node);
+size_t read_file_data(FStree * node, char * buf, size_t size, off_t offset);
 
 /*
-Fetch the block number of a given data block corresponding to a particular file
+Writes 'size' bytes from 'buf' at 'offset' of file 'node', touching only the data blocks in that range and allocating missing ones. Returns 'size', or -ENOSPC / -EIO
 */
-unsigned long int find_data_block(unsigned long int blocknumber);
+int write_file_data(FStree * node, const char * buf, size_t size, off_t offset);
 
 /*
-Loads the file data into memory upon read / write requests
+Sets the size of file 'node' to 'size', freeing the data blocks past the new end or zero filling the new range. Returns 0, or -ENOSPC / -EIO
 */
-char * deserialize_file_data(unsigned long int inode);
+int truncate_file_data(FStree * node, off_t size);
 
 #endif
@@ -0,0 +1,23 @@
+#ifndef FSLOG
+#define FSLOG
+
+#include "fs_log.h"
+
+/*
+Log levels are FS_LOG_ERROR .. FS_LOG_TRACE from fs_log.h. Calls above FS_LOG_LEVEL are removed at compile time, their arguments are not evaluated. Build with -DFS_LOG_LEVEL=4 to get the per-call traces back
+*/
+#ifndef FS_LOG_LEVEL
+#define FS_LOG_LEVEL FS_LOG_INFO
+#endif
+
+/*
+Kept messages go to the calling thread's ring buffer in ../common (fs_log), written out by fs_log_flush and at once for FS_ERROR
+*/
+#define FS_LOG(level, tag, ...) do{ if((level) <= FS_LOG_LEVEL) fs_log(level, tag, __VA_ARGS__); }while(0)
+#define FS_ERROR(...) FS_LOG(FS_LOG_ERROR, "ERROR", __VA_ARGS__)
+#define FS_WARN(...) FS_LOG(FS_LOG_WARN, "WARN", __VA_ARGS__)
+#define FS_INFO(...) FS_LOG(FS_LOG_INFO, "INFO", __VA_ARGS__)
+#define FS_DEBUG(...) FS_LOG(FS_LOG_DEBUG, "DEBUG", __VA_ARGS__)
+#define FS_TRACE(...) FS_LOG(FS_LOG_TRACE, "TRACE", __VA_ARGS__)
+
+#endif
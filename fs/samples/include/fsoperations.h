@@ -78,6 +78,21 @@ Change the size of a file
 */
 int do_truncate(const char *path, off_t size);
 
+/*
+Release an open file: write back its record if writes left it dirty
+*/
+int do_release(const char *path, struct fuse_file_info *fi);
+
+/*
+Synchronize file contents: write back its record and wait for the disk files to be flushed
+*/
+int do_fsync(const char *path, int datasync, struct fuse_file_info *fi);
+
+/*
+Get filesystem statistics
+*/
+int do_statfs(const char *path, struct statvfs *st);
+
 /*
 Rename / move a file
 */
@@ -87,4 +102,9 @@ int do_rename(const char* from, const char* to);
 Check file access permissions
 */
 int do_access(const char* path,int mask);
+
+/*
+Clean up filesystem on exit: flush and close the disk files
+*/
+void do_destroy(void * private_data);
 #endif
@@ -10,31 +10,31 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include "fslog.h"
 #include "fsdisk.h"
 
 /*
 Structure of a data node
 */
 struct FSfile{
-	char * path;        // Path upto file
 	char * name;        // Name of the file
-	char * data;        // Data 
 	long int offset;    // Offset within the file
-	off_t size;         // Size of the file
+	int slot;           // Position in the parent's fchildren
 };
 
 /*
 Structure of a metadata tree node
 */
 struct FStree{
-    char * path;                    // Path upto node
-    char * name;                    // Name of the file / directory
+    char * name;                    // Name of the file / directory. The path is not stored, it follows from the parent pointers
     char * type;                    // Type : "directory" or "file"
     mode_t permissions;		        // Permissions 
     uid_t user_id;		            // userid
     gid_t group_id;		            // groupid
     int num_children;               // Number of children nodes
     int num_files;		            // Number of files
+    int max_children;               // Allocated length of children
+    int max_files;                  // Allocated length of fchildren
     time_t a_time;                  // Access time
     time_t m_time;                  // Modified time
     time_t c_time;                  // Status change time
@@ -44,6 +44,15 @@ struct FStree{
     struct FStree * parent;         // Pointer to parent node
     struct FStree ** children;      // Pointers to children nodes
     struct FSfile ** fchildren;     // Pointers to files in the directory
+    struct FStree ** index;         // Hash index over the children names, open addressing. NULL for small directories
+    uint32_t index_size;            // Number of slots in index, a power of 2
+    uint32_t hash;                  // Hash of name
+    int slot;                       // Position in the parent's children
+    struct FSfile * file;           // Data node of a file, NULL for a directory
+    uint64_t * blocks;              // Data blocks of a file, in order
+    uint32_t num_blocks;            // Number of data blocks
+    uint32_t max_blocks;            // Allocated length of blocks
+    int dirty;                      // Position + 1 in the dirty node set, 0 when the record on disk is current
 };
 
 /*
@@ -67,31 +76,37 @@ Pointer to the root of the metadata tree
 extern FStree * root;       
 
 /*
-Function to extract next directory in a given path. E.g "a/b/c" returns "a" and changes the input string to "b/c"
+A path component: a view of 'len' bytes into the path string, not terminated
 */
-char * extract_path(char ** copy_path);
+struct path_comp{
+    const char * name;
+    size_t len;
+};
 
 /*
-General purpose function to reverse the content of a string. Mode signifies use for dropping extra '/' in directory.
+Moves '*cursor' past the next component of a path and fills 'comp' with it, without allocating. Returns 0 when the path has no more components. E.g "/a//b" gives "a", then "b"
+*/
+int next_component(const char ** cursor, struct path_comp * comp);
 
-E.g "/a/d/" should produce current dir as 'd' and not '/'
+/*
+Function to search for the child named by the 'len' bytes at 'name' in a directory node, through the directory's hash index when it has one
 */
-char * reverse(char * str, int mode);
+FStree * find_child(FStree * dir, const char * name, size_t len);
 
 /*
-Function to extract current directory in a given path. E.g "/a/b/c" returns "c"
+Function to search for a node in the FS tree, given the path. Returns NULL for "/" (no component)
 */
-char * extract_dir(char ** copy_path);
+FStree * search_node(const char * path);
 
 /*
-Function to search for a node in the FS tree, given the path
+Function to search for the directory holding the last component of a path. 'name' is set to that component. E.g "/a/b/c" returns the node of "/a/b" and "c"
 */
-FStree * search_node(char * path);
+FStree * search_parent(const char * path, struct path_comp * name);
 
 /*
 Function to initialise an FS tree node
 */
-FStree * init_node(const char * path, char * name, FStree * parent,int type);
+FStree * init_node(const char * name, size_t name_len, FStree * parent,int type);
 
 /*
 Function to insert a node into the FS tree
@@ -101,7 +116,7 @@ void insert_node(const char * path);
 /*
 Function to intialise a file node
 */
-FSfile * init_file(const char * path,char * name);
+FSfile * init_file(const char * name, size_t name_len);
 
 /*
 Function to insert file into FStree
@@ -124,23 +139,13 @@ Function to search for a file in FStree. Returns a pointer to the file node.
 FSfile * find_file(const char * path);
 
 /*
-Moves a file or directory from src to dst
-*/
-void move_node(const char * from,const char * to);
-
-/*
-Function used by move to update the paths of the moved files / directories
-*/
-void path_update(FStree * dir_node,char * topath);
-
-/*
-Loads a tree node from disk file into the tree structure
+Moves a file or directory from src to dst, replacing a file or an empty directory at dst. Only the moved node is relinked; its subtree is untouched. Returns 0, -ENOENT, -ENOTEMPTY or -EINVAL (dst below src)
 */
-void load_node(char * path, char * type, gid_t groupid, uid_t userid, time_t lc_time, time_t lm_time, time_t la_time, time_t lb_time, unsigned long int inode, off_t size, mode_t lpermissions);
+int move_node(const char * from,const char * to);
 
 /*
-Loads a file from disk file for read / write
+Loads a tree node from disk file into the tree structure as the child named by the 'name_len' bytes at 'name' of 'dir_node', or as the root when 'dir_node' is NULL. Returns the loaded node, NULL if that name is already taken
 */
-void load_file(const char *path, char * data);
+FStree * load_node(FStree * dir_node, const char * name, size_t name_len, char * type, gid_t groupid, uid_t userid, time_t lc_time, time_t lm_time, time_t la_time, time_t lb_time, unsigned long int inode, off_t size, mode_t lpermissions);
 
 #endif
@@ -11,97 +11,25 @@ int create_bitmap(uint8_t ** bitmap, uint64_t * bitmap_size) {
     return 0;
 }
 
-int clear_bit(uint8_t ** bitmap, uint64_t bitno) {
-    uint64_t index = bitno / 8;
-    int bit_index = bitno % 8;
-
-    int val = (int)pow(2, bit_index);
-    (* bitmap)[index] = (* bitmap)[index] & ~(val);
-
-    return 0;
-}
-
-int set_bit(uint8_t ** bitmap, uint64_t bitno) {
-    uint64_t index = bitno / 8;
-    int bit_index = bitno % 8;
-
-    int val = (int)pow(2, bit_index);
-    (* bitmap)[index] = (* bitmap)[index] | (val);
-
-    return 0;
-}
-
-uint64_t get_first_unset_bit(uint8_t * bitmap, uint64_t bitmap_size) {
-    uint64_t index = 0;
-    int bit_index = 0;
-    int val, found = 0;
-
-    while(index < bitmap_size) {
-        bit_index = 0;
-        while(bit_index < 8) {
-            val = (int)pow(2, bit_index);
-            
-            if( !(bitmap[index] & val) ) {
-                found = 1;
-                break;
-            }
-            bit_index++;
-        }
-
-        if(!found)
-            index++;
-        else
-            break;
-    }
-
-    if(found)
-        return (index * 8 + bit_index);
-    else
-        return -1;
-}
-
-uint64_t get_first_set_bit(uint8_t * bitmap, uint64_t bitmap_size) {
-    uint64_t index = 0;
-    int bit_index = 0;
-    int val, found = 0;
-
-    while(index < bitmap_size) {
-        bit_index = 0;
-        while(bit_index < 8) {
-            val = (int)pow(2, bit_index);
-            
-            if(bitmap[index] & val) {
-                found = 1;
-                break;
-            }
-            bit_index++;
-        }
-
-        if(!found)
-            index++;
-        else
-            break;
-    }
-
-    if(found)
-        return (index * 8 + bit_index);
-    else
-        return -1;
+/*
+End of the run of equal bits starting at 'start'
+*/
+static uint64_t run_end(uint8_t * bitmap, uint64_t bits, uint64_t start){
+    return fs_bitmap_scan(bitmap, bits, start, bits, !fs_bitmap_test(bitmap, start));
 }
 
 void print_bitmap(uint8_t * bitmap, uint64_t bitmap_size){
-    printf("Little Endian\n");
-    int index = 0, bit_index = 0;
-    for(index = 0; index < bitmap_size; index++){
-        for (bit_index = 0; bit_index < 8; bit_index++) {
-            printf("%d", !!((bitmap[index] << bit_index) & 0x80));
-        }
-        printf(" ");
+    uint64_t bits = bitmap_size * 8, used = fs_bitmap_count(bitmap, bits), runs = 0, start;
+    for(start = 0; start < bits; start = run_end(bitmap, bits, start)){
+        runs++;
     }
-    printf("\n");
+    printf("%lu used, %lu free, %lu runs:", (unsigned long)used, (unsigned long)(bits - used), (unsigned long)runs);
+    for(start = 0, runs = 0; start < bits && runs < PRINT_RUNS; start = run_end(bitmap, bits, start), runs++){
+        printf(" %lu-%lu %s", (unsigned long)start, (unsigned long)(run_end(bitmap, bits, start) - 1), fs_bitmap_test(bitmap, start) ? "used" : "free");
+    }
+    printf("%s\n", start < bits ? " ..." : "");
 }
 
-
 int free_bitmap(uint8_t ** bitmap){
     free(*bitmap);
     *bitmap = NULL;
@@ -1,96 +1,216 @@
 #include <stdint.h>
 #include "../include/fsdisk.h"
 
-uint64_t datamap_size = 32768;
+uint64_t datamap_size = BITMAP_SIZE;
 uint8_t * datamap = NULL;
-uint64_t metamap_size = 32768;
+uint64_t metamap_size = BITMAP_SIZE;
 uint8_t * metamap = NULL;
+int data_fd = -1;
+int meta_fd = -1;
 
-unsigned long int *array;
-int set=0;
-int t_set = 0;
-unsigned long int w_freeblock;
-int w_flag=0;
 
-void resetdatafd(){
-    printf("RESETDATAFD CALLED\n");
-    close(data_fd);
-    data_fd = -1;
-    return;
+/*
+A disk file kept open and mapped for the life of the mount
+*/
+struct disk_store{
+    const char * name;
+    int * fd;
+    char * base;            // Mapping of every block the bitmap can address
+    off_t size;             // Current size of the file
+};
+
+static struct disk_store data_store = { "fsdata", &data_fd, NULL, 0 };
+static struct disk_store meta_store = { "fsmeta", &meta_fd, NULL, 0 };
+static int dirty_updates = 0;
+
+/*
+Offset of the file data in a data block, after OPEN_MARKER "INOD=" inode "\0\n" "DATA="
+*/
+#define DATA_OFFSET (2 + 5 + sizeof(unsigned long int) + 2 + 5)
+
+/*
+File bytes stored per data block
+*/
+#define DATA_CHUNK (512 - sizeof(unsigned long int) - 13)
+
+/*
+Nodes whose record on disk is out of date, rewritten by flush_dirty_nodes. A node's 'dirty' field is its position + 1
+*/
+static FStree ** dirty_nodes = NULL;
+static int num_dirty_nodes = 0;
+static int max_dirty_nodes = 0;
+
+/*
+Opens (creating if needed) and maps a disk file. Returns 1 if the file was created, 0 if it existed, -1 on error
+*/
+static int store_open(struct disk_store * store){
+    struct stat st;
+    int created = access(store->name, F_OK) == -1;
+    * store->fd = open(store->name, O_CREAT | O_RDWR, 0644);
+    if(* store->fd < 0 || fstat(* store->fd, &st) < 0){
+        return -1;
+    }
+    store->size = st.st_size;
+    if(store->size < INIT_SIZE){
+        // an image written before the stores were mapped may end in a short block
+        if(ftruncate(* store->fd, INIT_SIZE) < 0){
+            return -1;
+        }
+        store->size = INIT_SIZE;
+    }
+    // reserve the whole range once so the base never moves when the file grows
+    store->base = (char *)mmap(NULL, STORE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, * store->fd, 0);
+    if(store->base == MAP_FAILED){
+        store->base = NULL;
+        return -1;
+    }
+    return created;
 }
 
-void resetmetafd(){
-    printf("RESETMETAFD CALLED\n");
-    close(meta_fd);
-    meta_fd = -1;
-    return;
+/*
+Returns the address of block 'blocknumber' in a store. With 'grow' set the file is extended (doubling) to cover the block, otherwise NULL is returned for a block past its end
+*/
+static char * store_block(struct disk_store * store, unsigned long int blocknumber, int grow){
+    off_t end = ((off_t)blocknumber + 1) * BLOCK_SIZE;
+    off_t size = store->size;
+    if(store->base == NULL || end > STORE_MAP_SIZE){
+        return NULL;
+    }
+    if(end > size){
+        if(!grow){
+            return NULL;
+        }
+        while(size < end){
+            size *= 2;
+        }
+        if(size > STORE_MAP_SIZE){
+            size = STORE_MAP_SIZE;
+        }
+        if(ftruncate(* store->fd, size) < 0){
+            return NULL;
+        }
+        store->size = size;
+    }
+    return store->base + (off_t)blocknumber * BLOCK_SIZE;
 }
 
-void writebitmap(int fd, uint8_t * bitmap, uint64_t bitmap_size){
-    printf("WRITE BITMAP CALLED\n");
-    lseek(fd, 0, SEEK_SET);
-    write(fd, bitmap, bitmap_size);
-    return;
+static void store_close(struct disk_store * store){
+    if(store->base != NULL){
+        msync(store->base, store->size, MS_SYNC);
+        munmap(store->base, STORE_MAP_SIZE);
+        store->base = NULL;
+    }
+    if(* store->fd >= 0){
+        close(* store->fd);
+        * store->fd = -1;
+    }
 }
 
-void loadbitmap(int fd, uint8_t ** bitmap, uint64_t * bitmap_size){
-    printf("LOADBITMAP CALLED\n");
-    create_bitmap(bitmap, bitmap_size);
-    lseek(fd, 0, SEEK_SET);
-    read(fd, (* bitmap), (* bitmap_size));
-    return;
+void mark_dirty(){
+    if(++dirty_updates >= SYNC_BATCH){
+        sync_disk(0);
+    }
+}
+
+void sync_disk(int wait){
+    FS_TRACE("SYNC_DISK CALLED\n");
+    if(meta_store.base != NULL){
+        msync(meta_store.base, meta_store.size, wait ? MS_SYNC : MS_ASYNC);
+    }
+    if(data_store.base != NULL){
+        msync(data_store.base, data_store.size, wait ? MS_SYNC : MS_ASYNC);
+    }
+    dirty_updates = 0;
+}
+
+void closedisk(){
+    FS_TRACE("CLOSEDISK CALLED\n");
+    flush_dirty_nodes();
+    store_close(&meta_store);
+    store_close(&data_store);
+    datamap = NULL;
+    metamap = NULL;
+    fs_log_flush(stdout);
 }
 
 int createdisk(){
-    printf("CREATEDISK CALLED\n");
+    FS_TRACE("CREATEDISK CALLED\n");
     int flag = 0;
-    if(!(access("fsdata", F_OK ) != -1 )){
+    int created = store_open(&data_store);
+    if(created < 0){
+        perror("Data Disk Creation Error!\n");
+        return -1;
+    }
+    datamap = (uint8_t *)data_store.base;
+    if(created){
         flag = 1;
-        create_bitmap(&datamap, &datamap_size);
         set_bit(&datamap, 0);
-        data_fd = open("fsdata", O_CREAT | O_RDWR | O_TRUNC, 0644);
-        if(data_fd < 0){
-            perror("Data Disk Creation Error!\n");
-            return -1;
-        }
-        writebitmap(data_fd, datamap, datamap_size);
-        resetdatafd();
     }
-    else{
-        printf("LOADING METADATA\n");
-        data_fd = open("fsdata", O_RDWR, 0644);
-        loadbitmap(data_fd, &datamap, &datamap_size);
-        resetdatafd();
+    created = store_open(&meta_store);
+    if(created < 0){
+        perror("Metadata Disk Creation Error!\n");
+        return -1;
     }
-    if(!(access("fsmeta", F_OK ) != -1 )){
+    metamap = (uint8_t *)meta_store.base;
+    if(created){
         char * rpath = "/";
         insert_node(rpath);
         flag = 1;
-        create_bitmap(&metamap, &metamap_size);
         set_bit(&metamap, 0);
-        meta_fd = open("fsmeta", O_CREAT | O_RDWR | O_TRUNC, 0644);
-        if(meta_fd < 0){
-            perror("Metadata Disk Creation Error!\n");
-            return -1;
-        }
-        writebitmap(meta_fd, metamap, metamap_size);
-        resetmetafd();
     }
     else{
+        FS_DEBUG("LOADING METADATA\n");
         deserialize_metadata_wrapper();
     }
+    mark_dirty();
+    fs_log_flush(stdout);
     return flag;
 }
 
+/*
+Allocation hint of a bitmap: every block below it is in use, so the search for a free block starts there
+*/
+static uint64_t * alloc_hint(uint8_t * bitmap){
+    static uint64_t data_hint = 0, meta_hint = 0;
+    return bitmap == datamap ? &data_hint : &meta_hint;
+}
+
 unsigned long int find_free_block(uint8_t * bitmap, uint64_t bitmap_size){
-    printf("FIND_FREE_BLOCK CALLED\n");
-    unsigned long int freeblock = get_first_unset_bit(bitmap, bitmap_size);
-    set_bit(&bitmap, freeblock);
+    FS_TRACE("FIND_FREE_BLOCK CALLED\n");
+    uint64_t * hint = alloc_hint(bitmap);
+    unsigned long int freeblock = fs_bitmap_find_zero(bitmap, bitmap_size * 8, * hint);
+    if(freeblock >= bitmap_size * 8){
+        return NO_FREE_BLOCK;
+    }
+    fs_bitmap_set(bitmap, freeblock);
+    * hint = freeblock + 1;
     return freeblock;
 }
 
+void free_block(uint8_t * bitmap, unsigned long int blocknumber){
+    uint64_t * hint = alloc_hint(bitmap);
+    fs_bitmap_clear(bitmap, blocknumber);
+    if(blocknumber < * hint){
+        * hint = blocknumber;
+    }
+}
+
+int statfs_disk(struct statvfs * st){
+    memset(st, 0, sizeof(* st));
+    st->f_bsize = DATA_CHUNK;               // file data per data block
+    st->f_frsize = DATA_CHUNK;
+    st->f_blocks = datamap_size * 8;
+    st->f_bfree = st->f_blocks - fs_bitmap_count(datamap, datamap_size * 8);
+    st->f_bavail = st->f_bfree;
+    st->f_files = metamap_size * 8;
+    st->f_ffree = st->f_files - fs_bitmap_count(metamap, metamap_size * 8);
+    st->f_favail = st->f_ffree;
+    st->f_namemax = 255;
+    return 0;
+}
+
 unsigned long int get_parent_block(int fd, FStree * node, int child_blocknumber){
-    printf("GET_PARENT_BLOCK CALLED\n");
+    FS_TRACE("GET_PARENT_BLOCK CALLED\n");
     if(node->parent == NULL){
         return 0;
     }
@@ -98,632 +218,626 @@ unsigned long int get_parent_block(int fd, FStree * node, int child_blocknumber)
     return parent_inode;
 }
 
-int update_node_wrapper(FStree * node, int mode){
-    printf("UPDATE_NODE_WRAPPER CALLED\n");
-    if(meta_fd < 0){
-        meta_fd = open("fsmeta", O_RDWR , 0644);
+int update_node_wrapper(FStree * node){
+    FS_TRACE("UPDATE_NODE_WRAPPER CALLED\n");
+    return update_node(meta_fd, metamap, metamap_size, node);
+}
+
+void mark_node_dirty(FStree * node){
+    if(node->dirty){
+        return;
+    }
+    if(num_dirty_nodes == max_dirty_nodes){
+        max_dirty_nodes = max_dirty_nodes ? max_dirty_nodes * 2 : 16;
+        dirty_nodes = (FStree **)realloc(dirty_nodes, sizeof(FStree *) * max_dirty_nodes);
+    }
+    dirty_nodes[num_dirty_nodes++] = node;
+    node->dirty = num_dirty_nodes;
+}
+
+/*
+Takes 'node' out of the dirty node set, the last node taking its position
+*/
+static void clean_node(FStree * node){
+    FStree * last;
+    if(!node->dirty){
+        return;
+    }
+    last = dirty_nodes[--num_dirty_nodes];
+    dirty_nodes[node->dirty - 1] = last;
+    last->dirty = node->dirty;
+    node->dirty = 0;
+}
+
+void flush_dirty_nodes(){
+    while(num_dirty_nodes > 0){
+        update_node_wrapper(dirty_nodes[num_dirty_nodes - 1]);
     }
-    lseek(meta_fd, (node->inode_number * BLOCK_SIZE), SEEK_SET);
-    update_node(meta_fd, metamap, metamap_size, node, mode);
+}
+
+static void free_record_chain(uint8_t * bitmap, struct rec_node * rec){
+    uint32_t i;
+    for(i = 0; i < rec->num_chain; i++){
+        free_block(bitmap, rec->chain[i]);
+    }
+}
+
+static int write_node(int fd, uint8_t * bitmap, uint64_t bitmap_size, unsigned long int blocknumber, FStree * node){
+    struct rec_node rec;
+    uint64_t * children = NULL;
+    int i, ret;
+    memset(&rec, 0, sizeof(rec));
+    rec.hdr.type = (strcmp(node->type, "file") == 0) ? REC_TYPE_FILE : REC_TYPE_DIR;
+    rec.hdr.parent = get_parent_block(fd, node, blocknumber);
+    rec.hdr.permissions = node->permissions;
+    rec.hdr.user_id = node->user_id;
+    rec.hdr.group_id = node->group_id;
+    rec.hdr.a_time = node->a_time;
+    rec.hdr.m_time = node->m_time;
+    rec.hdr.c_time = node->c_time;
+    rec.hdr.b_time = node->b_time;
+    rec.hdr.size = node->size;
+    rec.hdr.num_children = node->num_children;
+    rec.hdr.num_data = node->num_blocks;
+    if(node->num_children > 0){
+        children = (uint64_t *)malloc(sizeof(uint64_t) * node->num_children);
+        for(i = 0; i < node->num_children; i++){
+            children[i] = node->children[i]->inode_number;
+        }
+    }
+    rec.path = node->name;
+    rec.children = children;
+    rec.data = node->blocks;
+    ret = write_record(bitmap, bitmap_size, blocknumber, &rec);
+    free(children);
+    return ret;
+}
+
+int update_node(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node){
+    FS_TRACE("UPDATE_NODE CALLED\n");
+    struct rec_node old;
+    uint32_t i;
+    int ret;
+    clean_node(node);
+    if(read_record(node->inode_number, &old) == 0){
+        // the record is rewritten in place, its continuation blocks are given back first
+        free_record_chain(bitmap, &old);
+        ret = write_node(fd, bitmap, bitmap_size, node->inode_number, node);
+        if(ret < 0){
+            // nothing was written, the old record still owns its chain
+            for(i = 0; i < old.num_chain; i++){
+                fs_bitmap_set(bitmap, old.chain[i]);
+            }
+        }
+        free_record(&old);
+    }
+    else{
+        ret = write_diskfile(fd, bitmap, bitmap_size, node);
+    }
+    mark_dirty();
+    return ret;
+}
+
+int write_diskfile(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node){
+    FS_TRACE("WRITE_DISKFILE CALLED\n");
+    unsigned long int freeblock = find_free_block(bitmap, bitmap_size);
+    if(freeblock == NO_FREE_BLOCK){
+        return -ENOSPC;
+    }
+    if(write_node(fd, bitmap, bitmap_size, freeblock, node) < 0){
+        free_block(bitmap, freeblock);
+        return -ENOSPC;
+    }
+    node->inode_number = freeblock;
     return 0;
 }
 
-int update_node(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node, int mode){
-    printf("UPDATE_NODE CALLED\n");
-    FSfile * getfile = NULL;
-    clear_bit(&bitmap, node->inode_number);
-    write_diskfile(fd, bitmap, bitmap_size, node);
-    if(mode && strcmp(node->type, "file") == 0){
-        getfile = find_file(node->path);
-        load_file(node->path, getfile->data);
-        serialize_filedata_wrapper(node->inode_number, getfile->data, node);
+/*
+Payload bytes carried by the first block of a record and by each continuation block
+*/
+#define REC_HEAD_ROOM (BLOCK_SIZE - sizeof(struct rec_hdr))
+#define REC_CONT_ROOM (BLOCK_SIZE - sizeof(struct rec_cont))
+#define REC_PATH_ROOM(len) (((len) + 8) & ~7UL)
+
+int write_record(uint8_t * bitmap, uint64_t bitmap_size, unsigned long int blocknumber, struct rec_node * rec){
+    size_t path_len = strlen(rec->path);
+    size_t children_off = REC_PATH_ROOM(path_len);
+    size_t data_off = children_off + sizeof(uint64_t) * rec->hdr.num_children;
+    size_t payload_len = data_off + sizeof(uint64_t) * rec->hdr.num_data;
+    size_t done, room, head;
+    unsigned long int blocks = 1, i;
+    unsigned long int * chain = NULL;
+    char * block;
+    char * payload = (char *)calloc(1, payload_len);
+    memcpy(payload, rec->path, path_len);
+    if(rec->hdr.num_children > 0){
+        memcpy(payload + children_off, rec->children, sizeof(uint64_t) * rec->hdr.num_children);
+    }
+    if(rec->hdr.num_data > 0){
+        memcpy(payload + data_off, rec->data, sizeof(uint64_t) * rec->hdr.num_data);
+    }
+    if(payload_len > REC_HEAD_ROOM){
+        blocks += (payload_len - REC_HEAD_ROOM + REC_CONT_ROOM - 1) / REC_CONT_ROOM;
+    }
+    chain = (unsigned long int *)calloc(sizeof(unsigned long int), blocks + 1);
+    chain[0] = blocknumber;
+    for(i = 1; i < blocks; i++){
+        chain[i] = find_free_block(bitmap, bitmap_size);
+        if(chain[i] == NO_FREE_BLOCK){
+            // give back the continuation blocks taken so far, block 0 must not be overwritten
+            while(--i > 0){
+                free_block(bitmap, chain[i]);
+            }
+            free(chain);
+            free(payload);
+            return -ENOSPC;
+        }
+    }
+
+    rec->hdr.magic = REC_MAGIC;
+    rec->hdr.version = REC_VERSION;
+    rec->hdr.inode = blocknumber;
+    rec->hdr.path_len = path_len;
+    rec->hdr.next_block = chain[1];
+    done = 0;
+    for(i = 0; i < blocks; i++){
+        block = store_block(&meta_store, chain[i], 1);
+        if(block == NULL){
+            break;
+        }
+        memset(block, 0, BLOCK_SIZE);
+        if(i == 0){
+            memcpy(block, &rec->hdr, sizeof(rec->hdr));
+            head = sizeof(rec->hdr);
+        }
+        else{
+            struct rec_cont cont = { REC_CONT_MAGIC, 0, chain[i + 1] };
+            memcpy(block, &cont, sizeof(cont));
+            head = sizeof(cont);
+        }
+        room = BLOCK_SIZE - head;
+        if(room > payload_len - done){
+            room = payload_len - done;
+        }
+        memcpy(block + head, payload + done, room);
+        done += room;
     }
-    writebitmap(meta_fd, metamap, metamap_size);
+    free(chain);
+    free(payload);
     return 0;
 }
 
-void write_diskfile(int fd, uint8_t * bitmap, uint64_t bitmap_size, FStree * node){
-    printf("WRITE_DISKFILE CALLED\n");
-    int childnodes = 0;
-    unsigned long int freeblock = find_free_block(bitmap, bitmap_size);
-    unsigned long int offset = freeblock * BLOCK_SIZE;
-    unsigned long int init_next_block = 0;
-    unsigned long int parent = get_parent_block(fd, node, freeblock);
-    lseek(fd, offset, SEEK_SET);
-    write(fd, OPEN_MARKER, 2);
-    write(fd, "PATH=", 5);
-    write(fd, node->path, (int)strlen(node->path));
-    write(fd, "\0\n", 2);
-    write(fd, "INOD=", 5);
-    write(fd, &(freeblock), sizeof(freeblock));
-    write(fd, "\0\n", 2);
-    write(fd, "TYPE=", 5);
-    write(fd, node->type, (int)strlen(node->type));
-    write(fd, "\0\n", 2);
-    write(fd, "PERM=", 5);
-    write(fd, &(node->permissions), sizeof(node->permissions));
-    write(fd, "\0\n", 2);
-    write(fd, "NUID=", 5);
-    write(fd, &(node->user_id), sizeof(node->user_id));
-    write(fd, "\0\n", 2);
-    write(fd, "NGID=", 5);
-    write(fd, &(node->group_id), sizeof(node->group_id));
-    write(fd, "\0\n", 2);
-    write(fd, "ATIM=", 5);
-    write(fd, &(node->a_time), sizeof(node->a_time));
-    write(fd, "\0\n", 2);
-    write(fd, "MTIM=", 5);
-    write(fd, &(node->m_time), sizeof(node->m_time));
-    write(fd, "\0\n", 2);
-    write(fd, "CTIM=", 5);
-    write(fd, &(node->c_time), sizeof(node->c_time));
-    write(fd, "\0\n", 2);
-    write(fd, "BTIM=", 5);
-    write(fd, &(node->b_time), sizeof(node->b_time));
-    write(fd, "\0\n", 2);
-    write(fd, "SIZE=", 5);
-    write(fd, &(node->size), sizeof(node->size));
-    write(fd, "\0\n", 2);
-    write(fd, "PPTR=", 5);
-    write(fd, &(parent), sizeof(parent));
-    write(fd, "\0\n", 2);
-    write(fd, "NBLK=", 5);
-    write(fd, &(init_next_block), sizeof(init_next_block));
-    write(fd, "\0\n", 2);
-    write(fd, "CPTR=", 5);
-    while(childnodes < node->num_children){
-        write(fd, "<", 1);
-        write(fd, &((node->children[childnodes])->inode_number), sizeof((node->children[childnodes])->inode_number));
-        write(fd, ">", 1);
-        childnodes++;
-	}
-    write(fd, "\0\n", 2);
-    if(strcmp( node->type, "file") == 0 ){
-        write(fd, "DATA=", 5);
-        if(w_flag > 0){
-            lseek(fd,sizeof(unsigned long int)*(w_flag-1),SEEK_CUR);
-            write(fd,&(w_freeblock),sizeof(w_freeblock));
+int read_record(unsigned long int blocknumber, struct rec_node * rec){
+    char * block = store_block(&meta_store, blocknumber, 0);
+    struct rec_cont cont;
+    size_t children_off, data_off, payload_len, done, room;
+    uint64_t next;
+    char * payload;
+    memset(rec, 0, sizeof(* rec));
+    if(blocknumber == 0 || block == NULL){
+        return -1;
+    }
+    memcpy(&rec->hdr, block, sizeof(rec->hdr));
+    if(rec->hdr.magic != REC_MAGIC || rec->hdr.version < 1 || rec->hdr.version > REC_VERSION){
+        return -1;
+    }
+    children_off = REC_PATH_ROOM(rec->hdr.path_len);
+    data_off = children_off + sizeof(uint64_t) * rec->hdr.num_children;
+    payload_len = data_off + sizeof(uint64_t) * rec->hdr.num_data;
+    // the continuation block list is kept after the payload
+    payload = (char *)calloc(1, payload_len + sizeof(uint64_t) * (payload_len / REC_CONT_ROOM + 1));
+    room = payload_len < REC_HEAD_ROOM ? payload_len : REC_HEAD_ROOM;
+    memcpy(payload, block + sizeof(rec->hdr), room);
+    done = room;
+    rec->chain = (uint64_t *)(payload + payload_len);
+    next = rec->hdr.next_block;
+    while(done < payload_len){
+        block = store_block(&meta_store, next, 0);
+        if(next == 0 || block == NULL){
+            free(payload);
+            return -1;
         }
-        write(fd,"\0\n",2);
+        memcpy(&cont, block, sizeof(cont));
+        if(cont.magic != REC_CONT_MAGIC){
+            free(payload);
+            return -1;
+        }
+        rec->chain[rec->num_chain++] = next;
+        room = payload_len - done < REC_CONT_ROOM ? payload_len - done : REC_CONT_ROOM;
+        memcpy(payload + done, block + sizeof(cont), room);
+        done += room;
+        next = cont.next_block;
     }
-    write(fd, CLOSE_MARKER, 2);
-    node->inode_number = freeblock;
-    return;
+    payload[rec->hdr.path_len] = '\0';
+    rec->path = payload;
+    rec->children = (uint64_t *)(payload + children_off);
+    rec->data = (uint64_t *)(payload + data_off);
+    return 0;
+}
+
+void free_record(struct rec_node * rec){
+    free(rec->path);
+    rec->path = NULL;
 }
 
-void serialize_metadata(FStree * temp){
-    printf("SERIALIZE_METADATA CALLED\n");
+int serialize_metadata(FStree * temp){
+    FS_TRACE("SERIALIZE_METADATA CALLED\n");
     if(temp == NULL){
-        return;
+        return 0;
     }
-    write_diskfile(meta_fd, metamap, metamap_size, temp);
-    return;
+    return write_diskfile(meta_fd, metamap, metamap_size, temp);
 }
 
-void serialize_metadata_wrapper(FStree * node){
-    printf("SERIALIZE_METADATA_WRAPPER CALLED\n");
+int serialize_metadata_wrapper(FStree * node){
+    FS_TRACE("SERIALIZE_METADATA_WRAPPER CALLED\n");
     FStree * temp = node;
-    meta_fd = open("fsmeta", O_RDWR , 0644);
-    serialize_metadata(temp);
-    writebitmap(meta_fd, metamap, metamap_size);
-    resetmetafd();
+    int ret = serialize_metadata(temp);
+    mark_dirty();
+    return ret;
 }
 
 int check_validity_block(unsigned long int blocknumber){
-    printf("CHECK_VALIDITY_BLOCK CALLED\n");
+    FS_TRACE("CHECK_VALIDITY_BLOCK CALLED\n");
     unsigned long int index = blocknumber / 8;
     int bit_index = blocknumber % 8;
     return ((metamap[index] >> bit_index)  & 0x01);
 }
 
-void delete_metadata_block(char * type,unsigned long int blocknumber){
-    printf("DELETE_METADATA_BLOCK CALLED\n");
-    meta_fd = open("fsmeta", O_RDWR , 0644);
-    clear_bit(&metamap, blocknumber);
-    writebitmap(meta_fd, metamap, metamap_size);
-    resetmetafd();
-    if(strcmp(type, "file") == 0){
-        unsigned long int d_block = find_data_block(blocknumber);
-        data_fd = open("fsdata", O_RDWR , 0644);
-        clear_bit(&datamap, d_block);
-        writebitmap(data_fd, datamap, datamap_size);
-        resetdatafd();
-        if(t_set != 0){
-            int i = 0;
-            while(t_set != 0){
-                d_block = array[i];
-                i = i + 1;
-                t_set = t_set -1;	
-                data_fd = open("fsdata", O_RDWR , 0644);
-                clear_bit(&datamap, d_block);
-                writebitmap(data_fd, datamap, datamap_size);
-                resetdatafd();
-            }
-            t_set = 0;
-        }
+void delete_metadata_block(FStree * node){
+    FS_TRACE("DELETE_METADATA_BLOCK CALLED\n");
+    struct rec_node rec;
+    uint32_t i;
+    clean_node(node);
+    for(i = 0; i < node->num_blocks; i++){
+        free_block(datamap, node->blocks[i]);
     }
+    free(node->blocks);
+    node->blocks = NULL;
+    node->num_blocks = 0;
+    node->max_blocks = 0;
+    if(read_record(node->inode_number, &rec) == 0){
+        free_record_chain(metamap, &rec);
+        free_record(&rec);
+    }
+    if(node->inode_number != NO_FREE_BLOCK){
+        // a node whose record could not be written never got a block
+        free_block(metamap, node->inode_number);
+    }
+    mark_dirty();
 }
 
-unsigned long int find_data_block(unsigned long int blocknumber){
-    printf("FIND_DATA_BLOCK CALLED\n");
-    char buffer[1] = {0};
-    unsigned long int offset = blocknumber * BLOCK_SIZE;
-    meta_fd = open("fsmeta", O_RDWR , 0644);
-    lseek(meta_fd, offset, SEEK_SET);
-    int readbytes = read(meta_fd, &buffer, 1);
-    unsigned long int d_block;
-    while(readbytes){
-    	if(buffer[0]=='D'){
-            readbytes = read(meta_fd, &buffer, 1);
-            if(buffer[0]=='A'){
-                readbytes = read(meta_fd, &buffer, 1);
-                if(buffer[0]=='T'){
-                    readbytes = read(meta_fd, &buffer, 1);
-                    readbytes = read(meta_fd, &buffer, 1);
-                    readbytes = read(meta_fd, &buffer, 1);
-                    if(buffer[0] == '\0'){
-                        return 0;
-                    }
-                    lseek(meta_fd,-1,SEEK_CUR);
-                    read(meta_fd, &(d_block), sizeof(d_block));
-                    readbytes = read(meta_fd, &buffer, 1);
-                    t_set=0;
-                    set = 0;
-                    while(buffer[0] != '\0'){
-                        set = set+1;
-                        lseek(meta_fd,-1,SEEK_CUR);
-                        array = (unsigned long int *)realloc(array, sizeof(array) * set);
-                        read(meta_fd, &(array[set-1]), sizeof(d_block));
-                        readbytes = read(meta_fd, &buffer, 1);
-                        t_set = set;
-                        
-                    }
-                    break;
-                }
-            }
-        }
-        readbytes = read(meta_fd, &buffer, 1);
+unsigned long int find_data_block(FStree * node, unsigned long int index){
+    if(index >= node->num_blocks){
+        return 0;
     }
-    set = 0;
-    return d_block;
+    return node->blocks[index];
 }		
 
 void deserialize_metadata_wrapper(){
-    printf("DESERIALIZE_METADATA_WRAPPER CALLED\n");
-    meta_fd = open("fsmeta", O_RDWR , 0644);
-    loadbitmap(meta_fd, &metamap, &metamap_size);
-    deserialize_metadata(1);
-}
-
-void deserialize_metadata(unsigned long int blknumber){
-    printf("DESERIALIZE_METADATA CALLED\n");
-    char buffer[1] = {0};
-    int i = 0;
-    int pathlen = 1;
-    int typelen = 1;
-    int num_children = 0;
-    mode_t permissions = 0;
-    uid_t user_id = 0;
-    gid_t group_id = 0;
-    time_t a_time = 0;
-    time_t b_time = 0;
-    time_t c_time = 0;
-    time_t m_time = 0;
-    off_t size = 0;
-    unsigned long int nblk = 0;
-    unsigned long int parent = 0;
-    unsigned long int inode = 0;
-    char * path = (char *)calloc(sizeof(char), 1);
-    char * type = (char *)calloc(sizeof(char), 1);
-    unsigned long int * children = (unsigned long int *)calloc(sizeof(unsigned long int), 1);
-    lseek(meta_fd, blknumber * BLOCK_SIZE, SEEK_SET);
-    int readbytes = read(meta_fd, &buffer, 1);
-    while(readbytes){
-        switch(buffer[0]){
-            case 'P':
-                readbytes = read(meta_fd, &buffer, 1);
-                switch(buffer[0]){
-                    case 'A':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        while(buffer[0] != '\0'){
-                            pathlen++;
-                            path = (char *)realloc(path, sizeof(char) * pathlen);
-                            path[pathlen - 1] = '\0';
-                            read(meta_fd, &path[pathlen - 2], 1);
-                            buffer[0] = path[pathlen - 2];
-                        }
-                        //printf("PATH FOUND : %s\n", path);
-                        if(search_node(path) != NULL){
-                            return; 
-                        }
-                        break;
-                    case 'E':
-                        readbytes = read(meta_fd, &buffer, 1);
-                        if(buffer[0] != 'R'){
-                            break;
-                        }
-                        for(i = 0; i < 2; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &permissions, sizeof(permissions));
-                        //printf("PERMISSIONS FOUND : (%3o)\n", permissions&0777);
-                        break;
-                    case 'P':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &parent, sizeof(parent));
-                        //printf("PARENT FOUND : %lu\n", parent);
-                        break;
-                }   
-                break;
-            case 'I':
-                readbytes = read(meta_fd, &buffer, 1);
-                switch(buffer[0]){
-                    case 'N':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &inode, sizeof(inode));
-                        //printf("INODE FOUND : %lu\n", inode);
-                        break;
-                }  
-                break; 
-            case 'T':
-                readbytes = read(meta_fd, &buffer, 1);
-                switch(buffer[0]){
-                    case 'Y':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        while(buffer[0] != '\0'){
-                            typelen++;
-                            type = (char *)realloc(type, sizeof(char) * typelen);
-                            type[typelen - 1] = '\0';
-                            read(meta_fd, &type[typelen - 2], 1);
-                            buffer[0] = type[typelen - 2];
-                        }
-                        //printf("TYPE FOUND : %s\n", type);
-                        break;
-                }   
-                break;
-            case 'N':
-                readbytes = read(meta_fd, &buffer, 1);
-                switch(buffer[0]){
-                    case 'U':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &user_id, sizeof(user_id));
-                        //printf("USER ID FOUND : %d\n", user_id);
-                        break;
-                    case 'G':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &group_id, sizeof(group_id));
-                        //printf("GROUP ID FOUND : %d\n", group_id);
-                        break;
-                    case 'B':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        read(meta_fd, &nblk, sizeof(nblk));
-                        //printf("NEXT BLOCK FOUND : %lu\n", nblk);
-                        break;
-                }  
+    FS_TRACE("DESERIALIZE_METADATA_WRAPPER CALLED\n");
+    char * root_block = store_block(&meta_store, 1, 0);
+    if(root_block != NULL && memcmp(root_block, OPEN_MARKER, 2) == 0){
+        int converted = convert_legacy_metadata();
+        FS_INFO("CONVERTED %d LEGACY METADATA RECORDS\n", converted);
+    }
+    deserialize_metadata(1, NULL);
+}
+
+void deserialize_metadata(unsigned long int blknumber, FStree * parent){
+    FS_TRACE("DESERIALIZE_METADATA CALLED\n");
+    struct rec_node rec;
+    FStree * node;
+    const char * name;
+    uint32_t i;
+    if(!check_validity_block(blknumber) || read_record(blknumber, &rec) < 0){
+        return;
+    }
+    // a record left listed by a directory it was moved out of names its real parent
+    if(parent != NULL && rec.hdr.parent != 0 && rec.hdr.parent != parent->inode_number){
+        free_record(&rec);
+        return;
+    }
+    // version 1 records hold the full path, the name is its last component
+    name = strrchr(rec.path, '/') ? strrchr(rec.path, '/') + 1 : rec.path;
+    node = load_node(parent, name, strlen(name), rec.hdr.type == REC_TYPE_FILE ? "file" : "directory", rec.hdr.group_id, rec.hdr.user_id, rec.hdr.c_time, rec.hdr.m_time, rec.hdr.a_time, rec.hdr.b_time, blknumber, rec.hdr.size, rec.hdr.permissions);
+    if(node == NULL){
+        free_record(&rec);
+        return;
+    }
+    if(rec.hdr.num_data > 0){
+        node->blocks = (uint64_t *)malloc(sizeof(uint64_t) * rec.hdr.num_data);
+        memcpy(node->blocks, rec.data, sizeof(uint64_t) * rec.hdr.num_data);
+        node->num_blocks = rec.hdr.num_data;
+        node->max_blocks = rec.hdr.num_data;
+    }
+    if(rec.hdr.type == REC_TYPE_FILE && node->size > (off_t)node->num_blocks * DATA_CHUNK){
+        node->size = (off_t)node->num_blocks * DATA_CHUNK;     // images written before sizes were kept exactly
+    }
+    if(rec.hdr.type == REC_TYPE_DIR){
+        for(i = 0; i < rec.hdr.num_children; i++){
+            deserialize_metadata(rec.children[i], node);
+        }
+    }
+    free_record(&rec);
+    return;
+}
+
+/*
+Fields of one legacy record, in the order write_diskfile used to emit them
+*/
+static const char * legacy_tags[] = { "PATH", "INOD", "TYPE", "PERM", "NUID", "NGID", "ATIM", "MTIM", "CTIM", "BTIM", "SIZE", "PPTR", "NBLK", "CPTR", "DATA" };
+
+/*
+Appends one block number to a growing array
+*/
+static uint64_t * legacy_push(uint64_t * list, uint32_t * count, const char * src){
+    list = (uint64_t *)realloc(list, sizeof(uint64_t) * (* count + 1));
+    memcpy(&list[* count], src, sizeof(uint64_t));
+    (* count)++;
+    return list;
+}
+
+/*
+Parses a legacy tagged record held in 'block' into 'rec'. 'rec->path', 'rec->children' and 'rec->data' are separate allocations here
+*/
+static int legacy_parse(const char * block, struct rec_node * rec){
+    const char * p = block + 2;
+    const char * end = block + BLOCK_SIZE;
+    char tag[5] = {0};
+    int field;
+    size_t len;
+    memset(rec, 0, sizeof(* rec));
+    if(memcmp(block, OPEN_MARKER, 2) != 0){
+        return -1;
+    }
+    while(p + 5 <= end && memcmp(p, CLOSE_MARKER, 2) != 0){
+        memcpy(tag, p, 4);
+        p += 5;
+        for(field = 0; field < (int)(sizeof(legacy_tags) / sizeof(legacy_tags[0])); field++){
+            if(strcmp(tag, legacy_tags[field]) == 0){
                 break;
-            case 'A':
-                for(i = 0; i < 3; i++){
-                    readbytes = read(meta_fd, &buffer, 1);
+            }
+        }
+        switch(field){
+            case 0:     // PATH
+            case 2:     // TYPE
+                len = strnlen(p, end - p);
+                if(field == 0){
+                    rec->path = strndup(p, len);
+                    rec->hdr.path_len = len;
                 }
-                if(buffer[0] != 'M'){
-                    break;
+                else{
+                    rec->hdr.type = (strncmp(p, "file", len) == 0) ? REC_TYPE_FILE : REC_TYPE_DIR;
                 }
-                readbytes = read(meta_fd, &buffer, 1);
-                read(meta_fd, &a_time, sizeof(a_time));
-                //printf("ACCESS TIME FOUND : %s", ctime(&a_time));
+                p += len;
                 break;
-            case 'M':
-                readbytes = read(meta_fd, &buffer, 1);
-                if(buffer[0] != 'T'){
-                    break;
-                }
-                for(i = 0; i < 3; i++){
-                    readbytes = read(meta_fd, &buffer, 1);
-                }
-                readbytes = read(meta_fd, &buffer, 1);
-                read(meta_fd, &m_time, sizeof(m_time));
-                //printf("MODIFIED TIME FOUND : %s", ctime(&m_time));
+            case 3:     // PERM
+                memcpy(&rec->hdr.permissions, p, sizeof(mode_t));
+                p += sizeof(mode_t);
                 break;
-            case 'C':
-                readbytes = read(meta_fd, &buffer, 1);
-                switch(buffer[0]){
-                    case 'T':
-                        for(i = 0; i < 3; i++){
-                            readbytes = read(meta_fd, &buffer, 1);
-                        }
-                        readbytes = read(meta_fd, &buffer, 1);
-                        read(meta_fd, &c_time, sizeof(c_time));
-                        //printf("STATUS CHANGE TIME FOUND : %s", ctime(&c_time));
-                        break;
-                    case 'P':
-                        if(strcmp(type,"file") == 0){
-			                if(check_validity_block(inode)){
-                                load_node(path, type, group_id, user_id, c_time, m_time, a_time, b_time, inode, size, permissions);
-                                pathlen = 1;
-                                typelen = 1;
-                                num_children = 0;
-                                //num_files = 0;
-                                free(type);
-                                free(path);
-                                free(children);
-                                path = (char *)calloc(sizeof(char), 1);
-                                type = (char *)calloc(sizeof(char), 1);
-                                children = (unsigned long int *)calloc(sizeof(unsigned long int), 1);
-                                inode = -1;
-                                permissions = 0;
-                                user_id = 0; 
-                                group_id = 0;
-                                a_time = 0;
-                                b_time = 0;
-                                c_time = 0;
-                                m_time = 0;
-                                size = 0;
-                                parent = 0;
-                                nblk = 0;
-			                }
-			                else{
-                                pathlen = 1;
-                                typelen = 1;
-                                num_children = 0;
-                                free(type);
-                                free(path);
-                                free(children);
-                                path = (char *)calloc(sizeof(char), 1);
-                                type = (char *)calloc(sizeof(char), 1);
-                                children = (unsigned long int *)calloc(sizeof(unsigned long int), 1);
-                                inode = -1;
-                                permissions = 0;
-                                user_id = 0; 
-                                group_id = 0;
-                                a_time = 0;
-                                b_time = 0;
-                                c_time = 0;
-                                m_time = 0;
-                                size = 0;
-                                parent = 0;
-                                nblk = 0;
-		                    }
-			            }
-                        else{
-		                    while(buffer[0] != '\0'){
-		                        if(buffer[0] == '<'){
-		                            num_children++;
-		                            children = (unsigned long int *)realloc(children, sizeof(unsigned long int) * (num_children));
-		                            read(meta_fd, &children[num_children - 1], sizeof(children[num_children - 1]));
-		                        }
-		                        read(meta_fd, &buffer, 1);
-		                    }   
-		                    if(check_validity_block(inode)){
-                                load_node(path, type, group_id, user_id, c_time, m_time, a_time, b_time, inode, size, permissions);
-                                pathlen = 1;
-                                typelen = 1;
-                                num_children = 0;
-                                free(type);
-                                free(path);
-                                free(children);
-                                path = (char *)calloc(sizeof(char), 1);
-                                type = (char *)calloc(sizeof(char), 1);
-                                children = (unsigned long int *)calloc(sizeof(unsigned long int), 1);
-                                inode = -1;
-                                permissions = 0;
-                                user_id = 0; 
-                                group_id = 0;
-                                a_time = 0;
-                                b_time = 0;
-                                c_time = 0;
-                                m_time = 0;
-                                size = 0;
-                                parent = 0;
-                                nblk = 0;
-                                for(i = 0; i < num_children; i++){
-                                    deserialize_metadata(children[i]);
-                                }
-		                    }
-                            else{
-                                pathlen = 1;
-                                typelen = 1;
-                                num_children = 0;
-                                free(type);
-                                free(path);
-                                free(children);
-                                path = (char *)calloc(sizeof(char), 1);
-                                type = (char *)calloc(sizeof(char), 1);
-                                children = (unsigned long int *)calloc(sizeof(unsigned long int), 1);
-                                inode = -1;
-                                permissions = 0;
-                                user_id = 0; 
-                                group_id = 0;
-                                a_time = 0;
-                                b_time = 0;
-                                c_time = 0;
-                                m_time = 0;
-                                size = 0;
-                                parent = 0;
-                                nblk = 0;
-                            }
-			            }
-                        break;
-                }
+            case 4:     // NUID
+                memcpy(&rec->hdr.user_id, p, sizeof(uid_t));
+                p += sizeof(uid_t);
                 break;
-            case 'B':
-                readbytes = read(meta_fd, &buffer, 1);
-                if(buffer[0] != 'T'){
-                    break;
-                }
-                for(i = 0; i < 3; i++){
-                    readbytes = read(meta_fd, &buffer, 1);
+            case 5:     // NGID
+                memcpy(&rec->hdr.group_id, p, sizeof(gid_t));
+                p += sizeof(gid_t);
+                break;
+            case 6:     // ATIM
+            case 7:     // MTIM
+            case 8:     // CTIM
+            case 9:     // BTIM
+            case 10:    // SIZE
+                memcpy(field == 6 ? &rec->hdr.a_time : field == 7 ? &rec->hdr.m_time : field == 8 ? &rec->hdr.c_time : field == 9 ? &rec->hdr.b_time : &rec->hdr.size, p, sizeof(int64_t));
+                p += sizeof(int64_t);
+                break;
+            case 1:     // INOD
+            case 11:    // PPTR
+            case 12:    // NBLK
+                memcpy(field == 1 ? &rec->hdr.inode : field == 11 ? &rec->hdr.parent : &rec->hdr.next_block, p, sizeof(uint64_t));
+                p += sizeof(uint64_t);
+                break;
+            case 13:    // CPTR: "<" block ">" ...
+                while(p + 10 <= end && p[0] == '<'){
+                    rec->children = legacy_push(rec->children, &rec->hdr.num_children, p + 1);
+                    p += 10;
                 }
-                readbytes = read(meta_fd, &buffer, 1);
-                read(meta_fd, &b_time, sizeof(b_time));
-                //printf("CREATION TIME FOUND : %s", ctime(&b_time));
                 break;
-            case 'S':
-                for(i = 0; i < 4; i++){
-                    readbytes = read(meta_fd, &buffer, 1);
+            case 14:    // DATA: raw block numbers up to the terminator
+                while(p + 8 <= end && p[0] != '\0'){
+                    rec->data = legacy_push(rec->data, &rec->hdr.num_data, p);
+                    p += 8;
                 }
-                read(meta_fd, &size, sizeof(size));
                 break;
+            default:
+                return -1;
         }
-        readbytes = read(meta_fd, &buffer, 1);
+        p += 2;     // "\0\n"
     }
-    return;
+    if(rec->path == NULL){
+        return -1;
+    }
+    return 0;
 }
 
-void write_data(int fd, uint8_t * bitmap, uint64_t bitmap_size,unsigned long int inode,char * data,FStree * node){
-	printf("WRITE_DATA CALLED\n");
-	unsigned long int offset;
-	int x = sizeof(unsigned long int);
-	int d_block = find_data_block(node->inode_number);
-	if(w_flag > 0)
-		d_block = 0 ;
-	if(d_block == 0){
-		w_freeblock = find_free_block(bitmap, bitmap_size);
-		offset = w_freeblock * BLOCK_SIZE;
-		lseek(fd, offset, SEEK_SET);
-		write(fd, OPEN_MARKER, 2);
-		write(fd, "INOD=", 5);
-		write(fd, &(inode), sizeof(inode));
-		write(fd, "\0\n", 2);
-		write(fd, "DATA=", 5);
-		if(strlen(data) < (512 - x - 13)){
-			write(fd, data, (int)strlen(data));
-			write(fd, "\0\n", 2);
-			write(fd, CLOSE_MARKER, 2);
-			w_flag++;
-			update_node_wrapper(node, 0);
-			w_flag=0;
-		}
-		else {	
-			char *substr= calloc(sizeof(char),512-x-13+1);
-			char *remain = calloc(sizeof(char),strlen(data)-(512-x-13)+1);
-			strncpy(substr,data,512-x-13);
-			substr[strlen(substr)]='\0';
-			if((strlen(data)-(512-x-13))!=0){
-				strncpy(remain,data+(512-x-13),strlen(data)-(512-x-13));
-				remain[strlen(remain)]='\0';
-			}
-			write(fd, substr, (int)strlen(substr));
-			write(fd, "\0\n", 2);
-			write(fd, CLOSE_MARKER, 2);
-			w_flag=w_flag+1;
-			update_node_wrapper(node, 0);
-			if((strlen(data)-(512-x-13))!=0){
-				write_data(data_fd, datamap, datamap_size, inode,remain,node);
-			}
-			else{
-				w_flag = 0;
-			}
-		}
+int convert_legacy_metadata(){
+    FS_TRACE("CONVERT_LEGACY_METADATA CALLED\n");
+    char * block;
+    struct rec_node rec;
+    uint64_t blocknumber;
+    int converted = 0;
+    for(blocknumber = 1; blocknumber < metamap_size * 8; blocknumber++){
+        if(!check_validity_block(blocknumber)){
+            continue;
+        }
+        block = store_block(&meta_store, blocknumber, 0);
+        if(block == NULL){
+            break;
+        }
+        // continuation blocks allocated by earlier conversions are skipped here
+        if(legacy_parse(block, &rec) == 0){
+            if(strrchr(rec.path, '/') != NULL){
+                memmove(rec.path, strrchr(rec.path, '/') + 1, strlen(strrchr(rec.path, '/')));
+            }
+            if(write_record(metamap, metamap_size, blocknumber, &rec) == 0){
+                converted++;
+            }
+        }
+        free(rec.path);
+        free(rec.children);
+        free(rec.data);
+    }
+    mark_dirty();
+    return converted;
+}
+
+/*
+Writes the header, zeroed data and trailer of a fresh data block of 'inode'
+*/
+static char * init_data_block(unsigned long int blocknumber, unsigned long int inode){
+	char * block = store_block(&data_store, blocknumber, 1);
+	char * p = block;
+	if(block == NULL){
+		return NULL;
+	}
+	memcpy(p, OPEN_MARKER, 2);
+	p += 2;
+	memcpy(p, "INOD=", 5);
+	p += 5;
+	memcpy(p, &inode, sizeof(inode));
+	p += sizeof(inode);
+	memcpy(p, "\0\n", 2);
+	p += 2;
+	memcpy(p, "DATA=", 5);
+	p += 5;
+	memset(p, 0, DATA_CHUNK);
+	p += DATA_CHUNK;
+	memcpy(p, "\0\n", 2);
+	p += 2;
+	memcpy(p, CLOSE_MARKER, 2);
+	return block;
+}
+
+/*
+Grows the block list of 'node' to 'count' fresh blocks, -ENOSPC when the data disk is full
+*/
+static int grow_blocks(FStree * node, uint32_t count){
+	unsigned long int blocknumber;
+	if(count > node->max_blocks){
+		node->max_blocks = node->max_blocks * 2 > count ? node->max_blocks * 2 : count;
+		node->blocks = (uint64_t *)realloc(node->blocks, sizeof(uint64_t) * node->max_blocks);
 	}
-	else {
-		lseek(fd,(d_block*BLOCK_SIZE+13+sizeof(unsigned long int)),SEEK_SET);
-		char buffer[1] = {0};
-    	read(data_fd, &buffer, 1);
-		w_freeblock = d_block;
-		if(strlen(data) < (512 - x - 13)){
-			write(fd, data, (int)strlen(data));
-			write(fd, "\0\n", 2);
-			write(fd, CLOSE_MARKER, 2);
-			w_flag++;
-			update_node_wrapper(node, 0);
-			w_flag=0;
+	while(node->num_blocks < count){
+		blocknumber = find_free_block(datamap, datamap_size);
+		if(blocknumber == NO_FREE_BLOCK){
+			return -ENOSPC;
 		}
-		else{	
-			char *substr= calloc(sizeof(char),512-x-13+1);
-			char *remain = calloc(sizeof(char),strlen(data)-(512-x-13+1));
-			strncpy(substr,data,512-x-13);
-			substr[strlen(substr)]='\0';
-			if((strlen(data) - (512 - x - 13)) != 0){
-				strncpy(remain,data+(512-x-13),strlen(data)-(512-x-13));
-				remain[strlen(remain)]='\0';
-			}
-			write(fd, substr, (int)strlen(substr));
-			write(fd, "\0\n", 2);
-			write(fd, CLOSE_MARKER, 2);
-			w_flag = w_flag + 1;
-			update_node_wrapper(node, 0);
-			if((strlen(data) - (512 - x - 13)) != 0){
-				write_data(data_fd, datamap, datamap_size, inode,remain,node);
-			}
-			else{
-				w_flag = 0;
-			}
+		if(init_data_block(blocknumber, node->inode_number) == NULL){
+			free_block(datamap, blocknumber);
+			return -EIO;
 		}
+		node->blocks[node->num_blocks++] = blocknumber;
 	}
-	return;
+	return 0;
 }
 
-void serialize_filedata(unsigned long int inode,char * data,FStree * node){
-    printf("SERIALIZE_FILEDATA CALLED\n");
-    write_data(data_fd, datamap, datamap_size, inode,data,node);
-    return;
+/*
+Zeroes bytes [from, to) of the file data, all of which lie in allocated blocks
+*/
+static void zero_file_data(FStree * node, off_t from, off_t to){
+	char * block;
+	size_t chunk, skip;
+	while(from < to){
+		skip = from % DATA_CHUNK;
+		chunk = DATA_CHUNK - skip < (size_t)(to - from) ? DATA_CHUNK - skip : (size_t)(to - from);
+		block = store_block(&data_store, find_data_block(node, from / DATA_CHUNK), 0);
+		if(block != NULL){
+			memset(block + DATA_OFFSET + skip, 0, chunk);
+		}
+		from += chunk;
+	}
 }
 
-void serialize_filedata_wrapper(unsigned long int inode,char * data,FStree * node){
-    printf("SERIALIZE_FILEDATA_WRAPPER CALLED\n");
-    data_fd = open("fsdata", O_RDWR , 0644);
-    serialize_filedata(inode,data,node);
-    writebitmap(data_fd, datamap, datamap_size);
-    resetdatafd();
+size_t read_file_data(FStree * node, char * buf, size_t size, off_t offset){
+	FS_TRACE("READ_FILE_DATA CALLED\n");
+	char * block;
+	size_t done, chunk, skip;
+	if(offset >= node->size){
+		return 0;
+	}
+	if(size > (size_t)(node->size - offset)){
+		size = node->size - offset;
+	}
+	for(done = 0; done < size; done += chunk){
+		skip = (offset + done) % DATA_CHUNK;
+		chunk = DATA_CHUNK - skip < size - done ? DATA_CHUNK - skip : size - done;
+		block = store_block(&data_store, find_data_block(node, (offset + done) / DATA_CHUNK), 0);
+		if(block != NULL){
+			memcpy(buf + done, block + DATA_OFFSET + skip, chunk);
+		}
+		else{
+			memset(buf + done, 0, chunk);
+		}
+	}
+	return size;
 }
 
-char * deserialize_file_data(unsigned long int inode){
-	printf("DESERIALIZE_FILE_DATA CALLED\n");
-	char * data = (char *)calloc(sizeof(char), 1);
-	char * data1 = (char *)calloc(sizeof(char), 1);
-	char buffer[1] = {0};
-    	int datalen=1;
-	unsigned long int d_block = find_data_block(inode);
-	if(d_block==0){
-		return '\0';
+int write_file_data(FStree * node, const char * buf, size_t size, off_t offset){
+	FS_TRACE("WRITE_FILE_DATA CALLED\n");
+	char * block;
+	size_t done, chunk, skip;
+	off_t end = offset + size;
+	int ret;
+	if(size == 0){
+		return 0;
+	}
+	ret = grow_blocks(node, (end + DATA_CHUNK - 1) / DATA_CHUNK);
+	if(ret < 0){
+		return ret;
+	}
+	if(offset > node->size){
+		// a hole, the tail of the old last block may still hold bytes of an earlier, longer file
+		zero_file_data(node, node->size, offset);
 	}
-	data_fd = open("fsdata", O_RDWR , 0644);
-	lseek(data_fd, (d_block * BLOCK_SIZE + 13 + sizeof(unsigned long int)), SEEK_SET);
-	read(data_fd, &buffer, 1);	
-	while(buffer[0] != '\0'){
-        datalen++;
-        data = (char *)realloc(data, sizeof(char) * datalen);
-        data[datalen - 1] = '\0';
-        read(data_fd, &data[datalen - 2], 1);
-        buffer[0] = data[datalen - 2];
-    }
-	if(t_set != 0){
-		int i = 0;
-		while(t_set != 0){
-			datalen = 1;
-			d_block = array[i];
-			i = i + 1;
-			t_set = t_set - 1;	
-			lseek(data_fd,(d_block*BLOCK_SIZE+13+sizeof(unsigned long int)),SEEK_SET);
-			read(data_fd, &buffer, 1);	
-			while(buffer[0] != '\0'){
-			    datalen++;
-			    data1 = (char *)realloc(data1, sizeof(char) * datalen);
-			    data1[datalen - 1] = '\0';
-			    read(data_fd, &data1[datalen - 2], 1);
-			    buffer[0] = data1[datalen - 2];
-			}
-			data = (char *)realloc(data,strlen(data)+strlen(data1)+1);
-			data = strcat(data,data1);
+	for(done = 0; done < size; done += chunk){
+		skip = (offset + done) % DATA_CHUNK;
+		chunk = DATA_CHUNK - skip < size - done ? DATA_CHUNK - skip : size - done;
+		block = store_block(&data_store, find_data_block(node, (offset + done) / DATA_CHUNK), 1);
+		if(block == NULL){
+			return done > 0 ? (int)done : -EIO;
 		}
-		t_set = 0;
-		free(data1);
+		memcpy(block + DATA_OFFSET + skip, buf + done, chunk);
 	}
+	if(end > node->size){
+		node->size = end;
+	}
+	mark_node_dirty(node);
+	mark_dirty();
+	return size;
+}
 
-	data[strlen(data)] = '\0';
-	return data;
+int truncate_file_data(FStree * node, off_t size){
+	FS_TRACE("TRUNCATE_FILE_DATA CALLED\n");
+	uint32_t needed = (size + DATA_CHUNK - 1) / DATA_CHUNK;
+	uint32_t i;
+	int ret;
+	if(size < node->size){
+		for(i = needed; i < node->num_blocks; i++){
+			free_block(datamap, node->blocks[i]);
+		}
+		if(needed < node->num_blocks){
+			node->num_blocks = needed;
+		}
+	}
+	else if(size > node->size){
+		ret = grow_blocks(node, needed);
+		if(ret < 0){
+			return ret;
+		}
+		zero_file_data(node, node->size, size);
+	}
+	node->size = size;
+	mark_node_dirty(node);
+	mark_dirty();
+	return 0;
 }
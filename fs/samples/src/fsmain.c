@@ -32,6 +32,10 @@ static struct fuse_operations operations = {
         .utime	    = do_utimens,
         .access	    = do_access,
         .rename     = do_rename,
+        .release    = do_release,
+        .fsync      = do_fsync,
+        .statfs     = do_statfs,
+        .destroy    = do_destroy,
 };
 
 int main( int argc, char *argv[] ){
@@ -1,11 +1,9 @@
 #include "../include/fsoperations.h"
 
 int do_getattr(const char *path, struct stat *st){
-	printf( "GETATTR CALLED\n" );
-	printf(">>>>>>>>>>>>>>>> call get attr : %s\n", path);
+	FS_TRACE("GETATTR CALLED %s\n", path);
 	char * copy_path = (char *)path;
 	FStree * dir_node = NULL;
-	FSfile * file_node;
 
 	if(strlen(copy_path) > 1){
 		dir_node = search_node(copy_path);
@@ -23,17 +21,8 @@ int do_getattr(const char *path, struct stat *st){
 		}
 		else{
 		 	st->st_nlink = 1;
-			char * temp = deserialize_file_data(dir_node->inode_number);
-			if(temp!='\0'){
-				load_file(path,temp);
-				file_node=find_file(path);
-			 	st->st_size = file_node->size;
-				st->st_blocks = (((st->st_size) / 512) + 1);
-			}
-			else{
-				st->st_size = 0;
-				st->st_blocks = 0;
-			}
+		 	st->st_size = dir_node->size;
+			st->st_blocks = (st->st_size + 511) / 512;
 		 }
 	 }
 	st->st_nlink += dir_node->num_children;
@@ -47,7 +36,7 @@ int do_getattr(const char *path, struct stat *st){
 }
 	
 int do_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ){
-	printf("READDIR CALLED\n");
+	FS_TRACE("READDIR CALLED\n");
 		
 	filler(buffer, ".", NULL, 0 ); 
 	filler(buffer, "..", NULL, 0 );
@@ -76,20 +65,25 @@ int do_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t off
 }
 	
 int do_mkdir(const char * path, mode_t x){
-	printf("MKDIR CALLED\n");
+	FS_TRACE("MKDIR CALLED\n");
+	int ret = 0;
 	insert_node(path);
 	FStree * node = search_node((char *)path);
 	if(node != NULL){
-		serialize_metadata_wrapper(node);
-		if(node->parent != NULL){
-			update_node_wrapper(node->parent, 0);
+		ret = serialize_metadata_wrapper(node);
+		if(ret == 0 && node->parent != NULL){
+			ret = update_node_wrapper(node->parent);
+		}
+		if(ret < 0){
+			// the metadata disk is full, the new directory is dropped again
+			delete_node(path);
 		}
 	}
-	return 0;
+	return ret;
 }
 	
 int do_rmdir(const char * path){
-	printf("GETATTR CALLED\n");
+	FS_TRACE("GETATTR CALLED\n");
 	int ret = delete_node(path);
 	if(ret < 0){
 		return -ENOTEMPTY;
@@ -98,36 +92,39 @@ int do_rmdir(const char * path){
 }
 	
 int do_mknod(const char * path, mode_t x, dev_t y){
-	printf("MKNOD CALLED\n");
+	FS_TRACE("MKNOD CALLED\n");
+	int ret = 0;
 	insert_file(path);
 	FStree * node = search_node((char *)path);
 	if(node != NULL){
-		serialize_metadata_wrapper(node);
-		if(node->parent != NULL){
-			update_node_wrapper(node->parent, 0);
+		ret = serialize_metadata_wrapper(node);
+		if(ret == 0 && node->parent != NULL){
+			ret = update_node_wrapper(node->parent);
+		}
+		if(ret < 0){
+			// the metadata disk is full, the new file is dropped again
+			delete_file(path);
 		}
 	}
-	return 0;
+	return ret;
 }
 	
 int do_open(const char *path, struct fuse_file_info *fi) {
-	printf("OPEN CALLED\n");
-	FStree * my_file_tree_node = search_node((char *)path);
-	char * temp = deserialize_file_data(my_file_tree_node->inode_number);
-	if(temp != '\0'){
-		load_file(path,temp);
+	FS_TRACE("OPEN CALLED\n");
+	if(search_node((char *)path) == NULL){
+		return -ENOENT;
 	}
 	return 0;
 }
 	
 int do_unlink(const char * path){
-	printf("UNLINK CALLED\n");
+	FS_TRACE("UNLINK CALLED\n");
 	delete_file(path);
 	return 0;
 }
 
 int do_access(const char * path, int mask){
-	printf("ACCESS CALLED\n");
+	FS_TRACE("ACCESS CALLED\n");
 	char * copy_path = (char *)path;
 	uid_t u = getuid();
 	gid_t g = getgid();
@@ -206,107 +203,63 @@ int do_access(const char * path, int mask){
 }
 	
 int do_read(const char *path, char *buf, size_t size, off_t offset,struct fuse_file_info *fi) {
-	printf("READ CALLED\n");
+	FS_TRACE("READ CALLED\n");
 
 	if(do_access(path,R_OK)!=0){
 		return -EACCES;
 	}
 
-	size_t len;
 	FStree * my_file_tree_node;
-	FSfile * my_file;
 	my_file_tree_node = search_node((char *)path);
-	my_file = find_file(path);
-	char * temp = deserialize_file_data(my_file_tree_node->inode_number);
-
-	if(temp != '\0')
-		load_file(path,temp);
 
 	if(my_file_tree_node != NULL){	
 		my_file_tree_node->a_time = time(NULL);
-		len = strlen(my_file->data);
-		if(len == 0){
-			return 0;
-		}
-		memcpy(buf, my_file->data + offset, size);
-		return size;
+		return read_file_data(my_file_tree_node, buf, size, offset);
 	}
 	return -ENOENT;
 }
 	
 int do_chmod(const char *path, mode_t new){	
-	printf("CHMOD CALLED\n");
+	FS_TRACE("CHMOD CALLED\n");
 	FStree * current;
 	current = search_node((char *)path);
 	if(current != NULL){
 		current->c_time=time(NULL);
 		current->permissions = new;
-		update_node_wrapper(current, 1);
+		update_node_wrapper(current);
 		return 0;
 	}
 	return -ENOENT;
 }
 
 int do_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-	printf("WRITE CALLED and path is :%s\n",path);
+	FS_TRACE("WRITE CALLED %s\n", path);
 	if(do_access(path,W_OK)!=0){
 		return -EACCES;
 	}
 
 	FStree * my_file_tree_node;
-	FSfile * my_file;
-	my_file = find_file(path);
+	my_file_tree_node = search_node((char *)path);
 
-	if(my_file != NULL){
-		my_file_tree_node = search_node((char *)path);
-		my_file_tree_node->path = (char *)realloc(my_file_tree_node->path, sizeof(char) * strlen(path)+1);
-		strcpy(my_file_tree_node->path,path);
-		my_file_tree_node->path[strlen(my_file_tree_node->path)]='\0';
+	if(my_file_tree_node != NULL && my_file_tree_node->file != NULL){
 		my_file_tree_node->m_time = time(NULL);
 		my_file_tree_node->c_time = time(NULL);
-		my_file->data = (char *)realloc(my_file->data, sizeof(char) * (size + offset + 1));
-		my_file->size = size + offset;
-		memset((my_file->data) + offset, 0, size);
-		memcpy((my_file->data) + offset, buf, size);
-		my_file_tree_node->size = size + offset;
-		if(offset>0){
-			my_file->data[strlen(buf)+offset-1]='\0';	
-		}
-		else{
-			my_file->data[strlen(buf)]='\0';
-		}
-		int i, j=0, k, flag =0;
-		char sub [] = ".goutputstream";
-		for(i=0; path[i]; i++)
-		{
-			if(path[i] == sub[j])
-			{
-				for(k=i, j=0; path[k] && sub[j]; j++, k++)
-					if(path[k]!=sub[j])
-						break;
-				if(!sub[j]){
-					flag = 1;
-        			}
-			}
-		}
-		if(flag == 0){
-			serialize_filedata_wrapper(my_file_tree_node->inode_number,my_file->data,my_file_tree_node);
-		}
-		memset((char *)buf, 0, strlen(buf));
-		return size;
+		return write_file_data(my_file_tree_node, buf, size, offset);
 	}
 	return -ENOENT;
 }
 
 int do_utimens(const char *path, struct utimbuf *tv){
-	printf("UTIMENS CALLED\n");
+	FS_TRACE("UTIMENS CALLED\n");
 	return 0;
 }
 
 int do_rename(const char* from, const char* to){
-	printf("RENAME CALLED\n");
+	FS_TRACE("RENAME CALLED\n");
 	FStree * src;
 	FStree * dst;
+	FStree * from_parent;
+	int ret;
 	src = search_node((char *)from);
 	if(src == NULL){
 		return -ENOENT;
@@ -317,66 +270,59 @@ int do_rename(const char* from, const char* to){
 			return -EPERM;
 		}
 	}
-	move_node(from,to);
-	if(strcmp(dst->type,"file")==0){
-		int i, j=0, k, flag =0;
-		char sub [] = "goutputstream";
-		for(i=0; from[i]; i++)
-		{
-			if(from[i] == sub[j])
-			{
-				for(k=i, j=0; from[k] && sub[j]; j++, k++)
-					if(from[k]!=sub[j])
-						break;
-				if(!sub[j]){
-					flag = 1;
-				}
-			}
-		}
-		if(flag == 0){
-			delete_metadata_block(src->type,src->inode_number);
-			update_node_wrapper(src->parent, 0);
-		}
-	
-		dst = search_node((char *)to);
-		serialize_metadata_wrapper(dst);
-		if(dst->parent != NULL){
-			update_node_wrapper(dst->parent, 0);
-		}
-		FSfile * my_file = find_file((char*)to);
-		serialize_filedata_wrapper(dst->inode_number,my_file->data,dst);
+	from_parent = src->parent;
+	ret = move_node(from,to);
+	if(ret < 0){
+		return ret;
+	}
+	// the moved node's record names it and its parent, the two directory records list it; nothing below it changes
+	update_node_wrapper(src);
+	update_node_wrapper(src->parent);
+	if(from_parent != src->parent){
+		update_node_wrapper(from_parent);
 	}
 	return 0;
 }
 
 int do_truncate(const char *path, off_t size){
-	printf("TRUNCATE CALLED\n");
-	FSfile * my_file;
-	my_file = find_file(path);
+	FS_TRACE("TRUNCATE CALLED\n");
 	FStree * my_file_tree_node;
 	my_file_tree_node = search_node((char *)path);
-	if(my_file != NULL){
-		if(size <= 0){
-			free(my_file->data);
-			my_file->data = (char *)calloc(1,sizeof(char));
-			my_file->size = 0;
-			load_file(path,my_file->data);
-			serialize_filedata_wrapper(my_file_tree_node->inode_number,my_file->data,my_file_tree_node);
-		}
-		else{
-			char *buf;
-			buf = (char *)malloc(sizeof(char)*(size + 1));
-			strncpy(buf, my_file->data, size);
-			free(my_file->data);
-			my_file->data = (char *)calloc(size + 1, sizeof(char));
-			my_file->data[strlen(my_file->data)-1]='\0';
-			strcpy(my_file->data,buf);
-			my_file->size=size;
-			load_file(path,my_file->data);
-			serialize_filedata_wrapper(my_file_tree_node->inode_number,my_file->data,my_file_tree_node);
-	
-		}
-		return 0;
+	if(my_file_tree_node != NULL && my_file_tree_node->file != NULL){
+		my_file_tree_node->m_time = time(NULL);
+		my_file_tree_node->c_time = time(NULL);
+		return truncate_file_data(my_file_tree_node, size < 0 ? 0 : size);
 	}
 	return -ENOENT;
 }
+
+int do_release(const char *path, struct fuse_file_info *fi){
+	FS_TRACE("RELEASE CALLED\n");
+	FStree * my_file_tree_node;
+	my_file_tree_node = search_node((char *)path);
+	if(my_file_tree_node != NULL && my_file_tree_node->dirty){
+		update_node_wrapper(my_file_tree_node);
+	}
+	return 0;
+}
+
+int do_fsync(const char *path, int datasync, struct fuse_file_info *fi){
+	FS_TRACE("FSYNC CALLED\n");
+	FStree * my_file_tree_node;
+	my_file_tree_node = search_node((char *)path);
+	if(my_file_tree_node != NULL && my_file_tree_node->dirty){
+		update_node_wrapper(my_file_tree_node);
+	}
+	sync_disk(1);
+	return 0;
+}
+
+int do_statfs(const char *path, struct statvfs *st){
+	FS_TRACE("STATFS CALLED\n");
+	return statfs_disk(st);
+}
+
+void do_destroy(void * private_data){
+	FS_TRACE("DESTROY CALLED\n");
+	closedisk();
+}
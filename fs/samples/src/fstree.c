@@ -2,120 +2,205 @@
 
 FStree * root = NULL;
 
-char * extract_path(char ** copy_path){
-	printf("EXTRACT PATH CALLED\n");
-    char * retval = (char *)calloc(sizeof(char), 1);
-    int retlen = 0;
-    char temp;
-    char * tempstr;
-    temp = **(copy_path);
-    while(temp != '\0'){    
-        if(temp == '/'){
-            if(strlen(*copy_path) > 1){
-                (*copy_path)++;
-            }
-            break;
-        }
-        tempstr = (char *)calloc(sizeof(char) , (retlen + 2));
-        strcpy(tempstr, retval);
-        retlen += 1;
-        tempstr[retlen - 1] = temp;
-        retval = (char *)realloc(retval, sizeof(char) * (retlen + 2));
-        strcpy(retval, tempstr);
-        (*copy_path)++;
-        temp = **(copy_path);
-        free(tempstr);
+int next_component(const char ** cursor, struct path_comp * comp){
+    const char * p = * cursor;
+    while(* p == '/'){
+        p++;
     }
-    retval = (char *)realloc(retval, sizeof(char) * (retlen + 1));
-    retval[retlen] = '\0';
-    return retval;
+    comp->name = p;
+    while(* p != '\0' && * p != '/'){
+        p++;
+    }
+    comp->len = p - comp->name;
+    * cursor = p;
+    return comp->len != 0;
+}
+
+/*
+Whether the terminated string 'str' equals the 'len' bytes at 'name'
+*/
+static int name_equal(const char * str, const char * name, size_t len){
+    return strncmp(str, name, len) == 0 && str[len] == '\0';
 }
 
-char * reverse(char * str, int mode){
-	printf("REVERSE CALLED\n");
+/*
+Directories with up to INDEX_MIN children are scanned linearly and have no index. Also the initial length of the children / fchildren arrays
+*/
+#define INDEX_MIN 8
+
+/*
+FNV-1a hash of the 'len' bytes at 'name'
+*/
+static uint32_t hash_name(const char * name, size_t len){
+    uint32_t h = 2166136261u;
+    size_t i;
+    for(i = 0; i < len; i++){
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+/*
+Puts 'child' into the first free slot of its probe sequence in the index of 'dir'
+*/
+static void index_put(FStree * dir, FStree * child){
+    uint32_t mask = dir->index_size - 1;
+    uint32_t i = child->hash & mask;
+    while(dir->index[i] != NULL){
+        i = (i + 1) & mask;
+    }
+    dir->index[i] = child;
+}
+
+/*
+Rebuilds the index of 'dir' with 'size' slots
+*/
+static void index_resize(FStree * dir, uint32_t size){
     int i;
-    int len = strlen(str);
-    char * retval = (char *)calloc(sizeof(char), (len + 1));
-    for(i = 0; i <= len/2; i++){
-        retval[i] = str[len - 1 -i];
-        retval[len - i - 1] = str[i];
+    free(dir->index);
+    dir->index = (FStree **)calloc(size, sizeof(FStree *));
+    dir->index_size = size;
+    for(i = 0; i < dir->num_children; i++){
+        index_put(dir, dir->children[i]);
     }
-    if(retval[0] == '/' && mode == 1) {   // if mode is set to 1, then drop the leading '/'. Set to 0 for normal reversing.
-        retval++;
+}
+
+/*
+Takes 'child' out of the index of 'dir', shifting back the entries of its probe run so no tombstone is left
+*/
+static void index_remove(FStree * dir, FStree * child){
+    uint32_t mask = dir->index_size - 1;
+    uint32_t i = child->hash & mask, j, home;
+    while(dir->index[i] != child){
+        i = (i + 1) & mask;
+    }
+    dir->index[i] = NULL;
+    for(j = (i + 1) & mask; dir->index[j] != NULL; j = (j + 1) & mask){
+        home = dir->index[j]->hash & mask;
+        // the entry at j can move to the hole at i unless its home lies cyclically in (i, j]
+        if(((j - home) & mask) >= ((j - i) & mask)){
+            dir->index[i] = dir->index[j];
+            dir->index[j] = NULL;
+            i = j;
+        }
     }
-    return retval;
 }
 
-char * extract_dir(char ** copy_path){
-	printf("EXTRACT_DIR CALLED\n");
-    char * retval = (char *)calloc(sizeof(char), 1);
-    int retlen = 0;
-    char temp;
-    char * tempstr;
-    *copy_path = reverse(*copy_path, 1);    // change "a/b/c" to "c/b/a" and extract content upto the first '/'
-    temp = **(copy_path);
-    while(temp != '/'){    
-        tempstr = (char *)calloc(sizeof(char), (retlen + 2));
-        strcpy(tempstr, retval);
-        retlen += 1;
-        tempstr[retlen - 1] = temp;
-        retval = (char *)realloc(retval, sizeof(char) * (retlen + 1));
-        strcpy(retval, tempstr);
-        (*copy_path)++;
-        temp = **(copy_path);
-        free(tempstr);
+/*
+Appends 'child' to the children of 'dir' and indexes it once 'dir' is past INDEX_MIN children. The array and the index double when full; the index is kept at most half full
+*/
+static void attach_child(FStree * dir, FStree * child){
+    if(dir->num_children == dir->max_children){
+        dir->max_children = dir->max_children ? dir->max_children * 2 : INDEX_MIN;
+        dir->children = (FStree **)realloc(dir->children, sizeof(FStree *) * dir->max_children);
+    }
+    child->slot = dir->num_children;
+    child->parent = dir;
+    dir->children[dir->num_children++] = child;
+    if(dir->index == NULL && dir->num_children <= INDEX_MIN){
+        return;
     }
-    if(strlen(*copy_path) > 1){
-        (*copy_path)++;                     // remove the leading '/' from "/b/a" after extracting 'c'
+    if((uint32_t)dir->num_children * 2 > dir->index_size){
+        index_resize(dir, dir->index_size ? dir->index_size * 2 : INDEX_MIN * 4);
+    }
+    else{
+        index_put(dir, child);
     }
-    retval = (char *)realloc(retval, sizeof(char) * (retlen + 1));
-    retval[retlen] = '\0';
-    retval = reverse(retval, 0);        
-    *(copy_path) = reverse(*(copy_path), 0);
-    return retval;
 }
 
-FStree * search_node(char * path){
-	printf("SEARCH_NODE CALLED\n");
-    FStree * temp = root;
-    FStree * retval = NULL;
-    char * curr_node = NULL;
-    int flag = 0, i = 0;
-    if(path[0] == '/'){
-        path++;
+/*
+Removes 'child' from the children of 'dir' in O(1): the last child takes its slot
+*/
+static void detach_child(FStree * dir, FStree * child){
+    FStree * last = dir->children[--dir->num_children];
+    dir->children[child->slot] = last;
+    last->slot = child->slot;
+    if(dir->index != NULL){
+        index_remove(dir, child);
     }
-    while(temp != NULL){
-        curr_node = extract_path(&path);
-        if(strlen(curr_node) == 0){
-            break;
-        }
-        for(i = 0; i < temp->num_children; i++){
-            if(strcmp(temp->children[i]->name, curr_node) == 0){
-                retval = temp->children[i];
-                temp = temp->children[i];
-                flag = 1;
+}
+
+/*
+Appends 'file' to the fchildren of 'dir', doubling the array when full
+*/
+static void attach_file(FStree * dir, FSfile * file){
+    if(dir->num_files == dir->max_files){
+        dir->max_files = dir->max_files ? dir->max_files * 2 : INDEX_MIN;
+        dir->fchildren = (FSfile **)realloc(dir->fchildren, sizeof(FSfile *) * dir->max_files);
+    }
+    file->slot = dir->num_files;
+    dir->fchildren[dir->num_files++] = file;
+}
+
+/*
+Removes 'file' from the fchildren of 'dir' in O(1): the last file takes its slot
+*/
+static void detach_file(FStree * dir, FSfile * file){
+    FSfile * last = dir->fchildren[--dir->num_files];
+    dir->fchildren[file->slot] = last;
+    last->slot = file->slot;
+}
+
+FStree * find_child(FStree * dir, const char * name, size_t len){
+    uint32_t h, mask, i;
+    int j;
+    FStree * child;
+    if(dir->index == NULL){
+        for(j = 0; j < dir->num_children; j++){
+            if(name_equal(dir->children[j]->name, name, len)){
+                return dir->children[j];
             }
         }
-        if(!flag){
-            return NULL;
+        return NULL;
+    }
+    h = hash_name(name, len);
+    mask = dir->index_size - 1;
+    for(i = h & mask; (child = dir->index[i]) != NULL; i = (i + 1) & mask){
+        if(child->hash == h && name_equal(child->name, name, len)){
+            return child;
         }
-        else{
-            flag = 0;
+    }
+    return NULL;
+}
+
+FStree * search_node(const char * path){
+	FS_TRACE("SEARCH_NODE CALLED\n");
+    FStree * temp = root;
+    struct path_comp comp;
+    if(!next_component(&path, &comp)){
+        return NULL;                        // "/" has no component; callers handle the root themselves
+    }
+    do{
+        temp = find_child(temp, comp.name, comp.len);
+    }while(temp != NULL && next_component(&path, &comp));
+    return temp;
+}
+
+FStree * search_parent(const char * path, struct path_comp * name){
+    FStree * dir = root;
+    struct path_comp comp;
+    name->name = path;
+    name->len = 0;
+    if(!next_component(&path, &comp)){
+        return NULL;
+    }
+    while(1){
+        * name = comp;
+        if(!next_component(&path, &comp)){
+            return dir;
+        }
+        dir = find_child(dir, name->name, name->len);
+        if(dir == NULL){
+            return NULL;
         }
     }
-    if(retval!=NULL){
-    	return retval;
-	}
-	return NULL;
 }
 
-FStree * init_node(const char * path, char * name, FStree * parent,int type){
-	printf("INIT_NODE CALLED\n");
+FStree * init_node(const char * name, size_t name_len, FStree * parent,int type){
+	FS_TRACE("INIT_NODE CALLED\n");
     FStree * new = (FStree *)malloc(sizeof(FStree));
-    new->path = (char *)calloc(sizeof(char), strlen(path) + 1);
-    new->name = (char *)calloc(sizeof(char), strlen(name) + 1);
-    strcpy(new->path, (char *)path);
-    strcpy(new->name, (char *)name);
+    new->name = strndup(name, name_len);
+    new->hash = hash_name(name, name_len);
     if(type == 1){
     	new->type = "directory";  
         new->permissions = S_IFDIR | 0777;
@@ -136,336 +221,162 @@ FStree * init_node(const char * path, char * name, FStree * parent,int type){
     new->children = NULL;
     new->fchildren = NULL;
     new->num_files = 0;
+    new->max_children = 0;
+    new->max_files = 0;
+    new->index = NULL;
+    new->index_size = 0;
+    new->slot = 0;
+    new->file = NULL;
     new->size = 0;
+    new->blocks = NULL;
+    new->num_blocks = 0;
+    new->max_blocks = 0;
+    new->dirty = 0;
     return new;
 }
 
 void insert_node(const char * path){
-	printf("INSERT_NODE CALLED\n");
+	FS_TRACE("INSERT_NODE CALLED\n");
     if(root == NULL){
-		printf("CREATING ROOT\n");
-        root = init_node("/", "root", NULL,1);
+		FS_DEBUG("CREATING ROOT\n");
+        root = init_node("root", 4, NULL,1);
         return;
     }
     else{
-        char * copy_path = (char *)path;
-        char * dir = extract_dir(&copy_path);
-        FStree * dir_node = NULL;
-        if(strlen(copy_path) == 1){   
-            root->num_children++;
-            if(root->children == NULL){
-                root->children = (FStree **)malloc(sizeof(FStree *));
-                root->children[0] = init_node(path, dir, root,1);
-            }
-            else{
-                root->children = (FStree **)realloc(root->children, sizeof(FStree *) * root->num_children);
-                root->children[root->num_children - 1] = init_node(path, dir, root,1);
-            }
-        }
-        else{
-            dir_node = search_node(copy_path);  
-            if(dir_node != NULL){
-				if(dir_node->parent!=NULL){
-					dir_node->c_time=time(NULL);
-					dir_node->m_time=time(NULL);
-				}
-                dir_node->num_children++;
-                dir_node->children = (FStree **)realloc(dir_node->children, sizeof(FStree *) * dir_node->num_children);
-                dir_node->children[dir_node->num_children - 1] = init_node(path, dir, dir_node,1);
+        struct path_comp name;
+        FStree * dir_node = search_parent(path, &name);
+        if(dir_node != NULL){
+            if(dir_node->parent!=NULL){
+                dir_node->c_time=time(NULL);
+                dir_node->m_time=time(NULL);
             }
+            attach_child(dir_node, init_node(name.name, name.len, dir_node,1));
         }
         return;
     }
     return;
 }
 
-void load_node(char * path, char * type, gid_t groupid, uid_t userid, time_t lc_time, time_t lm_time, time_t la_time, time_t lb_time, unsigned long int inode, off_t size, mode_t lpermissions){
-    printf("LOAD_NODE CALLED\n");
-    if(root == NULL){
-		printf("LOADING ROOT NODE!\n");
-        root = init_node("/", "root", NULL, 1);
-		root->group_id = groupid;
-		root->user_id = userid;
-		root->c_time = lc_time;
-		root->a_time = la_time;
-		root->m_time = lm_time;
-		root->b_time = lb_time;
-		root->inode_number = inode;
-		root->size = size;
+FStree * load_node(FStree * dir_node, const char * name, size_t name_len, char * type, gid_t groupid, uid_t userid, time_t lc_time, time_t lm_time, time_t la_time, time_t lb_time, unsigned long int inode, off_t size, mode_t lpermissions){
+    FS_TRACE("LOAD_NODE CALLED\n");
+    FStree * node;
+    if(dir_node == NULL){
+        if(root != NULL){
+            return NULL;
+        }
+		FS_DEBUG("LOADING ROOT NODE!\n");
+        root = init_node("root", 4, NULL, 1);
+        node = root;
     }
     else{
-        char * copy_path = (char *)path;
-        char * dir = extract_dir(&copy_path);
-		char * tdir = (char *)calloc(sizeof(char), strlen(dir));
-    	strcpy(tdir,dir);
-        FStree * dir_node = NULL;
-        if(strlen(copy_path) == 1){     
-            root->num_children++;
-            if(root->children == NULL){
-                root->children = (FStree **)malloc(sizeof(FStree *));
-				if(strcmp(type,"directory")==0){
-                	root->children[0] = init_node(path, dir, root,1);
-					root->children[0]->permissions=lpermissions;
-					root->children[0]->type="directory";
-				}
-				else{	root->num_files++;
-					root->children[0] = init_node(path, dir, root,2);
-					root->children[0]->permissions=lpermissions;
-					root->fchildren = (FSfile **)malloc(sizeof(FSfile *));
-					root->fchildren[0] = init_file(path,tdir);
-					root->children[0]->type="file";
-				}
-				root->children[0]->group_id = groupid;
-				root->children[0]->user_id = userid;
-				root->children[0]->c_time = lc_time;
-				root->children[0]->a_time = la_time;
-				root->children[0]->m_time = lm_time;
-				root->children[0]->b_time = lb_time;
-				root->children[0]->inode_number = inode;
-				root->children[0]->size = size;
-            }
-            else{
-                root->children = (FStree **)realloc(root->children, sizeof(FStree *) * root->num_children);
-				if(strcmp(type,"directory")==0){
-                	root->children[root->num_children - 1] = init_node(path, dir, root,1);
-					root->children[root->num_children - 1]->permissions = lpermissions; 
-					root->children[root->num_children - 1]->type = "directory";
-				}
-				else{
-					root->num_files++;
-					root->children[root->num_children - 1] = init_node(path, dir, root,2);
-					root->children[root->num_children - 1]->permissions= lpermissions; 
-					root->fchildren = (FSfile **)realloc(root->fchildren, sizeof(FSfile *) * root->num_files);
-					root->fchildren[root->num_files - 1] = init_file(path,tdir);
-					root->children[root->num_children - 1]->type = "file";
-				}
-				root->children[root->num_children - 1]->group_id = groupid;
-				root->children[root->num_children - 1]->user_id = userid;
-				root->children[root->num_children - 1]->c_time = lc_time;
-				root->children[root->num_children - 1]->a_time = la_time;
-				root->children[root->num_children - 1]->m_time = lm_time;
-				root->children[root->num_children - 1]->b_time = lb_time;
-				root->children[root->num_children - 1]->inode_number = inode;
-				root->children[root->num_children - 1]->size = size;
-            }
+        if(find_child(dir_node, name, name_len) != NULL){
+            return NULL;
+        }
+        if(strcmp(type,"directory")==0){
+            node = init_node(name, name_len, dir_node,1);
         }
         else{
-            dir_node = search_node(copy_path); 
-            if(dir_node != NULL){
-				if(dir_node->parent!=NULL){
-					dir_node->c_time=time(NULL);
-					dir_node->m_time=time(NULL);
-				}
-                dir_node->num_children++;
-                dir_node->children = (FStree **)realloc(dir_node->children, sizeof(FStree *) * dir_node->num_children);
-				if(strcmp(type,"directory")==0){
-                	dir_node->children[dir_node->num_children - 1] = init_node(path, dir, dir_node,1);
-					dir_node->children[dir_node->num_children - 1] ->permissions = lpermissions; //S_IFDIR | 0755
-					dir_node->children[dir_node->num_children - 1]->type = "directory";
-				}
-				else{	dir_node->num_files++;
-					dir_node->children[dir_node->num_children - 1] = init_node(path, dir, dir_node,2);
-					dir_node->children[dir_node->num_children - 1] ->permissions = lpermissions; //S_IFREG | 0644
-					dir_node->fchildren = (FSfile **)realloc(dir_node->fchildren, sizeof(FSfile *) * dir_node->num_files);
-					dir_node->fchildren[dir_node->num_files - 1] = init_file(path,dir);
-					dir_node->children[dir_node->num_children - 1]->type = "file";
-				}
-            }
-			dir_node->children[dir_node->num_children - 1]->group_id = groupid;
-			dir_node->children[dir_node->num_children - 1]->user_id = userid;
-			dir_node->children[dir_node->num_children - 1]->c_time = lc_time;
-			dir_node->children[dir_node->num_children - 1]->a_time = la_time;
-			dir_node->children[dir_node->num_children - 1]->m_time = lm_time;
-			dir_node->children[dir_node->num_children - 1]->b_time = lb_time;
-			dir_node->children[dir_node->num_children - 1]->inode_number = inode;
-			dir_node->children[dir_node->num_children - 1]->size = size;
+            node = init_node(name, name_len, dir_node,0);
+            node->file = init_file(name, name_len);
+            attach_file(dir_node, node->file);
         }
+        node->permissions = lpermissions;
+        attach_child(dir_node, node);
     }
-    return;
+    node->group_id = groupid;
+    node->user_id = userid;
+    node->c_time = lc_time;
+    node->a_time = la_time;
+    node->m_time = lm_time;
+    node->b_time = lb_time;
+    node->inode_number = inode;
+    node->size = size;
+    return node;
 }
 
-FSfile * init_file(const char * path,char * name){
-	printf("INIT_FILE CALLED\n");
+FSfile * init_file(const char * name, size_t name_len){
+	FS_TRACE("INIT_FILE CALLED\n");
 	FSfile * new = (FSfile *)malloc(sizeof(FSfile));
-    new->path = (char *)calloc(sizeof(char), strlen(path) + 1);
-    new->name = (char *)calloc(sizeof(char), strlen(name) + 1);
-    strcpy(new->path, (char *)path);
-    strcpy(new->name, (char *)name);
-	new->data = (char *)calloc(sizeof(char), 1);
-	new->size=0;
+    new->name = strndup(name, name_len);
 	new->offset=0;
+	new->slot=0;
 	return new;
 }
 
-void load_file(const char * path, char * data){
-	printf("LOAD_FILE CALLED\n");
-	FSfile * file = find_file(path);
-	file->data = (char *)realloc(file->data, sizeof(char) * (strlen(data) + 1));
-	strcpy(file->data, data);
-	file->size = strlen(data);
-	return;
-}
-
-
 //function to insert file into FStree
 void insert_file(const char * path){
-	printf("INSERT_FILE CALLED\n");
-	char * copy_path = (char *)path;
-    char * name = extract_dir(&copy_path);
-	copy_path++;
-    if(strlen(copy_path) == 0){ 
-		root->num_children++;
-        if(root->children == NULL){ 
-            root->children = (FStree **)malloc(sizeof(FStree *));
-            root->children[0] = init_node(path, name, root,0);
-        }
-        else{ 
-            root->children = (FStree **)realloc(root->children, sizeof(FStree *) * root->num_children);
-            root->children[root->num_children - 1] = init_node(path, name, root,0);
-        }
-		if(root->fchildren == NULL){
-			root->num_files++;
-			root->fchildren= (FSfile **)malloc(sizeof(FSfile *));
-			root->fchildren[0]=init_file(path,name);
-		}
-		else{
-			root->num_files++;
-			root->fchildren = (FSfile **)realloc(root->fchildren, sizeof(FSfile *) * root->num_files);
-			root->fchildren[root->num_files - 1]=init_file(path,name);
-		}
-	}
-	else{
-		char * rpath = reverse(reverse(copy_path,0),1);
-		FStree * parent_dir_node = search_node(rpath);
-		if(parent_dir_node != NULL){
-		    parent_dir_node->num_children++;
-		    parent_dir_node->children = (FStree **)realloc(parent_dir_node->children, sizeof(FStree *) * parent_dir_node->num_children);
-		    parent_dir_node->children[parent_dir_node->num_children - 1] = init_node(path, name, parent_dir_node,0);
-			if(parent_dir_node->fchildren==NULL){
-				parent_dir_node->num_files++;
-				parent_dir_node->fchildren= (FSfile **)malloc(sizeof(FSfile*));
-				parent_dir_node->fchildren[0]=init_file(path,name);
-			}
-			else{
-				parent_dir_node->num_files++;
-				parent_dir_node->fchildren=(FSfile **)realloc(parent_dir_node->fchildren, sizeof(FSfile *) * parent_dir_node->num_files);
-				parent_dir_node->fchildren[parent_dir_node->num_files -1]=init_file(path,name);
-			}
-        }
+	FS_TRACE("INSERT_FILE CALLED\n");
+	struct path_comp name;
+	FStree * parent_dir_node = search_parent(path, &name);
+	if(parent_dir_node != NULL){
+		FStree * node = init_node(name.name, name.len, parent_dir_node,0);
+		node->file = init_file(name.name, name.len);
+		attach_child(parent_dir_node, node);
+		attach_file(parent_dir_node, node->file);
 	}
 	return;
 }
 
 void delete_file(const char *path){
-	printf("DELETE_FILE CALLED\n");
+	FS_TRACE("DELETE_FILE CALLED\n");
 	if(root == NULL){
         	return;
 	}
 	else{	
-		int i,j;
-		FStree * parent_dir_node = NULL;
-		FStree * file_tree_node = search_node((char *)path);
-		int file_ino;
-		file_ino = file_tree_node->inode_number;
-		char * typ = (char *)malloc(strlen(file_tree_node->type));
-		strcpy(typ,file_tree_node->type);
-		FSfile * del_file = NULL;
-		char * copy_path = (char *)path;
-		char * name = extract_dir(&copy_path);
-	    if(strlen(copy_path) == 1){
-			parent_dir_node = root;
+		struct path_comp name;
+		FStree * parent_dir_node = search_parent(path, &name);
+		FStree * file_tree_node;
+		FSfile * del_file;
+		if(parent_dir_node == NULL){
+			return;
 		}
-		else{
-			char * rpath = reverse(reverse(copy_path,0),1);
-			parent_dir_node = search_node(rpath);
+		file_tree_node = find_child(parent_dir_node, name.name, name.len);
+		if(file_tree_node == NULL || file_tree_node->file == NULL){
+			return;
 		}
+		del_file = file_tree_node->file;
 		parent_dir_node->c_time=time(&t);
 	    parent_dir_node->m_time=time(&t);
-		for(i = 0; i < parent_dir_node->num_children; i++){
-			if(strcmp(parent_dir_node->children[i]->name, name) == 0){	
-				for(j = i; j < parent_dir_node->num_children - 1; j++){
-                    parent_dir_node->children[j] = parent_dir_node->children[j+1];
-                }
-                break;
-            }
-		}
-		parent_dir_node->num_children--;
-		if(parent_dir_node->num_children == 0){
-            parent_dir_node->children = NULL;
-        }
-        else{
-            parent_dir_node->children = (FStree **)realloc(parent_dir_node->children,sizeof(FStree *) * parent_dir_node->num_children);
-        }
-		for(i = 0; i < parent_dir_node->num_files; i++){
-			if(strcmp(parent_dir_node->fchildren[i]->name, name) == 0){
-                del_file = parent_dir_node->fchildren[i];
-				for(j = i; j < parent_dir_node->num_files - 1; j++){
-					parent_dir_node->fchildren[j] = parent_dir_node->fchildren[j+1];
-				}
-				break;
-			}
-		}
-		parent_dir_node->num_files--;
-		if(parent_dir_node->num_files == 0){
-        	parent_dir_node->fchildren = NULL;
-        }
-        else{
-            parent_dir_node->fchildren = (FSfile **)realloc(parent_dir_node->fchildren,sizeof(FSfile *) * parent_dir_node->num_files);
-        }
-		delete_metadata_block(typ,file_ino);
-		update_node_wrapper(parent_dir_node, 0);
+		detach_child(parent_dir_node, file_tree_node);
+		detach_file(parent_dir_node, del_file);
+		delete_metadata_block(file_tree_node);
+		update_node_wrapper(parent_dir_node);
+		free(del_file->name);
 		free(del_file);
+		free(file_tree_node->name);
+		free(file_tree_node);
     }
 	return;
 }
 
 int delete_node(const char * path){
-    printf("DELETE_NODE CALLED\n");
+    FS_TRACE("DELETE_NODE CALLED\n");
     if(root == NULL){
         return 0;
     }
     else{
         char * copy_path = (char *)path;
         FStree * dir_node = NULL;
-        int i, j;
+        FStree * parent_dir_node;
         if(strlen(copy_path) == 1){
-            printf("Cannot delete root directory!\n"); 
+            FS_WARN("Cannot delete root directory!\n"); 
             return -1;
         }
         else{
             dir_node = search_node(copy_path);  
-			if(dir_node->children != NULL){
+			if(dir_node == NULL || dir_node->num_children != 0){
 				return -1;
 			}
 	    	dir_node->parent->c_time=time(&t);
 	    	dir_node->parent->m_time=time(&t);
-            if(dir_node->children != NULL){
-                for(i = dir_node->num_children - 1; i >= 0; i--){
-                    if(strcmp(dir_node->type, "directory") == 0){
-                        delete_node((const char *)dir_node->children[i]->path);       
-                    }
-                }
-            }
-            while(dir_node->num_files > 0){
-                delete_file(dir_node->fchildren[dir_node->num_files - 1]->path);
-            }
-            for(i = 0; i < dir_node->parent->num_children; i++){
-                if(dir_node->parent->children[i] == dir_node){
-                    for(j = i; j < dir_node->parent->num_children - 1; j++){
-                        dir_node->parent->children[j] = dir_node->parent->children[j+1];
-                    }
-                    break;
-                }
-            }
-            dir_node->parent->num_children--; 
-            if(dir_node->parent->num_children == 0){
-                dir_node->parent->children = NULL;
-            }
-            else{
-                dir_node->parent->children = (FStree **)realloc(dir_node->parent->children,sizeof(FStree *) * dir_node->parent->num_children);
-            }
-			delete_metadata_block(dir_node->type,dir_node->inode_number);
-			update_node_wrapper(dir_node->parent, 0);
+            parent_dir_node = dir_node->parent;
+            detach_child(parent_dir_node, dir_node);
+			delete_metadata_block(dir_node);
+			update_node_wrapper(parent_dir_node);
+			free(dir_node->children);
+			free(dir_node->fchildren);
+			free(dir_node->index);
+			free(dir_node->name);
 			free(dir_node);
             return 0;
         }
@@ -474,138 +385,64 @@ int delete_node(const char * path){
 }
 
 FSfile * find_file(const char * path){
-	printf("FIND_FILE CALLED\n");
-	char * copy_path = (char *)path;
-    char * name = extract_dir(&copy_path);
-	copy_path++;
-	FStree * parent_dir_node;
-	FSfile * my_file;
-	int i;
-	if(strlen(copy_path) == 0){ 
-		parent_dir_node = root;
+	FS_TRACE("FIND_FILE CALLED\n");
+	struct path_comp name;
+	FStree * parent_dir_node = search_parent(path, &name);
+	FStree * file_tree_node;
+	if(parent_dir_node == NULL){
+		return NULL;
 	}
-	else{
-		char * rpath = reverse(reverse(copy_path,0),1);
-		parent_dir_node = search_node(rpath);
-	}
-	for(i = 0;i < parent_dir_node->num_files; i++){
-		if(strcmp(parent_dir_node->fchildren[i]->name, name) == 0){
-			my_file = parent_dir_node->fchildren[i];
-			return my_file;
-		}
+	file_tree_node = find_child(parent_dir_node, name.name, name.len);
+	if(file_tree_node == NULL){
+		return NULL;
 	}
-	return NULL;
+	return file_tree_node->file;
 }
 
-void move_node(const char * from,const char * to){
-	printf("MOVE_NODE CALLED\n");
-	int i,j,flag = 0;
-	char * copy_frompath = (char *)from;
-	char * copy_topath = (char *)to;
-	FStree * dir_node = search_node(copy_frompath);
-	FStree * todir =  search_node(copy_topath);
-	if(dir_node != NULL && todir != NULL){
-		if(strcmp(todir->type,"file") == 0)
-			delete_file(copy_topath);
-		else
-			delete_node(copy_topath);
+int move_node(const char * from,const char * to){
+	FS_TRACE("MOVE_NODE CALLED\n");
+	struct path_comp toname;
+	FStree * dir_node = search_node(from);
+	FStree * to_parent_dir_node = search_parent(to, &toname);
+	FStree * todir;
+	FStree * ancestor;
+	if(dir_node == NULL || to_parent_dir_node == NULL){
+		return -ENOENT;
 	}
-	char temp_path[20];
-	if(dir_node != NULL){
-		char * name = extract_dir(&copy_frompath);
-		copy_frompath++;
-		FStree * parent_dir_node;
-		if(strlen(copy_frompath) == 0){ 
-			parent_dir_node = root;
-		}
-		else{
-			char * rpath = reverse(reverse(copy_frompath,0),1);
-			parent_dir_node = search_node(rpath);
-		}
-		char * toname = extract_dir(&copy_topath);
-		copy_topath++;
-		FSfile * file_node;
-		FStree * to_parent_dir_node;
-		if(search_node((char *)to)==NULL)
-			flag=1;
-		if(strlen(copy_topath) == 0){ 
-			to_parent_dir_node = root;
-		}
-		else{
-			char * r_topath = reverse(reverse(copy_topath,0),1);
-			to_parent_dir_node = search_node(r_topath);
-		}
-		to_parent_dir_node->num_children++;
-		to_parent_dir_node->c_time=time(NULL);
-		to_parent_dir_node->children = (FStree **)realloc(to_parent_dir_node->children,sizeof(FStree *) * to_parent_dir_node->num_children);
-		dir_node->a_time = time(NULL);
-		to_parent_dir_node->children[to_parent_dir_node->num_children - 1]=dir_node;		
-		for(i = 0;i < parent_dir_node->num_children; i++){
-			if(strcmp(parent_dir_node->children[i]->name,name)==0){
-				for(j = i; j < parent_dir_node->num_children-1; j++){
-					parent_dir_node->children[j]=parent_dir_node->children[j+1];
-				}
-				break;
-			}
-		}
-		parent_dir_node->num_children--;
-		if(parent_dir_node->num_children == 0){
-            parent_dir_node->children = NULL;
-        }
-        else{
-            parent_dir_node->children = (FStree **)realloc(parent_dir_node->children,sizeof(FStree *) * parent_dir_node->num_children);
-        }
-		
-		if(strcmp(dir_node->type,"file")==0){
-			file_node = find_file(from);
-			to_parent_dir_node->num_files++;
-			to_parent_dir_node->fchildren = (FSfile **)realloc(to_parent_dir_node->fchildren,sizeof(FSfile *) * to_parent_dir_node->num_files);
-			to_parent_dir_node->fchildren[to_parent_dir_node->num_files - 1]=file_node;
-			parent_dir_node->num_files--;
-			if(parent_dir_node->num_files == 0){
-                parent_dir_node->fchildren = NULL;
-            }
-            else{
-                parent_dir_node->fchildren = (FSfile **)realloc(parent_dir_node->fchildren,sizeof(FSfile *) * parent_dir_node->num_files);
-            }
-			if(flag == 1){
-				file_node->name=toname;
-				file_node->path=(char *)to;
-			}
-		}
-		strcpy(temp_path,to_parent_dir_node->path);
-		dir_node->parent=to_parent_dir_node;
-		if(flag == 1){
-			dir_node->name=toname;
-			dir_node->path=(char *)to;
-		}
-		if(strcmp(dir_node->type,"directory")==0){
-			path_update(dir_node,temp_path);
-		}
-	}		
-}
-
-void path_update(FStree * dir_node,char * topath){
-	printf("PATH_UPDATE CALLED\n");
-	FStree * temp=dir_node;
-	int i,j;
-	temp->path = realloc(temp->path, strlen(topath) + strlen(temp->name) + 1);
-	memset(temp->path,0,strlen(topath)+strlen(temp->name));
-	strcat(temp->path,topath);
-	temp->path[strlen(topath)] = '/';
-	strcat(temp->path,temp->name); 
-	temp->path[strlen(topath)+strlen(temp->name)+1] = '\0';
-	for(i = 0;i < temp->num_children; i++){
-		for(j = 0;j < temp->num_files; j++){
-			memset(temp->fchildren[j]->path,0,strlen(temp->path)+strlen(temp->name));
-			strcat(temp->fchildren[j]->path,temp->path);
-			temp->fchildren[j]->path[strlen(temp->path)]='/';
-			strcat(temp->fchildren[j]->path,temp->fchildren[j]->name);
-			temp->fchildren[j]->path[strlen(temp->path)+strlen(temp->name)+1]='\0';
+	// a directory cannot move below itself
+	for(ancestor = to_parent_dir_node; ancestor != NULL; ancestor = ancestor->parent){
+		if(ancestor == dir_node){
+			return -EINVAL;
 		}
-		temp->children[i]->parent=dir_node;
-		path_update(temp->children[i],temp->path);
 	}
+	todir = find_child(to_parent_dir_node, toname.name, toname.len);
+	if(todir == dir_node){
+		return 0;
+	}
+	if(todir != NULL){
+		if(strcmp(todir->type,"file") == 0)
+			delete_file(to);
+		else if(delete_node(to) < 0)
+			return -ENOTEMPTY;
+	}
+	to_parent_dir_node->c_time=time(NULL);
+	to_parent_dir_node->m_time=time(NULL);
+	dir_node->parent->c_time=time(NULL);
+	dir_node->parent->m_time=time(NULL);
+	dir_node->c_time = time(NULL);
+	// the subtree below moves with the node: paths are never stored, only names and parent pointers
+	detach_child(dir_node->parent, dir_node);
+	if(dir_node->file != NULL){
+		detach_file(dir_node->parent, dir_node->file);
+	}
+	free(dir_node->name);
+	dir_node->name=strndup(toname.name, toname.len);
+	dir_node->hash=hash_name(toname.name, toname.len);
+	attach_child(to_parent_dir_node, dir_node);
+	if(dir_node->file != NULL){
+		free(dir_node->file->name);
+		dir_node->file->name=strndup(toname.name, toname.len);
+		attach_file(to_parent_dir_node, dir_node->file);
+	}
+	return 0;
 }
-	
-
@@ -10,6 +10,7 @@
 #include "fuse.h"
 #include <stddef.h>
 #include "ddriver.h"
+#include "fs_blkio.h"
 #include "errno.h"
 #include "types.h"
 
@@ -46,6 +47,7 @@ void* 			   sfs_init(struct fuse_conn_info *);
 void  			   sfs_destroy(void *);
 int   			   sfs_mkdir(const char *, mode_t);
 int   			   sfs_getattr(const char *, struct stat *);
+void 			   sfs_fill_stat(struct sfs_dentry *, struct stat *);
 int   			   sfs_readdir(const char *, void *, fuse_fill_dir_t, off_t,
 						       struct fuse_file_info *);
 int   			   sfs_mknod(const char *, mode_t, dev_t);
@@ -62,6 +64,11 @@ int 			   sfs_symlink(const char *, const char *);
 int 			   sfs_readlink(const char *, char *, size_t);
 			
 int   			   sfs_open(const char *, struct fuse_file_info *);
+int   			   sfs_create(const char *, mode_t, struct fuse_file_info *);
+int   			   sfs_fgetattr(const char *, struct stat *, struct fuse_file_info *);
+int   			   sfs_ftruncate(const char *, off_t, struct fuse_file_info *);
+int   			   sfs_flush(const char *, struct fuse_file_info *);
+int   			   sfs_release(const char *, struct fuse_file_info *);
 int   			   sfs_opendir(const char *, struct fuse_file_info *);
 int   			   sfs_access(const char *, int);
 /******************************************************************************
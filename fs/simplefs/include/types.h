@@ -45,6 +45,8 @@ typedef enum sfs_file_type {
 
 #define SFS_FLAG_BUF_DIRTY      0x1
 #define SFS_FLAG_BUF_OCCUPY     0x2
+
+#define SFS_BLKIO_CACHE         64      /* 块设备层缓冲缓存的IO单位数 */
 /* *****************************************************************************
 * SECTION: Macro Function
 *******************************************************************************/
@@ -64,6 +66,7 @@ typedef enum sfs_file_type {
 #define SFS_IS_DIR(pinode)              (pinode->dentry->ftype == SFS_DIR)
 #define SFS_IS_REG(pinode)              (pinode->dentry->ftype == SFS_REG_FILE)
 #define SFS_IS_SYM_LINK(pinode)         (pinode->dentry->ftype == SFS_SYM_LINK)
+#define SFS_FILE(fi)                    ((struct sfs_file *)(uintptr_t)(fi)->fh)   /* open保存的文件句柄 */
 /* *****************************************************************************
 * SECTION: FS Specific Structure - In memory structure
 ****************************************************************************** */
@@ -85,6 +88,8 @@ struct sfs_inode
     struct sfs_dentry* dentry;                        /* 指向该inode的dentry */
     struct sfs_dentry* dentrys;                       /* 所有目录项 */
     uint8_t*           data;           
+    int                open_cnt;                      /* 打开该文件的句柄数 */
+    boolean            is_unlinked;                   /* 已unlink但仍有句柄，最后一个句柄关闭时释放 */
 };  
 
 struct sfs_dentry
@@ -97,9 +102,16 @@ struct sfs_dentry
     SFS_FILE_TYPE      ftype;
 };
 
+struct sfs_file
+{
+    struct sfs_dentry* dentry;                        /* open/create时解析到的dentry */
+    struct sfs_inode*  inode;                         /* 对应的inode，open_cnt计入本句柄 */
+};
+
 struct sfs_super
 {
     int                driver_fd;
+    struct fs_blkdev   blkdev;                        /* driver_fd之上的块设备层 */
     
     int                sz_io;
     int                sz_disk;
@@ -35,11 +35,43 @@ static struct fuse_operations operations = {
 	.readlink = sfs_readlink,						  /* 读链接 */
 	.symlink = sfs_symlink,							  /* 软链接 */
 
-	.open = sfs_open,							
+	.open = sfs_open,								  /* 打开文件，句柄保存在fi->fh */
+	.create = sfs_create,							  /* 创建并打开文件 */
+	.fgetattr = sfs_fgetattr,						  /* 按句柄获取属性，fstat */
+	.ftruncate = sfs_ftruncate,						  /* 按句柄改变文件大小 */
+	.flush = sfs_flush,								  /* close时调用 */
+	.release = sfs_release,							  /* 关闭文件，释放句柄 */
 	.opendir = sfs_opendir,
-	.access = sfs_access
+	.releasedir = sfs_release,						  /* 关闭目录，释放句柄 */
+	.access = sfs_access,
+
+	.flag_nullpath_ok = 1,							  /* 带句柄的操作不需要路径 */
+	.flag_nopath = 1								  /* 带句柄的操作FUSE不再计算路径 */
 };
 /******************************************************************************
+* SECTION: File Handle
+*******************************************************************************/
+/**
+ * @brief 取得操作对象：有句柄时直接使用open解析好的dentry，否则按路径查找
+ * 
+ * @param path 相对于挂载点的路径，flag_nopath下带句柄的操作为NULL
+ * @param fi 文件信息，可为NULL
+ * @return struct sfs_dentry* 找不到时为NULL
+ */
+static struct sfs_dentry* sfs_resolve(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct sfs_dentry* dentry;
+
+	if (fi != NULL && fi->fh != 0) {
+		return SFS_FILE(fi)->dentry;
+	}
+	if (path == NULL) {
+		return NULL;
+	}
+	dentry = sfs_lookup(path, &is_find, &is_root);
+	return is_find ? dentry : NULL;
+}
+/******************************************************************************
 * SECTION: Function Implementation
 *******************************************************************************/
 void* sfs_init(struct fuse_conn_info * conn_info) {
@@ -104,6 +136,16 @@ int sfs_getattr(const char* path, struct stat * sfs_stat) {
 		return -SFS_ERROR_NOTFOUND;
 	}
 
+	sfs_fill_stat(dentry, sfs_stat);
+	return SFS_ERROR_NONE;
+}
+/**
+ * @brief 按dentry填充文件属性，getattr和fgetattr共用
+ * 
+ * @param dentry 已读入inode的dentry
+ * @param sfs_stat 返回状态
+ */
+void sfs_fill_stat(struct sfs_dentry* dentry, struct stat * sfs_stat) {
 	if (SFS_IS_DIR(dentry->inode)) {
 		sfs_stat->st_mode = S_IFDIR | SFS_DEFAULT_PERM;
 		sfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct sfs_dentry_d);
@@ -124,12 +166,11 @@ int sfs_getattr(const char* path, struct stat * sfs_stat) {
 	sfs_stat->st_mtime   = time(NULL);
 	sfs_stat->st_blksize = SFS_IO_SZ();
 
-	if (is_root) {
+	if (dentry == sfs_super.root_dentry) {
 		sfs_stat->st_size	= sfs_super.sz_usage; 
 		sfs_stat->st_blocks = SFS_DISK_SZ() / SFS_IO_SZ();
 		sfs_stat->st_nlink  = 2;		/* !特殊，根目录link数为2 */
 	}
-	return SFS_ERROR_NONE;
 }
 /**
  * @brief 
@@ -151,13 +192,12 @@ int sfs_getattr(const char* path, struct stat * sfs_stat) {
  */
 int sfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    struct fuse_file_info * fi) {
-    boolean	is_find, is_root;
 	int		cur_dir = offset;
 
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_dentry* dentry = sfs_resolve(path, fi);
 	struct sfs_dentry* sub_dentry;
 	struct sfs_inode* inode;
-	if (is_find) {
+	if (dentry != NULL) {
 		inode = dentry->inode;
 		sub_dentry = sfs_get_dentry(inode, cur_dir);
 		if (sub_dentry) {
@@ -216,11 +256,10 @@ int sfs_mknod(const char* path, mode_t mode, dev_t dev) {
  */
 int sfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-    boolean	is_find, is_root;
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_dentry* dentry = sfs_resolve(path, fi);
 	struct sfs_inode*  inode;
 	
-	if (is_find == FALSE) {
+	if (dentry == NULL) {
 		return -SFS_ERROR_NOTFOUND;
 	}
 
@@ -251,11 +290,10 @@ int sfs_write(const char* path, const char* buf, size_t size, off_t offset,
  */
 int sfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	boolean	is_find, is_root;
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_dentry* dentry = sfs_resolve(path, fi);
 	struct sfs_inode*  inode;
 
-	if (is_find == FALSE) {
+	if (dentry == NULL) {
 		return -SFS_ERROR_NOTFOUND;
 	}
 
@@ -290,8 +328,12 @@ int sfs_unlink(const char* path) {
 
 	inode = dentry->inode;
 
-	sfs_drop_inode(inode);
 	sfs_drop_dentry(dentry->parent->inode, dentry);
+	if (inode->open_cnt > 0 && !SFS_IS_DIR(inode)) {  /* 仍有句柄，推迟到最后一次release */
+		inode->is_unlinked = TRUE;
+		return SFS_ERROR_NONE;
+	}
+	sfs_drop_inode(inode);
 	return SFS_ERROR_NONE;
 }
 /**
@@ -404,25 +446,127 @@ int sfs_readlink (const char *path, char *buf, size_t size){
 	return SFS_ERROR_NONE;
 }
 /**
- * @brief 
+ * @brief 打开文件，只在这里解析一次路径，句柄保存在fi->fh中
  * 
  * @param path 
  * @param fi 
  * @return int 
  */
 int sfs_open(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_file*   file;
+
+	if (is_find == FALSE) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	file = (struct sfs_file *)malloc(sizeof(struct sfs_file));
+	file->dentry = dentry;
+	file->inode  = dentry->inode;
+	file->inode->open_cnt++;
+	fi->fh = (uint64_t)(uintptr_t)file;
 	return SFS_ERROR_NONE;
 }
 /**
- * @brief 
+ * @brief 创建并打开文件
  * 
  * @param path 
+ * @param mode 
  * @param fi 
  * @return int 
  */
-int sfs_opendir(const char* path, struct fuse_file_info* fi) {
+int sfs_create(const char* path, mode_t mode, struct fuse_file_info* fi) {
+	int ret = sfs_mknod(path, mode, 0);
+
+	if (ret != SFS_ERROR_NONE) {
+		return ret;
+	}
+	return sfs_open(path, fi);
+}
+/**
+ * @brief 按句柄获取文件属性
+ * 
+ * @param path 可能为NULL
+ * @param sfs_stat 
+ * @param fi 
+ * @return int 
+ */
+int sfs_fgetattr(const char* path, struct stat * sfs_stat, struct fuse_file_info* fi) {
+	struct sfs_dentry* dentry = sfs_resolve(path, fi);
+
+	if (dentry == NULL) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	sfs_fill_stat(dentry, sfs_stat);
 	return SFS_ERROR_NONE;
 }
+/**
+ * @brief 按句柄改变文件大小
+ * 
+ * @param path 可能为NULL
+ * @param offset 
+ * @param fi 
+ * @return int 
+ */
+int sfs_ftruncate(const char* path, off_t offset, struct fuse_file_info* fi) {
+	struct sfs_dentry* dentry = sfs_resolve(path, fi);
+
+	if (dentry == NULL) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	if (SFS_IS_DIR(dentry->inode)) {
+		return -SFS_ERROR_ISDIR;
+	}
+
+	dentry->inode->size = offset;
+	return SFS_ERROR_NONE;
+}
+/**
+ * @brief close时调用，数据在卸载时统一写回，这里无需落盘
+ * 
+ * @param path 可能为NULL
+ * @param fi 
+ * @return int 
+ */
+int sfs_flush(const char* path, struct fuse_file_info* fi) {
+	return sfs_resolve(path, fi) == NULL ? -SFS_ERROR_NOTFOUND : SFS_ERROR_NONE;
+}
+/**
+ * @brief 关闭文件或目录，释放句柄；已unlink的文件在最后一个句柄关闭时释放
+ * 
+ * @param path 可能为NULL
+ * @param fi 
+ * @return int 
+ */
+int sfs_release(const char* path, struct fuse_file_info* fi) {
+	struct sfs_file*  file = SFS_FILE(fi);
+	struct sfs_inode* inode;
+
+	if (file == NULL) {
+		return SFS_ERROR_NONE;
+	}
+
+	inode = file->inode;
+	if (--inode->open_cnt == 0 && inode->is_unlinked) {
+		sfs_drop_inode(inode);
+	}
+	free(file);
+	fi->fh = 0;
+	return SFS_ERROR_NONE;
+}
+/**
+ * @brief 打开目录，与文件一样保存句柄，readdir不再查路径
+ * 
+ * @param path 
+ * @param fi 
+ * @return int 
+ */
+int sfs_opendir(const char* path, struct fuse_file_info* fi) {
+	return sfs_open(path, fi);
+}
 /**
  * @brief 
  * 
@@ -38,7 +38,7 @@ int sfs_calc_lvl(const char * path) {
     return lvl;
 }
 /**
- * @brief 驱动读
+ * @brief 驱动读，经块设备层（fs_blkio）：对齐的整单位直接读入out_content
  * 
  * @param offset 
  * @param out_content 
@@ -46,26 +46,13 @@ int sfs_calc_lvl(const char * path) {
  * @return int 
  */
 int sfs_driver_read(int offset, uint8_t *out_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    if (fs_blk_read(&sfs_super.blkdev, offset, out_content, size) != 0) {
+        return -SFS_ERROR_IO;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
     return SFS_ERROR_NONE;
 }
 /**
- * @brief 驱动写
+ * @brief 驱动写，经块设备层：只有首尾不满的IO单位需要先读出合并
  * 
  * @param offset 
  * @param in_content 
@@ -73,25 +60,9 @@ int sfs_driver_read(int offset, uint8_t *out_content, int size) {
  * @return int 
  */
 int sfs_driver_write(int offset, uint8_t *in_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    sfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-    
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    if (fs_blk_write(&sfs_super.blkdev, offset, in_content, size) != 0) {
+        return -SFS_ERROR_IO;
     }
-
-    free(temp_content);
     return SFS_ERROR_NONE;
 }
 /**
@@ -189,6 +160,8 @@ struct sfs_inode* sfs_alloc_inode(struct sfs_dentry * dentry) {
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
+    inode->open_cnt = 0;
+    inode->is_unlinked = FALSE;
     
     if (SFS_IS_REG(inode)) {
         inode->data = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_DATA_PER_FILE));
@@ -350,6 +323,8 @@ struct sfs_inode* sfs_read_inode(struct sfs_dentry * dentry, int ino) {
     inode->dir_cnt = 0;
     inode->ino = inode_d.ino;
     inode->size = inode_d.size;
+    inode->open_cnt = 0;
+    inode->is_unlinked = FALSE;
     memcpy(inode->target_path, inode_d.target_path, SFS_MAX_FILE_NAME);
     inode->dentry = dentry;
     inode->dentrys = NULL;
@@ -518,6 +493,10 @@ int sfs_mount(struct custom_options options){
     sfs_super.driver_fd = driver_fd;
     ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &sfs_super.sz_disk);
     ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &sfs_super.sz_io);
+    if (fs_blk_open(&sfs_super.blkdev, SFS_DRIVER(), SFS_IO_SZ(), SFS_BLKIO_CACHE) != 0) {
+        ddriver_close(SFS_DRIVER());
+        return -ENOMEM;
+    }
     
     root_dentry = new_dentry("/", SFS_DIR);
 
@@ -600,6 +579,7 @@ int sfs_umount() {
     }
 
     free(sfs_super.map_inode);
+    fs_blk_close(&sfs_super.blkdev);
     ddriver_close(SFS_DRIVER());
 
     return SFS_ERROR_NONE;
@@ -10,6 +10,7 @@
 #include "fuse.h"
 #include <stddef.h>
 #include "ddriver.h"
+#include "fs_blkio.h"
 #include "errno.h"
 #include "types.h"
 
@@ -2,6 +2,7 @@
 #define _TYPES_H_
 
 #define MAX_NAME_LEN    128     
+#define BLKIO_CACHE     64      /* 块设备层缓冲缓存的IO单位数 */
 
 struct custom_options {
 	const char*        device;
@@ -10,6 +11,8 @@ struct custom_options {
 struct PROJECT_NAME_super {
     uint32_t magic;
     int      fd;
+    int      sz_io;
+    struct fs_blkdev blkdev;    /* fd之上的块设备层，按字节偏移读写：fs_blk_read / fs_blk_write */
     /* TODO: Define yourself */
 };
 
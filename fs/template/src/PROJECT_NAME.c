@@ -51,6 +51,17 @@ void* PROJECT_NAME_init(struct fuse_conn_info * conn_info) {
 
 	/* 下面是一个控制设备的示例 */
 	super.fd = ddriver_open(PROJECT_NAME_options.device);
+	if (super.fd < 0) {
+		fuse_exit(fuse_get_context()->fuse);
+		return NULL;
+	}
+	ddriver_ioctl(super.fd, IOC_REQ_DEVICE_IO_SZ, &super.sz_io);
+	/* 之后用fs_blk_read / fs_blk_write按字节偏移读写设备，不必自己对齐到IO单位 */
+	if (fs_blk_open(&super.blkdev, super.fd, super.sz_io, BLKIO_CACHE) != 0) {
+		ddriver_close(super.fd);
+		fuse_exit(fuse_get_context()->fuse);
+		return NULL;
+	}
 	
 	return NULL;
 }
@@ -64,6 +75,7 @@ void* PROJECT_NAME_init(struct fuse_conn_info * conn_info) {
 void PROJECT_NAME_destroy(void* p) {
 	/* TODO: 在这里进行卸载 */
 	
+	fs_blk_close(&super.blkdev);
 	ddriver_close(super.fd);
 
 	return;
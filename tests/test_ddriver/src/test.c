@@ -3,8 +3,10 @@
 
 int main(int argc, char const *argv[])
 {
-    int size;
+    int size, i;
     struct ddriver_state state;
+    struct ddriver_state_ext ext;
+    struct ddriver_region_map map;
     int fd = ddriver_open("/home/students/200110526/ddriver");
     if (fd < 0) {
         return -1;
@@ -42,6 +44,39 @@ int main(int argc, char const *argv[])
     printf("write_cnt: %d\n", state.write_cnt);
     printf("seek_cnt: %d\n", state.seek_cnt);
 
+    /* Cycle 5: ioctl test - extended state with a region map */
+    map.count = 2;
+    map.regions[0].offset = 0;
+    map.regions[0].size = 512;
+    map.regions[0].type = DDRIVER_REGION_SUPER;
+    map.regions[1].offset = 512;
+    map.regions[1].size = 1024;
+    map.regions[1].type = DDRIVER_REGION_DATA;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_REGION_MAP, &map);
+    ddriver_seek(fd, 0, SEEK_SET);
+    ddriver_write(fd, buffer, 512);
+    ddriver_write(fd, buffer, 512);
+    ddriver_seek(fd, 512, SEEK_SET);
+    ddriver_read(fd, rbuffer, 512);
+
+    ext.version = DDRIVER_STATE_EXT_VERSION;
+    ext.size = sizeof(ext);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE_EXT, &ext);
+    printf("version: %u\n", ext.version);
+    printf("bytes_read: %llu\n", ext.bytes_read);
+    printf("bytes_written: %llu\n", ext.bytes_written);
+    printf("seek_distance: %llu\n", ext.seek_distance);
+    printf("rotate/read/write ns: %llu %llu %llu\n", ext.rotate_ns, ext.read_ns, ext.write_ns);
+    for (i = 0; i < DDRIVER_REGION_TYPES; i++) {
+        printf("region %d: %llu reads, %llu writes, %llu ns\n", 
+               i, ext.region_reads[i], ext.region_writes[i], ext.region_ns[i]);
+    }
+    if (ext.bytes_written != 1024 || ext.region_writes[DDRIVER_REGION_SUPER] != 1 ||
+        ext.region_writes[DDRIVER_REGION_DATA] != 1 || ext.region_reads[DDRIVER_REGION_DATA] != 1) {
+        printf("Test Fail :(\n");
+        return -1;
+    }
+
     ddriver_close(fd);
 
     printf("Test Pass :)\n");